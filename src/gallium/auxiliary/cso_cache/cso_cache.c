@@ -125,7 +125,7 @@ cso_hash_find_data_from_template(struct cso_hash *hash,
          /* We found a match */
          return iter_data;
       }
-      iter = cso_hash_iter_next(iter);
+      iter = cso_hash_find_next(iter);
    }
    return NULL;
 }
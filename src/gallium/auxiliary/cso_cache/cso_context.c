@@ -122,6 +122,17 @@ struct cso_context_priv {
    unsigned min_samples, min_samples_saved;
    struct pipe_stencil_ref stencil_ref, stencil_ref_saved;
 
+   /* The states of the last blend, depth_stencil and rasterizer set through
+    * the cache, and their handles.  Setting one of them again while it is
+    * still bound skips the cache lookup.
+    */
+   struct pipe_blend_state last_blend;
+   struct pipe_depth_stencil_alpha_state last_depth_stencil;
+   struct pipe_rasterizer_state last_rasterizer;
+   void *last_blend_handle;
+   void *last_depth_stencil_handle;
+   void *last_rasterizer_handle;
+
    /* This should be last to keep all of the above together in memory. */
    struct cso_cache cache;
 };
@@ -498,6 +509,14 @@ cso_destroy_context(struct cso_context *cso)
 #define CSO_BLEND_KEY_SIZE_RT0      offsetof(struct pipe_blend_state, rt[1])
 #define CSO_BLEND_KEY_SIZE_ALL_RT   sizeof(struct pipe_blend_state)
 
+
+static ALWAYS_INLINE bool
+is_last_state_bound(void *bound, void *last_handle, const void *last_state,
+                    const void *templ, unsigned key_size)
+{
+   return bound && bound == last_handle && !memcmp(last_state, templ, key_size);
+}
+
 /*
  * If the driver returns 0 from the create method then they will assign
  * the data member of the cso to be the template itself.
@@ -517,11 +536,21 @@ cso_set_blend(struct cso_context *cso,
        * to be a literal constant, so that memcpy and the hash computation can
        * be inlined and unrolled.
        */
+      if (is_last_state_bound(ctx->blend, ctx->last_blend_handle,
+                              &ctx->last_blend, templ,
+                              CSO_BLEND_KEY_SIZE_ALL_RT))
+         return PIPE_OK;
+
       hash_key = cso_construct_key(templ, CSO_BLEND_KEY_SIZE_ALL_RT);
       iter = cso_find_state_template(&ctx->cache, hash_key, CSO_BLEND,
                                      templ, CSO_BLEND_KEY_SIZE_ALL_RT);
       key_size = CSO_BLEND_KEY_SIZE_ALL_RT;
    } else {
+      if (is_last_state_bound(ctx->blend, ctx->last_blend_handle,
+                              &ctx->last_blend, templ,
+                              CSO_BLEND_KEY_SIZE_RT0))
+         return PIPE_OK;
+
       hash_key = cso_construct_key(templ, CSO_BLEND_KEY_SIZE_RT0);
       iter = cso_find_state_template(&ctx->cache, hash_key, CSO_BLEND,
                                      templ, CSO_BLEND_KEY_SIZE_RT0);
@@ -548,6 +577,9 @@ cso_set_blend(struct cso_context *cso,
       handle = ((struct cso_blend *)cso_hash_iter_data(iter))->data;
    }
 
+   ctx->last_blend = ((struct cso_blend *)cso_hash_iter_data(iter))->state;
+   ctx->last_blend_handle = handle;
+
    if (ctx->blend != handle) {
       ctx->blend = handle;
       ctx->base.pipe->bind_blend_state(ctx->base.pipe, handle);
@@ -581,6 +613,11 @@ cso_set_depth_stencil_alpha(struct cso_context *cso,
 {
    struct cso_context_priv *ctx = (struct cso_context_priv *)cso;
    const unsigned key_size = sizeof(struct pipe_depth_stencil_alpha_state);
+
+   if (is_last_state_bound(ctx->depth_stencil, ctx->last_depth_stencil_handle,
+                           &ctx->last_depth_stencil, templ, key_size))
+      return PIPE_OK;
+
    const unsigned hash_key = cso_construct_key(templ, key_size);
    struct cso_hash_iter iter = cso_find_state_template(&ctx->cache,
                                                        hash_key,
@@ -611,6 +648,9 @@ cso_set_depth_stencil_alpha(struct cso_context *cso,
                 cso_hash_iter_data(iter))->data;
    }
 
+   ctx->last_depth_stencil = *templ;
+   ctx->last_depth_stencil_handle = handle;
+
    if (ctx->depth_stencil != handle) {
       ctx->depth_stencil = handle;
       ctx->base.pipe->bind_depth_stencil_alpha_state(ctx->base.pipe, handle);
@@ -645,6 +685,11 @@ cso_set_rasterizer(struct cso_context *cso,
 {
    struct cso_context_priv *ctx = (struct cso_context_priv *)cso;
    const unsigned key_size = sizeof(struct pipe_rasterizer_state);
+
+   if (is_last_state_bound(ctx->rasterizer, ctx->last_rasterizer_handle,
+                           &ctx->last_rasterizer, templ, key_size))
+      return PIPE_OK;
+
    const unsigned hash_key = cso_construct_key(templ, key_size);
    struct cso_hash_iter iter = cso_find_state_template(&ctx->cache,
                                                        hash_key,
@@ -676,6 +721,9 @@ cso_set_rasterizer(struct cso_context *cso,
       handle = ((struct cso_rasterizer *)cso_hash_iter_data(iter))->data;
    }
 
+   ctx->last_rasterizer = *templ;
+   ctx->last_rasterizer_handle = handle;
+
    if (ctx->rasterizer != handle) {
       ctx->rasterizer = handle;
       ctx->flatshade_first = templ->flatshade_first;
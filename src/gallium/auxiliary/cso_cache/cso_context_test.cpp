@@ -0,0 +1,265 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cso_context.h"
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
+#include <gtest/gtest.h>
+
+enum fake_state {
+   FAKE_BLEND,
+   FAKE_DSA,
+   FAKE_RASTERIZER,
+   FAKE_NUM_STATES,
+};
+
+/* A pipe_context that hands out unique handles and counts the creates and
+ * the non-NULL binds of each state.  The screen has no caps, so the cso
+ * context doesn't touch any of the per-stage state.
+ */
+struct fake_pipe {
+   struct pipe_context base;
+   struct pipe_screen screen;
+   uintptr_t next_handle;
+   unsigned num_creates[FAKE_NUM_STATES];
+   unsigned num_binds[FAKE_NUM_STATES];
+   void *bound[FAKE_NUM_STATES];
+};
+
+static void *
+fake_create(struct pipe_context *pipe, enum fake_state state)
+{
+   struct fake_pipe *fake = (struct fake_pipe *)pipe;
+   fake->num_creates[state]++;
+   return (void *)(++fake->next_handle * 16);
+}
+
+static void
+fake_bind(struct pipe_context *pipe, enum fake_state state, void *handle)
+{
+   struct fake_pipe *fake = (struct fake_pipe *)pipe;
+   if (handle)
+      fake->num_binds[state]++;
+   fake->bound[state] = handle;
+}
+
+static void *
+fake_create_blend(struct pipe_context *pipe, const struct pipe_blend_state *)
+{
+   return fake_create(pipe, FAKE_BLEND);
+}
+
+static void *
+fake_create_dsa(struct pipe_context *pipe,
+                const struct pipe_depth_stencil_alpha_state *)
+{
+   return fake_create(pipe, FAKE_DSA);
+}
+
+static void *
+fake_create_rasterizer(struct pipe_context *pipe,
+                       const struct pipe_rasterizer_state *)
+{
+   return fake_create(pipe, FAKE_RASTERIZER);
+}
+
+static void
+fake_bind_blend(struct pipe_context *pipe, void *handle)
+{
+   fake_bind(pipe, FAKE_BLEND, handle);
+}
+
+static void
+fake_bind_dsa(struct pipe_context *pipe, void *handle)
+{
+   fake_bind(pipe, FAKE_DSA, handle);
+}
+
+static void
+fake_bind_rasterizer(struct pipe_context *pipe, void *handle)
+{
+   fake_bind(pipe, FAKE_RASTERIZER, handle);
+}
+
+static void fake_bind_noop(struct pipe_context *, void *) {}
+static void fake_delete(struct pipe_context *, void *) {}
+static void fake_set_stencil_ref(struct pipe_context *, const struct pipe_stencil_ref) {}
+static void fake_set_sample_mask(struct pipe_context *, unsigned) {}
+static void fake_set_constant_buffer(struct pipe_context *, mesa_shader_stage, uint,
+                                     bool, const struct pipe_constant_buffer *) {}
+static void fake_set_framebuffer_state(struct pipe_context *,
+                                       const struct pipe_framebuffer_state *) {}
+
+class cso_context_test : public ::testing::Test {
+protected:
+   void SetUp() override
+   {
+      /* pipe_screen isn't trivially constructible in C++ */
+      fake = (struct fake_pipe *)calloc(1, sizeof(*fake));
+      ASSERT_NE(fake, nullptr);
+      fake->base.screen = &fake->screen;
+      fake->base.create_blend_state = fake_create_blend;
+      fake->base.bind_blend_state = fake_bind_blend;
+      fake->base.delete_blend_state = fake_delete;
+      fake->base.create_depth_stencil_alpha_state = fake_create_dsa;
+      fake->base.bind_depth_stencil_alpha_state = fake_bind_dsa;
+      fake->base.delete_depth_stencil_alpha_state = fake_delete;
+      fake->base.create_rasterizer_state = fake_create_rasterizer;
+      fake->base.bind_rasterizer_state = fake_bind_rasterizer;
+      fake->base.delete_rasterizer_state = fake_delete;
+      fake->base.bind_fs_state = fake_bind_noop;
+      fake->base.bind_vs_state = fake_bind_noop;
+      fake->base.bind_vertex_elements_state = fake_bind_noop;
+      fake->base.delete_sampler_state = fake_delete;
+      fake->base.delete_vertex_elements_state = fake_delete;
+      fake->base.set_stencil_ref = fake_set_stencil_ref;
+      fake->base.set_sample_mask = fake_set_sample_mask;
+      fake->base.set_constant_buffer = fake_set_constant_buffer;
+      fake->base.set_framebuffer_state = fake_set_framebuffer_state;
+
+      cso = cso_create_context(&fake->base, CSO_NO_VBUF);
+      ASSERT_NE(cso, nullptr);
+   }
+
+   void TearDown() override
+   {
+      if (cso)
+         cso_destroy_context(cso);
+      free(fake);
+   }
+
+   struct fake_pipe *fake = NULL;
+   struct cso_context *cso = NULL;
+};
+
+TEST_F(cso_context_test, blend_last_bound)
+{
+   struct pipe_blend_state a, b;
+   memset(&a, 0, sizeof(a));
+   memset(&b, 0, sizeof(b));
+   a.rt[0].colormask = 0xf;
+   b.rt[0].colormask = 0x1;
+
+   cso_set_blend(cso, &a);
+   void *handle_a = fake->bound[FAKE_BLEND];
+   cso_set_blend(cso, &a);
+   EXPECT_EQ(fake->num_creates[FAKE_BLEND], 1);
+   EXPECT_EQ(fake->num_binds[FAKE_BLEND], 1);
+
+   /* Without independent blending only rt[0] is part of the key. */
+   a.rt[1].colormask = 0x3;
+   cso_set_blend(cso, &a);
+   EXPECT_EQ(fake->num_creates[FAKE_BLEND], 1);
+   EXPECT_EQ(fake->num_binds[FAKE_BLEND], 1);
+
+   a.independent_blend_enable = 1;
+   cso_set_blend(cso, &a);
+   EXPECT_EQ(fake->num_creates[FAKE_BLEND], 2);
+   EXPECT_EQ(fake->num_binds[FAKE_BLEND], 2);
+   a.independent_blend_enable = 0;
+   a.rt[1].colormask = 0;
+
+   /* Going back to a cached state rebinds it without creating it again. */
+   cso_set_blend(cso, &b);
+   cso_set_blend(cso, &a);
+   EXPECT_EQ(fake->num_creates[FAKE_BLEND], 3);
+   EXPECT_EQ(fake->num_binds[FAKE_BLEND], 4);
+   EXPECT_EQ(fake->bound[FAKE_BLEND], handle_a);
+}
+
+TEST_F(cso_context_test, depth_stencil_alpha_last_bound)
+{
+   struct pipe_depth_stencil_alpha_state a, b;
+   memset(&a, 0, sizeof(a));
+   memset(&b, 0, sizeof(b));
+   a.depth_enabled = 1;
+   a.depth_func = PIPE_FUNC_LESS;
+   b.depth_enabled = 1;
+   b.depth_func = PIPE_FUNC_GREATER;
+
+   cso_set_depth_stencil_alpha(cso, &a);
+   void *handle_a = fake->bound[FAKE_DSA];
+   cso_set_depth_stencil_alpha(cso, &a);
+   EXPECT_EQ(fake->num_creates[FAKE_DSA], 1);
+   EXPECT_EQ(fake->num_binds[FAKE_DSA], 1);
+
+   cso_set_depth_stencil_alpha(cso, &b);
+   cso_set_depth_stencil_alpha(cso, &a);
+   EXPECT_EQ(fake->num_creates[FAKE_DSA], 2);
+   EXPECT_EQ(fake->num_binds[FAKE_DSA], 3);
+   EXPECT_EQ(fake->bound[FAKE_DSA], handle_a);
+}
+
+TEST_F(cso_context_test, rasterizer_last_bound)
+{
+   struct pipe_rasterizer_state a, b;
+   memset(&a, 0, sizeof(a));
+   memset(&b, 0, sizeof(b));
+   a.cull_face = PIPE_FACE_BACK;
+   b.cull_face = PIPE_FACE_FRONT;
+
+   cso_set_rasterizer(cso, &a);
+   void *handle_a = fake->bound[FAKE_RASTERIZER];
+   cso_set_rasterizer(cso, &a);
+   EXPECT_EQ(fake->num_creates[FAKE_RASTERIZER], 1);
+   EXPECT_EQ(fake->num_binds[FAKE_RASTERIZER], 1);
+
+   cso_set_rasterizer(cso, &b);
+   cso_set_rasterizer(cso, &a);
+   EXPECT_EQ(fake->num_creates[FAKE_RASTERIZER], 2);
+   EXPECT_EQ(fake->num_binds[FAKE_RASTERIZER], 3);
+   EXPECT_EQ(fake->bound[FAKE_RASTERIZER], handle_a);
+}
+
+/* Restoring a saved state binds it behind the back of the last-bound
+ * check, so setting the state that was last set again must rebind it.
+ */
+TEST_F(cso_context_test, last_bound_after_restore)
+{
+   struct pipe_blend_state blend_a, blend_b;
+   struct pipe_depth_stencil_alpha_state dsa_a, dsa_b;
+   struct pipe_rasterizer_state rast_a, rast_b;
+   memset(&blend_a, 0, sizeof(blend_a));
+   memset(&blend_b, 0, sizeof(blend_b));
+   memset(&dsa_a, 0, sizeof(dsa_a));
+   memset(&dsa_b, 0, sizeof(dsa_b));
+   memset(&rast_a, 0, sizeof(rast_a));
+   memset(&rast_b, 0, sizeof(rast_b));
+   blend_b.rt[0].blend_enable = 1;
+   dsa_b.depth_enabled = 1;
+   rast_b.scissor = 1;
+
+   cso_set_blend(cso, &blend_a);
+   cso_set_depth_stencil_alpha(cso, &dsa_a);
+   cso_set_rasterizer(cso, &rast_a);
+   void *blend_handle_a = fake->bound[FAKE_BLEND];
+   void *dsa_handle_a = fake->bound[FAKE_DSA];
+   void *rast_handle_a = fake->bound[FAKE_RASTERIZER];
+
+   cso_save_state(cso, CSO_BIT_BLEND | CSO_BIT_DEPTH_STENCIL_ALPHA |
+                       CSO_BIT_RASTERIZER);
+   cso_set_blend(cso, &blend_b);
+   cso_set_depth_stencil_alpha(cso, &dsa_b);
+   cso_set_rasterizer(cso, &rast_b);
+   void *blend_handle_b = fake->bound[FAKE_BLEND];
+   void *dsa_handle_b = fake->bound[FAKE_DSA];
+   void *rast_handle_b = fake->bound[FAKE_RASTERIZER];
+
+   cso_restore_state(cso, 0);
+   EXPECT_EQ(fake->bound[FAKE_BLEND], blend_handle_a);
+   EXPECT_EQ(fake->bound[FAKE_DSA], dsa_handle_a);
+   EXPECT_EQ(fake->bound[FAKE_RASTERIZER], rast_handle_a);
+
+   cso_set_blend(cso, &blend_b);
+   cso_set_depth_stencil_alpha(cso, &dsa_b);
+   cso_set_rasterizer(cso, &rast_b);
+   EXPECT_EQ(fake->bound[FAKE_BLEND], blend_handle_b);
+   EXPECT_EQ(fake->bound[FAKE_DSA], dsa_handle_b);
+   EXPECT_EQ(fake->bound[FAKE_RASTERIZER], rast_handle_b);
+   for (unsigned i = 0; i < FAKE_NUM_STATES; i++) {
+      EXPECT_EQ(fake->num_creates[i], 2);
+      EXPECT_EQ(fake->num_binds[i], 4);
+   }
+}
@@ -30,167 +30,107 @@
   *   Zack Rusin <zackr@vmware.com>
   */
 
-#include "util/u_debug.h"
 #include "util/u_memory.h"
-#include "util/bitscan.h"
 
 #include "cso_hash.h"
 
-#ifndef MAX
-#define MAX(a, b) ((a > b) ? (a) : (b))
-#endif
-
-static const int MinNumBits = 4;
-
-static const unsigned char prime_deltas[] = {
-   0,  0,  1,  3,  1,  5,  3,  3,  1,  9,  7,  5,  3,  9, 25,  3,
-   1, 21,  3, 21,  7, 15,  9,  5,  3, 29, 15,  0,  0,  0,  0,  0
-};
-
-
-static int
-primeForNumBits(int numBits)
-{
-   return (1 << numBits) + prime_deltas[numBits];
-}
-
-
-/*
- * Returns the smallest integer n such that
- * primeForNumBits(n) >= hint.
+/* Smallest table, and maximum load including the deleted slots, in
+ * fourths.  Probing relies on at least one slot being empty.
  */
-static int
-countBits(int hint)
-{
-   int numBits = util_bitcount(hint);
-
-   if (numBits >= (int)sizeof(prime_deltas)) {
-      numBits = sizeof(prime_deltas) - 1;
-   } else if (primeForNumBits(numBits) < hint) {
-      ++numBits;
-   }
-   return numBits;
-}
+static const unsigned MinNumBits = 4;
+static const unsigned MaxLoad = 3;
 
 
-static struct cso_node *
-cso_hash_create_node(struct cso_hash *hash,
-                     unsigned akey, void *avalue,
-                     struct cso_node **anextNode)
+static bool
+cso_data_rehash(struct cso_hash *hash, unsigned num_entries)
 {
-   struct cso_node *node = MALLOC(sizeof(struct cso_node));
+   unsigned num_bits = MinNumBits;
 
-   if (!node)
-      return NULL;
+   /* Leave the table half empty after growing */
+   while ((1u << num_bits) < num_entries * 2)
+      ++num_bits;
 
-   node->key = akey;
-   node->value = avalue;
+   struct cso_hash_slot *slots = CALLOC(1u << num_bits, sizeof(*slots));
+   if (!slots)
+      return false;
 
-   node->next = *anextNode;
-   *anextNode = node;
-   ++hash->size;
-   return node;
-}
+   struct cso_hash_slot *old_slots = hash->slots;
+   const unsigned old_num_slots = hash->num_slots;
 
+   hash->slots = slots;
+   hash->num_slots = 1u << num_bits;
+   hash->shift = 32 - num_bits;
+   hash->num_deleted = 0;
 
-static void
-cso_data_rehash(struct cso_hash *hash, int hint)
-{
-   if (hint < 0) {
-      hint = countBits(-hint);
-      if (hint < MinNumBits)
-         hint = MinNumBits;
-      hash->userNumBits = (short)hint;
-      while (primeForNumBits(hint) < (hash->size >> 1))
-         ++hint;
-   } else if (hint < MinNumBits) {
-      hint = MinNumBits;
-   }
+   const unsigned mask = hash->num_slots - 1;
+   for (unsigned i = 0; i < old_num_slots; ++i) {
+      struct cso_hash_slot *old = &old_slots[i];
+      if (!old->value || old->value == CSO_HASH_DELETED)
+         continue;
 
-   if (hash->numBits != hint) {
-      struct cso_node *e = (struct cso_node *)hash;
-      struct cso_node **oldBuckets = hash->buckets;
-      const int oldNumBuckets = hash->numBuckets;
-
-      hash->numBits = (short)hint;
-      hash->numBuckets = primeForNumBits(hint);
-      hash->buckets = MALLOC(sizeof(struct cso_node*) * hash->numBuckets);
-      for (int i = 0; i < hash->numBuckets; ++i)
-         hash->buckets[i] = e;
-
-      for (int i = 0; i < oldNumBuckets; ++i) {
-         struct cso_node *firstNode = oldBuckets[i];
-         while (firstNode != e) {
-            unsigned h = firstNode->key;
-            struct cso_node *lastNode = firstNode;
-            struct cso_node *afterLastNode;
-            struct cso_node **beforeFirstNode;
-
-            while (lastNode->next != e && lastNode->next->key == h)
-               lastNode = lastNode->next;
-
-            afterLastNode = lastNode->next;
-            beforeFirstNode = &hash->buckets[h % hash->numBuckets];
-            while (*beforeFirstNode != e)
-               beforeFirstNode = &(*beforeFirstNode)->next;
-            lastNode->next = *beforeFirstNode;
-            *beforeFirstNode = firstNode;
-            firstNode = afterLastNode;
-         }
-      }
-      FREE(oldBuckets);
+      unsigned j = cso_hash_home(hash, old->key);
+      while (slots[j].value)
+         j = (j + 1) & mask;
+      slots[j] = *old;
    }
-}
 
-
-static void
-cso_data_might_grow(struct cso_hash *hash)
-{
-   if (hash->size >= hash->numBuckets)
-      cso_data_rehash(hash, hash->numBits + 1);
+   FREE(old_slots);
+   return true;
 }
 
 
-static void
-cso_data_has_shrunk(struct cso_hash *hash)
+static unsigned
+cso_data_next_used(const struct cso_hash *hash, unsigned index)
 {
-   if (hash->size <= (hash->numBuckets >> 3) &&
-       hash->numBits > hash->userNumBits) {
-      int max = MAX(hash->numBits-2, hash->userNumBits);
-      cso_data_rehash(hash,  max);
-   }
+   while (index < hash->num_slots &&
+          (!hash->slots[index].value ||
+           hash->slots[index].value == CSO_HASH_DELETED))
+      ++index;
+   return index;
 }
 
 
-static struct cso_node *
-cso_data_first_node(struct cso_hash *hash)
-{
-   struct cso_node *e = (struct cso_node *)hash;
-   struct cso_node **bucket = hash->buckets;
-   int n = hash->numBuckets;
-
-   while (n--) {
-      if (*bucket != e)
-         return *bucket;
-      ++bucket;
+static void
+cso_data_remove(struct cso_hash *hash, unsigned index)
+{
+   /* Lookups stop at the next empty slot anyway, so this one can become
+    * empty too if the next one is.
+    */
+   if (!hash->slots[(index + 1) & (hash->num_slots - 1)].value) {
+      hash->slots[index].value = NULL;
+   } else {
+      hash->slots[index].value = CSO_HASH_DELETED;
+      ++hash->num_deleted;
    }
-   return e;
+   --hash->size;
 }
 
 
 struct cso_hash_iter
 cso_hash_insert(struct cso_hash *hash, unsigned key, void *data)
 {
-   cso_data_might_grow(hash);
+   struct cso_hash_iter null_iter = {hash, hash->num_slots};
+
+   assert(data && data != CSO_HASH_DELETED);
 
-   struct cso_node **nextNode = cso_hash_find_node(hash, key);
-   struct cso_node *node = cso_hash_create_node(hash, key, data, nextNode);
-   if (!node) {
-      struct cso_hash_iter null_iter = {hash, NULL};
-      return null_iter;
+   if ((hash->size + hash->num_deleted + 1) * 4 > hash->num_slots * MaxLoad) {
+      if (!cso_data_rehash(hash, hash->size + 1))
+         return null_iter;
    }
 
-   struct cso_hash_iter iter = {hash, node};
+   const unsigned mask = hash->num_slots - 1;
+   unsigned i = cso_hash_home(hash, key);
+   while (hash->slots[i].value && hash->slots[i].value != CSO_HASH_DELETED)
+      i = (i + 1) & mask;
+
+   if (hash->slots[i].value == CSO_HASH_DELETED)
+      --hash->num_deleted;
+
+   hash->slots[i].key = key;
+   hash->slots[i].value = data;
+   ++hash->size;
+
+   struct cso_hash_iter iter = {hash, i};
    return iter;
 }
 
@@ -198,85 +138,50 @@ cso_hash_insert(struct cso_hash *hash, unsigned key, void *data)
 void
 cso_hash_init(struct cso_hash *hash)
 {
-   hash->fakeNext = NULL;
-   hash->buckets = NULL;
+   hash->slots = NULL;
+   hash->num_slots = 0;
+   hash->shift = 0;
    hash->size = 0;
-   hash->userNumBits = (short)MinNumBits;
-   hash->numBits = 0;
-   hash->numBuckets = 0;
-   hash->end = (struct cso_node*)hash;
+   hash->num_deleted = 0;
 }
 
 
 void
 cso_hash_deinit(struct cso_hash *hash)
 {
-   struct cso_node *e_for_x = hash->end;
-   struct cso_node **bucket = hash->buckets;
-   int n = hash->numBuckets;
-
-   while (n--) {
-      struct cso_node *cur = *bucket++;
-      while (cur != e_for_x) {
-         struct cso_node *next = cur->next;
-         FREE(cur);
-         cur = next;
-      }
-   }
-   FREE(hash->buckets);
+   FREE(hash->slots);
+   cso_hash_init(hash);
 }
 
 
 unsigned
 cso_hash_iter_key(struct cso_hash_iter iter)
 {
-   if (!iter.node || iter.hash->end == iter.node)
+   if (cso_hash_iter_is_null(iter))
       return 0;
-   return iter.node->key;
+   return iter.hash->slots[iter.index].key;
 }
 
 
-struct cso_node *
-cso_hash_data_next(struct cso_node *node)
+struct cso_hash_iter
+cso_hash_iter_next(struct cso_hash_iter iter)
 {
-   union {
-      struct cso_node *next;
-      struct cso_node *e;
-      struct cso_hash *d;
-   } a;
-
-   a.next = node->next;
-   if (!a.next) {
-      debug_printf("iterating beyond the last element\n");
-      return NULL;
-   }
-   if (a.next->next)
-      return a.next;
-
-   int start = (node->key % a.d->numBuckets) + 1;
-   struct cso_node **bucket = a.d->buckets + start;
-   int n = a.d->numBuckets - start;
-   while (n--) {
-      if (*bucket != a.e)
-         return *bucket;
-      ++bucket;
-   }
-   return a.e;
+   struct cso_hash_iter next = {iter.hash, iter.hash->num_slots};
+
+   if (iter.index < iter.hash->num_slots)
+      next.index = cso_data_next_used(iter.hash, iter.index + 1);
+   return next;
 }
 
 
 void *
 cso_hash_take(struct cso_hash *hash, unsigned akey)
 {
-   struct cso_node **node = cso_hash_find_node(hash, akey);
-
-   if (*node != hash->end) {
-      void *t = (*node)->value;
-      struct cso_node *next = (*node)->next;
-      FREE(*node);
-      *node = next;
-      --hash->size;
-      cso_data_has_shrunk(hash);
+   struct cso_hash_iter iter = cso_hash_find(hash, akey);
+
+   if (!cso_hash_iter_is_null(iter)) {
+      void *t = hash->slots[iter.index].value;
+      cso_data_remove(hash, iter.index);
       return t;
    }
    return NULL;
@@ -286,7 +191,7 @@ cso_hash_take(struct cso_hash *hash, unsigned akey)
 struct cso_hash_iter
 cso_hash_first_node(struct cso_hash *hash)
 {
-   struct cso_hash_iter iter = {hash, cso_data_first_node(hash)};
+   struct cso_hash_iter iter = {hash, cso_data_next_used(hash, 0)};
    return iter;
 }
 
@@ -301,27 +206,17 @@ cso_hash_size(const struct cso_hash *hash)
 struct cso_hash_iter
 cso_hash_erase(struct cso_hash *hash, struct cso_hash_iter iter)
 {
-   struct cso_hash_iter ret = iter;
-   struct cso_node *node = iter.node;
-   struct cso_node **node_ptr;
-
-   if (node == hash->end)
+   if (cso_hash_iter_is_null(iter))
       return iter;
 
-   ret = cso_hash_iter_next(ret);
-   node_ptr = &hash->buckets[node->key % hash->numBuckets];
-   while (*node_ptr != node)
-      node_ptr = &(*node_ptr)->next;
-   *node_ptr = node->next;
-   FREE(node);
-   --hash->size;
-   return ret;
+   /* Removing never moves entries, so the walk can go on from here */
+   cso_data_remove(hash, iter.index);
+   return cso_hash_iter_next(iter);
 }
 
 
 bool
 cso_hash_contains(struct cso_hash *hash, unsigned key)
 {
-   struct cso_node **node = cso_hash_find_node(hash, key);
-   return *node != hash->end;
+   return !cso_hash_iter_is_null(cso_hash_find(hash, key));
 }
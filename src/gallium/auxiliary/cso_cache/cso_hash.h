@@ -29,14 +29,14 @@
  * @file
  * Hash table implementation.
  *
- * This file provides a hash implementation that is capable of dealing
- * with collisions. It stores colliding entries in linked list. All
- * functions operating on the hash return an iterator. The iterator
- * itself points to the collision list. If there wasn't any collision
- * the list will have just one entry, otherwise client code should
- * iterate over the entries to find the exact entry among ones that
- * had the same key (e.g. memcmp could be used on the data to check
- * that)
+ * This file provides an open addressing hash table keyed by 32-bit
+ * hashes, which are stored next to the values so that probing never
+ * touches the entries themselves.  Several entries may share the same key.
+ * cso_hash_find() returns an iterator to the first of them and
+ * cso_hash_find_next() to the following ones, and client code should
+ * check the entries to find the exact one among them (e.g. memcmp could
+ * be used on the data to check that).  cso_hash_first_node() and
+ * cso_hash_iter_next() walk all the entries.
  *
  * @author Zack Rusin <zackr@vmware.com>
  */
@@ -51,27 +51,27 @@ extern "C" {
 #endif
 
 
-struct cso_node {
-   struct cso_node *next;
+struct cso_hash_slot {
    void *value;
    unsigned key;
 };
 
 struct cso_hash_iter {
    struct cso_hash *hash;
-   struct cso_node *node;
+   unsigned index;
 };
 
 struct cso_hash {
-   struct cso_node *fakeNext;
-   struct cso_node **buckets;
-   struct cso_node *end;
+   struct cso_hash_slot *slots;
+   unsigned num_slots;   /* zero or a power of two */
+   unsigned shift;       /* 32 - log2(num_slots) */
    int size;
-   short userNumBits;
-   short numBits;
-   int numBuckets;
+   unsigned num_deleted;
 };
 
+/* Value of the slots whose entry was removed, which lookups skip over */
+#define CSO_HASH_DELETED ((void *)(uintptr_t)1)
+
 
 void
 cso_hash_init(struct cso_hash *hash);
@@ -84,9 +84,9 @@ cso_hash_size(const struct cso_hash *hash);
 
 
 /**
- * Adds a data with the given key to the hash. If entry with the given
- * key is already in the hash, this current entry is instered before it
- * in the collision list.
+ * Adds a data with the given key to the hash. If entries with the given
+ * key are already in the hash, they are kept and the new one is added
+ * along them.  The data must not be NULL.
  * Function returns iterator pointing to the inserted item in the hash.
  */
 struct cso_hash_iter
@@ -120,9 +120,9 @@ cso_hash_iter_key(struct cso_hash_iter iter);
 
 
 /**
- * Convenience routine to iterate over the collision list while doing a memory
- * comparison to see which entry in the list is a direct copy of our template
- * and returns that entry.
+ * Convenience routine to iterate over the entries with the given key while
+ * doing a memory comparison to see which entry is a direct copy of our
+ * template and returns that entry.
  */
 void *
 cso_hash_find_data_from_template(struct cso_hash *hash,
@@ -130,62 +130,88 @@ cso_hash_find_data_from_template(struct cso_hash *hash,
                                  void *templ,
                                  int size);
 
-struct cso_node *
-cso_hash_data_next(struct cso_node *node);
-
 
 static inline bool
 cso_hash_iter_is_null(struct cso_hash_iter iter)
 {
-   return !iter.node || iter.node == iter.hash->end;
+   return iter.index >= iter.hash->num_slots;
 }
 
 
 static inline void *
 cso_hash_iter_data(struct cso_hash_iter iter)
 {
-   if (!iter.node || iter.hash->end == iter.node)
+   if (iter.index >= iter.hash->num_slots)
       return NULL;
-   return iter.node->value;
+   return iter.hash->slots[iter.index].value;
+}
+
+
+/**
+ * Return the slot where the probe sequence of key starts.  This uses
+ * Fibonacci hashing, as the keys are often poorly distributed.
+ */
+static inline unsigned
+cso_hash_home(const struct cso_hash *hash, unsigned key)
+{
+   return (key * 2654435769u) >> hash->shift;
 }
 
 
-static inline struct cso_node **
-cso_hash_find_node(struct cso_hash *hash, unsigned akey)
+/**
+ * Return the index of the first slot with the given key, starting the
+ * probe sequence at start, or num_slots if there is none.
+ */
+static inline unsigned
+cso_hash_probe(const struct cso_hash *hash, unsigned key, unsigned start)
 {
-   struct cso_node **node;
-
-   if (hash->numBuckets) {
-      node = &hash->buckets[akey % hash->numBuckets];
-      assert(*node == hash->end || (*node)->next);
-      while (*node != hash->end && (*node)->key != akey)
-         node = &(*node)->next;
-   } else {
-      node = &hash->end;
+   const unsigned mask = hash->num_slots - 1;
+
+   for (unsigned i = start;; i = (i + 1) & mask) {
+      const struct cso_hash_slot *slot = &hash->slots[i];
+
+      if (!slot->value)
+         return hash->num_slots;
+      if (slot->key == key && slot->value != CSO_HASH_DELETED)
+         return i;
    }
-   return node;
 }
 
 
 /**
- * Return an iterator pointing to the first entry in the collision list.
+ * Return an iterator pointing to the first entry with the given key.
  */
 static inline struct cso_hash_iter
 cso_hash_find(struct cso_hash *hash, unsigned key)
 {
-   struct cso_node **nextNode = cso_hash_find_node(hash, key);
-   struct cso_hash_iter iter = {hash, *nextNode};
+   struct cso_hash_iter iter = {hash, hash->num_slots};
+
+   if (hash->num_slots)
+      iter.index = cso_hash_probe(hash, key, cso_hash_home(hash, key));
    return iter;
 }
 
 
+/**
+ * Return an iterator pointing to the next entry with the same key as iter.
+ */
 static inline struct cso_hash_iter
-cso_hash_iter_next(struct cso_hash_iter iter)
+cso_hash_find_next(struct cso_hash_iter iter)
 {
-   struct cso_hash_iter next = {iter.hash, cso_hash_data_next(iter.node)};
+   struct cso_hash *hash = iter.hash;
+   struct cso_hash_iter next = {hash, hash->num_slots};
+
+   if (iter.index < hash->num_slots) {
+      next.index = cso_hash_probe(hash, hash->slots[iter.index].key,
+                                  (iter.index + 1) & (hash->num_slots - 1));
+   }
    return next;
 }
 
+
+struct cso_hash_iter
+cso_hash_iter_next(struct cso_hash_iter iter);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,182 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <vector>
+
+#include "cso_cache.h"
+#include "cso_hash.h"
+#include "util/os_time.h"
+#include <gtest/gtest.h>
+
+static void *
+value(uintptr_t i)
+{
+   /* Values must not be NULL */
+   return (void *)((i + 1) * 16);
+}
+
+TEST(cso_hash, insert_find_take)
+{
+   struct cso_hash hash;
+   cso_hash_init(&hash);
+
+   EXPECT_TRUE(cso_hash_iter_is_null(cso_hash_find(&hash, 1)));
+   EXPECT_TRUE(cso_hash_iter_is_null(cso_hash_first_node(&hash)));
+
+   for (unsigned i = 0; i < 1000; i++)
+      cso_hash_insert(&hash, i * 7, value(i));
+   EXPECT_EQ(cso_hash_size(&hash), 1000);
+
+   for (unsigned i = 0; i < 1000; i++) {
+      struct cso_hash_iter iter = cso_hash_find(&hash, i * 7);
+      ASSERT_FALSE(cso_hash_iter_is_null(iter));
+      EXPECT_EQ(cso_hash_iter_data(iter), value(i));
+      EXPECT_EQ(cso_hash_iter_key(iter), i * 7);
+      EXPECT_TRUE(cso_hash_iter_is_null(cso_hash_find_next(iter)));
+   }
+   EXPECT_FALSE(cso_hash_contains(&hash, 1));
+
+   for (unsigned i = 0; i < 1000; i += 2)
+      EXPECT_EQ(cso_hash_take(&hash, i * 7), value(i));
+   EXPECT_EQ(cso_hash_size(&hash), 500);
+
+   for (unsigned i = 0; i < 1000; i++)
+      EXPECT_EQ(cso_hash_contains(&hash, i * 7), i % 2 == 1);
+
+   cso_hash_deinit(&hash);
+}
+
+TEST(cso_hash, same_key)
+{
+   struct cso_hash hash;
+   cso_hash_init(&hash);
+
+   /* Many entries with the same key, mixed with others */
+   for (unsigned i = 0; i < 100; i++) {
+      cso_hash_insert(&hash, 42, value(i));
+      cso_hash_insert(&hash, 1000 + i, value(1000 + i));
+   }
+
+   std::vector<bool> seen(100);
+   unsigned count = 0;
+   for (struct cso_hash_iter iter = cso_hash_find(&hash, 42);
+        !cso_hash_iter_is_null(iter); iter = cso_hash_find_next(iter)) {
+      uintptr_t i = (uintptr_t)cso_hash_iter_data(iter) / 16 - 1;
+      ASSERT_LT(i, 100u);
+      EXPECT_FALSE(seen[i]);
+      seen[i] = true;
+      count++;
+   }
+   EXPECT_EQ(count, 100u);
+
+   cso_hash_deinit(&hash);
+}
+
+TEST(cso_hash, erase_while_iterating)
+{
+   struct cso_hash hash;
+   cso_hash_init(&hash);
+
+   for (unsigned i = 0; i < 300; i++)
+      cso_hash_insert(&hash, i * 0x10000, value(i));
+
+   /* Remove every other entry in a single walk */
+   unsigned visited = 0;
+   struct cso_hash_iter iter = cso_hash_first_node(&hash);
+   while (!cso_hash_iter_is_null(iter)) {
+      uintptr_t i = (uintptr_t)cso_hash_iter_data(iter) / 16 - 1;
+      visited++;
+      if (i % 2)
+         iter = cso_hash_erase(&hash, iter);
+      else
+         iter = cso_hash_iter_next(iter);
+   }
+   EXPECT_EQ(visited, 300u);
+   EXPECT_EQ(cso_hash_size(&hash), 150);
+
+   for (unsigned i = 0; i < 300; i++)
+      EXPECT_EQ(cso_hash_contains(&hash, i * 0x10000), i % 2 == 0);
+
+   /* Reuse the removed slots */
+   for (unsigned i = 1; i < 300; i += 2)
+      cso_hash_insert(&hash, i * 0x10000, value(i));
+   for (unsigned i = 0; i < 300; i++) {
+      EXPECT_EQ(cso_hash_iter_data(cso_hash_find(&hash, i * 0x10000)),
+                value(i));
+   }
+
+   cso_hash_deinit(&hash);
+}
+
+TEST(cso_hash, churn)
+{
+   struct cso_hash hash;
+   cso_hash_init(&hash);
+
+   /* Keep inserting and taking so that the table is full of removed
+    * slots, which must not make lookups fail or loop.
+    */
+   for (unsigned round = 0; round < 100; round++) {
+      for (unsigned i = 0; i < 64; i++)
+         cso_hash_insert(&hash, round * 64 + i, value(i));
+      for (unsigned i = 0; i < 64; i++)
+         EXPECT_EQ(cso_hash_take(&hash, round * 64 + i), value(i));
+   }
+   EXPECT_EQ(cso_hash_size(&hash), 0);
+   EXPECT_TRUE(cso_hash_iter_is_null(cso_hash_find(&hash, 0)));
+
+   cso_hash_deinit(&hash);
+}
+
+/* Microbenchmark of the lookups done by cso_set_blend() and friends, run
+ * with --gtest_also_run_disabled_tests:
+ * states bound in a loop, looked up with cso_find_state_template() and
+ * inserted on misses.
+ */
+TEST(cso_hash, DISABLED_bench_state_lookup)
+{
+   static const unsigned num_states[] = { 4, 64, 1024 };
+
+   for (unsigned n : num_states) {
+      struct cso_cache cache;
+      memset(&cache, 0, sizeof(cache));
+      for (unsigned i = 0; i < CSO_CACHE_MAX; i++)
+         cso_hash_init(&cache.hashes[i]);
+
+      std::vector<struct cso_rasterizer> states(n);
+      for (unsigned i = 0; i < n; i++) {
+         memset(&states[i].state, 0, sizeof(states[i].state));
+         states[i].state.line_width = 1.0f + i / 8;
+         states[i].state.point_size = 1.0f + i % 8;
+         states[i].state.cull_face = i % 4;
+         states[i].data = value(i);
+      }
+
+      const unsigned iterations = 1000000;
+      const unsigned key_size = sizeof(struct pipe_rasterizer_state);
+      unsigned misses = 0;
+
+      int64_t start = os_time_get_nano();
+      for (unsigned i = 0; i < iterations; i++) {
+         const struct pipe_rasterizer_state *templ =
+            &states[(i * 7) % n].state;
+         unsigned hash_key = cso_construct_key(templ, key_size);
+         struct cso_hash_iter iter =
+            cso_find_state_template(&cache, hash_key, CSO_RASTERIZER,
+                                    templ, key_size);
+         if (cso_hash_iter_is_null(iter)) {
+            cso_hash_insert(&cache.hashes[CSO_RASTERIZER], hash_key,
+                            &states[(i * 7) % n]);
+            misses++;
+         }
+      }
+      int64_t end = os_time_get_nano();
+
+      EXPECT_EQ(misses, n);
+      printf("%5u states: %.1f ns per lookup\n",
+             n, (double)(end - start) / iterations);
+
+      for (unsigned i = 0; i < CSO_CACHE_MAX; i++)
+         cso_hash_deinit(&cache.hashes[i]);
+   }
+}
@@ -1271,6 +1271,14 @@ draw_set_tess_state(struct draw_context *draw,
 }
 
 
+void
+draw_set_vs_queue(struct draw_context *draw, struct util_queue *queue)
+{
+   /* queued chunks never outlive a draw, so nothing refers to the old one */
+   draw->vs_queue = queue;
+}
+
+
 void
 draw_set_disk_cache_callbacks(struct draw_context *draw,
                               void *data_cookie,
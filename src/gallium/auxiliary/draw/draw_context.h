@@ -55,6 +55,7 @@ struct tgsi_sampler;
 struct tgsi_image;
 struct tgsi_buffer;
 struct lp_cached_code;
+struct util_queue;
 
 
 /*
@@ -417,6 +418,13 @@ bool
 draw_get_option_use_llvm(void);
 
 
+/* Lets the llvm middle end shade the vertices of large draws on queue,
+ * which may be shared with other draw contexts.  NULL, the default, shades
+ * on the draw thread.
+ */
+void
+draw_set_vs_queue(struct draw_context *draw, struct util_queue *queue);
+
 void
 draw_set_disk_cache_callbacks(struct draw_context *draw,
                               void *data_cookie,
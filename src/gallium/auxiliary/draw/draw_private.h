@@ -394,6 +394,8 @@ struct draw_context
 
    struct draw_assembler *ia;
 
+   struct util_queue *vs_queue;
+
    void *disk_cache_cookie;
    void (*disk_cache_find_shader)(void *cookie,
                                   struct lp_cached_code *cache,
@@ -164,6 +164,9 @@ draw_pt_arrays(struct draw_context *draw,
          draw->pt.user.drawid++;
    }
 
+   if (middle->flush)
+      middle->flush(middle);
+
    return true;
 }
 
@@ -125,6 +125,11 @@ struct draw_pt_middle_end {
 
    int (*get_max_vertex_count)(struct draw_pt_middle_end *);
 
+   /* Complete the work of the run calls so far, which a middle end may
+    * defer until the end of the draw.  May be NULL.
+    */
+   void (*flush)(struct draw_pt_middle_end *);
+
    void (*finish)(struct draw_pt_middle_end *);
    void (*destroy)(struct draw_pt_middle_end *);
 };
@@ -28,6 +28,7 @@
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_prim.h"
+#include "util/u_queue.h"
 #include "draw/draw_context.h"
 #include "draw/draw_gs.h"
 #include "draw/draw_tess.h"
@@ -41,6 +42,43 @@
 #include "gallivm/lp_bld_debug.h"
 
 
+/* Chunks of a draw in flight, each is one run call from vsplit */
+#define LLVM_MAX_SHADE_JOBS 32
+
+
+/**
+ * Arguments of the vertex shader for a chunk, captured when it is queued
+ * since the frontend reuses its element buffers.
+ */
+struct llvm_shade_job {
+   struct llvm_middle_end *fpme;
+   struct util_queue_fence fence;
+   bool queued;
+
+   draw_jit_vert_func jit_func;
+   unsigned count;
+   unsigned start;
+   unsigned vertex_id_offset;
+   unsigned instance_id;
+   unsigned start_instance;
+   unsigned draw_id;
+   unsigned view_id;
+   const unsigned *fetch_elts;
+
+   struct vertex_header *verts;
+   bool clipped;
+
+   struct draw_prim_info prim_info;
+   unsigned prim_count;
+
+   /* Copies of the element lists */
+   unsigned *fetch_elts_copy;
+   unsigned fetch_elts_size;
+   uint16_t *draw_elts_copy;
+   unsigned draw_elts_size;
+};
+
+
 struct llvm_middle_end {
    struct draw_pt_middle_end base;
    struct draw_context *draw;
@@ -58,6 +96,14 @@ struct llvm_middle_end {
 
    struct draw_llvm *llvm;
    struct draw_llvm_variant *current_variant;
+
+   /* With a vs_queue, the vertex shader runs on chunks of a draw in
+    * parallel.  Everything after it, up to handing primitives to the
+    * driver, runs on the draw thread in the order of the chunks.
+    */
+   struct llvm_shade_job jobs[LLVM_MAX_SHADE_JOBS];
+   unsigned first_job;
+   unsigned num_jobs;
 };
 
 
@@ -489,41 +535,203 @@ emit(struct pt_emit *emit,
 }
 
 
+static struct vertex_header *
+llvm_alloc_verts(struct llvm_middle_end *fpme, unsigned count)
+{
+   return (struct vertex_header *)
+      MALLOC(fpme->vertex_size *
+             align(count, lp_native_vector_width / 32) +
+             DRAW_EXTRA_VERTICES_PADDING);
+}
+
+
+static void
+llvm_shade_job_init(struct llvm_middle_end *fpme,
+                    struct llvm_shade_job *job,
+                    const struct draw_fetch_info *fetch_info)
+{
+   struct draw_context *draw = fpme->draw;
+
+   job->fpme = fpme;
+   job->jit_func = fpme->current_variant->jit_func;
+   job->count = fetch_info->count;
+   if (fetch_info->linear) {
+      job->start = fetch_info->start;
+      job->vertex_id_offset = draw->start_index;
+      job->fetch_elts = NULL;
+   } else {
+      job->start = draw->pt.user.eltMax;
+      job->vertex_id_offset = draw->pt.user.eltBias;
+      job->fetch_elts = fetch_info->elts;
+   }
+   job->instance_id = draw->instance_id;
+   job->start_instance = draw->start_instance;
+   job->draw_id = draw->pt.user.drawid;
+   job->view_id = draw->pt.user.viewid;
+}
+
+
+static void
+llvm_shade_job_run(struct llvm_shade_job *job)
+{
+   struct llvm_middle_end *fpme = job->fpme;
+   struct draw_context *draw = fpme->draw;
+
+   /* Run vertex fetch shader */
+   job->clipped = job->jit_func(&fpme->llvm->vs_jit_context,
+                                &fpme->llvm->jit_resources[MESA_SHADER_VERTEX],
+                                job->verts,
+                                draw->pt.user.vbuffer,
+                                job->count,
+                                job->start,
+                                fpme->vertex_size,
+                                draw->pt.vertex_buffer,
+                                job->instance_id,
+                                job->vertex_id_offset,
+                                job->start_instance,
+                                job->fetch_elts,
+                                job->draw_id,
+                                job->view_id);
+}
+
+
+static void
+llvm_shade_job_execute(void *data, void *gdata, int thread_index)
+{
+   struct llvm_shade_job *job = data;
+
+   /* Same floating point state as draw_vbo() sets on the draw thread */
+   unsigned fpstate = util_fpstate_get();
+   util_fpstate_set_denorms_to_zero(fpstate);
+
+   llvm_shade_job_run(job);
+
+   util_fpstate_set(fpstate);
+}
+
+
+static void
+llvm_pipeline_prims(struct llvm_middle_end *fpme,
+                    struct draw_vertex_info *vert_info,
+                    const struct draw_prim_info *in_prim_info,
+                    bool clipped);
+
+
+static void
+llvm_shade_job_queue(struct llvm_middle_end *fpme, struct llvm_shade_job *job)
+{
+   job->queued = true;
+   util_queue_add_job(fpme->draw->vs_queue, job, &job->fence,
+                      llvm_shade_job_execute, NULL, 0);
+}
+
+
+/**
+ * Waits for the vertices of the oldest chunk and runs the rest of the
+ * pipeline on them.
+ */
+static void
+llvm_shade_job_complete(struct llvm_middle_end *fpme)
+{
+   struct llvm_shade_job *job = &fpme->jobs[fpme->first_job];
+
+   assert(fpme->num_jobs > 0);
+
+   if (job->queued)
+      util_queue_fence_wait(&job->fence);
+   else
+      llvm_shade_job_run(job);
+
+   struct draw_vertex_info vert_info = {
+      .verts = job->verts,
+      .vertex_size = fpme->vertex_size,
+      .stride = fpme->vertex_size,
+      .count = job->count,
+   };
+   llvm_pipeline_prims(fpme, &vert_info, &job->prim_info, job->clipped);
+
+   job->verts = NULL;
+   fpme->first_job = (fpme->first_job + 1) % LLVM_MAX_SHADE_JOBS;
+   fpme->num_jobs--;
+}
+
+
+static void
+llvm_middle_end_flush(struct draw_pt_middle_end *middle)
+{
+   struct llvm_middle_end *fpme = llvm_middle_end(middle);
+
+   while (fpme->num_jobs)
+      llvm_shade_job_complete(fpme);
+}
+
+
+/**
+ * Queues the vertex shader of a chunk.  The first chunk of a draw is held
+ * back and shaded on the draw thread if it remains the only one, so that
+ * small draws don't pay for the handoff.
+ */
+static void
+llvm_shade_job_add(struct llvm_middle_end *fpme,
+                   const struct draw_fetch_info *fetch_info,
+                   const struct draw_prim_info *prim_info,
+                   struct vertex_header *verts)
+{
+   if (fpme->num_jobs == LLVM_MAX_SHADE_JOBS)
+      llvm_shade_job_complete(fpme);
+
+   struct llvm_shade_job *job =
+      &fpme->jobs[(fpme->first_job + fpme->num_jobs) % LLVM_MAX_SHADE_JOBS];
+
+   llvm_shade_job_init(fpme, job, fetch_info);
+   job->verts = verts;
+   job->queued = false;
+
+   if (job->fetch_elts) {
+      if (job->fetch_elts_size < job->count) {
+         FREE(job->fetch_elts_copy);
+         job->fetch_elts_copy = MALLOC(job->count * sizeof(unsigned));
+         job->fetch_elts_size = job->count;
+      }
+      memcpy(job->fetch_elts_copy, job->fetch_elts, job->count * sizeof(unsigned));
+      job->fetch_elts = job->fetch_elts_copy;
+   }
+
+   job->prim_info = *prim_info;
+   job->prim_count = prim_info->count;
+   job->prim_info.primitive_lengths = &job->prim_count;
+   assert(prim_info->primitive_count == 1);
+   if (prim_info->elts) {
+      if (job->draw_elts_size < prim_info->count) {
+         FREE(job->draw_elts_copy);
+         job->draw_elts_copy = MALLOC(prim_info->count * sizeof(uint16_t));
+         job->draw_elts_size = prim_info->count;
+      }
+      memcpy(job->draw_elts_copy, prim_info->elts, prim_info->count * sizeof(uint16_t));
+      job->prim_info.elts = job->draw_elts_copy;
+   }
+
+   fpme->num_jobs++;
+
+   if (fpme->num_jobs == 2 && !fpme->jobs[fpme->first_job].queued)
+      llvm_shade_job_queue(fpme, &fpme->jobs[fpme->first_job]);
+   if (fpme->num_jobs > 1)
+      llvm_shade_job_queue(fpme, job);
+}
+
+
 static void
 llvm_pipeline_generic(struct draw_pt_middle_end *middle,
                       const struct draw_fetch_info *fetch_info,
-                      const struct draw_prim_info *in_prim_info)
+                      const struct draw_prim_info *prim_info)
 {
    struct llvm_middle_end *fpme = llvm_middle_end(middle);
    struct draw_context *draw = fpme->draw;
-   struct draw_geometry_shader *gshader = draw->gs.geometry_shader;
-   struct draw_tess_ctrl_shader *tcs_shader = draw->tcs.tess_ctrl_shader;
-   struct draw_tess_eval_shader *tes_shader = draw->tes.tess_eval_shader;
-   struct draw_prim_info tcs_prim_info;
-   struct draw_prim_info tes_prim_info;
-   struct draw_prim_info gs_prim_info[TGSI_MAX_VERTEX_STREAMS];
-   struct draw_vertex_info llvm_vert_info;
-   struct draw_vertex_info tcs_vert_info;
-   struct draw_vertex_info tes_vert_info;
-   struct draw_vertex_info *vert_info;
-   struct draw_prim_info ia_prim_info;
-   struct draw_vertex_info ia_vert_info;
-   const struct draw_prim_info *prim_info = in_prim_info;
-   bool free_prim_info = false;
-   unsigned opt = fpme->opt;
-   bool clipped = 0;
-   uint16_t *tes_elts_out = NULL;
 
    assert(fetch_info->count > 0);
 
-   llvm_vert_info.count = fetch_info->count;
-   llvm_vert_info.vertex_size = fpme->vertex_size;
-   llvm_vert_info.stride = fpme->vertex_size;
-   llvm_vert_info.verts = (struct vertex_header *)
-      MALLOC(fpme->vertex_size *
-             align(fetch_info->count, lp_native_vector_width / 32) +
-             DRAW_EXTRA_VERTICES_PADDING);
-   if (!llvm_vert_info.verts) {
+   struct vertex_header *verts = llvm_alloc_verts(fpme, fetch_info->count);
+   if (!verts) {
       assert(0);
       return;
    }
@@ -539,40 +747,52 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
       draw->statistics.vs_invocations += fetch_info->count;
    }
 
-   {
-      unsigned start, vertex_id_offset;
-      const unsigned *elts;
-
-      if (fetch_info->linear) {
-         start = fetch_info->start;
-         vertex_id_offset = draw->start_index;
-         elts = NULL;
-      } else {
-         start = draw->pt.user.eltMax;
-         vertex_id_offset = draw->pt.user.eltBias;
-         elts = fetch_info->elts;
-      }
-      /* Run vertex fetch shader */
-      clipped = fpme->current_variant->jit_func(&fpme->llvm->vs_jit_context,
-                                                &fpme->llvm->jit_resources[MESA_SHADER_VERTEX],
-                                                llvm_vert_info.verts,
-                                                draw->pt.user.vbuffer,
-                                                fetch_info->count,
-                                                start,
-                                                fpme->vertex_size,
-                                                draw->pt.vertex_buffer,
-                                                draw->instance_id,
-                                                vertex_id_offset,
-                                                draw->start_instance,
-                                                elts,
-                                                draw->pt.user.drawid,
-                                                draw->pt.user.viewid);
-
-      /* Finished with fetch and vs */
-      fetch_info = NULL;
-      vert_info = &llvm_vert_info;
+   if (draw->vs_queue) {
+      llvm_shade_job_add(fpme, fetch_info, prim_info, verts);
+      return;
    }
 
+   struct llvm_shade_job job;
+   llvm_shade_job_init(fpme, &job, fetch_info);
+   job.verts = verts;
+   llvm_shade_job_run(&job);
+
+   struct draw_vertex_info vert_info = {
+      .verts = verts,
+      .vertex_size = fpme->vertex_size,
+      .stride = fpme->vertex_size,
+      .count = fetch_info->count,
+   };
+   llvm_pipeline_prims(fpme, &vert_info, prim_info, job.clipped);
+}
+
+
+/**
+ * Runs everything after the vertex shader on the vertices of a chunk and
+ * frees them.
+ */
+static void
+llvm_pipeline_prims(struct llvm_middle_end *fpme,
+                    struct draw_vertex_info *vert_info,
+                    const struct draw_prim_info *in_prim_info,
+                    bool clipped)
+{
+   struct draw_context *draw = fpme->draw;
+   struct draw_geometry_shader *gshader = draw->gs.geometry_shader;
+   struct draw_tess_ctrl_shader *tcs_shader = draw->tcs.tess_ctrl_shader;
+   struct draw_tess_eval_shader *tes_shader = draw->tes.tess_eval_shader;
+   struct draw_prim_info tcs_prim_info;
+   struct draw_prim_info tes_prim_info;
+   struct draw_prim_info gs_prim_info[TGSI_MAX_VERTEX_STREAMS];
+   struct draw_vertex_info tcs_vert_info;
+   struct draw_vertex_info tes_vert_info;
+   struct draw_prim_info ia_prim_info;
+   struct draw_vertex_info ia_vert_info;
+   const struct draw_prim_info *prim_info = in_prim_info;
+   bool free_prim_info = false;
+   unsigned opt = fpme->opt;
+   uint16_t *tes_elts_out = NULL;
+
    /* Keep track of the patch lengths if we have a geometry shader, this way we can increment
     * gl_PrimitiveID once per patch, instead of per tessellation output primitive.
     * The Vulkan and OpenGL specs say:
@@ -845,7 +1065,7 @@ llvm_middle_end_linear_run_elts(struct draw_pt_middle_end *middle,
 static void
 llvm_middle_end_finish(struct draw_pt_middle_end *middle)
 {
-   /* nothing to do */
+   llvm_middle_end_flush(middle);
 }
 
 
@@ -854,6 +1074,15 @@ llvm_middle_end_destroy(struct draw_pt_middle_end *middle)
 {
    struct llvm_middle_end *fpme = llvm_middle_end(middle);
 
+   /* the queue belongs to the driver, only wait for our own chunks */
+   llvm_middle_end_flush(middle);
+
+   for (unsigned i = 0; i < LLVM_MAX_SHADE_JOBS; i++) {
+      util_queue_fence_destroy(&fpme->jobs[i].fence);
+      FREE(fpme->jobs[i].fetch_elts_copy);
+      FREE(fpme->jobs[i].draw_elts_copy);
+   }
+
    if (fpme->fetch)
       draw_pt_fetch_destroy(fpme->fetch);
 
@@ -887,11 +1116,15 @@ draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
    fpme->base.run             = llvm_middle_end_run;
    fpme->base.run_linear      = llvm_middle_end_linear_run;
    fpme->base.run_linear_elts = llvm_middle_end_linear_run_elts;
+   fpme->base.flush           = llvm_middle_end_flush;
    fpme->base.finish          = llvm_middle_end_finish;
    fpme->base.destroy         = llvm_middle_end_destroy;
 
    fpme->draw = draw;
 
+   for (unsigned i = 0; i < LLVM_MAX_SHADE_JOBS; i++)
+      util_queue_fence_init(&fpme->jobs[i].fence);
+
    fpme->fetch = draw_pt_fetch_create(draw);
    if (!fpme->fetch)
       goto fail;
@@ -358,10 +358,7 @@ int draw_tess_eval_shader_run(struct draw_tess_eval_shader *shader,
 #if DRAW_LLVM_AVAILABLE
    struct pipe_tessellation_factors factors;
    struct pipe_tessellator_data data = { 0 };
-   struct pipe_tessellator *ptess = p_tess_init(shader->prim_mode,
-                                                shader->spacing,
-                                                !shader->vertex_order_cw,
-                                                shader->point_mode);
+   struct pipe_tessellator *ptess = shader->tessellator;
    unsigned first_patch = input_prims->start / shader->draw->pt.vertices_per_patch;
    for (unsigned i = 0; i < input_prims->primitive_count; i++) {
       uint32_t vert_start = output_verts->count;
@@ -414,7 +411,6 @@ int draw_tess_eval_shader_run(struct draw_tess_eval_shader *shader,
          output_prims->primitive_lengths[i] = prim_len;
       }
    }
-   p_tess_destroy(ptess);
 #endif
 
    *elts_out = elts;
@@ -593,6 +589,8 @@ draw_create_tess_eval_shader(struct draw_context *draw,
       memset(tes->tes_input, 0, sizeof(struct draw_tes_inputs));
 
       tes->jit_resources = &draw->llvm->jit_resources[MESA_SHADER_TESS_EVAL];
+      tes->tessellator = p_tess_init(tes->prim_mode, tes->spacing,
+                                     !tes->vertex_order_cw, tes->point_mode);
       llvm_tes->variant_key_size =
          draw_tes_llvm_variant_key_size(
                                         tes->info.file_max[TGSI_FILE_SAMPLER]+1,
@@ -634,6 +632,7 @@ void draw_delete_tess_eval_shader(struct draw_context *draw,
 
       assert(shader->variants_cached == 0);
       align_free(dtes->tes_input);
+      p_tess_destroy(dtes->tessellator);
    }
 #endif
    if (dtes->state.type == PIPE_SHADER_IR_NIR && dtes->state.ir.nir)
@@ -341,6 +341,23 @@ lp_build_gather_avx2(struct gallivm_state *gallivm,
       unsigned l_idx = 0;
 
       assert(src_width == 32 || src_width == 64);
+      if (src_width == 32 && length == 16) {
+         /* AVX-512 takes the mask as a k register and a 32-bit scale. */
+         LLVMValueRef args[] = {
+            LLVMGetUndef(src_vec_type),
+            base_ptr,
+            offsets,
+            LLVMConstInt(LLVMInt16TypeInContext(gallivm->context), 0xffff, 0),
+            LLVMConstInt(LLVMInt32TypeInContext(gallivm->context), 1, 0),
+         };
+
+         intrinsic = dst_type.floating ? "llvm.x86.avx512.gather.dps.512" :
+                                         "llvm.x86.avx512.gather.dpi.512";
+         res = lp_build_intrinsic(builder, intrinsic, src_vec_type, args, 5, 0);
+         return LLVMBuildBitCast(builder, res,
+                                 lp_build_vec_type(gallivm, res_type), "");
+      }
+
       if (src_width == 32) {
          assert(length == 4 || length == 8);
       } else {
@@ -491,6 +508,10 @@ lp_build_gather(struct gallivm_state *gallivm,
               src_width == 32 && (length == 4 || length == 8)) {
       return lp_build_gather_avx2(gallivm, length, src_width, dst_type,
                                   base_ptr, offsets);
+   } else if (util_get_cpu_caps()->has_avx512f && !need_expansion &&
+              src_width == 32 && length == 16) {
+      return lp_build_gather_avx2(gallivm, length, src_width, dst_type,
+                                  base_ptr, offsets);
    /*
     * This looks bad on paper wrt throughtput/latency on Haswell.
     * Even on Broadwell it doesn't look stellar.
@@ -156,7 +156,7 @@ init_gallivm_engine(struct gallivm_state *gallivm)
       char *error = NULL;
       int ret;
 
-      if (gallivm_perf & GALLIVM_PERF_NO_OPT) {
+      if ((gallivm_perf & GALLIVM_PERF_NO_OPT) || gallivm->fast_compile) {
          optlevel = None;
       }
       else {
@@ -367,6 +367,29 @@ gallivm_destroy(struct gallivm_state *gallivm)
    FREE(gallivm);
 }
 
+void
+gallivm_set_fast_compile(struct gallivm_state *gallivm)
+{
+   assert(!gallivm->compiled);
+
+   if (gallivm->fast_compile)
+      return;
+
+   gallivm->fast_compile = true;
+
+   LLVMTypeRef i32 = LLVMInt32TypeInContext(gallivm->context);
+   LLVMAddModuleFlag(gallivm->module, LLVMModuleFlagBehaviorOverride,
+                     LP_MODULE_FLAG_NO_OPT, strlen(LP_MODULE_FLAG_NO_OPT),
+                     LLVMValueAsMetadata(LLVMConstInt(i32, 1, 0)));
+
+   /* The optimization passes were picked when the module was created. */
+   if (gallivm->passmgr) {
+      lp_passmgr_dispose(gallivm->passmgr);
+      gallivm->passmgr = NULL;
+      lp_passmgr_create(gallivm->module, &gallivm->passmgr);
+   }
+}
+
 void
 gallivm_add_global_mapping(struct gallivm_state *gallivm, LLVMValueRef sym, void* addr)
 {
@@ -404,6 +427,8 @@ gallivm_compile_module(struct gallivm_state *gallivm)
       goto skip_cached;
    }
 
+   lp_set_module_vector_width(gallivm);
+
    /* Dump bitcode to a file */
    if (gallivm_debug & GALLIVM_DEBUG_DUMP_BC) {
       char filename[256];
@@ -502,7 +527,13 @@ gallivm_jit_function(struct gallivm_state *gallivm,
    if (gallivm_debug & GALLIVM_DEBUG_PERF)
       time_begin = os_time_get();
 
-   code = LLVMGetPointerToGlobal(gallivm->engine, func);
+   if (func) {
+      code = LLVMGetPointerToGlobal(gallivm->engine, func);
+   } else {
+      lp_finalize_engine(gallivm->engine);
+      code = (void *)(uintptr_t)LLVMGetFunctionAddress(gallivm->engine,
+                                                        func_name);
+   }
    assert(code);
    jit_func = pointer_to_func(code);
 
@@ -510,7 +541,7 @@ gallivm_jit_function(struct gallivm_state *gallivm,
       int64_t time_end = os_time_get();
       int time_msec = (int)(time_end - time_begin) / 1000;
       debug_printf("   jitting func %s took %d msec\n",
-                   LLVMGetValueName(func), time_msec);
+                   func_name, time_msec);
    }
 
    return jit_func;
@@ -71,6 +71,7 @@ struct gallivm_state
    LLVMDIBuilderRef di_builder;
    struct lp_cached_code *cache;
    unsigned compiled;
+   bool fast_compile;
    LLVMValueRef coro_malloc_hook;
    LLVMValueRef coro_free_hook;
    LLVMValueRef debug_printf_hook;
@@ -105,6 +106,14 @@ gallivm_destroy(struct gallivm_state *gallivm);
 void
 gallivm_free_ir(struct gallivm_state *gallivm);
 
+/**
+ * Favor compilation speed over code quality for this module only, the
+ * per-module equivalent of GALLIVM_PERF_NO_OPT.  Must be called before
+ * gallivm_compile_module().
+ */
+void
+gallivm_set_fast_compile(struct gallivm_state *gallivm);
+
 void
 gallivm_verify_function(struct gallivm_state *gallivm,
                         LLVMValueRef func);
@@ -116,10 +125,18 @@ gallivm_add_global_mapping(struct gallivm_state *gallivm, LLVMValueRef sym, void
  * for ORCJIT, after this function gets called, all access and modification to
  * module and any structure associated to it should be avoided,
  * as module has been moved into ORCJIT and may be recycled
+ *
+ * If gallivm->cache holds object code, it is used instead of compiling the
+ * module.  The module may then be left without any function definitions,
+ * which are looked up by name instead, see gallivm_jit_function().
  */
 void
 gallivm_compile_module(struct gallivm_state *gallivm);
 
+/**
+ * func may be NULL if the code was loaded from the cache without building
+ * the IR, in which case the function is looked up by func_name.
+ */
 func_pointer
 gallivm_jit_function(struct gallivm_state *gallivm,
                      LLVMValueRef func, const char *func_name);
@@ -131,6 +148,8 @@ unsigned gallivm_get_perf_flags(void);
 
 void lp_init_clock_hook(struct gallivm_state *gallivm);
 
+void lp_set_module_vector_width(struct gallivm_state *gallivm);
+
 void lp_init_env_options(void);
 
 static inline void
@@ -106,6 +106,42 @@ lp_init_clock_hook(struct gallivm_state *gallivm)
    gallivm->get_time_hook = LLVMAddFunction(gallivm->module, "get_time_hook", get_time_type);
 }
 
+/**
+ * Make LLVM keep vectors wider than 256 bits whole.
+ *
+ * Most AVX-512 capable x86 CPUs are tuned to prefer 256-bit vectors, and
+ * the backend then splits 512-bit operations in two unless the function
+ * says it needs them.
+ */
+void
+lp_set_module_vector_width(struct gallivm_state *gallivm)
+{
+   if (lp_native_vector_width <= 256)
+      return;
+
+   char width[16];
+   int width_len = snprintf(width, sizeof(width), "%u", lp_native_vector_width);
+
+   static const char *attrs[] = {
+      "min-legal-vector-width",
+      "prefer-vector-width",
+   };
+
+   for (LLVMValueRef func = LLVMGetFirstFunction(gallivm->module); func;
+        func = LLVMGetNextFunction(func)) {
+      if (LLVMIsDeclaration(func))
+         continue;
+
+      for (unsigned i = 0; i < ARRAY_SIZE(attrs); i++) {
+         LLVMAttributeRef attr =
+            LLVMCreateStringAttribute(gallivm->context,
+                                      attrs[i], strlen(attrs[i]),
+                                      width, width_len);
+         LLVMAddAttributeAtIndex(func, LLVMAttributeFunctionIndex, attr);
+      }
+   }
+}
+
 /**
  * Validate a function.
  * Verification is only done with debug builds.
@@ -205,6 +205,17 @@ public:
       ));
    }
 
+   static void add_object_to_jd(
+         const void *data,
+         size_t size,
+         LLVMOrcJITDylibRef jd) {
+      auto buf = llvm::MemoryBuffer::getMemBufferCopy(
+         llvm::StringRef((const char *)data, size));
+      ExitOnErr(get_instance()->lljit->addObjectFile(
+         *::unwrap(jd), std::move(buf)
+      ));
+   }
+
    static void add_mapping_to_jd(
          LLVMValueRef sym,
          void *addr,
@@ -234,14 +245,21 @@ public:
 
    static void *lookup_in_jd(
          const char *func_name,
-         LLVMOrcJITDylibRef jd) {
+         LLVMOrcJITDylibRef jd,
+         llvm::ObjectCache *objcache) {
       using llvm::orc::JITDylib;
       using llvm::JITEvaluatedSymbol;
       using llvm::orc::ExecutorAddr;
       JITDylib* JD = ::unwrap(jd);
       LPJit* jit = get_instance();
       jit->lookup_mutex.lock();
+      /* The first lookup compiles the module on this thread.  The compiler
+       * and its object cache are shared by all threads, so the cache of
+       * the module is only installed while holding the lock.
+       */
+      set_object_cache(objcache);
       auto func = ExitOnErr(jit->lljit->lookup(*JD, func_name));
+      set_object_cache(NULL);
       jit->lookup_mutex.unlock();
 #if LLVM_VERSION_MAJOR >= 15
       return func.toPtr<void *>();
@@ -622,7 +640,25 @@ gallivm_free_ir(struct gallivm_state *gallivm)
    gallivm->_ts_context=NULL;
    gallivm->cache=NULL;
    LPJit::deregister_gallivm_state(gallivm);
-   LPJit::set_object_cache(NULL);
+}
+
+void
+gallivm_set_fast_compile(struct gallivm_state *gallivm)
+{
+   assert(gallivm->module);
+
+   if (gallivm->fast_compile)
+      return;
+
+   gallivm->fast_compile = true;
+
+   /* Only the IR passes in module_transform() can be skipped, the code
+    * generation level is shared by the whole LLJIT instance.
+    */
+   LLVMTypeRef i32 = LLVMInt32TypeInContext(gallivm->context);
+   LLVMAddModuleFlag(gallivm->module, LLVMModuleFlagBehaviorOverride,
+                     LP_MODULE_FLAG_NO_OPT, strlen(LP_MODULE_FLAG_NO_OPT),
+                     LLVMValueAsMetadata(LLVMConstInt(i32, 1, 0)));
 }
 
 void
@@ -631,6 +667,17 @@ gallivm_add_global_mapping(struct gallivm_state *gallivm, LLVMValueRef sym, void
    LPJit::add_mapping_to_jd(sym, addr, gallivm->_per_module_jd);
 }
 
+static bool
+module_has_definitions(LLVMModuleRef module)
+{
+   for (LLVMValueRef func = LLVMGetFirstFunction(module); func;
+        func = LLVMGetNextFunction(func)) {
+      if (!LLVMIsDeclaration(func))
+         return true;
+   }
+   return false;
+}
+
 void
 gallivm_compile_module(struct gallivm_state *gallivm)
 {
@@ -644,6 +691,19 @@ gallivm_compile_module(struct gallivm_state *gallivm)
 
    lp_build_coro_add_malloc_hooks(gallivm);
 
+   /* Without any IR to compile, the symbols can't be found through the
+    * object cache, so add the cached object directly.  The module is
+    * freed by gallivm_free_ir().
+    */
+   if (gallivm->cache && gallivm->cache->data_size &&
+       !module_has_definitions(gallivm->module)) {
+      LPJit::add_object_to_jd(gallivm->cache->data, gallivm->cache->data_size,
+                              gallivm->_per_module_jd);
+      return;
+   }
+
+   lp_set_module_vector_width(gallivm);
+
    LPJit::add_ir_module_to_jd(gallivm->_ts_context, gallivm->module,
       gallivm->_per_module_jd);
    /* ownership of module is now transferred into orc jit,
@@ -652,13 +712,9 @@ gallivm_compile_module(struct gallivm_state *gallivm)
    LPJit::register_gallivm_state(gallivm);
    gallivm->module = nullptr;
 
-   if (gallivm->cache) {
-      if (!gallivm->cache->jit_obj_cache) {
-         LPObjectCacheORC *objcache = new LPObjectCacheORC(gallivm->cache);
-         gallivm->cache->jit_obj_cache = (void *)objcache;
-      }
-      auto *objcache = (LPObjectCacheORC *)gallivm->cache->jit_obj_cache;
-      LPJit::set_object_cache(objcache);
+   if (gallivm->cache && !gallivm->cache->jit_obj_cache) {
+      LPObjectCacheORC *objcache = new LPObjectCacheORC(gallivm->cache);
+      gallivm->cache->jit_obj_cache = (void *)objcache;
    }
    /* defer compilation till first lookup by gallivm_jit_function */
 }
@@ -667,8 +723,11 @@ func_pointer
 gallivm_jit_function(struct gallivm_state *gallivm,
                      LLVMValueRef func, const char *func_name)
 {
+   llvm::ObjectCache *objcache = gallivm->cache ?
+      (LPObjectCacheORC *)gallivm->cache->jit_obj_cache : NULL;
+
    return pointer_to_func(
-      LPJit::lookup_in_jd(func_name, gallivm->_per_module_jd));
+      LPJit::lookup_in_jd(func_name, gallivm->_per_module_jd, objcache));
 }
 
 void
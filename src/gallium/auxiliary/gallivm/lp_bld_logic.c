@@ -350,6 +350,17 @@ lp_build_select(struct lp_build_context *bld,
 
       res = LLVMBuildSelect(builder, mask, a, b, "");
    }
+   else if (util_get_cpu_caps()->has_avx512f &&
+            type.width * type.length == 512 &&
+            (type.width >= 32 || util_get_cpu_caps()->has_avx512bw)) {
+      /* There is no 512-bit blendv, but AVX-512 selects with a k register
+       * mask, which the sign test below compiles straight into
+       * (vpmovd2m, or folded into the compare that made the mask).
+       */
+      mask = LLVMBuildICmp(builder, LLVMIntSLT, mask,
+                           LLVMConstNull(LLVMTypeOf(mask)), "");
+      res = LLVMBuildSelect(builder, mask, a, b, "");
+   }
    else if (((util_get_cpu_caps()->has_sse4_1 &&
               type.width * type.length == 128) ||
              (util_get_cpu_caps()->has_avx &&
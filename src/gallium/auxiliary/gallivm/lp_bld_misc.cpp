@@ -378,6 +378,11 @@ lp_build_fill_mattrs(std::vector<std::string> &MAttrs)
    MAttrs.push_back(util_get_cpu_caps()->has_avx512dq ? "+avx512dq"  : "-avx512dq");
    MAttrs.push_back(util_get_cpu_caps()->has_avx512vl ? "+avx512vl"  : "-avx512vl");
    MAttrs.push_back(util_get_cpu_caps()->has_avx512vbmi ? "+avx512vbmi"  : "-avx512vbmi");
+#if LLVM_VERSION_MAJOR >= 18
+   /* 512-bit registers are a separate feature since llvm-18 (AVX10/256) */
+   if (util_get_cpu_caps()->has_avx512f)
+      MAttrs.push_back("+evex512");
+#endif
 #endif
 #if DETECT_ARCH_ARM
    if (!util_get_cpu_caps()->has_neon) {
@@ -648,6 +653,17 @@ lp_free_objcache(void *objcache_ptr)
    delete objcache;
 }
 
+/*
+ * Load and relocate any object code still pending in the engine, so that
+ * symbols can be looked up by name even when the owning module carries no
+ * IR definitions (i.e. its code came straight from the object cache).
+ */
+extern "C" void
+lp_finalize_engine(LLVMExecutionEngineRef EE)
+{
+   llvm::unwrap(EE)->finalizeObject();
+}
+
 extern "C" LLVMValueRef
 lp_get_called_value(LLVMValueRef call)
 {
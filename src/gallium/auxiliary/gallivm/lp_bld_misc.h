@@ -85,6 +85,9 @@ lp_get_default_memory_manager();
 extern void
 lp_free_memory_manager(LLVMMCJITMemoryManagerRef memorymgr);
 
+extern void
+lp_finalize_engine(LLVMExecutionEngineRef EE);
+
 extern LLVMValueRef
 lp_get_called_value(LLVMValueRef call);
 
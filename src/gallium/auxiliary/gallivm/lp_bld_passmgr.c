@@ -54,6 +54,16 @@ struct lp_passmgr {
 struct lp_passmgr;
 #endif
 
+bool
+lp_passmgr_module_no_opt(LLVMModuleRef module)
+{
+   if (gallivm_perf & GALLIVM_PERF_NO_OPT)
+      return true;
+
+   return LLVMGetModuleFlag(module, LP_MODULE_FLAG_NO_OPT,
+                            strlen(LP_MODULE_FLAG_NO_OPT)) != NULL;
+}
+
 bool
 lp_passmgr_create(LLVMModuleRef module, struct lp_passmgr **mgr_p)
 {
@@ -84,7 +94,7 @@ lp_passmgr_create(LLVMModuleRef module, struct lp_passmgr **mgr_p)
    LLVMAddCoroSplitPass(mgr->cgpassmgr);
    LLVMAddCoroElidePass(mgr->cgpassmgr);
 
-   if ((gallivm_perf & GALLIVM_PERF_NO_OPT) == 0) {
+   if (!lp_passmgr_module_no_opt(module)) {
       /*
        * TODO: Evaluate passes some more - keeping in mind
        * both quality of generated code and compile times.
@@ -151,7 +161,7 @@ lp_passmgr_run(struct lp_passmgr *mgr,
    LLVMPassBuilderOptionsRef opts = LLVMCreatePassBuilderOptions();
    LLVMRunPasses(module, passes, tm, opts);
 
-   if (!(gallivm_perf & GALLIVM_PERF_NO_OPT))
+   if (!lp_passmgr_module_no_opt(module))
 #if LLVM_VERSION_MAJOR >= 18
       strcpy(passes, "sroa,early-cse,simplifycfg,reassociate,mem2reg,instsimplify,instcombine<no-verify-fixpoint>");
 #else
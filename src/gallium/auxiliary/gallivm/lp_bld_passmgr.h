@@ -37,6 +37,14 @@ extern "C" {
 
 struct lp_passmgr;
 
+/*
+ * Module flag marking a module which should be compiled as fast as
+ * possible rather than optimized, see gallivm_set_fast_compile().
+ */
+#define LP_MODULE_FLAG_NO_OPT "lp.no_opt"
+
+bool lp_passmgr_module_no_opt(LLVMModuleRef module);
+
 /*
  * mgr can be returned as NULL for modern pass mgr handling
  * so use a bool to denote success/fail.
@@ -0,0 +1,378 @@
+/**************************************************************************
+ *
+ * Copyright 2026 Red Hat.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#include "util/detect.h"
+
+#if DETECT_ARCH_AARCH64
+
+#include <string.h>
+
+#include "util/compiler.h"
+#include "util/u_debug.h"
+#include "util/u_pointer.h"
+
+#include "rtasm_execmem.h"
+#include "rtasm_aarch64.h"
+
+
+static void do_realloc( struct aarch64_function *p )
+{
+   if (p->store == p->error_overflow) {
+      p->csr = p->store;
+   }
+   else if (p->size == 0) {
+      p->size = 1024;
+      p->store = rtasm_exec_malloc(p->size);
+      p->csr = p->store;
+   }
+   else {
+      uintptr_t used = pointer_to_uintptr( p->csr ) - pointer_to_uintptr( p->store );
+      uint32_t *tmp = p->store;
+      p->size *= 2;
+      p->store = rtasm_exec_malloc(p->size);
+
+      if (p->store) {
+         memcpy(p->store, tmp, used);
+         p->csr = p->store + used / 4;
+      }
+      else {
+         p->csr = p->store;
+      }
+
+      rtasm_exec_free(tmp);
+   }
+
+   if (p->store == NULL) {
+      p->store = p->csr = p->error_overflow;
+      p->size = sizeof(p->error_overflow);
+   }
+}
+
+static void emit_ins( struct aarch64_function *p, uint32_t ins )
+{
+   if ((p->csr - p->store + 1) * 4 > (int) p->size)
+      do_realloc(p);
+
+   *p->csr++ = ins;
+}
+
+
+void aarch64_init_func( struct aarch64_function *p )
+{
+   p->size = 0;
+   p->store = NULL;
+   p->csr = NULL;
+}
+
+void aarch64_release_func( struct aarch64_function *p )
+{
+   if (p->store && p->store != p->error_overflow)
+      rtasm_exec_free(p->store);
+
+   p->store = NULL;
+   p->csr = NULL;
+   p->size = 0;
+}
+
+
+static inline aarch64_func
+voidptr_to_aarch64_func(void *v)
+{
+   union {
+      void *v;
+      aarch64_func f;
+   } u;
+   STATIC_ASSERT(sizeof(u.v) == sizeof(u.f));
+   u.v = v;
+   return u.f;
+}
+
+
+aarch64_func aarch64_get_func( struct aarch64_function *p )
+{
+   if (p->store == NULL || p->store == p->error_overflow)
+      return voidptr_to_aarch64_func(NULL);
+
+   /* The data and instruction caches aren't coherent */
+   __builtin___clear_cache((char *)p->store, (char *)p->csr);
+
+   return voidptr_to_aarch64_func(p->store);
+}
+
+
+int aarch64_get_label( struct aarch64_function *p )
+{
+   return p->csr - p->store;
+}
+
+
+/***********************************************************************
+ * Branches
+ */
+
+void a64_b_cond( struct aarch64_function *p, enum a64_cond cond, int label )
+{
+   int offset = label - aarch64_get_label(p);
+   emit_ins(p, 0x54000000 | (offset & 0x7ffff) << 5 | cond);
+}
+
+/* The offset is filled in by a64_fixup_fwd_branch()
+ */
+int a64_cbz_w_forward( struct aarch64_function *p, unsigned rt )
+{
+   emit_ins(p, 0x34000000 | rt);
+   return aarch64_get_label(p) - 1;
+}
+
+void a64_fixup_fwd_branch( struct aarch64_function *p, int fixup )
+{
+   int offset = aarch64_get_label(p) - fixup;
+
+   /* probably out of memory (using the error_overflow buffer) */
+   if (p->store == p->error_overflow)
+      return;
+
+   p->store[fixup] |= (offset & 0x7ffff) << 5;
+}
+
+void a64_ret( struct aarch64_function *p )
+{
+   emit_ins(p, 0xd65f03c0);
+}
+
+
+/***********************************************************************
+ * Integer instructions
+ */
+
+void a64_mov( struct aarch64_function *p, unsigned rd, unsigned rn )
+{
+   /* orr xd, xzr, xn */
+   emit_ins(p, 0xaa0003e0 | rn << 16 | rd);
+}
+
+void a64_mov_imm( struct aarch64_function *p, unsigned rd, uint64_t imm )
+{
+   /* movz for the low half word, then movk for the others that are set */
+   emit_ins(p, 0xd2800000 | (uint32_t)(imm & 0xffff) << 5 | rd);
+   for (unsigned hw = 1; hw < 4; hw++) {
+      uint32_t bits = (imm >> (hw * 16)) & 0xffff;
+      if (bits)
+         emit_ins(p, 0xf2800000 | hw << 21 | bits << 5 | rd);
+   }
+}
+
+void a64_mov_w( struct aarch64_function *p, unsigned rd, unsigned rn )
+{
+   /* orr wd, wzr, wn, which zeroes the upper half of xd */
+   emit_ins(p, 0x2a0003e0 | rn << 16 | rd);
+}
+
+void a64_add( struct aarch64_function *p, unsigned rd, unsigned rn, unsigned rm )
+{
+   emit_ins(p, 0x8b000000 | rm << 16 | rn << 5 | rd);
+}
+
+void a64_add_imm( struct aarch64_function *p, unsigned rd, unsigned rn, unsigned imm )
+{
+   assert(imm < 4096);
+   emit_ins(p, 0x91000000 | imm << 10 | rn << 5 | rd);
+}
+
+void a64_add_w( struct aarch64_function *p, unsigned rd, unsigned rn, unsigned rm )
+{
+   emit_ins(p, 0x0b000000 | rm << 16 | rn << 5 | rd);
+}
+
+void a64_subs_imm_w( struct aarch64_function *p, unsigned rd, unsigned rn, unsigned imm )
+{
+   assert(imm < 4096);
+   emit_ins(p, 0x71000000 | imm << 10 | rn << 5 | rd);
+}
+
+void a64_madd( struct aarch64_function *p, unsigned rd, unsigned rn, unsigned rm,
+               unsigned ra )
+{
+   emit_ins(p, 0x9b000000 | rm << 16 | ra << 10 | rn << 5 | rd);
+}
+
+void a64_udiv_w( struct aarch64_function *p, unsigned rd, unsigned rn, unsigned rm )
+{
+   emit_ins(p, 0x1ac00800 | rm << 16 | rn << 5 | rd);
+}
+
+void a64_cmp_w( struct aarch64_function *p, unsigned rn, unsigned rm )
+{
+   /* subs wzr, wn, wm */
+   emit_ins(p, 0x6b000000 | rm << 16 | rn << 5 | A64_XZR);
+}
+
+void a64_csel_w( struct aarch64_function *p, unsigned rd, unsigned rn, unsigned rm,
+                 enum a64_cond cond )
+{
+   emit_ins(p, 0x1a800000 | rm << 16 | cond << 12 | rn << 5 | rd);
+}
+
+
+void a64_ldr( struct aarch64_function *p, unsigned rt, unsigned rn, unsigned offset )
+{
+   assert(offset % 8 == 0 && offset / 8 < 4096);
+   emit_ins(p, 0xf9400000 | (offset / 8) << 10 | rn << 5 | rt);
+}
+
+void a64_str( struct aarch64_function *p, unsigned rt, unsigned rn, unsigned offset )
+{
+   assert(offset % 8 == 0 && offset / 8 < 4096);
+   emit_ins(p, 0xf9000000 | (offset / 8) << 10 | rn << 5 | rt);
+}
+
+void a64_ldr_w( struct aarch64_function *p, unsigned rt, unsigned rn, unsigned offset )
+{
+   assert(offset % 4 == 0 && offset / 4 < 4096);
+   emit_ins(p, 0xb9400000 | (offset / 4) << 10 | rn << 5 | rt);
+}
+
+void a64_ldr_elt( struct aarch64_function *p, unsigned size, unsigned rt, unsigned rn )
+{
+   /* ldrb, ldrh or ldr into a w register */
+   assert(size <= 2);
+   emit_ins(p, 0x39400000 | size << 30 | rn << 5 | rt);
+}
+
+void a64_prfm_pldl1strm( struct aarch64_function *p, unsigned rn, unsigned offset )
+{
+   assert(offset % 8 == 0 && offset / 8 < 4096);
+   emit_ins(p, 0xf9800000 | (offset / 8) << 10 | rn << 5 | 1);
+}
+
+
+/***********************************************************************
+ * SIMD&FP instructions
+ */
+
+/* Size and opc fields of the scalar loads and stores */
+static uint32_t fp_ldst_size( unsigned size )
+{
+   assert(size <= 4);
+   return size == 4 ? 0x00800000 : size << 30;
+}
+
+bool a64_fp_offset_ok( unsigned size, int offset )
+{
+   /* unsigned scaled offset, or an unscaled one */
+   return (offset >= 0 && offset % (1 << size) == 0 && (offset >> size) < 4096) ||
+          (offset >= -256 && offset < 256);
+}
+
+static void fp_ldst( struct aarch64_function *p, uint32_t op, unsigned size,
+                     unsigned vt, unsigned rn, int offset )
+{
+   assert(a64_fp_offset_ok(size, offset));
+
+   if (offset >= 0 && offset % (1 << size) == 0 && (offset >> size) < 4096)
+      emit_ins(p, 0x3d000000 | op | fp_ldst_size(size) |
+                  (offset >> size) << 10 | rn << 5 | vt);
+   else
+      emit_ins(p, 0x3c000000 | op | fp_ldst_size(size) |
+                  (offset & 0x1ff) << 12 | rn << 5 | vt);
+}
+
+void neon_ldr( struct aarch64_function *p, unsigned size, unsigned vt, unsigned rn,
+               int offset )
+{
+   fp_ldst(p, 0x00400000, size, vt, rn, offset);
+}
+
+void neon_str( struct aarch64_function *p, unsigned size, unsigned vt, unsigned rn,
+               int offset )
+{
+   fp_ldst(p, 0, size, vt, rn, offset);
+}
+
+
+void neon_mov( struct aarch64_function *p, unsigned vd, unsigned vn )
+{
+   /* orr vd.16b, vn.16b, vn.16b */
+   emit_ins(p, 0x4ea01c00 | vn << 16 | vn << 5 | vd);
+}
+
+void neon_ins( struct aarch64_function *p, unsigned size, unsigned vd, unsigned dst_idx,
+               unsigned vn, unsigned src_idx )
+{
+   uint32_t imm5 = (dst_idx << (size + 1)) | (1 << size);
+   uint32_t imm4 = src_idx << size;
+
+   assert(size <= 3);
+   emit_ins(p, 0x6e000400 | imm5 << 16 | imm4 << 11 | vn << 5 | vd);
+}
+
+/* Widens the low half of vn from elements of 1 << size bytes */
+void neon_uxtl( struct aarch64_function *p, unsigned size, unsigned vd, unsigned vn )
+{
+   assert(size <= 1);
+   emit_ins(p, 0x2f00a400 | (8 << size) << 16 | vn << 5 | vd);
+}
+
+void neon_sxtl( struct aarch64_function *p, unsigned size, unsigned vd, unsigned vn )
+{
+   assert(size <= 1);
+   emit_ins(p, 0x0f00a400 | (8 << size) << 16 | vn << 5 | vd);
+}
+
+void neon_ucvtf( struct aarch64_function *p, unsigned vd, unsigned vn )
+{
+   emit_ins(p, 0x6e21d800 | vn << 5 | vd);
+}
+
+void neon_scvtf( struct aarch64_function *p, unsigned vd, unsigned vn )
+{
+   emit_ins(p, 0x4e21d800 | vn << 5 | vd);
+}
+
+void neon_fmul( struct aarch64_function *p, unsigned vd, unsigned vn, unsigned vm )
+{
+   emit_ins(p, 0x6e20dc00 | vm << 16 | vn << 5 | vd);
+}
+
+void neon_fmax( struct aarch64_function *p, unsigned vd, unsigned vn, unsigned vm )
+{
+   emit_ins(p, 0x4e20f400 | vm << 16 | vn << 5 | vd);
+}
+
+/* Converts the unsigned w register rn to a float in lane 0 of vd */
+void neon_ucvtf_w( struct aarch64_function *p, unsigned vd, unsigned rn )
+{
+   emit_ins(p, 0x1e230000 | rn << 5 | vd);
+}
+
+#else
+
+void aarch64_dummy( void );
+
+void aarch64_dummy( void )
+{
+}
+
+#endif
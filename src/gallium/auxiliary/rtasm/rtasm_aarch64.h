@@ -0,0 +1,124 @@
+/**************************************************************************
+ *
+ * Copyright 2026 Red Hat.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#ifndef _RTASM_AARCH64_H_
+#define _RTASM_AARCH64_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "util/compiler.h"
+#include "util/detect.h"
+
+#if DETECT_ARCH_AARCH64
+
+/* A small A64 emitter, just enough for translate_neon.c.
+ *
+ * General purpose registers are given by number, 31 being the zero
+ * register or the stack pointer depending on the instruction.  Vector
+ * registers are given by number too.  Instructions taking an element
+ * size use its log2 in bytes: 0 for bytes up to 4 for quadwords.
+ */
+#define A64_XZR 31
+
+enum a64_cond {
+   cc_EQ = 0x0,
+   cc_NE = 0x1,
+   cc_HS = 0x2,
+   cc_LO = 0x3,
+   cc_HI = 0x8,
+   cc_LS = 0x9,
+};
+
+struct aarch64_function {
+   unsigned size;
+   uint32_t *store;
+   uint32_t *csr;
+
+   uint32_t error_overflow[4];
+};
+
+typedef void (*aarch64_func)(void);
+
+void aarch64_init_func(struct aarch64_function *p);
+void aarch64_release_func(struct aarch64_function *p);
+aarch64_func aarch64_get_func(struct aarch64_function *p);
+
+/* Labels are instruction indices */
+int aarch64_get_label(struct aarch64_function *p);
+
+/* Branches
+ */
+void a64_b_cond(struct aarch64_function *p, enum a64_cond cond, int label);
+int a64_cbz_w_forward(struct aarch64_function *p, unsigned rt);
+void a64_fixup_fwd_branch(struct aarch64_function *p, int fixup);
+void a64_ret(struct aarch64_function *p);
+
+/* Integer arithmetic, on 64-bit registers unless suffixed with _w
+ */
+void a64_mov(struct aarch64_function *p, unsigned rd, unsigned rn);
+void a64_mov_imm(struct aarch64_function *p, unsigned rd, uint64_t imm);
+void a64_mov_w(struct aarch64_function *p, unsigned rd, unsigned rn);
+void a64_add(struct aarch64_function *p, unsigned rd, unsigned rn, unsigned rm);
+void a64_add_imm(struct aarch64_function *p, unsigned rd, unsigned rn, unsigned imm);
+void a64_add_w(struct aarch64_function *p, unsigned rd, unsigned rn, unsigned rm);
+void a64_subs_imm_w(struct aarch64_function *p, unsigned rd, unsigned rn, unsigned imm);
+void a64_madd(struct aarch64_function *p, unsigned rd, unsigned rn, unsigned rm, unsigned ra);
+void a64_udiv_w(struct aarch64_function *p, unsigned rd, unsigned rn, unsigned rm);
+void a64_cmp_w(struct aarch64_function *p, unsigned rn, unsigned rm);
+void a64_csel_w(struct aarch64_function *p, unsigned rd, unsigned rn, unsigned rm,
+                enum a64_cond cond);
+
+/* Integer loads and stores with an unsigned offset scaled by the size.
+ * a64_ldr_elt() loads and zero extends an element of 1, 2 or 4 bytes.
+ */
+void a64_ldr(struct aarch64_function *p, unsigned rt, unsigned rn, unsigned offset);
+void a64_str(struct aarch64_function *p, unsigned rt, unsigned rn, unsigned offset);
+void a64_ldr_w(struct aarch64_function *p, unsigned rt, unsigned rn, unsigned offset);
+void a64_ldr_elt(struct aarch64_function *p, unsigned size, unsigned rt, unsigned rn);
+void a64_prfm_pldl1strm(struct aarch64_function *p, unsigned rn, unsigned offset);
+
+/* Scalar SIMD&FP loads and stores of 1 << size bytes, which zero the rest
+ * of the register.  a64_fp_offset_ok() tells if an offset can be encoded.
+ */
+bool a64_fp_offset_ok(unsigned size, int offset);
+void neon_ldr(struct aarch64_function *p, unsigned size, unsigned vt, unsigned rn, int offset);
+void neon_str(struct aarch64_function *p, unsigned size, unsigned vt, unsigned rn, int offset);
+
+/* Vector operations, on four 32-bit lanes unless told otherwise
+ */
+void neon_mov(struct aarch64_function *p, unsigned vd, unsigned vn);
+void neon_ins(struct aarch64_function *p, unsigned size, unsigned vd, unsigned dst_idx,
+              unsigned vn, unsigned src_idx);
+void neon_uxtl(struct aarch64_function *p, unsigned size, unsigned vd, unsigned vn);
+void neon_sxtl(struct aarch64_function *p, unsigned size, unsigned vd, unsigned vn);
+void neon_ucvtf(struct aarch64_function *p, unsigned vd, unsigned vn);
+void neon_scvtf(struct aarch64_function *p, unsigned vd, unsigned vn);
+void neon_fmul(struct aarch64_function *p, unsigned vd, unsigned vn, unsigned vm);
+void neon_fmax(struct aarch64_function *p, unsigned vd, unsigned vn, unsigned vm);
+void neon_ucvtf_w(struct aarch64_function *p, unsigned vd, unsigned rn);
+
+#endif
+#endif
@@ -23,6 +23,8 @@
  *
  **************************************************************************/
 
+#include "util/hash_table.h"
+#include "util/list.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "pipe/p_defines.h"
@@ -31,6 +33,54 @@
 
 #include <new>
 
+/* Bounds of the pattern cache of a tessellator */
+#define PIPE_TESS_CACHE_MAX_PATTERNS 64
+#define PIPE_TESS_CACHE_MAX_BYTES (4 * 1024 * 1024)
+
+/* Every PIPE_TESS_CACHE_WINDOW lookups the hit rate is checked.  If at most
+ * a quarter of them hit, as with continuously varying fractional factors,
+ * the next PIPE_TESS_CACHE_BYPASS tessellations skip the cache.
+ */
+#define PIPE_TESS_CACHE_WINDOW 64
+#define PIPE_TESS_CACHE_BYPASS 1024
+
+/* The domain, partitioning and output primitive are fixed for a tessellator,
+ * so patterns only have to be told apart by the factors the domain uses.
+ * The factors are clamped and rounded the way the tessellator does, so all
+ * factors giving the same pattern share a key.  Unused ones are zero, as are
+ * all of them for culled patches.
+ */
+struct pipe_tess_pattern_key
+{
+   uint32_t factors[6];
+};
+
+/* The output of one tessellation, allocated in a single block */
+struct pipe_tess_pattern
+{
+   struct list_head link;
+   struct pipe_tess_pattern_key key;
+   size_t size;
+
+   uint32_t num_domain_points;
+   uint32_t num_indices;
+   float    *domain_points_u;
+   float    *domain_points_v;
+   uint32_t *indices;
+};
+
+static uint32_t
+pipe_tess_pattern_hash(const void *key)
+{
+   return _mesa_hash_data(key, sizeof(struct pipe_tess_pattern_key));
+}
+
+static bool
+pipe_tess_pattern_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, sizeof(struct pipe_tess_pattern_key)) == 0;
+}
+
 namespace pipe_tessellator_wrap
 {
    /// Wrapper class for the CHWTessellator reference tessellator from MSFT
@@ -44,7 +94,145 @@ namespace pipe_tessellator_wrap
       alignas(32) float      domain_points_v[MAX_POINT_COUNT];
       uint32_t               num_domain_points;
 
+      /* Range of the factors for the partitioning */
+      bool                   integer_partitioning;
+      float                  min_factor;
+      float                  max_factor;
+
+      /* Recently used patterns, most recent first */
+      struct hash_table      *patterns;
+      struct list_head       lru;
+      size_t                 cache_size;
+      unsigned               window_lookups;
+      unsigned               window_misses;
+      unsigned               bypass_count;
+
+      /* Like the tessellator, maps NaN to the lower bound */
+      static float NormalizeFactor(float factor, float lower, float upper,
+                                   bool integer)
+      {
+         if (!(factor > lower))
+            return lower;
+         factor = MIN2(factor, upper);
+         return integer ? ceilf(factor) : factor;
+      }
+
+      void MakeKey(const struct pipe_tessellation_factors *tess_factors,
+                   struct pipe_tess_pattern_key *key)
+      {
+         const unsigned num_outer =
+            prim_mode == MESA_PRIM_QUADS ? 4 : prim_mode == MESA_PRIM_TRIANGLES ? 3 : 2;
+         const unsigned num_inner =
+            prim_mode == MESA_PRIM_QUADS ? 2 : prim_mode == MESA_PRIM_TRIANGLES ? 1 : 0;
+         float factors[6] = { 0 };
+
+         for (unsigned i = 0; i < num_outer; i++) {
+            if (!(tess_factors->outer_tf[i] > 0)) {
+               memset(key, 0, sizeof(*key));
+               return;
+            }
+         }
+
+         for (unsigned i = 0; i < num_outer; i++) {
+            factors[i] = NormalizeFactor(tess_factors->outer_tf[i], min_factor,
+                                         max_factor, integer_partitioning);
+         }
+         for (unsigned i = 0; i < num_inner; i++) {
+            factors[num_outer + i] =
+               NormalizeFactor(tess_factors->inner_tf[i], min_factor,
+                               max_factor, integer_partitioning);
+         }
+
+         /* The line density is always integer, whatever the partitioning */
+         if (prim_mode == MESA_PRIM_LINES) {
+            factors[0] = NormalizeFactor(tess_factors->outer_tf[0],
+                                         PIPE_TESSELLATOR_MIN_ISOLINE_DENSITY_TESSELLATION_FACTOR,
+                                         PIPE_TESSELLATOR_MAX_ISOLINE_DENSITY_TESSELLATION_FACTOR,
+                                         true);
+         }
+
+         memcpy(key->factors, factors, sizeof(key->factors));
+      }
+
+      /* Counts a lookup, and starts bypassing the cache when most of the
+       * recent ones missed.
+       */
+      void CountLookup(bool hit)
+      {
+         window_lookups++;
+         if (!hit)
+            window_misses++;
+
+         if (window_lookups == PIPE_TESS_CACHE_WINDOW) {
+            if (window_misses * 4 >= window_lookups * 3)
+               bypass_count = PIPE_TESS_CACHE_BYPASS;
+            window_lookups = 0;
+            window_misses = 0;
+         }
+      }
+
+      /* Copies the output of the last tessellation into a new pattern,
+       * evicting the least recently used ones to make room.
+       */
+      struct pipe_tess_pattern *AddPattern(const struct pipe_tess_pattern_key *key)
+      {
+         uint32_t point_count = (uint32_t)SUPER::GetPointCount();
+         uint32_t index_count = (uint32_t)SUPER::GetIndexCount();
+
+         /* The shaders read the points a full vector at a time */
+         size_t header_size = align64(sizeof(struct pipe_tess_pattern), 64);
+         size_t points_size = align64(point_count, 16) * sizeof(float);
+         size_t size = header_size + 2 * points_size + index_count * sizeof(uint32_t);
+
+         while (!list_is_empty(&lru) &&
+                (patterns->entries >= PIPE_TESS_CACHE_MAX_PATTERNS ||
+                 cache_size + size > PIPE_TESS_CACHE_MAX_BYTES)) {
+            struct pipe_tess_pattern *old =
+               list_last_entry(&lru, struct pipe_tess_pattern, link);
+            _mesa_hash_table_remove_key(patterns, &old->key);
+            list_del(&old->link);
+            cache_size -= old->size;
+            align_free(old);
+         }
+
+         struct pipe_tess_pattern *pattern =
+            (struct pipe_tess_pattern *)align_calloc(size, 64);
+         if (!pattern)
+            return NULL;
+
+         pattern->key = *key;
+         pattern->size = size;
+         pattern->num_domain_points = point_count;
+         pattern->num_indices = index_count;
+         pattern->domain_points_u = (float *)((char *)pattern + header_size);
+         pattern->domain_points_v = (float *)((char *)pattern->domain_points_u + points_size);
+         pattern->indices = (uint32_t *)((char *)pattern->domain_points_v + points_size);
+
+         DOMAIN_POINT *points = SUPER::GetPoints();
+         for (uint32_t i = 0; i < point_count; i++) {
+            pattern->domain_points_u[i] = points[i].u;
+            pattern->domain_points_v[i] = points[i].v;
+         }
+         memcpy(pattern->indices, SUPER::GetIndices(), index_count * sizeof(uint32_t));
+
+         if (!_mesa_hash_table_insert(patterns, &pattern->key, pattern)) {
+            align_free(pattern);
+            return NULL;
+         }
+         list_add(&pattern->link, &lru);
+         cache_size += size;
+
+         return pattern;
+      }
+
    public:
+      ~pipe_ts()
+      {
+         list_for_each_entry_safe(struct pipe_tess_pattern, pattern, &lru, link)
+            align_free(pattern);
+         _mesa_hash_table_destroy(patterns, NULL);
+      }
+
       void Init(enum mesa_prim tes_prim_mode,
                 enum pipe_tess_spacing ts_spacing,
                 bool tes_vertex_order_cw, bool tes_point_mode)
@@ -70,11 +258,58 @@ namespace pipe_tessellator_wrap
 
          prim_mode          = tes_prim_mode;
          num_domain_points = 0;
+
+         switch (ts_spacing) {
+         case PIPE_TESS_SPACING_FRACTIONAL_ODD:
+            integer_partitioning = false;
+            min_factor = PIPE_TESSELLATOR_MIN_ODD_TESSELLATION_FACTOR;
+            max_factor = PIPE_TESSELLATOR_MAX_ODD_TESSELLATION_FACTOR;
+            break;
+         case PIPE_TESS_SPACING_FRACTIONAL_EVEN:
+            integer_partitioning = false;
+            min_factor = PIPE_TESSELLATOR_MIN_EVEN_TESSELLATION_FACTOR;
+            max_factor = PIPE_TESSELLATOR_MAX_EVEN_TESSELLATION_FACTOR;
+            break;
+         default:
+            integer_partitioning = true;
+            min_factor = PIPE_TESSELLATOR_MIN_ODD_TESSELLATION_FACTOR;
+            max_factor = PIPE_TESSELLATOR_MAX_EVEN_TESSELLATION_FACTOR;
+            break;
+         }
+
+         patterns = _mesa_hash_table_create(NULL, pipe_tess_pattern_hash,
+                                            pipe_tess_pattern_equal);
+         list_inithead(&lru);
+         cache_size = 0;
+         window_lookups = 0;
+         window_misses = 0;
+         bypass_count = 0;
       }
 
       void Tessellate(const struct pipe_tessellation_factors *tess_factors,
                       struct pipe_tessellator_data *tess_data)
       {
+         /* Content tends to reuse a handful of factors, so look for the
+          * pattern before generating it again.
+          */
+         struct pipe_tess_pattern_key key;
+         struct pipe_tess_pattern *pattern = NULL;
+         bool use_cache = patterns && !bypass_count;
+         if (bypass_count)
+            bypass_count--;
+         if (use_cache) {
+            MakeKey(tess_factors, &key);
+            struct hash_entry *entry = _mesa_hash_table_search(patterns, &key);
+            CountLookup(entry != NULL);
+            if (entry) {
+               pattern = (struct pipe_tess_pattern *)entry->data;
+               list_del(&pattern->link);
+               list_add(&pattern->link, &lru);
+               GetPattern(pattern, tess_data);
+               return;
+            }
+         }
+
          switch (prim_mode)
             {
             case MESA_PRIM_QUADS:
@@ -106,6 +341,13 @@ namespace pipe_tessellator_wrap
                return;
             }
 
+         if (use_cache)
+            pattern = AddPattern(&key);
+         if (pattern) {
+            GetPattern(pattern, tess_data);
+            return;
+         }
+
          num_domain_points = (uint32_t)SUPER::GetPointCount();
 
          DOMAIN_POINT *points = SUPER::GetPoints();
@@ -121,6 +363,16 @@ namespace pipe_tessellator_wrap
 
          tess_data->indices = (uint32_t*)SUPER::GetIndices();
       }
+
+      void GetPattern(const struct pipe_tess_pattern *pattern,
+                      struct pipe_tessellator_data *tess_data)
+      {
+         tess_data->num_domain_points = pattern->num_domain_points;
+         tess_data->domain_points_u = pattern->domain_points_u;
+         tess_data->domain_points_v = pattern->domain_points_v;
+         tess_data->num_indices = pattern->num_indices;
+         tess_data->indices = pattern->indices;
+      }
    };
 } // namespace Tessellator
 
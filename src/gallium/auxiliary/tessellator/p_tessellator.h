@@ -59,6 +59,8 @@ void p_tess_destroy(struct pipe_tessellator *pipe_ts);
 
 
 /// Perform Tessellation
+/// The output is owned by the tessellator, which caches recently used
+/// patterns, and stays valid until the next call.
 void p_tessellate(struct pipe_tessellator *pipe_ts,
                   const struct pipe_tessellation_factors *tess_factors,
                   struct pipe_tessellator_data *tess_data);
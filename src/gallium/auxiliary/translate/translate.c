@@ -31,9 +31,13 @@
   */
 
 #include "util/detect.h"
+#include "util/u_debug.h"
 #include "pipe/p_state.h"
 #include "translate.h"
 
+/* The NEON code generator is opt-in until it has seen more testing. */
+DEBUG_GET_ONCE_BOOL_OPTION(translate_neon, "TRANSLATE_NEON", false)
+
 struct translate *translate_create( const struct translate_key *key )
 {
    struct translate *translate = NULL;
@@ -42,6 +46,12 @@ struct translate *translate_create( const struct translate_key *key )
    translate = translate_sse2_create( key );
    if (translate)
       return translate;
+#elif DETECT_ARCH_AARCH64
+   if (debug_get_option_translate_neon()) {
+      translate = translate_neon_create( key );
+      if (translate)
+         return translate;
+   }
 #else
    (void)translate;
 #endif
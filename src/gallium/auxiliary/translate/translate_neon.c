@@ -0,0 +1,747 @@
+/*
+ * Copyright 2026 Red Hat.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * on the rights to use, copy, modify, merge, publish, distribute, sub
+ * license, and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS AND/OR THEIR SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * AArch64 counterpart of translate_sse.c.
+ *
+ * Fetches plain 8 and 16-bit integer and 32-bit float formats into 32-bit
+ * float outputs, and copies attributes whose input and output formats
+ * match.  Keys with other conversions get the generic translate.
+ */
+
+#include "util/detect.h"
+#include "util/compiler.h"
+#include "util/u_memory.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_math.h"
+#include "util/format/u_format.h"
+
+#include "translate.h"
+
+
+#if DETECT_ARCH_AARCH64 && UTIL_ARCH_LITTLE_ENDIAN
+
+#include "rtasm/rtasm_aarch64.h"
+
+
+/* Registers of the generated functions.  The first six hold the arguments
+ * as the AAPCS64 passes them, everything else is scratch.
+ */
+#define REG_MACHINE        0
+#define REG_IDX            1    /* start+i, &elt[i] or the buffer pointer */
+#define REG_COUNT          2
+#define REG_START_INSTANCE 3
+#define REG_INSTANCE_ID    4
+#define REG_OUTBUF         5
+#define REG_TMP            6
+#define REG_TMP2           7
+#define REG_SRC            8    /* pointer to the current attribute */
+#define REG_ELT            9
+#define REG_TMP3           10
+#define REG_DST            11
+
+#define VREG_DATA   0
+#define VREG_TMP    1
+#define VREG_CONST  2
+
+
+struct translate_buffer
+{
+   const void *base_ptr;
+   uintptr_t stride;
+   unsigned max_index;
+};
+
+struct translate_buffer_variant
+{
+   unsigned buffer_index;
+   unsigned instance_divisor;
+   void *ptr;                   /* updated either per vertex or per instance */
+};
+
+
+#define ELEMENT_BUFFER_INSTANCE_ID  1001
+
+enum
+{
+   CONST_IDENTITY,
+   CONST_INV_127,
+   CONST_INV_255,
+   CONST_INV_32767,
+   CONST_INV_65535,
+   CONST_MINUS_1,
+   NUM_CONSTS
+};
+
+/* Computed in single precision like the util_format unpack functions, so
+ * that the results match the generic translate.
+ */
+#define C(v) {(v), (v), (v), (v)}
+static const float consts[NUM_CONSTS][4] = {
+   {0, 0, 0, 1},
+   C(1.0f / 127.0f),
+   C(1.0f / 255.0f),
+   C(1.0f / 32767.0f),
+   C(1.0f / 65535.0f),
+   C(-1.0f),
+};
+
+#undef C
+
+struct translate_neon
+{
+   struct translate translate;
+
+   struct aarch64_function linear_func;
+   struct aarch64_function elt_func;
+   struct aarch64_function elt16_func;
+   struct aarch64_function elt8_func;
+   struct aarch64_function *func;
+
+   alignas(16) float consts[NUM_CONSTS][4];
+
+   struct translate_buffer buffer[TRANSLATE_MAX_ATTRIBS];
+   unsigned nr_buffers;
+
+   /* Multiple buffer variants can map to a single buffer. */
+   struct translate_buffer_variant buffer_variant[TRANSLATE_MAX_ATTRIBS];
+   unsigned nr_buffer_variants;
+
+   /* Multiple elements can map to a single buffer variant. */
+   unsigned element_to_buffer_variant[TRANSLATE_MAX_ATTRIBS];
+};
+
+
+static int
+get_offset(const void *a, const void *b)
+{
+   return (const char *) b - (const char *) a;
+}
+
+
+/* Returns a base register and offset from which the size bytes at
+ * reg + offset can be addressed by the SIMD&FP loads and stores, using tmp
+ * if the offset is too large.
+ */
+static unsigned
+get_address(struct translate_neon *p, unsigned reg, unsigned offset,
+            unsigned size, unsigned tmp, int *out_offset)
+{
+   if (offset + size <= 256) {
+      *out_offset = offset;
+      return reg;
+   }
+
+   a64_mov_imm(p->func, tmp, offset);
+   a64_add(p->func, tmp, reg, tmp);
+   *out_offset = 0;
+   return tmp;
+}
+
+
+static void
+emit_load_const(struct translate_neon *p, unsigned vreg, unsigned id)
+{
+   neon_ldr(p->func, 4, vreg, REG_MACHINE, get_offset(p, &p->consts[id]));
+}
+
+
+static void
+emit_memcpy(struct translate_neon *p, unsigned dst, int dst_offset,
+            unsigned src, int src_offset, unsigned size)
+{
+   unsigned i = 0;
+
+   for (int chunk = 4; chunk >= 0; chunk--) {
+      while (size - i >= (1u << chunk)) {
+         neon_ldr(p->func, chunk, VREG_TMP, src, src_offset + i);
+         neon_str(p->func, chunk, VREG_TMP, dst, dst_offset + i);
+         i += 1 << chunk;
+      }
+   }
+}
+
+
+/* Loads size bytes into the low bytes of vreg and zeroes the rest */
+static bool
+emit_load_bytes(struct translate_neon *p, unsigned vreg,
+                unsigned src, int src_offset, unsigned size)
+{
+   switch (size) {
+   case 1:
+   case 2:
+   case 4:
+   case 8:
+   case 16:
+      neon_ldr(p->func, util_logbase2(size), vreg, src, src_offset);
+      return true;
+   case 3:
+   case 6:
+   case 12: {
+      /* The first two thirds, then the last third into its lane */
+      unsigned lane_size = util_logbase2(size / 3);
+      neon_ldr(p->func, lane_size + 1, vreg, src, src_offset);
+      neon_ldr(p->func, lane_size, VREG_TMP, src, src_offset + size / 3 * 2);
+      neon_ins(p->func, lane_size, vreg, 2, VREG_TMP, 0);
+      return true;
+   }
+   default:
+      return false;
+   }
+}
+
+
+static void
+emit_store_float32(struct translate_neon *p, unsigned dst, int dst_offset,
+                   unsigned nr_channels)
+{
+   switch (nr_channels) {
+   case 1:
+      neon_str(p->func, 2, VREG_DATA, dst, dst_offset);
+      break;
+   case 2:
+      neon_str(p->func, 3, VREG_DATA, dst, dst_offset);
+      break;
+   case 3:
+      neon_str(p->func, 3, VREG_DATA, dst, dst_offset);
+      neon_ins(p->func, 2, VREG_TMP, 0, VREG_DATA, 2);
+      neon_str(p->func, 2, VREG_TMP, dst, dst_offset + 8);
+      break;
+   case 4:
+      neon_str(p->func, 4, VREG_DATA, dst, dst_offset);
+      break;
+   }
+}
+
+
+static unsigned
+get_float32_channels(enum pipe_format format)
+{
+   switch (format) {
+   case PIPE_FORMAT_R32_FLOAT:
+      return 1;
+   case PIPE_FORMAT_R32G32_FLOAT:
+      return 2;
+   case PIPE_FORMAT_R32G32B32_FLOAT:
+      return 3;
+   case PIPE_FORMAT_R32G32B32A32_FLOAT:
+      return 4;
+   default:
+      return 0;
+   }
+}
+
+
+/* Whether the format stores its channels in xyzw order, all of the same
+ * type, with the missing ones defaulting to (0, 0, 0, 1).
+ */
+static bool
+is_plain_rgba_array(const struct util_format_description *desc)
+{
+   if (desc->layout != UTIL_FORMAT_LAYOUT_PLAIN ||
+       desc->colorspace != UTIL_FORMAT_COLORSPACE_RGB ||
+       !desc->is_array || desc->is_mixed)
+      return false;
+
+   for (unsigned i = 0; i < 4; i++) {
+      unsigned swizzle;
+      if (i < desc->nr_channels)
+         swizzle = PIPE_SWIZZLE_X + i;
+      else
+         swizzle = i == 3 ? PIPE_SWIZZLE_1 : PIPE_SWIZZLE_0;
+
+      if (desc->swizzle[i] != swizzle)
+         return false;
+
+      if (i < desc->nr_channels &&
+          (desc->channel[i].normalized != desc->channel[0].normalized ||
+           desc->channel[i].pure_integer))
+         return false;
+   }
+
+   return true;
+}
+
+
+static bool
+translate_attr_convert(struct translate_neon *p,
+                       const struct translate_element *a,
+                       unsigned src, int src_offset,
+                       unsigned dst, int dst_offset)
+{
+   const struct util_format_description *input_desc =
+      util_format_description(a->input_format);
+   unsigned nr_outputs = get_float32_channels(a->output_format);
+
+   if (!nr_outputs || !input_desc || !is_plain_rgba_array(input_desc))
+      return false;
+
+   const struct util_format_channel_description *channel =
+      &input_desc->channel[0];
+   unsigned nr_inputs = input_desc->nr_channels;
+
+   switch (channel->type) {
+   case UTIL_FORMAT_TYPE_FLOAT:
+      if (channel->size != 32)
+         return false;
+      break;
+   case UTIL_FORMAT_TYPE_UNSIGNED:
+   case UTIL_FORMAT_TYPE_SIGNED:
+      if (channel->size != 8 && channel->size != 16)
+         return false;
+      break;
+   default:
+      return false;
+   }
+
+   if (!emit_load_bytes(p, VREG_DATA, src, src_offset,
+                        nr_inputs * channel->size / 8))
+      return false;
+
+   if (channel->type != UTIL_FORMAT_TYPE_FLOAT) {
+      bool is_signed = channel->type == UTIL_FORMAT_TYPE_SIGNED;
+
+      /* Widen to 32-bit lanes and convert */
+      for (unsigned size = util_logbase2(channel->size / 8); size < 2; size++) {
+         if (is_signed)
+            neon_sxtl(p->func, size, VREG_DATA, VREG_DATA);
+         else
+            neon_uxtl(p->func, size, VREG_DATA, VREG_DATA);
+      }
+
+      if (is_signed)
+         neon_scvtf(p->func, VREG_DATA, VREG_DATA);
+      else
+         neon_ucvtf(p->func, VREG_DATA, VREG_DATA);
+
+      if (channel->normalized) {
+         unsigned scale;
+         if (channel->size == 8)
+            scale = is_signed ? CONST_INV_127 : CONST_INV_255;
+         else
+            scale = is_signed ? CONST_INV_32767 : CONST_INV_65535;
+
+         emit_load_const(p, VREG_CONST, scale);
+         neon_fmul(p->func, VREG_DATA, VREG_DATA, VREG_CONST);
+
+         /* -128 and -32768 map to -1.0 as well */
+         if (is_signed) {
+            emit_load_const(p, VREG_CONST, CONST_MINUS_1);
+            neon_fmax(p->func, VREG_DATA, VREG_DATA, VREG_CONST);
+         }
+      }
+   }
+
+   /* The missing channels were loaded as zero, but w defaults to one */
+   if (nr_inputs < 4 && nr_outputs == 4) {
+      emit_load_const(p, VREG_CONST, CONST_IDENTITY);
+      neon_ins(p->func, 2, VREG_DATA, 3, VREG_CONST, 3);
+   }
+
+   emit_store_float32(p, dst, dst_offset, nr_outputs);
+   return true;
+}
+
+
+static bool
+translate_attr(struct translate_neon *p,
+               const struct translate_element *a,
+               unsigned src, unsigned dst)
+{
+   const struct util_format_description *input_desc =
+      util_format_description(a->input_format);
+   int src_offset, dst_offset;
+
+   if (!input_desc || input_desc->block.bits % 8)
+      return false;
+
+   src = get_address(p, src, a->input_offset, input_desc->block.bits / 8,
+                     REG_TMP2, &src_offset);
+   dst = get_address(p, dst, a->output_offset,
+                     util_format_get_blocksize(a->output_format),
+                     REG_DST, &dst_offset);
+
+   if (a->input_format == a->output_format) {
+      if (input_desc->block.width != 1 || input_desc->block.height != 1)
+         return false;
+
+      emit_memcpy(p, dst, dst_offset, src, src_offset,
+                  input_desc->block.bits / 8);
+      return true;
+   }
+
+   return translate_attr_convert(p, a, src, src_offset, dst, dst_offset);
+}
+
+
+static bool
+translate_instance_id(struct translate_neon *p,
+                      const struct translate_element *a)
+{
+   int dst_offset;
+
+   /* Like the generic translate, only convert to float */
+   if (a->output_format != PIPE_FORMAT_R32_FLOAT)
+      return false;
+
+   unsigned dst = get_address(p, REG_OUTBUF, a->output_offset, 4,
+                              REG_DST, &dst_offset);
+   neon_ucvtf_w(p->func, VREG_DATA, REG_INSTANCE_ID);
+   neon_str(p->func, 2, VREG_DATA, dst, dst_offset);
+   return true;
+}
+
+
+static void
+init_inputs(struct translate_neon *p, unsigned index_size)
+{
+   for (unsigned i = 0; i < p->nr_buffer_variants; i++) {
+      struct translate_buffer_variant *variant = &p->buffer_variant[i];
+      struct translate_buffer *buffer = &p->buffer[variant->buffer_index];
+
+      if (index_size && !variant->instance_divisor)
+         continue;
+
+      /* Calculate pointer to first attrib:
+       *   base_ptr + stride * index, where index depends on instance divisor
+       */
+      if (variant->instance_divisor) {
+         /* instance = (instance_id / divisor) + start_instance
+          *
+          * Not clamped: the max_index of set_buffer() bounds the vertex
+          * index, it says nothing about the number of instances.
+          */
+         a64_mov_w(p->func, REG_TMP, REG_INSTANCE_ID);
+         if (variant->instance_divisor != 1) {
+            a64_mov_imm(p->func, REG_TMP2, variant->instance_divisor);
+            a64_udiv_w(p->func, REG_TMP, REG_TMP, REG_TMP2);
+         }
+         a64_add_w(p->func, REG_TMP, REG_TMP, REG_START_INSTANCE);
+      }
+      else {
+         /* Linear draws aren't clamped, as in the generic translate */
+         a64_mov_w(p->func, REG_TMP, REG_IDX);
+      }
+
+      a64_ldr(p->func, REG_TMP2, REG_MACHINE, get_offset(p, &buffer->stride));
+      a64_ldr(p->func, REG_TMP3, REG_MACHINE, get_offset(p, &buffer->base_ptr));
+      a64_madd(p->func, REG_TMP, REG_TMP, REG_TMP2, REG_TMP3);
+
+      /* In the linear case, keep the buffer pointer instead of the
+       * index number.
+       */
+      if (!index_size && p->nr_buffer_variants == 1)
+         a64_mov(p->func, REG_IDX, REG_TMP);
+      else
+         a64_str(p->func, REG_TMP, REG_MACHINE, get_offset(p, &variant->ptr));
+   }
+}
+
+
+static unsigned
+get_buffer_ptr(struct translate_neon *p, unsigned index_size, unsigned var_idx)
+{
+   const struct translate_buffer_variant *variant = &p->buffer_variant[var_idx];
+
+   if (!index_size && p->nr_buffer_variants == 1) {
+      return REG_IDX;
+   }
+   else if (!index_size || variant->instance_divisor) {
+      a64_ldr(p->func, REG_SRC, REG_MACHINE, get_offset(p, &variant->ptr));
+      return REG_SRC;
+   }
+   else {
+      const struct translate_buffer *buffer = &p->buffer[variant->buffer_index];
+
+      /* Clamp to max_index
+       */
+      a64_ldr_w(p->func, REG_TMP3, REG_MACHINE, get_offset(p, &buffer->max_index));
+      a64_cmp_w(p->func, REG_ELT, REG_TMP3);
+      a64_csel_w(p->func, REG_SRC, REG_ELT, REG_TMP3, cc_LO);
+
+      a64_ldr(p->func, REG_TMP2, REG_MACHINE, get_offset(p, &buffer->stride));
+      a64_ldr(p->func, REG_TMP3, REG_MACHINE, get_offset(p, &buffer->base_ptr));
+      a64_madd(p->func, REG_SRC, REG_SRC, REG_TMP2, REG_TMP3);
+      return REG_SRC;
+   }
+}
+
+
+static void
+incr_inputs(struct translate_neon *p, unsigned index_size)
+{
+   if (!index_size && p->nr_buffer_variants == 1) {
+      const struct translate_buffer_variant *variant = &p->buffer_variant[0];
+
+      if (variant->instance_divisor == 0) {
+         a64_ldr(p->func, REG_TMP2, REG_MACHINE,
+                 get_offset(p, &p->buffer[variant->buffer_index].stride));
+         a64_add(p->func, REG_IDX, REG_IDX, REG_TMP2);
+         a64_prfm_pldl1strm(p->func, REG_IDX, 192);
+      }
+   }
+   else if (!index_size) {
+      for (unsigned i = 0; i < p->nr_buffer_variants; i++) {
+         struct translate_buffer_variant *variant = &p->buffer_variant[i];
+
+         if (variant->instance_divisor == 0) {
+            a64_ldr(p->func, REG_TMP, REG_MACHINE, get_offset(p, &variant->ptr));
+            a64_ldr(p->func, REG_TMP2, REG_MACHINE,
+                    get_offset(p, &p->buffer[variant->buffer_index].stride));
+            a64_add(p->func, REG_TMP, REG_TMP, REG_TMP2);
+            if (i == 0)
+               a64_prfm_pldl1strm(p->func, REG_TMP, 192);
+            a64_str(p->func, REG_TMP, REG_MACHINE, get_offset(p, &variant->ptr));
+         }
+      }
+   }
+   else {
+      a64_add_imm(p->func, REG_IDX, REG_IDX, index_size);
+   }
+}
+
+
+/* Build run( struct translate *machine,
+ *            unsigned start,
+ *            unsigned count,
+ *            unsigned start_instance,
+ *            unsigned instance_id,
+ *            void *output_buffer )
+ * or
+ *  run_elts( struct translate *machine,
+ *            unsigned *elts,
+ *            unsigned count,
+ *            unsigned start_instance,
+ *            unsigned instance_id,
+ *            void *output_buffer )
+ */
+static bool
+build_vertex_emit(struct translate_neon *p,
+                  struct aarch64_function *func, unsigned index_size)
+{
+   int fixup, label;
+
+   p->func = func;
+
+   aarch64_init_func(p->func);
+
+   /* Nothing to do for a zero count
+    */
+   fixup = a64_cbz_w_forward(p->func, REG_COUNT);
+
+   init_inputs(p, index_size);
+
+   /* Note address for loop jump
+    */
+   label = aarch64_get_label(p->func);
+   {
+      int last_variant = -1;
+      unsigned vb = REG_IDX;
+
+      if (index_size)
+         a64_ldr_elt(p->func, util_logbase2(index_size), REG_ELT, REG_IDX);
+
+      for (unsigned j = 0; j < p->translate.key.nr_elements; j++) {
+         const struct translate_element *a = &p->translate.key.element[j];
+         unsigned variant = p->element_to_buffer_variant[j];
+
+         if (variant == ELEMENT_BUFFER_INSTANCE_ID) {
+            if (!translate_instance_id(p, a))
+               return false;
+            continue;
+         }
+
+         /* Figure out source pointer address:
+          */
+         if (variant != last_variant) {
+            last_variant = variant;
+            vb = get_buffer_ptr(p, index_size, variant);
+         }
+
+         if (!translate_attr(p, a, vb, REG_OUTBUF))
+            return false;
+      }
+
+      /* Next output vertex:
+       */
+      if (p->translate.key.output_stride < 4096) {
+         a64_add_imm(p->func, REG_OUTBUF, REG_OUTBUF,
+                     p->translate.key.output_stride);
+      }
+      else {
+         a64_mov_imm(p->func, REG_TMP2, p->translate.key.output_stride);
+         a64_add(p->func, REG_OUTBUF, REG_OUTBUF, REG_TMP2);
+      }
+
+      /* Incr index
+       */
+      incr_inputs(p, index_size);
+   }
+
+   /* decr count, loop if not zero
+    */
+   a64_subs_imm_w(p->func, REG_COUNT, REG_COUNT, 1);
+   a64_b_cond(p->func, cc_NE, label);
+
+   /* Land forward jump here:
+    */
+   a64_fixup_fwd_branch(p->func, fixup);
+
+   a64_ret(p->func);
+
+   return true;
+}
+
+
+static void
+translate_neon_set_buffer(struct translate *translate,
+                          unsigned buf,
+                          const void *ptr, unsigned stride, unsigned max_index)
+{
+   struct translate_neon *p = (struct translate_neon *) translate;
+
+   if (buf < p->nr_buffers) {
+      p->buffer[buf].base_ptr = (char *) ptr;
+      p->buffer[buf].stride = stride;
+      p->buffer[buf].max_index = max_index;
+   }
+}
+
+
+static void
+translate_neon_release(struct translate *translate)
+{
+   struct translate_neon *p = (struct translate_neon *) translate;
+
+   aarch64_release_func(&p->elt8_func);
+   aarch64_release_func(&p->elt16_func);
+   aarch64_release_func(&p->elt_func);
+   aarch64_release_func(&p->linear_func);
+
+   os_free_aligned(p);
+}
+
+
+struct translate *
+translate_neon_create(const struct translate_key *key)
+{
+   struct translate_neon *p = NULL;
+   unsigned i;
+
+   if (!util_get_cpu_caps()->has_neon)
+      goto fail;
+
+   p = os_malloc_aligned(sizeof(struct translate_neon), 16);
+   if (!p)
+      goto fail;
+
+   memset(p, 0, sizeof(*p));
+   memcpy(p->consts, consts, sizeof(consts));
+
+   p->translate.key = *key;
+   p->translate.release = translate_neon_release;
+   p->translate.set_buffer = translate_neon_set_buffer;
+
+   assert(key->nr_elements <= TRANSLATE_MAX_ATTRIBS);
+
+   for (i = 0; i < key->nr_elements; i++) {
+      if (key->element[i].type == TRANSLATE_ELEMENT_NORMAL) {
+         unsigned j;
+
+         p->nr_buffers =
+            MAX2(p->nr_buffers, key->element[i].input_buffer + 1);
+
+         /*
+          * Map vertex element to vertex buffer variant.
+          */
+         for (j = 0; j < p->nr_buffer_variants; j++) {
+            if (p->buffer_variant[j].buffer_index ==
+                key->element[i].input_buffer
+                && p->buffer_variant[j].instance_divisor ==
+                key->element[i].instance_divisor) {
+               break;
+            }
+         }
+         if (j == p->nr_buffer_variants) {
+            p->buffer_variant[j].buffer_index = key->element[i].input_buffer;
+            p->buffer_variant[j].instance_divisor =
+               key->element[i].instance_divisor;
+            p->nr_buffer_variants++;
+         }
+         p->element_to_buffer_variant[i] = j;
+      }
+      else {
+         assert(key->element[i].type == TRANSLATE_ELEMENT_INSTANCE_ID);
+
+         p->element_to_buffer_variant[i] = ELEMENT_BUFFER_INSTANCE_ID;
+      }
+   }
+
+   if (!build_vertex_emit(p, &p->linear_func, 0))
+      goto fail;
+
+   if (!build_vertex_emit(p, &p->elt_func, 4))
+      goto fail;
+
+   if (!build_vertex_emit(p, &p->elt16_func, 2))
+      goto fail;
+
+   if (!build_vertex_emit(p, &p->elt8_func, 1))
+      goto fail;
+
+   p->translate.run = (run_func) aarch64_get_func(&p->linear_func);
+   if (p->translate.run == NULL)
+      goto fail;
+
+   p->translate.run_elts = (run_elts_func) aarch64_get_func(&p->elt_func);
+   if (p->translate.run_elts == NULL)
+      goto fail;
+
+   p->translate.run_elts16 = (run_elts16_func) aarch64_get_func(&p->elt16_func);
+   if (p->translate.run_elts16 == NULL)
+      goto fail;
+
+   p->translate.run_elts8 = (run_elts8_func) aarch64_get_func(&p->elt8_func);
+   if (p->translate.run_elts8 == NULL)
+      goto fail;
+
+   return &p->translate;
+
+ fail:
+   if (p)
+      translate_neon_release(&p->translate);
+
+   return NULL;
+}
+
+
+#else
+
+struct translate *
+translate_neon_create(const struct translate_key *key)
+{
+   return NULL;
+}
+
+#endif
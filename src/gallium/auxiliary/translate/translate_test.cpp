@@ -0,0 +1,200 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "translate.h"
+#include "util/format/u_format.h"
+#include <gtest/gtest.h>
+
+/* Checks that the code generators produce the same vertices as the generic
+ * translate.  The NEON one is tested directly, as translate_create() only
+ * uses it when TRANSLATE_NEON is set.
+ */
+
+#define NUM_VERTICES 16
+#define INPUT_STRIDE 32
+#define MAX_OUTPUT_STRIDE 64
+
+struct format_pair {
+   enum pipe_format input;
+   enum pipe_format output;
+};
+
+static const struct format_pair format_pairs[] = {
+   { PIPE_FORMAT_R32G32B32A32_FLOAT, PIPE_FORMAT_R32G32B32A32_FLOAT },
+   { PIPE_FORMAT_R32G32B32_FLOAT,    PIPE_FORMAT_R32G32B32_FLOAT },
+   { PIPE_FORMAT_R32G32_FLOAT,       PIPE_FORMAT_R32G32B32A32_FLOAT },
+   { PIPE_FORMAT_R32G32B32_FLOAT,    PIPE_FORMAT_R32G32B32A32_FLOAT },
+   { PIPE_FORMAT_R32G32B32A32_FLOAT, PIPE_FORMAT_R32G32_FLOAT },
+   { PIPE_FORMAT_R8G8B8A8_UNORM,     PIPE_FORMAT_R32G32B32A32_FLOAT },
+   { PIPE_FORMAT_R8G8B8_UNORM,       PIPE_FORMAT_R32G32B32A32_FLOAT },
+   { PIPE_FORMAT_R8G8B8A8_SNORM,     PIPE_FORMAT_R32G32B32A32_FLOAT },
+   { PIPE_FORMAT_R8G8_USCALED,       PIPE_FORMAT_R32G32_FLOAT },
+   { PIPE_FORMAT_R8G8B8A8_SSCALED,   PIPE_FORMAT_R32G32B32_FLOAT },
+   { PIPE_FORMAT_R16G16B16A16_UNORM, PIPE_FORMAT_R32G32B32A32_FLOAT },
+   { PIPE_FORMAT_R16G16_SNORM,       PIPE_FORMAT_R32G32B32A32_FLOAT },
+   { PIPE_FORMAT_R16G16B16_SNORM,    PIPE_FORMAT_R32G32B32_FLOAT },
+   { PIPE_FORMAT_R16_USCALED,        PIPE_FORMAT_R32_FLOAT },
+   { PIPE_FORMAT_R16G16B16A16_SSCALED, PIPE_FORMAT_R32G32B32A32_FLOAT },
+   { PIPE_FORMAT_R8G8B8A8_UNORM,     PIPE_FORMAT_R8G8B8A8_UNORM },
+   { PIPE_FORMAT_R16G16B16_UNORM,    PIPE_FORMAT_R16G16B16_UNORM },
+};
+
+class translate_test : public ::testing::TestWithParam<format_pair> {
+protected:
+   void SetUp() override
+   {
+      /* Arbitrary bytes for the integer formats, finite values for the
+       * float ones.
+       */
+      for (unsigned i = 0; i < sizeof(bytes); i++)
+         bytes[i] = i * 37 + 11;
+      for (unsigned i = 0; i < ARRAY_SIZE(floats); i++)
+         floats[i] = i * 0.25f - 20.0f;
+
+      memset(&key, 0, sizeof(key));
+   }
+
+   void add_element(enum pipe_format input_format,
+                    enum pipe_format output_format,
+                    unsigned instance_divisor)
+   {
+      struct translate_element *e = &key.element[key.nr_elements++];
+
+      e->type = TRANSLATE_ELEMENT_NORMAL;
+      e->input_format = input_format;
+      e->output_format = output_format;
+      e->input_buffer =
+         util_format_is_float(input_format) ? 1 : 0;
+      e->input_offset = 4;
+      e->instance_divisor = instance_divisor;
+      e->output_offset = key.output_stride;
+
+      key.output_stride += util_format_get_blocksize(output_format);
+   }
+
+   void add_instance_id()
+   {
+      struct translate_element *e = &key.element[key.nr_elements++];
+
+      e->type = TRANSLATE_ELEMENT_INSTANCE_ID;
+      e->input_format = PIPE_FORMAT_R32_USCALED;
+      e->output_format = PIPE_FORMAT_R32_FLOAT;
+      e->output_offset = key.output_stride;
+
+      key.output_stride += 4;
+   }
+
+   void set_buffers(struct translate *t)
+   {
+      t->set_buffer(t, 0, bytes, INPUT_STRIDE, NUM_VERTICES - 1);
+      t->set_buffer(t, 1, floats, INPUT_STRIDE, NUM_VERTICES - 1);
+   }
+
+   void check(const char *what, unsigned count)
+   {
+      for (unsigned i = 0; i < count; i++) {
+         for (unsigned j = 0; j < key.nr_elements; j++) {
+            const struct translate_element *e = &key.element[j];
+            unsigned offset = i * key.output_stride + e->output_offset;
+            unsigned size = util_format_get_blocksize(e->output_format);
+
+            if (util_format_is_float(e->output_format)) {
+               for (unsigned c = 0; c < size / 4; c++) {
+                  float a, b;
+                  memcpy(&a, &out[offset + c * 4], 4);
+                  memcpy(&b, &ref[offset + c * 4], 4);
+                  EXPECT_FLOAT_EQ(a, b) << what << " vertex " << i
+                     << " element " << j << " channel " << c;
+               }
+            } else {
+               EXPECT_EQ(memcmp(&out[offset], &ref[offset], size), 0)
+                  << what << " vertex " << i << " element " << j;
+            }
+         }
+      }
+   }
+
+   void run_all()
+   {
+      const unsigned elts[] = { 3, 0, 15, 7, 100, 1 };
+      const uint16_t elts16[] = { 3, 0, 15, 7, 100, 1 };
+      const uint8_t elts8[] = { 3, 0, 15, 7, 100, 1 };
+      const unsigned count = ARRAY_SIZE(elts);
+
+      struct translate *t = translate_neon_create(&key);
+      if (!t)
+         t = translate_create(&key);
+      struct translate *generic = translate_generic_create(&key);
+      ASSERT_TRUE(t);
+      ASSERT_TRUE(generic);
+
+      set_buffers(t);
+      set_buffers(generic);
+
+      memset(out, 0, sizeof(out));
+      memset(ref, 0, sizeof(ref));
+      t->run(t, 2, 5, 1, 3, out);
+      generic->run(generic, 2, 5, 1, 3, ref);
+      check("run", 5);
+
+      memset(out, 0, sizeof(out));
+      memset(ref, 0, sizeof(ref));
+      t->run_elts(t, elts, count, 0, 5, out);
+      generic->run_elts(generic, elts, count, 0, 5, ref);
+      check("run_elts", count);
+
+      memset(out, 0, sizeof(out));
+      memset(ref, 0, sizeof(ref));
+      t->run_elts16(t, elts16, count, 2, 1, out);
+      generic->run_elts16(generic, elts16, count, 2, 1, ref);
+      check("run_elts16", count);
+
+      memset(out, 0, sizeof(out));
+      memset(ref, 0, sizeof(ref));
+      t->run_elts8(t, elts8, count, 1, 0, out);
+      generic->run_elts8(generic, elts8, count, 1, 0, ref);
+      check("run_elts8", count);
+
+      /* A zero count must not touch the output */
+      memset(out, 0xcc, sizeof(out));
+      t->run(t, 0, 0, 0, 0, out);
+      t->run_elts(t, elts, 0, 0, 0, out);
+      for (unsigned i = 0; i < sizeof(out); i++)
+         ASSERT_EQ(out[i], 0xcc);
+
+      t->release(t);
+      generic->release(generic);
+   }
+
+   struct translate_key key;
+
+   uint8_t bytes[NUM_VERTICES * INPUT_STRIDE];
+   float floats[NUM_VERTICES * INPUT_STRIDE / 4];
+
+   uint8_t out[8 * MAX_OUTPUT_STRIDE];
+   uint8_t ref[8 * MAX_OUTPUT_STRIDE];
+};
+
+TEST_P(translate_test, single)
+{
+   add_element(GetParam().input, GetParam().output, 0);
+   run_all();
+}
+
+TEST_P(translate_test, instanced)
+{
+   add_element(PIPE_FORMAT_R32G32_FLOAT, PIPE_FORMAT_R32G32_FLOAT, 0);
+   add_element(GetParam().input, GetParam().output, 2);
+   add_instance_id();
+   run_all();
+}
+
+TEST_P(translate_test, two_buffers)
+{
+   add_element(GetParam().input, GetParam().output, 0);
+   add_element(PIPE_FORMAT_R8G8B8A8_UNORM, PIPE_FORMAT_R32G32B32A32_FLOAT, 0);
+   add_element(PIPE_FORMAT_R32G32B32_FLOAT, PIPE_FORMAT_R32G32B32_FLOAT, 0);
+   run_all();
+}
+
+INSTANTIATE_TEST_SUITE_P(translate, translate_test,
+                         ::testing::ValuesIn(format_pairs));
@@ -534,6 +534,112 @@ tc_add_call_end(struct tc_batch *next)
 #endif
 }
 
+/* State calls that are removed if a call of the same kind overwrites them
+ * before any call that could use the state.  None of them hold references.
+ */
+#define TC_REMOVABLE_CALLS(X) \
+   X(bind_blend_state) \
+   X(bind_rasterizer_state) \
+   X(bind_depth_stencil_alpha_state) \
+   X(bind_vertex_elements_state) \
+   X(bind_vs_state) \
+   X(bind_tcs_state) \
+   X(bind_tes_state) \
+   X(bind_gs_state) \
+   X(bind_fs_state) \
+   X(bind_compute_state) \
+   X(set_blend_color) \
+   X(set_stencil_ref) \
+   X(set_clip_state) \
+   X(set_sample_mask) \
+   X(set_min_samples) \
+   X(set_polygon_stipple) \
+   X(set_tess_state) \
+   X(set_patch_vertices)
+
+enum tc_removable_call {
+#define X(name) TC_REMOVABLE_##name,
+   TC_REMOVABLE_CALLS(X)
+#undef X
+   TC_NUM_REMOVABLE_CALLS,
+};
+
+/* Calls that only set state, so they don't stop the removal of the calls
+ * they come between.
+ */
+#define TC_STATE_CALL -1
+/* Anything else, e.g. draws, may use the state set before it. */
+#define TC_BARRIER_CALL -2
+
+static int
+tc_get_removable_call(unsigned call_id)
+{
+   switch (call_id) {
+#define X(name) case TC_CALL_##name: return TC_REMOVABLE_##name;
+   TC_REMOVABLE_CALLS(X)
+#undef X
+   case TC_CALL_set_vertex_buffers:
+   case TC_CALL_set_constant_buffer:
+   case TC_CALL_set_inlinable_constants:
+   case TC_CALL_set_sampler_views:
+   case TC_CALL_bind_sampler_states:
+   case TC_CALL_set_shader_images:
+   case TC_CALL_set_shader_buffers:
+   case TC_CALL_set_viewport_states:
+   case TC_CALL_set_scissor_states:
+   case TC_CALL_set_window_rectangles:
+   case TC_CALL_set_sample_locations:
+   case TC_CALL_nop:
+      return TC_STATE_CALL;
+   default:
+      return TC_BARRIER_CALL;
+   }
+}
+
+static uint16_t ALWAYS_INLINE
+tc_call_nop(UNUSED struct pipe_context *pipe, void *call)
+{
+   return ((struct tc_call_base *)call)->num_slots;
+}
+
+/* Turn the state calls of the batch that are overwritten before anything
+ * could use them into no-ops.
+ */
+static void
+tc_batch_remove_overwritten_calls(struct threaded_context *tc,
+                                  struct tc_batch *batch)
+{
+   struct tc_call_base *last[TC_NUM_REMOVABLE_CALLS];
+   /* last[i] is only valid if last_barrier[i] == num_barriers */
+   unsigned last_barrier[TC_NUM_REMOVABLE_CALLS] = {0};
+   unsigned num_barriers = 1;
+   unsigned num_removed = 0;
+   uint64_t *iter = batch->slots;
+   uint64_t *end = &batch->slots[batch->num_total_slots];
+
+   while (iter < end) {
+      struct tc_call_base *call = (struct tc_call_base *)iter;
+      int removable = tc_get_removable_call(call->call_id);
+
+      tc_assert(call->sentinel == TC_SENTINEL);
+
+      if (removable >= 0) {
+         if (last_barrier[removable] == num_barriers) {
+            last[removable]->call_id = TC_CALL_nop;
+            num_removed++;
+         }
+         last[removable] = call;
+         last_barrier[removable] = num_barriers;
+      } else if (removable == TC_BARRIER_CALL) {
+         num_barriers++;
+      }
+      iter += call->num_slots;
+   }
+
+   if (num_removed)
+      p_atomic_add(&tc->num_overwritten_calls, num_removed);
+}
+
 static void
 tc_update_batch_generation(struct threaded_context *tc, struct tc_batch *next)
 {
@@ -550,6 +656,8 @@ tc_batch_flush(struct threaded_context *tc, bool full_copy)
    unsigned next_id = (tc->next + 1) % TC_MAX_BATCHES;
 
    tc_assert(next->num_total_slots != 0);
+   if (tc->options.remove_redundant_state)
+      tc_batch_remove_overwritten_calls(tc, next);
    tc_add_call_end(next);
 
    tc_batch_check(next);
@@ -738,6 +846,8 @@ _tc_sync(struct threaded_context *tc, UNUSED const char *info, UNUSED const char
       p_atomic_add(&tc->num_direct_slots, next->num_total_slots);
       tc->bytes_mapped_estimate = 0;
       tc->bytes_replaced_estimate = 0;
+      if (tc->options.remove_redundant_state)
+         tc_batch_remove_overwritten_calls(tc, next);
       tc_add_call_end(next);
       tc_update_batch_generation(tc, next);
       tc_batch_execute(next, NULL, 0);
@@ -1092,13 +1202,27 @@ threaded_resource_deinit(struct pipe_resource *res)
    align_free(tres->cpu_storage);
 }
 
+/* Placed in bound_csos when the bound CSO isn't known */
+#define TC_UNKNOWN_CSO ((void *)(uintptr_t)-1)
+
+static void
+tc_forget_bound_csos(struct threaded_context *tc)
+{
+   for (unsigned i = 0; i < TC_NUM_BOUND_CSOS; i++)
+      tc->bound_csos[i] = TC_UNKNOWN_CSO;
+}
+
 struct pipe_context *
 threaded_context_unwrap_sync(struct pipe_context *pipe)
 {
    if (!pipe || !pipe->priv)
       return pipe;
 
-   tc_sync(threaded_context(pipe));
+   struct threaded_context *tc = threaded_context(pipe);
+
+   tc_sync(tc);
+   /* the caller can change the bound state behind our back */
+   tc_forget_bound_csos(tc);
    return (struct pipe_context*)pipe->priv;
 }
 
@@ -1358,6 +1482,31 @@ tc_render_condition(struct pipe_context *_pipe,
  * constant (immutable) states
  */
 
+static ALWAYS_INLINE bool
+tc_is_redundant_bind(struct threaded_context *tc, enum tc_bound_cso cso,
+                     void *state)
+{
+   if (!tc->options.remove_redundant_state)
+      return false;
+
+   if (tc->bound_csos[cso] == state) {
+      p_atomic_inc(&tc->num_redundant_binds);
+      return true;
+   }
+
+   tc->bound_csos[cso] = state;
+   return false;
+}
+
+static ALWAYS_INLINE void
+tc_forget_bound_cso(struct threaded_context *tc, enum tc_bound_cso cso,
+                    void *state)
+{
+   /* A new CSO could be created at the same address */
+   if (tc->bound_csos[cso] == state)
+      tc->bound_csos[cso] = TC_UNKNOWN_CSO;
+}
+
 #define TC_CSO_CREATE(name, sname) \
    static void * \
    tc_create_##name##_state(struct pipe_context *_pipe, \
@@ -1367,8 +1516,37 @@ tc_render_condition(struct pipe_context *_pipe,
       return pipe->create_##name##_state(pipe, state); \
    }
 
-#define TC_CSO_BIND(name, ...) TC_FUNC1(bind_##name##_state, , void *, , , ##__VA_ARGS__)
-#define TC_CSO_DELETE(name) TC_FUNC1(delete_##name##_state, , void *, , )
+/* Like TC_FUNC1, but binds of the CSO that is already bound aren't
+ * recorded.  The extra code still runs for them.
+ */
+#define TC_CSO_BIND(name, ...) \
+   struct tc_call_bind_##name##_state { \
+      struct tc_call_base base; \
+      void *state; \
+   }; \
+   \
+   static uint16_t ALWAYS_INLINE \
+   tc_call_bind_##name##_state(struct pipe_context *pipe, void *call) \
+   { \
+      pipe->bind_##name##_state(pipe, \
+                                to_call(call, tc_call_bind_##name##_state)->state); \
+      return call_size(tc_call_bind_##name##_state); \
+   } \
+   \
+   static void \
+   tc_bind_##name##_state(struct pipe_context *_pipe, void *param) \
+   { \
+      struct threaded_context *tc = threaded_context(_pipe); \
+      if (!tc_is_redundant_bind(tc, TC_BOUND_##name, param)) { \
+         tc_add_call(tc, TC_CALL_bind_##name##_state, \
+                     tc_call_bind_##name##_state)->state = param; \
+      } \
+      __VA_ARGS__; \
+   }
+
+#define TC_CSO_DELETE(name) \
+   TC_FUNC1(delete_##name##_state, , void *, , , \
+            tc_forget_bound_cso(tc, TC_BOUND_##name, param))
 
 #define TC_CSO(name, sname, ...) \
    TC_CSO_CREATE(name, sname) \
@@ -1411,7 +1589,7 @@ TC_CSO_SHADER_TRACK(gs)
 TC_CSO_SHADER_TRACK(tcs)
 TC_CSO_SHADER_TRACK(tes)
 TC_CSO_CREATE(sampler, sampler)
-TC_CSO_DELETE(sampler)
+TC_FUNC1(delete_sampler_state, , void *, , )
 TC_CSO_BIND(vertex_elements)
 TC_CSO_DELETE(vertex_elements)
 
@@ -5451,6 +5629,10 @@ threaded_context_create(struct pipe_context *pipe,
       tc->options = *options;
    }
 
+   if (debug_get_bool_option("GALLIUM_THREAD_DEDUP_STATE", false))
+      tc->options.remove_redundant_state = true;
+   tc_forget_bound_csos(tc);
+
    pipe = trace_context_create_threaded(pipe->screen, pipe, &replace_buffer, &tc->options);
 
    /* The driver context isn't wrapped, so set its "priv" to NULL. */
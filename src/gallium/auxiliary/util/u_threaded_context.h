@@ -180,6 +180,23 @@
  * util_idalloc_mt_init_tc.
  *
  *
+ * Optional removal of redundant state calls
+ * -----------------------------------------
+ *
+ * If remove_redundant_state is set in threaded_context_options, or if
+ * GALLIUM_THREAD_DEDUP_STATE=1, the threaded context doesn't record binds of
+ * CSOs and shaders that are already bound.  When a batch is flushed, it also
+ * turns state calls that are overwritten by a call of the same kind before
+ * any other call that could use that state (e.g. a draw) into no-ops.  Only
+ * calls that don't hold references are removed.  threaded_context counts
+ * the removed calls in num_redundant_binds and num_overwritten_calls, which
+ * drivers can expose as queries for the HUD, like num_syncs.
+ *
+ * This assumes that the driver context only changes the bound state through
+ * the threaded context, or restores it after internal operations like blits.
+ * threaded_context_unwrap_sync() forgets the bound state.
+ *
+ *
  * How it works (queue architecture)
  * ---------------------------------
  *
@@ -570,6 +587,23 @@ struct threaded_context_options {
     */
    void (*dsa_parse)(void *state, struct tc_renderpass_info *info);
    void (*fs_parse)(void *state, struct tc_renderpass_info *info);
+   /* if true, skip redundant binds and remove overwritten state calls */
+   bool remove_redundant_state;
+};
+
+/* CSOs and shaders whose bound state is tracked to skip redundant binds */
+enum tc_bound_cso {
+   TC_BOUND_blend,
+   TC_BOUND_rasterizer,
+   TC_BOUND_depth_stencil_alpha,
+   TC_BOUND_vertex_elements,
+   TC_BOUND_vs,
+   TC_BOUND_tcs,
+   TC_BOUND_tes,
+   TC_BOUND_gs,
+   TC_BOUND_fs,
+   TC_BOUND_compute,
+   TC_NUM_BOUND_CSOS,
 };
 
 struct tc_vertex_buffers {
@@ -593,6 +627,8 @@ struct threaded_context {
    unsigned num_offloaded_slots;
    unsigned num_direct_slots;
    unsigned num_syncs;
+   unsigned num_redundant_binds;
+   unsigned num_overwritten_calls;
 
    bool use_forced_staging_uploads;
    bool add_all_gfx_bindings_to_buffer_list;
@@ -687,6 +723,8 @@ struct threaded_context {
    struct tc_renderpass_info *renderpass_info;
    /* internal-only: if dsa/fs are bound between render passes */
    void *pending_renderpass_dsa, *pending_renderpass_fs;
+   /* the CSOs bound through the threaded context, if remove_redundant_state */
+   void *bound_csos[TC_NUM_BOUND_CSOS];
 };
 
 
@@ -102,3 +102,5 @@ CALL(delete_tes_state)
 CALL(begin_intel_perf_query)
 CALL(end_intel_perf_query)
 CALL(image_copy_buffer)
+
+CALL(nop)
@@ -0,0 +1,214 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <stdlib.h>
+
+#include "pipe/p_screen.h"
+#include "util/u_threaded_context.h"
+#include "util/u_upload_mgr.h"
+#include <gtest/gtest.h>
+
+enum fake_call_type {
+   FAKE_BIND_BLEND,
+   FAKE_SET_STENCIL_REF,
+   FAKE_SET_SAMPLE_MASK,
+   FAKE_MEMORY_BARRIER,
+};
+
+struct fake_call {
+   enum fake_call_type type;
+   uintptr_t value;
+};
+
+/* A pipe_context that logs the calls the threaded context executes. */
+struct fake_pipe {
+   struct pipe_context base;
+   struct pipe_screen screen;
+   struct fake_call calls[64];
+   unsigned num_calls;
+};
+
+static void
+fake_log(struct pipe_context *pipe, enum fake_call_type type, uintptr_t value)
+{
+   struct fake_pipe *fake = (struct fake_pipe *)pipe;
+   ASSERT_LT(fake->num_calls, ARRAY_SIZE(fake->calls));
+   fake->calls[fake->num_calls++] = { type, value };
+}
+
+static void *
+fake_create_blend(struct pipe_context *, const struct pipe_blend_state *)
+{
+   return NULL;
+}
+
+static void
+fake_bind_blend(struct pipe_context *pipe, void *state)
+{
+   fake_log(pipe, FAKE_BIND_BLEND, (uintptr_t)state);
+}
+
+static void
+fake_set_stencil_ref(struct pipe_context *pipe, const struct pipe_stencil_ref ref)
+{
+   fake_log(pipe, FAKE_SET_STENCIL_REF, ref.ref_value[0]);
+}
+
+static void
+fake_set_sample_mask(struct pipe_context *pipe, unsigned mask)
+{
+   fake_log(pipe, FAKE_SET_SAMPLE_MASK, mask);
+}
+
+static void
+fake_memory_barrier(struct pipe_context *pipe, unsigned flags)
+{
+   fake_log(pipe, FAKE_MEMORY_BARRIER, flags);
+}
+
+static void fake_delete(struct pipe_context *, void *) {}
+
+static void
+fake_destroy(struct pipe_context *pipe)
+{
+   u_upload_destroy(pipe->stream_uploader);
+}
+
+#define BLEND_A ((void *)0x10)
+#define BLEND_B ((void *)0x20)
+#define BLEND_C ((void *)0x30)
+
+class tc_remove_redundant_state : public ::testing::Test {
+protected:
+   void SetUp() override
+   {
+      /* pipe_screen isn't trivially constructible in C++ */
+      fake = (struct fake_pipe *)calloc(1, sizeof(*fake));
+      ASSERT_NE(fake, nullptr);
+      fake->base.screen = &fake->screen;
+      fake->base.destroy = fake_destroy;
+      fake->base.create_blend_state = fake_create_blend;
+      fake->base.bind_blend_state = fake_bind_blend;
+      fake->base.delete_blend_state = fake_delete;
+      fake->base.set_stencil_ref = fake_set_stencil_ref;
+      fake->base.set_sample_mask = fake_set_sample_mask;
+      fake->base.memory_barrier = fake_memory_barrier;
+      fake->base.stream_uploader = u_upload_create_default(&fake->base);
+      fake->base.const_uploader = fake->base.stream_uploader;
+      ASSERT_NE(fake->base.stream_uploader, nullptr);
+
+      slab_create_parent(&transfer_pool, 64, 16);
+   }
+
+   void TearDown() override
+   {
+      slab_destroy_parent(&transfer_pool);
+      free(fake);
+   }
+
+   struct pipe_context *create(bool remove_redundant_state)
+   {
+      struct threaded_context_options options = {};
+      options.remove_redundant_state = remove_redundant_state;
+      struct pipe_context *pipe =
+         threaded_context_create(&fake->base, &transfer_pool, NULL,
+                                 &options, &tc);
+      if (pipe == &fake->base)
+         tc = NULL;
+      return pipe;
+   }
+
+   void expect_call(unsigned i, enum fake_call_type type, uintptr_t value)
+   {
+      ASSERT_LT(i, fake->num_calls);
+      EXPECT_EQ(fake->calls[i].type, type) << "call " << i;
+      EXPECT_EQ(fake->calls[i].value, value) << "call " << i;
+   }
+
+   struct fake_pipe *fake = NULL;
+   struct slab_parent_pool transfer_pool;
+   struct threaded_context *tc = NULL;
+};
+
+static void
+record_calls(struct pipe_context *pipe)
+{
+   struct pipe_stencil_ref ref = {};
+
+   pipe->bind_blend_state(pipe, BLEND_A);
+   ref.ref_value[0] = 1;
+   pipe->set_stencil_ref(pipe, ref);
+   /* overwrites A: set_stencil_ref doesn't use the blend state */
+   pipe->bind_blend_state(pipe, BLEND_B);
+   pipe->memory_barrier(pipe, PIPE_BARRIER_ALL);
+   pipe->bind_blend_state(pipe, BLEND_C);
+   pipe->set_sample_mask(pipe, 0xf);
+   /* overwrites C */
+   pipe->bind_blend_state(pipe, BLEND_A);
+   /* redundant */
+   pipe->bind_blend_state(pipe, BLEND_A);
+   /* overwrites the first sample mask */
+   pipe->set_sample_mask(pipe, 0x1);
+}
+
+TEST_F(tc_remove_redundant_state, disabled)
+{
+   struct pipe_context *pipe = create(false);
+   if (!tc) {
+      pipe->destroy(pipe);
+      GTEST_SKIP() << "GALLIUM_THREAD is disabled";
+   }
+
+   record_calls(pipe);
+   threaded_context_unwrap_sync(pipe);
+
+   EXPECT_EQ(fake->num_calls, 9);
+   EXPECT_EQ(tc->num_redundant_binds, 0);
+   EXPECT_EQ(tc->num_overwritten_calls, 0);
+   pipe->destroy(pipe);
+}
+
+TEST_F(tc_remove_redundant_state, overwritten_calls)
+{
+   struct pipe_context *pipe = create(true);
+   if (!tc) {
+      pipe->destroy(pipe);
+      GTEST_SKIP() << "GALLIUM_THREAD is disabled";
+   }
+
+   record_calls(pipe);
+   threaded_context_unwrap_sync(pipe);
+
+   EXPECT_EQ(fake->num_calls, 5);
+   expect_call(0, FAKE_SET_STENCIL_REF, 1);
+   expect_call(1, FAKE_BIND_BLEND, (uintptr_t)BLEND_B);
+   expect_call(2, FAKE_MEMORY_BARRIER, PIPE_BARRIER_ALL);
+   expect_call(3, FAKE_BIND_BLEND, (uintptr_t)BLEND_A);
+   expect_call(4, FAKE_SET_SAMPLE_MASK, 0x1);
+   EXPECT_EQ(tc->num_redundant_binds, 1);
+   EXPECT_EQ(tc->num_overwritten_calls, 3);
+   pipe->destroy(pipe);
+}
+
+TEST_F(tc_remove_redundant_state, delete_bound_cso)
+{
+   struct pipe_context *pipe = create(true);
+   if (!tc) {
+      pipe->destroy(pipe);
+      GTEST_SKIP() << "GALLIUM_THREAD is disabled";
+   }
+
+   /* A new CSO can be created at the address of the deleted one, so
+    * binding it isn't redundant.  The delete also keeps the first bind.
+    */
+   pipe->bind_blend_state(pipe, BLEND_A);
+   pipe->delete_blend_state(pipe, BLEND_A);
+   pipe->bind_blend_state(pipe, BLEND_A);
+   threaded_context_unwrap_sync(pipe);
+
+   EXPECT_EQ(fake->num_calls, 2);
+   expect_call(0, FAKE_BIND_BLEND, (uintptr_t)BLEND_A);
+   expect_call(1, FAKE_BIND_BLEND, (uintptr_t)BLEND_A);
+   EXPECT_EQ(tc->num_redundant_binds, 0);
+   EXPECT_EQ(tc->num_overwritten_calls, 0);
+   pipe->destroy(pipe);
+}
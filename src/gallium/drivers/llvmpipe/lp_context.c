@@ -41,7 +41,9 @@
 #include "lp_clear.h"
 #include "lp_context.h"
 #include "lp_flush.h"
+#include "lp_ml.h"
 #include "lp_perf.h"
+#include "lp_public.h"
 #include "lp_state.h"
 #include "lp_surface.h"
 #include "lp_query.h"
@@ -191,6 +193,26 @@ lp_draw_disk_cache_insert_shader(void *cookie,
 }
 
 
+void
+llvmpipe_shader_set_code_cache(struct pipe_context *pipe,
+                               mesa_shader_stage stage, void *cso,
+                               struct lp_code_cache *cache)
+{
+   switch (stage) {
+   case MESA_SHADER_FRAGMENT:
+      ((struct lp_fragment_shader *)cso)->code_cache = cache;
+      break;
+   case MESA_SHADER_COMPUTE:
+   case MESA_SHADER_TASK:
+   case MESA_SHADER_MESH:
+      ((struct lp_compute_shader *)cso)->code_cache = cache;
+      break;
+   default:
+      break;
+   }
+}
+
+
 static enum pipe_reset_status
 llvmpipe_get_device_reset_status(struct pipe_context *pipe)
 {
@@ -252,6 +274,7 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    llvmpipe_init_rasterizer_funcs(llvmpipe);
    llvmpipe_init_context_resource_funcs(&llvmpipe->pipe);
    llvmpipe_init_surface_functions(llvmpipe);
+   llvmpipe_init_ml_funcs(llvmpipe);
 
    llvmpipe_init_sampler_matrix(llvmpipe);
 
@@ -290,6 +313,9 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    draw_set_constant_buffer_stride(llvmpipe->draw,
                                    lp_get_constant_buffer_stride(screen));
 
+   if (lp_screen->draw_vs_threads)
+      draw_set_vs_queue(llvmpipe->draw, &lp_screen->draw_vs_queue);
+
    /* FIXME: devise alternative to draw_texture_samplers */
 
    llvmpipe->setup = lp_setup_create(&llvmpipe->pipe, llvmpipe->draw);
@@ -165,6 +165,9 @@ struct llvmpipe_context {
    unsigned nr_fs_variants;
    unsigned nr_fs_instrs;
 
+   /** Bound variant still being compiled, its fallback is used meanwhile */
+   struct lp_fragment_shader_variant *fs_pending;
+
    bool permit_linear_rasterizer;
    bool single_vp;
 
@@ -28,9 +28,122 @@
  * based on threadpool.c but modified heavily to be compute shader tuned.
  */
 
+#include "util/u_atomic.h"
+#include "util/u_math.h"
 #include "util/u_thread.h"
 #include "util/u_memory.h"
 #include "lp_cs_tpool.h"
+#include "lp_screen.h"
+
+/* Dispatches with at most this many iterations are run by the submitting
+ * thread alone, waking up workers would cost more than it saves.  Going
+ * through the pool costs a few microseconds, which is what 16 iterations
+ * of ~130ns take in lp_test_cs_tpool.
+ */
+#define LP_CS_TPOOL_INLINE_ITERS 16
+
+/* Threads take this fraction of what's left of their own range at a time,
+ * so chunks start big and get smaller towards the end, where they are
+ * more likely to be stolen.
+ */
+#define LP_CS_TPOOL_CHUNK_DIV 4
+
+#define LP_CS_TPOOL_RANGE(begin, end) (((uint64_t)(end) << 32) | (begin))
+
+
+static bool
+range_pop_front(uint64_t *range, unsigned *begin_out, unsigned *end_out)
+{
+   uint64_t old = p_atomic_read(range);
+
+   for (;;) {
+      const uint32_t begin = (uint32_t)old, end = (uint32_t)(old >> 32);
+      if (begin >= end)
+         return false;
+
+      const uint32_t chunk = MAX2((end - begin) / LP_CS_TPOOL_CHUNK_DIV, 1);
+      uint64_t prev = p_atomic_cmpxchg(range, old,
+                                       LP_CS_TPOOL_RANGE(begin + chunk, end));
+      if (prev == old) {
+         *begin_out = begin;
+         *end_out = begin + chunk;
+         return true;
+      }
+      old = prev;
+   }
+}
+
+
+/**
+ * Move the back half of another thread's range into our own, empty range.
+ */
+static bool
+steal(struct lp_cs_tpool_task *task, unsigned slot)
+{
+   for (unsigned i = 1; i < task->num_ranges; i++) {
+      uint64_t *victim = &task->ranges[(slot + i) % task->num_ranges].iters;
+      uint64_t old = p_atomic_read(victim);
+
+      for (;;) {
+         const uint32_t begin = (uint32_t)old, end = (uint32_t)(old >> 32);
+         if (begin >= end)
+            break;
+
+         const uint32_t split = end - DIV_ROUND_UP(end - begin, 2);
+         uint64_t prev = p_atomic_cmpxchg(victim, old,
+                                          LP_CS_TPOOL_RANGE(begin, split));
+         if (prev == old) {
+            /* Nobody modifies an empty range, so no need for a CAS. */
+            p_atomic_set(&task->ranges[slot].iters,
+                         LP_CS_TPOOL_RANGE(split, end));
+            return true;
+         }
+         old = prev;
+      }
+   }
+
+   return false;
+}
+
+
+/**
+ * Execute iterations of the task until there are none left to take.
+ */
+static void
+run_task(struct lp_cs_tpool_task *task, unsigned slot,
+         struct lp_cs_local_mem *lmem)
+{
+   uint64_t *range = &task->ranges[slot].iters;
+
+   for (;;) {
+      unsigned begin, end;
+
+      if (!range_pop_front(range, &begin, &end)) {
+         if (!steal(task, slot))
+            break;
+         continue;
+      }
+
+      for (unsigned i = begin; i < end; i++)
+         task->work(task->data, i, lmem);
+   }
+}
+
+
+/**
+ * Called with the pool mutex held.  Once a thread finds nothing left to
+ * take, no other thread needs to join, and the last one out signals the
+ * task as finished.
+ */
+static void
+leave_task(struct lp_cs_tpool_task *task)
+{
+   list_delinit(&task->list);
+
+   if (--task->num_users == 0)
+      cnd_broadcast(&task->finish);
+}
+
 
 static int
 lp_cs_tpool_worker(void *data)
@@ -43,7 +156,6 @@ lp_cs_tpool_worker(void *data)
 
    while (!pool->shutdown) {
       struct lp_cs_tpool_task *task;
-      unsigned iter_per_thread;
 
       while (list_is_empty(&pool->workqueue) && !pool->shutdown)
          cnd_wait(&pool->new_work, &pool->m);
@@ -54,29 +166,16 @@ lp_cs_tpool_worker(void *data)
       task = list_first_entry(&pool->workqueue, struct lp_cs_tpool_task,
                               list);
 
-      unsigned this_iter = task->iter_start;
-
-      iter_per_thread = task->iter_per_thread;
-
-      if (task->iter_remainder &&
-          task->iter_start + task->iter_remainder == task->iter_total) {
-         task->iter_remainder--;
-         iter_per_thread = 1;
-      }
-
-      task->iter_start += iter_per_thread;
-
-      if (task->iter_start == task->iter_total)
-         list_del(&task->list);
+      const unsigned slot = task->num_joined++;
+      task->num_users++;
+      if (task->num_joined == task->num_ranges)
+         list_delinit(&task->list);
 
       mtx_unlock(&pool->m);
-      for (unsigned i = 0; i < iter_per_thread; i++)
-         task->work(task->data, this_iter + i, &lmem);
-
+      run_task(task, slot, &lmem);
       mtx_lock(&pool->m);
-      task->iter_finished += iter_per_thread;
-      if (task->iter_finished == task->iter_total)
-         cnd_broadcast(&task->finish);
+
+      leave_task(task);
    }
    mtx_unlock(&pool->m);
    FREE(lmem.local_mem_ptr);
@@ -101,6 +200,7 @@ lp_cs_tpool_create(unsigned num_threads)
          num_threads = i;  /* previous thread is max */
          break;
       }
+      llvmpipe_bind_thread_to_L3(pool->threads[i], i, num_threads);
    }
    pool->num_threads = num_threads;
    return pool;
@@ -142,7 +242,13 @@ lp_cs_tpool_queue_task(struct lp_cs_tpool *pool,
       FREE(lmem.local_mem_ptr);
       return NULL;
    }
-   task = CALLOC_STRUCT(lp_cs_tpool_task);
+   const unsigned num_ranges = num_iters <= LP_CS_TPOOL_INLINE_ITERS ? 1 :
+      MIN2(pool->num_threads + 1, num_iters);
+   const size_t ranges_offset = align(sizeof(*task), CACHE_LINE_SIZE);
+
+   task = align_calloc(ranges_offset +
+                       num_ranges * sizeof(struct lp_cs_tpool_range),
+                       CACHE_LINE_SIZE);
    if (!task) {
       return NULL;
    }
@@ -150,18 +256,38 @@ lp_cs_tpool_queue_task(struct lp_cs_tpool *pool,
    task->work = work;
    task->data = data;
    task->iter_total = num_iters;
+   task->ranges = (struct lp_cs_tpool_range *)((char *)task + ranges_offset);
+   task->num_ranges = num_ranges;
 
-   task->iter_per_thread = num_iters / pool->num_threads;
-   task->iter_remainder = num_iters % pool->num_threads;
+   for (unsigned i = 0; i < num_ranges; i++) {
+      task->ranges[i].iters =
+         LP_CS_TPOOL_RANGE((uint64_t)num_iters * i / num_ranges,
+                           (uint64_t)num_iters * (i + 1) / num_ranges);
+   }
 
+   /* The submitting thread takes the first range, in
+    * lp_cs_tpool_wait_for_task().
+    */
+   task->num_joined = 1;
+   task->num_users = 1;
    cnd_init(&task->finish);
+   list_inithead(&task->list);
 
-   mtx_lock(&pool->m);
+   if (num_ranges > 1) {
+      mtx_lock(&pool->m);
 
-   list_addtail(&task->list, &pool->workqueue);
+      list_addtail(&task->list, &pool->workqueue);
+
+      /* Only wake up as many workers as there are ranges to take. */
+      if (num_ranges - 1 >= pool->num_threads) {
+         cnd_broadcast(&pool->new_work);
+      } else {
+         for (unsigned i = 1; i < num_ranges; i++)
+            cnd_signal(&pool->new_work);
+      }
+      mtx_unlock(&pool->m);
+   }
 
-   cnd_broadcast(&pool->new_work);
-   mtx_unlock(&pool->m);
    return task;
 }
 
@@ -174,12 +300,19 @@ lp_cs_tpool_wait_for_task(struct lp_cs_tpool *pool,
    if (!pool || !task)
       return;
 
+   /* Help with the task instead of just waiting for it. */
+   struct lp_cs_local_mem lmem;
+   memset(&lmem, 0, sizeof(lmem));
+   run_task(task, 0, &lmem);
+   FREE(lmem.local_mem_ptr);
+
    mtx_lock(&pool->m);
-   while (task->iter_finished < task->iter_total)
+   leave_task(task);
+   while (task->num_users)
       cnd_wait(&task->finish, &pool->m);
    mtx_unlock(&pool->m);
 
    cnd_destroy(&task->finish);
-   FREE(task);
+   align_free(task);
    *task_handle = NULL;
 }
@@ -30,12 +30,18 @@
  * structs with just unique indexes in them.
  * It also supports a local memory support struct to be passed from
  * outside the thread exec function.
+ *
+ * The iterations of a task are split into one range per participating
+ * thread, the submitting thread included.  Threads take chunks from the
+ * front of their own range and steal half of another thread's range from
+ * the back when theirs is empty, all without taking the pool mutex.
  */
 #ifndef LP_CS_QUEUE
 #define LP_CS_QUEUE
 
 #include "util/compiler.h"
 
+#include "util/u_memory.h"
 #include "util/u_thread.h"
 #include "util/list.h"
 
@@ -58,16 +64,24 @@ struct lp_cs_local_mem {
 
 typedef void (*lp_cs_tpool_task_func)(void *data, int iter_idx, struct lp_cs_local_mem *lmem);
 
+struct lp_cs_tpool_range {
+   /* [begin, end) packed into 64 bits, end in the high half */
+   EXCLUSIVE_CACHELINE(uint64_t iters);
+};
+
 struct lp_cs_tpool_task {
    lp_cs_tpool_task_func work;
    void *data;
    struct list_head list;
    cnd_t finish;
    unsigned iter_total;
-   unsigned iter_start;
-   unsigned iter_finished;
-   unsigned iter_per_thread;
-   unsigned iter_remainder;
+
+   /* protected by the pool mutex */
+   unsigned num_joined;  /* threads that took a range, the submitter first */
+   unsigned num_users;   /* threads still working on the task */
+
+   unsigned num_ranges;
+   struct lp_cs_tpool_range *ranges;  /* cache line aligned, after the task */
 };
 
 struct lp_cs_tpool *lp_cs_tpool_create(unsigned num_threads);
@@ -66,7 +66,11 @@
 
 #define LP_MAX_SAMPLES 4
 
-#define LP_MAX_THREADS 32
+/**
+ * Max number of rasterizer and compute threads.  Enough for the bigger
+ * multi-socket machines; the per-thread state is small.
+ */
+#define LP_MAX_THREADS 256
 
 
 /**
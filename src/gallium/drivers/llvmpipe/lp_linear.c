@@ -302,6 +302,10 @@ lp_linear_check_variant(struct lp_fragment_shader_variant *variant)
     * that.
     */
    if (lp_linear_check_fastpath(variant)) {
+      if (LP_DEBUG & DEBUG_LINEAR) {
+         lp_debug_fs_variant(variant);
+         debug_printf("    ----> linear fastpath\n");
+      }
       return;
    }
 
@@ -334,7 +338,7 @@ lp_linear_check_variant(struct lp_fragment_shader_variant *variant)
 
    /* Check shader.  May not have been jitted.
     */
-   if (variant->linear_function == NULL) {
+   if (variant->jit_linear_llvm == NULL) {
       if (LP_DEBUG & DEBUG_LINEAR)
          debug_printf("  -- no linear shader\n");
       goto fail;
@@ -360,6 +364,11 @@ lp_linear_check_variant(struct lp_fragment_shader_variant *variant)
       debug_printf("linear input mask: 0x%x\n", variant->linear_input_mask);
    }
 
+   if (LP_DEBUG & DEBUG_LINEAR) {
+      lp_debug_fs_variant(variant);
+      debug_printf("    ----> llvm linear path\n");
+   }
+
    return;
 
 fail:
@@ -0,0 +1,1130 @@
+/*
+ * Copyright © 2026 Red Hat
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * @file
+ * CPU implementation of the pipe_context ML hooks used by the Teflon
+ * TensorFlow Lite delegate.
+ *
+ * Tensors are kept in host memory in NHWC layout.  Signed (INT8) tensors are
+ * biased by 0x80 on the way in and out, so that all kernels work on unsigned
+ * values and only the zero points differ.  The integer arithmetic follows
+ * the TensorFlow Lite reference kernels, so results match those of the CPU
+ * executor bit for bit.
+ *
+ * Every operation is split into rows (or chunks of elements) which are run
+ * on the compute shader thread pool.
+ */
+
+#include <math.h>
+
+#include "pipe/p_state.h"
+#include "util/detect.h"
+#include "util/macros.h"
+#include "util/u_dynarray.h"
+#include "util/u_inlines.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_sse.h"
+
+#include "lp_context.h"
+#include "lp_cs_tpool.h"
+#include "lp_ml.h"
+#include "lp_screen.h"
+
+#if DETECT_ARCH_SSE
+#include <emmintrin.h>
+#endif
+
+
+/* Number of elements per task for element-wise operations */
+#define LP_ML_CHUNK_SIZE 4096
+
+/* Number of output channels of a depthwise convolution accumulated at once */
+#define LP_ML_DW_CHANNELS 64
+
+
+struct lp_ml_tensor {
+   uint8_t *data;
+   unsigned size;
+};
+
+
+struct lp_ml_input {
+   unsigned index;
+   unsigned dims[4];
+
+   /* Added to the stored values to get those of the original type, or
+    * with the zero point subtracted too for addition.
+    */
+   int32_t offset;
+
+   /* Concatenation */
+   unsigned inner_size;
+   bool requantize;
+   float scale;
+   float bias;
+};
+
+
+struct lp_ml_operation {
+   enum pipe_ml_operation_type type;
+
+   struct lp_ml_input *inputs;
+   unsigned input_count;
+
+   unsigned output_index;
+   unsigned out_dims[4];
+
+   /* Zero points, in the biased unsigned range */
+   int32_t input_zero_point;
+   int32_t output_zero_point;
+   int32_t output_min;
+   int32_t output_max;
+
+   /* Convolution and pooling */
+   unsigned kernel_w, kernel_h;
+   unsigned stride_x, stride_y;
+   unsigned dilation_x, dilation_y;
+   unsigned pad_x, pad_y;
+
+   bool depthwise;
+   unsigned depth_multiplier;
+
+   /* Zero point already subtracted, OHWI layout, or HWO for depthwise */
+   int16_t *weights;
+   int32_t *biases;
+   int32_t *multipliers;
+   int *shifts;
+
+   /* Copy of the input with the zero point subtracted, and with the
+    * padding around it filled with zeros, so that no bounds checking is
+    * needed in the inner loops.
+    */
+   int16_t *padded;
+   unsigned padded_w, padded_h;
+
+   /* Addition */
+   int32_t input_multiplier[2];
+   int input_shift[2];
+   int32_t output_multiplier;
+   int output_shift;
+
+   /* Average pooling */
+   int32_t input_offset;
+
+   /* Concatenation */
+   unsigned outer_size;
+};
+
+
+struct lp_ml_subgraph {
+   struct pipe_ml_subgraph base;
+
+   struct util_dynarray operations; /* struct lp_ml_operation */
+   struct util_dynarray tensors;    /* struct lp_ml_tensor */
+};
+
+
+struct lp_ml_job {
+   struct lp_ml_subgraph *subgraph;
+   const struct lp_ml_operation *operation;
+};
+
+
+static inline struct lp_ml_tensor *
+get_tensor(struct lp_ml_subgraph *subgraph, unsigned index)
+{
+   return util_dynarray_element(&subgraph->tensors, struct lp_ml_tensor, index);
+}
+
+
+static inline unsigned
+tensor_bias(const struct pipe_tensor *tensor)
+{
+   return tensor->is_signed ? 0x80 : 0;
+}
+
+
+static inline unsigned
+tensor_size(const unsigned dims[4])
+{
+   return dims[0] * dims[1] * dims[2] * dims[3];
+}
+
+
+/*
+ * Fixed point helpers, as in tensorflow/lite/kernels/internal/common.h.
+ */
+
+static void
+quantize_multiplier(double real_multiplier, int32_t *multiplier, int *shift)
+{
+   if (real_multiplier == 0.0) {
+      *multiplier = 0;
+      *shift = 0;
+      return;
+   }
+
+   const double q = frexp(real_multiplier, shift);
+   int64_t q_fixed = llround(q * (double)(1ll << 31));
+
+   if (q_fixed == (1ll << 31)) {
+      q_fixed /= 2;
+      ++*shift;
+   }
+
+   if (*shift < -31) {
+      *shift = 0;
+      q_fixed = 0;
+   }
+
+   *multiplier = (int32_t)q_fixed;
+}
+
+
+static inline int32_t
+rounding_doubling_high_mul(int32_t a, int32_t b)
+{
+   if (a == b && a == INT32_MIN)
+      return INT32_MAX;
+
+   const int64_t ab = (int64_t)a * b;
+   const int64_t nudge = ab >= 0 ? (1 << 30) : (1 - (1 << 30));
+
+   return (int32_t)((ab + nudge) / (1ll << 31));
+}
+
+
+static inline int32_t
+rounding_divide_by_pot(int32_t x, int exponent)
+{
+   const int32_t mask = (int32_t)((1ll << exponent) - 1);
+   const int32_t remainder = x & mask;
+   const int32_t threshold = (mask >> 1) + (x < 0 ? 1 : 0);
+
+   return (x >> exponent) + (remainder > threshold ? 1 : 0);
+}
+
+
+static inline int32_t
+multiply_by_quantized_multiplier(int32_t x, int32_t multiplier, int shift)
+{
+   const int left_shift = shift > 0 ? shift : 0;
+   const int right_shift = shift > 0 ? 0 : -shift;
+
+   return rounding_divide_by_pot(
+      rounding_doubling_high_mul((int32_t)((uint32_t)x << left_shift),
+                                 multiplier),
+      right_shift);
+}
+
+
+static inline int32_t
+dot_i16(const int16_t *a, const int16_t *b, unsigned n)
+{
+   int32_t sum = 0;
+   unsigned i = 0;
+
+#if DETECT_ARCH_SSE
+   /* The operands are differences of 8-bit values, so the pairwise sums
+    * of _mm_madd_epi16 can't overflow.
+    */
+   __m128i acc = _mm_setzero_si128();
+
+   for (; i + 8 <= n; i += 8) {
+      const __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+      const __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+      acc = _mm_add_epi32(acc, _mm_madd_epi16(va, vb));
+   }
+
+   acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+   acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+   sum = _mm_cvtsi128_si32(acc);
+#endif
+
+   for (; i < n; i++)
+      sum += a[i] * b[i];
+
+   return sum;
+}
+
+
+static inline uint8_t
+requantize(const struct lp_ml_operation *operation, int32_t acc, unsigned oc)
+{
+   int32_t value = multiply_by_quantized_multiplier(acc,
+                                                    operation->multipliers[oc],
+                                                    operation->shifts[oc]);
+   value += operation->output_zero_point;
+
+   return CLAMP(value, operation->output_min, operation->output_max);
+}
+
+
+/*
+ * Kernels.  Each is called once per row of the output (or per chunk of
+ * elements), from the thread pool.
+ */
+
+static void
+pad_input_row(void *data, int iter_idx, struct lp_cs_local_mem *lmem)
+{
+   const struct lp_ml_job *job = data;
+   const struct lp_ml_operation *operation = job->operation;
+   const struct lp_ml_input *input = &operation->inputs[0];
+   const unsigned width = input->dims[2];
+   const unsigned channels = input->dims[3];
+   const unsigned n = iter_idx / input->dims[1];
+   const unsigned y = iter_idx % input->dims[1];
+   const int16_t zero_point = operation->input_zero_point;
+
+   const uint8_t *src = get_tensor(job->subgraph, input->index)->data +
+                        (size_t)iter_idx * width * channels;
+   int16_t *dst = operation->padded +
+                  (((size_t)n * operation->padded_h + y + operation->pad_y) *
+                   operation->padded_w + operation->pad_x) * channels;
+
+   for (unsigned i = 0; i < width * channels; i++)
+      dst[i] = src[i] - zero_point;
+}
+
+
+static void
+convolution_row(void *data, int iter_idx, struct lp_cs_local_mem *lmem)
+{
+   const struct lp_ml_job *job = data;
+   const struct lp_ml_operation *operation = job->operation;
+   const unsigned channels = operation->inputs[0].dims[3];
+   const unsigned out_w = operation->out_dims[2];
+   const unsigned out_c = operation->out_dims[3];
+   const unsigned kernel_w = operation->kernel_w;
+   const unsigned kernel_h = operation->kernel_h;
+   const size_t row_stride = (size_t)operation->padded_w * channels;
+   const unsigned n = iter_idx / operation->out_dims[1];
+   const unsigned oy = iter_idx % operation->out_dims[1];
+
+   uint8_t *dst = get_tensor(job->subgraph, operation->output_index)->data +
+                  (size_t)iter_idx * out_w * out_c;
+
+   for (unsigned ox = 0; ox < out_w; ox++) {
+      const int16_t *src = operation->padded +
+                           ((size_t)n * operation->padded_h +
+                            oy * operation->stride_y) * row_stride +
+                           (size_t)ox * operation->stride_x * channels;
+
+      for (unsigned oc = 0; oc < out_c; oc++) {
+         const int16_t *weights = operation->weights +
+                                  (size_t)oc * kernel_h * kernel_w * channels;
+         int32_t acc = operation->biases[oc];
+
+         for (unsigned ky = 0; ky < kernel_h; ky++) {
+            const int16_t *row = src + ky * operation->dilation_y * row_stride;
+            const int16_t *w = weights + ky * kernel_w * channels;
+
+            /* Without dilation the whole kernel row is contiguous */
+            if (operation->dilation_x == 1) {
+               acc += dot_i16(row, w, kernel_w * channels);
+            } else {
+               for (unsigned kx = 0; kx < kernel_w; kx++)
+                  acc += dot_i16(row + kx * operation->dilation_x * channels,
+                                 w + kx * channels, channels);
+            }
+         }
+
+         dst[ox * out_c + oc] = requantize(operation, acc, oc);
+      }
+   }
+}
+
+
+static void
+depthwise_convolution_row(void *data, int iter_idx,
+                          struct lp_cs_local_mem *lmem)
+{
+   const struct lp_ml_job *job = data;
+   const struct lp_ml_operation *operation = job->operation;
+   const unsigned channels = operation->inputs[0].dims[3];
+   const unsigned out_w = operation->out_dims[2];
+   const unsigned out_c = operation->out_dims[3];
+   const unsigned multiplier = operation->depth_multiplier;
+   const size_t row_stride = (size_t)operation->padded_w * channels;
+   const unsigned n = iter_idx / operation->out_dims[1];
+   const unsigned oy = iter_idx % operation->out_dims[1];
+   int32_t acc[LP_ML_DW_CHANNELS];
+
+   uint8_t *dst = get_tensor(job->subgraph, operation->output_index)->data +
+                  (size_t)iter_idx * out_w * out_c;
+
+   for (unsigned ox = 0; ox < out_w; ox++) {
+      const int16_t *src = operation->padded +
+                           ((size_t)n * operation->padded_h +
+                            oy * operation->stride_y) * row_stride +
+                           (size_t)ox * operation->stride_x * channels;
+
+      for (unsigned c0 = 0; c0 < out_c; c0 += LP_ML_DW_CHANNELS) {
+         const unsigned count = MIN2(LP_ML_DW_CHANNELS, out_c - c0);
+
+         memcpy(acc, operation->biases + c0, count * sizeof(acc[0]));
+
+         for (unsigned ky = 0; ky < operation->kernel_h; ky++) {
+            for (unsigned kx = 0; kx < operation->kernel_w; kx++) {
+               const int16_t *in = src +
+                                   ky * operation->dilation_y * row_stride +
+                                   kx * operation->dilation_x * channels;
+               const int16_t *w = operation->weights +
+                                  (ky * operation->kernel_w + kx) * out_c + c0;
+
+               if (multiplier == 1) {
+                  for (unsigned c = 0; c < count; c++)
+                     acc[c] += in[c0 + c] * w[c];
+               } else {
+                  for (unsigned c = 0; c < count; c++)
+                     acc[c] += in[(c0 + c) / multiplier] * w[c];
+               }
+            }
+         }
+
+         for (unsigned c = 0; c < count; c++)
+            dst[ox * out_c + c0 + c] = requantize(operation, acc[c], c0 + c);
+      }
+   }
+}
+
+
+static void
+add_chunk(void *data, int iter_idx, struct lp_cs_local_mem *lmem)
+{
+   const struct lp_ml_job *job = data;
+   const struct lp_ml_operation *operation = job->operation;
+   const unsigned size = tensor_size(operation->out_dims);
+   const unsigned start = iter_idx * LP_ML_CHUNK_SIZE;
+   const unsigned end = MIN2(start + LP_ML_CHUNK_SIZE, size);
+   const int left_shift = 20;
+
+   const uint8_t *src0 = get_tensor(job->subgraph, operation->inputs[0].index)->data;
+   const uint8_t *src1 = get_tensor(job->subgraph, operation->inputs[1].index)->data;
+   uint8_t *dst = get_tensor(job->subgraph, operation->output_index)->data;
+
+   for (unsigned i = start; i < end; i++) {
+      const int32_t a = (src0[i] + operation->inputs[0].offset) * (1 << left_shift);
+      const int32_t b = (src1[i] + operation->inputs[1].offset) * (1 << left_shift);
+      const int32_t sum =
+         multiply_by_quantized_multiplier(a, operation->input_multiplier[0],
+                                          operation->input_shift[0]) +
+         multiply_by_quantized_multiplier(b, operation->input_multiplier[1],
+                                          operation->input_shift[1]);
+      const int32_t value =
+         multiply_by_quantized_multiplier(sum, operation->output_multiplier,
+                                          operation->output_shift) +
+         operation->output_zero_point;
+
+      dst[i] = CLAMP(value, operation->output_min, operation->output_max);
+   }
+}
+
+
+static void
+average_pool_row(void *data, int iter_idx, struct lp_cs_local_mem *lmem)
+{
+   const struct lp_ml_job *job = data;
+   const struct lp_ml_operation *operation = job->operation;
+   const struct lp_ml_input *input = &operation->inputs[0];
+   const int in_h = input->dims[1];
+   const int in_w = input->dims[2];
+   const unsigned channels = input->dims[3];
+   const unsigned out_w = operation->out_dims[2];
+   const unsigned n = iter_idx / operation->out_dims[1];
+   const unsigned oy = iter_idx % operation->out_dims[1];
+
+   const uint8_t *src = get_tensor(job->subgraph, input->index)->data +
+                        (size_t)n * in_h * in_w * channels;
+   uint8_t *dst = get_tensor(job->subgraph, operation->output_index)->data +
+                  (size_t)iter_idx * out_w * channels;
+
+   const int y_origin = (int)(oy * operation->stride_y) - (int)operation->pad_y;
+   const int y0 = MAX2(y_origin, 0);
+   const int y1 = MIN2(y_origin + (int)operation->kernel_h, in_h);
+
+   for (unsigned ox = 0; ox < out_w; ox++) {
+      const int x_origin = (int)(ox * operation->stride_x) - (int)operation->pad_x;
+      const int x0 = MAX2(x_origin, 0);
+      const int x1 = MIN2(x_origin + (int)operation->kernel_w, in_w);
+      const int32_t count = (y1 - y0) * (x1 - x0);
+
+      for (unsigned c = 0; c < channels; c++) {
+         int32_t sum = 0;
+
+         for (int y = y0; y < y1; y++)
+            for (int x = x0; x < x1; x++)
+               sum += src[((size_t)y * in_w + x) * channels + c];
+
+         /* Round half away from zero, in the range of the original type */
+         sum += operation->input_offset * count;
+         sum = sum > 0 ? (sum + count / 2) / count : (sum - count / 2) / count;
+         sum -= operation->input_offset;
+
+         dst[ox * channels + c] = CLAMP(sum, 0, 255);
+      }
+   }
+}
+
+
+static void
+concatenation_row(void *data, int iter_idx, struct lp_cs_local_mem *lmem)
+{
+   const struct lp_ml_job *job = data;
+   const struct lp_ml_operation *operation = job->operation;
+   uint8_t *dst = get_tensor(job->subgraph, operation->output_index)->data;
+   size_t out_row = 0;
+
+   for (unsigned i = 0; i < operation->input_count; i++)
+      out_row += operation->inputs[i].inner_size;
+   dst += (size_t)iter_idx * out_row;
+
+   for (unsigned i = 0; i < operation->input_count; i++) {
+      const struct lp_ml_input *input = &operation->inputs[i];
+      const uint8_t *src = get_tensor(job->subgraph, input->index)->data +
+                           (size_t)iter_idx * input->inner_size;
+
+      if (!input->requantize) {
+         memcpy(dst, src, input->inner_size);
+      } else {
+         for (unsigned j = 0; j < input->inner_size; j++) {
+            const int32_t value =
+               (int32_t)roundf((src[j] + input->offset) * input->scale +
+                               input->bias) +
+               operation->output_zero_point;
+
+            dst[j] = CLAMP(value, 0, 255);
+         }
+      }
+
+      dst += input->inner_size;
+   }
+}
+
+
+static void
+run_operation(struct lp_ml_subgraph *subgraph,
+              const struct lp_ml_operation *operation)
+{
+   struct llvmpipe_screen *screen =
+      llvmpipe_screen(subgraph->base.context->screen);
+   struct lp_ml_job job = {
+      .subgraph = subgraph,
+      .operation = operation,
+   };
+   const unsigned rows = operation->out_dims[0] * operation->out_dims[1];
+   lp_cs_tpool_task_func func;
+   unsigned num_iters;
+
+   switch (operation->type) {
+   case PIPE_ML_OPERATION_TYPE_CONVOLUTION: {
+      const struct lp_ml_input *input = &operation->inputs[0];
+      struct lp_cs_tpool_task *task;
+
+      mtx_lock(&screen->cs_mutex);
+      task = lp_cs_tpool_queue_task(screen->cs_tpool, pad_input_row, &job,
+                                    input->dims[0] * input->dims[1]);
+      mtx_unlock(&screen->cs_mutex);
+      lp_cs_tpool_wait_for_task(screen->cs_tpool, &task);
+
+      func = operation->depthwise ? depthwise_convolution_row : convolution_row;
+      num_iters = rows;
+      break;
+   }
+   case PIPE_ML_OPERATION_TYPE_ADD:
+      func = add_chunk;
+      num_iters = DIV_ROUND_UP(tensor_size(operation->out_dims),
+                               LP_ML_CHUNK_SIZE);
+      break;
+   case PIPE_ML_OPERATION_TYPE_POOLING:
+      func = average_pool_row;
+      num_iters = rows;
+      break;
+   case PIPE_ML_OPERATION_TYPE_CONCATENATION:
+      func = concatenation_row;
+      num_iters = operation->outer_size;
+      break;
+   default:
+      UNREACHABLE("unsupported ML operation");
+   }
+
+   if (num_iters) {
+      struct lp_cs_tpool_task *task;
+
+      mtx_lock(&screen->cs_mutex);
+      task = lp_cs_tpool_queue_task(screen->cs_tpool, func, &job, num_iters);
+      mtx_unlock(&screen->cs_mutex);
+      lp_cs_tpool_wait_for_task(screen->cs_tpool, &task);
+   }
+}
+
+
+/*
+ * Graph compilation.
+ */
+
+/**
+ * Padding before the first element for the given output size, as
+ * ComputePaddingHeightWidth() in TensorFlow Lite does.
+ */
+static unsigned
+compute_padding(unsigned in_size, unsigned out_size, unsigned stride,
+                unsigned kernel_size, unsigned dilation, bool padding_same)
+{
+   const int effective_size = (kernel_size - 1) * dilation + 1;
+   const int total = (int)((out_size - 1) * stride) + effective_size -
+                     (int)in_size;
+
+   return padding_same ? MAX2(total, 0) / 2 : 0;
+}
+
+
+static unsigned
+compute_output_size(unsigned in_size, unsigned stride,
+                    unsigned kernel_size, unsigned dilation, bool padding_same)
+{
+   const unsigned effective_size = (kernel_size - 1) * dilation + 1;
+
+   if (padding_same)
+      return DIV_ROUND_UP(in_size, stride);
+
+   if (in_size < effective_size)
+      return 0;
+
+   return (in_size - effective_size + stride) / stride;
+}
+
+
+static bool
+per_tensor_quantization(const struct pipe_tensor *tensor)
+{
+   return tensor->scales == NULL && tensor->zero_points == NULL;
+}
+
+
+static bool
+same_dims(const struct pipe_tensor *a, const struct pipe_tensor *b)
+{
+   return memcmp(a->dims, b->dims, sizeof(a->dims)) == 0;
+}
+
+
+static int
+concatenation_axis(const struct pipe_ml_operation *poperation)
+{
+   /* Dimensions are aligned to the innermost one, so only axes counted from
+    * the end are unambiguous, plus the channel axis.
+    */
+   if (poperation->conc.axis < 0)
+      return poperation->conc.axis + 4;
+
+   return poperation->conc.axis == 3 ? 3 : -1;
+}
+
+
+static bool
+llvmpipe_ml_operation_supported(struct pipe_context *pcontext,
+                                const struct pipe_ml_operation *poperation)
+{
+   if (poperation->input_count < 1 || poperation->output_count != 1)
+      return false;
+
+   for (unsigned i = 0; i < poperation->input_count; i++) {
+      if (!per_tensor_quantization(poperation->input_tensors[i]))
+         return false;
+   }
+
+   const struct pipe_tensor *input = poperation->input_tensors[0];
+   const struct pipe_tensor *output = poperation->output_tensors[0];
+
+   if (!per_tensor_quantization(output) || output->dims[0] != input->dims[0])
+      return false;
+
+   switch (poperation->type) {
+   case PIPE_ML_OPERATION_TYPE_CONVOLUTION: {
+      const struct pipe_tensor *weights = poperation->conv.weight_tensor;
+      const struct pipe_tensor *biases = poperation->conv.bias_tensor;
+      const unsigned dilation_x = MAX2(poperation->conv.dilation_width_factor, 1);
+      const unsigned dilation_y = MAX2(poperation->conv.dilation_height_factor, 1);
+
+      if (!weights || !weights->resource || !biases || !biases->resource)
+         return false;
+
+      if (poperation->conv.depthwise) {
+         if (weights->dims[3] != output->dims[3] ||
+             output->dims[3] % input->dims[3] != 0)
+            return false;
+      } else {
+         if (weights->dims[0] != output->dims[3] ||
+             weights->dims[3] != input->dims[3])
+            return false;
+      }
+
+      if (!poperation->conv.stride_x || !poperation->conv.stride_y)
+         return false;
+
+      return output->dims[1] ==
+                compute_output_size(input->dims[1], poperation->conv.stride_y,
+                                    weights->dims[1], dilation_y,
+                                    poperation->conv.padding_same) &&
+             output->dims[2] ==
+                compute_output_size(input->dims[2], poperation->conv.stride_x,
+                                    weights->dims[2], dilation_x,
+                                    poperation->conv.padding_same);
+   }
+   case PIPE_ML_OPERATION_TYPE_ADD:
+      /* No broadcasting */
+      return poperation->input_count == 2 &&
+             same_dims(poperation->input_tensors[0], output) &&
+             same_dims(poperation->input_tensors[1], output);
+   case PIPE_ML_OPERATION_TYPE_POOLING:
+      if (!poperation->pooling.filter_width ||
+          !poperation->pooling.filter_height ||
+          !poperation->pooling.stride_x ||
+          !poperation->pooling.stride_y)
+         return false;
+
+      /* Average pooling doesn't requantize */
+      if (input->scale != output->scale ||
+          input->zero_point != output->zero_point ||
+          input->is_signed != output->is_signed ||
+          input->dims[3] != output->dims[3])
+         return false;
+
+      return output->dims[1] ==
+                compute_output_size(input->dims[1], poperation->pooling.stride_y,
+                                    poperation->pooling.filter_height, 1,
+                                    poperation->pooling.padding_same) &&
+             output->dims[2] ==
+                compute_output_size(input->dims[2], poperation->pooling.stride_x,
+                                    poperation->pooling.filter_width, 1,
+                                    poperation->pooling.padding_same);
+   case PIPE_ML_OPERATION_TYPE_CONCATENATION: {
+      const int axis = concatenation_axis(poperation);
+      unsigned axis_size = 0;
+
+      if (axis < 0)
+         return false;
+
+      for (unsigned i = 0; i < poperation->input_count; i++) {
+         const struct pipe_tensor *tensor = poperation->input_tensors[i];
+
+         for (int d = 0; d < 4; d++) {
+            if (d != axis && tensor->dims[d] != output->dims[d])
+               return false;
+         }
+         axis_size += tensor->dims[axis];
+      }
+
+      return axis_size == output->dims[axis];
+   }
+   default:
+      return false;
+   }
+}
+
+
+static bool
+create_tensor(struct lp_ml_subgraph *subgraph, const struct pipe_tensor *ptensor)
+{
+   struct lp_ml_tensor *tensor = get_tensor(subgraph, ptensor->index);
+   const unsigned size = tensor_size(ptensor->dims);
+
+   if (tensor->data) {
+      assert(tensor->size == size);
+      return true;
+   }
+
+   tensor->data = align_malloc(size, 64);
+   if (!tensor->data)
+      return false;
+   tensor->size = size;
+
+   /* Constant inputs */
+   if (ptensor->resource) {
+      struct pipe_context *pcontext = subgraph->base.context;
+      struct pipe_transfer *transfer;
+      const uint8_t *src = pipe_buffer_map(pcontext, ptensor->resource,
+                                           PIPE_MAP_READ, &transfer);
+      const uint8_t bias = tensor_bias(ptensor);
+
+      if (!src) {
+         align_free(tensor->data);
+         tensor->data = NULL;
+         return false;
+      }
+
+      for (unsigned i = 0; i < size; i++)
+         tensor->data[i] = src[i] ^ bias;
+
+      pipe_buffer_unmap(pcontext, transfer);
+   }
+
+   return true;
+}
+
+
+static void
+init_input(struct lp_ml_input *input, const struct pipe_tensor *ptensor)
+{
+   input->index = ptensor->index;
+   memcpy(input->dims, ptensor->dims, sizeof(input->dims));
+   input->offset = -(int32_t)tensor_bias(ptensor);
+}
+
+
+static bool
+compile_convolution(struct lp_ml_subgraph *subgraph,
+                    const struct pipe_ml_operation *poperation,
+                    struct lp_ml_operation *operation)
+{
+   struct pipe_context *pcontext = subgraph->base.context;
+   const struct pipe_tensor *input = poperation->input_tensors[0];
+   const struct pipe_tensor *output = poperation->output_tensors[0];
+   const struct pipe_tensor *wtensor = poperation->conv.weight_tensor;
+   const struct pipe_tensor *btensor = poperation->conv.bias_tensor;
+   const unsigned in_c = input->dims[3];
+   const unsigned out_c = output->dims[3];
+   struct pipe_transfer *transfer;
+
+   operation->kernel_h = wtensor->dims[1];
+   operation->kernel_w = wtensor->dims[2];
+   operation->stride_x = poperation->conv.stride_x;
+   operation->stride_y = poperation->conv.stride_y;
+   operation->dilation_x = MAX2(poperation->conv.dilation_width_factor, 1);
+   operation->dilation_y = MAX2(poperation->conv.dilation_height_factor, 1);
+   operation->depthwise = poperation->conv.depthwise;
+   operation->depth_multiplier = operation->depthwise ? out_c / in_c : 1;
+
+   operation->pad_y = compute_padding(input->dims[1], output->dims[1],
+                                      operation->stride_y, operation->kernel_h,
+                                      operation->dilation_y,
+                                      poperation->conv.padding_same);
+   operation->pad_x = compute_padding(input->dims[2], output->dims[2],
+                                      operation->stride_x, operation->kernel_w,
+                                      operation->dilation_x,
+                                      poperation->conv.padding_same);
+
+   /* Big enough for the windows of all output pixels, whatever side the
+    * padding falls on.
+    */
+   operation->padded_h =
+      MAX2(input->dims[1] + operation->pad_y,
+           (output->dims[1] - 1) * operation->stride_y +
+           (operation->kernel_h - 1) * operation->dilation_y + 1);
+   operation->padded_w =
+      MAX2(input->dims[2] + operation->pad_x,
+           (output->dims[2] - 1) * operation->stride_x +
+           (operation->kernel_w - 1) * operation->dilation_x + 1);
+   operation->padded = calloc((size_t)input->dims[0] * operation->padded_h *
+                              operation->padded_w * in_c,
+                              sizeof(*operation->padded));
+
+   const unsigned weight_count = tensor_size(wtensor->dims);
+   const unsigned per_channel = operation->depthwise ? 1 : weight_count / out_c;
+   operation->weights = malloc(weight_count * sizeof(*operation->weights));
+   operation->biases = malloc(out_c * sizeof(*operation->biases));
+   operation->multipliers = malloc(out_c * sizeof(*operation->multipliers));
+   operation->shifts = malloc(out_c * sizeof(*operation->shifts));
+
+   if (!operation->padded || !operation->weights || !operation->biases ||
+       !operation->multipliers || !operation->shifts)
+      return false;
+
+   const uint8_t *weights = pipe_buffer_map(pcontext, wtensor->resource,
+                                            PIPE_MAP_READ, &transfer);
+   if (!weights)
+      return false;
+
+   for (unsigned i = 0; i < weight_count; i++) {
+      /* OHWI, or 1HWO for depthwise */
+      const unsigned oc = operation->depthwise ? i % out_c : i / per_channel;
+      const int32_t zero_point = wtensor->zero_points ?
+                                 wtensor->zero_points[oc] :
+                                 wtensor->zero_point;
+      const int32_t value = wtensor->is_signed ? (int8_t)weights[i] :
+                                                 weights[i];
+
+      operation->weights[i] = value - zero_point;
+   }
+   pipe_buffer_unmap(pcontext, transfer);
+
+   const int32_t *biases = pipe_buffer_map(pcontext, btensor->resource,
+                                           PIPE_MAP_READ, &transfer);
+   if (!biases)
+      return false;
+
+   memcpy(operation->biases, biases, out_c * sizeof(*operation->biases));
+   pipe_buffer_unmap(pcontext, transfer);
+
+   for (unsigned oc = 0; oc < out_c; oc++) {
+      const float weight_scale = wtensor->scales ? wtensor->scales[oc] :
+                                                   wtensor->scale;
+      const double real_multiplier = (double)input->scale * weight_scale /
+                                     output->scale;
+
+      quantize_multiplier(real_multiplier, &operation->multipliers[oc],
+                          &operation->shifts[oc]);
+   }
+
+   if (poperation->conv.relu)
+      operation->output_min = MAX2(operation->output_zero_point, 0);
+
+   return true;
+}
+
+
+static void
+compile_add(const struct pipe_ml_operation *poperation,
+            struct lp_ml_operation *operation)
+{
+   const struct pipe_tensor *output = poperation->output_tensors[0];
+   const double twice_max_input_scale =
+      2.0 * MAX2((double)poperation->input_tensors[0]->scale,
+                 (double)poperation->input_tensors[1]->scale);
+
+   for (unsigned i = 0; i < 2; i++) {
+      const struct pipe_tensor *input = poperation->input_tensors[i];
+
+      /* Subtracts the zero point on the biased value */
+      operation->inputs[i].offset = -(int32_t)(input->zero_point +
+                                               tensor_bias(input));
+      quantize_multiplier(input->scale / twice_max_input_scale,
+                          &operation->input_multiplier[i],
+                          &operation->input_shift[i]);
+   }
+
+   quantize_multiplier(twice_max_input_scale /
+                       ((double)(1 << 20) * output->scale),
+                       &operation->output_multiplier,
+                       &operation->output_shift);
+}
+
+
+static void
+compile_pooling(const struct pipe_ml_operation *poperation,
+                struct lp_ml_operation *operation)
+{
+   const struct pipe_tensor *input = poperation->input_tensors[0];
+   const struct pipe_tensor *output = poperation->output_tensors[0];
+
+   operation->kernel_w = poperation->pooling.filter_width;
+   operation->kernel_h = poperation->pooling.filter_height;
+   operation->stride_x = poperation->pooling.stride_x;
+   operation->stride_y = poperation->pooling.stride_y;
+   operation->pad_y = compute_padding(input->dims[1], output->dims[1],
+                                      operation->stride_y, operation->kernel_h,
+                                      1, poperation->pooling.padding_same);
+   operation->pad_x = compute_padding(input->dims[2], output->dims[2],
+                                      operation->stride_x, operation->kernel_w,
+                                      1, poperation->pooling.padding_same);
+   operation->input_offset = -(int32_t)tensor_bias(input);
+}
+
+
+static void
+compile_concatenation(const struct pipe_ml_operation *poperation,
+                      struct lp_ml_operation *operation)
+{
+   const struct pipe_tensor *output = poperation->output_tensors[0];
+   const int axis = concatenation_axis(poperation);
+
+   operation->outer_size = 1;
+   for (int d = 0; d < axis; d++)
+      operation->outer_size *= output->dims[d];
+
+   for (unsigned i = 0; i < poperation->input_count; i++) {
+      const struct pipe_tensor *input = poperation->input_tensors[i];
+      struct lp_ml_input *linput = &operation->inputs[i];
+
+      linput->inner_size = 1;
+      for (int d = axis; d < 4; d++)
+         linput->inner_size *= input->dims[d];
+
+      /* As in the TensorFlow Lite reference kernel */
+      linput->requantize = input->scale != output->scale ||
+                           input->zero_point != output->zero_point ||
+                           input->is_signed != output->is_signed;
+      linput->scale = input->scale / output->scale;
+      linput->bias = -input->zero_point * linput->scale;
+   }
+}
+
+
+static void
+free_operation(struct lp_ml_operation *operation)
+{
+   free(operation->inputs);
+   free(operation->weights);
+   free(operation->biases);
+   free(operation->multipliers);
+   free(operation->shifts);
+   free(operation->padded);
+}
+
+
+static void
+llvmpipe_ml_subgraph_destroy(struct pipe_context *pcontext,
+                             struct pipe_ml_subgraph *psubgraph)
+{
+   struct lp_ml_subgraph *subgraph = (struct lp_ml_subgraph *)psubgraph;
+
+   util_dynarray_foreach(&subgraph->operations, struct lp_ml_operation, operation)
+      free_operation(operation);
+   util_dynarray_fini(&subgraph->operations);
+
+   util_dynarray_foreach(&subgraph->tensors, struct lp_ml_tensor, tensor)
+      align_free(tensor->data);
+   util_dynarray_fini(&subgraph->tensors);
+
+   free(subgraph);
+}
+
+
+static struct pipe_ml_subgraph *
+llvmpipe_ml_subgraph_create(struct pipe_context *pcontext,
+                            const struct pipe_ml_operation *poperations,
+                            unsigned count)
+{
+   struct lp_ml_subgraph *subgraph = calloc(1, sizeof(*subgraph));
+   unsigned tensor_count = 0;
+
+   if (!subgraph)
+      return NULL;
+
+   subgraph->base.context = pcontext;
+   util_dynarray_init(&subgraph->operations, NULL);
+   util_dynarray_init(&subgraph->tensors, NULL);
+
+   for (unsigned i = 0; i < count; i++) {
+      const struct pipe_ml_operation *poperation = &poperations[i];
+
+      for (unsigned j = 0; j < poperation->input_count; j++)
+         tensor_count = MAX2(tensor_count,
+                             poperation->input_tensors[j]->index + 1);
+      tensor_count = MAX2(tensor_count,
+                          poperation->output_tensors[0]->index + 1);
+   }
+
+   if (!util_dynarray_resize(&subgraph->tensors, struct lp_ml_tensor,
+                             tensor_count))
+      goto fail;
+   memset(util_dynarray_begin(&subgraph->tensors), 0, subgraph->tensors.size);
+
+   for (unsigned i = 0; i < count; i++) {
+      const struct pipe_ml_operation *poperation = &poperations[i];
+      const struct pipe_tensor *output = poperation->output_tensors[0];
+      struct lp_ml_operation *operation =
+         util_dynarray_grow(&subgraph->operations, struct lp_ml_operation, 1);
+
+      if (!operation)
+         goto fail;
+
+      memset(operation, 0, sizeof(*operation));
+      operation->type = poperation->type;
+      operation->input_count = poperation->input_count;
+      operation->inputs = calloc(poperation->input_count,
+                                 sizeof(*operation->inputs));
+      if (!operation->inputs)
+         goto fail;
+
+      for (unsigned j = 0; j < poperation->input_count; j++) {
+         init_input(&operation->inputs[j], poperation->input_tensors[j]);
+         if (!create_tensor(subgraph, poperation->input_tensors[j]))
+            goto fail;
+      }
+
+      operation->output_index = output->index;
+      memcpy(operation->out_dims, output->dims, sizeof(operation->out_dims));
+      if (!create_tensor(subgraph, output))
+         goto fail;
+
+      operation->input_zero_point = poperation->input_tensors[0]->zero_point +
+                                    tensor_bias(poperation->input_tensors[0]);
+      operation->output_zero_point = output->zero_point + tensor_bias(output);
+      operation->output_min = 0;
+      operation->output_max = 255;
+
+      switch (poperation->type) {
+      case PIPE_ML_OPERATION_TYPE_CONVOLUTION:
+         if (!compile_convolution(subgraph, poperation, operation))
+            goto fail;
+         break;
+      case PIPE_ML_OPERATION_TYPE_ADD:
+         compile_add(poperation, operation);
+         break;
+      case PIPE_ML_OPERATION_TYPE_POOLING:
+         compile_pooling(poperation, operation);
+         break;
+      case PIPE_ML_OPERATION_TYPE_CONCATENATION:
+         compile_concatenation(poperation, operation);
+         break;
+      default:
+         UNREACHABLE("unsupported ML operation");
+      }
+   }
+
+   return &subgraph->base;
+
+fail:
+   llvmpipe_ml_subgraph_destroy(pcontext, &subgraph->base);
+   return NULL;
+}
+
+
+static void
+llvmpipe_ml_subgraph_invoke(struct pipe_context *pcontext,
+                            struct pipe_ml_subgraph *psubgraph,
+                            unsigned inputs_count, unsigned input_idxs[],
+                            void *inputs[], bool is_signed[])
+{
+   struct lp_ml_subgraph *subgraph = (struct lp_ml_subgraph *)psubgraph;
+
+   for (unsigned i = 0; i < inputs_count; i++) {
+      struct lp_ml_tensor *tensor = get_tensor(subgraph, input_idxs[i]);
+      const uint8_t *src = inputs[i];
+      const uint8_t bias = is_signed[i] ? 0x80 : 0;
+
+      for (unsigned j = 0; j < tensor->size; j++)
+         tensor->data[j] = src[j] ^ bias;
+   }
+
+   util_dynarray_foreach(&subgraph->operations, struct lp_ml_operation, operation)
+      run_operation(subgraph, operation);
+}
+
+
+static void
+llvmpipe_ml_subgraph_read_output(struct pipe_context *pcontext,
+                                 struct pipe_ml_subgraph *psubgraph,
+                                 unsigned outputs_count,
+                                 unsigned output_idxs[], void *outputs[],
+                                 bool is_signed[])
+{
+   struct lp_ml_subgraph *subgraph = (struct lp_ml_subgraph *)psubgraph;
+
+   for (unsigned i = 0; i < outputs_count; i++) {
+      const struct lp_ml_tensor *tensor = get_tensor(subgraph, output_idxs[i]);
+      uint8_t *dst = outputs[i];
+      const uint8_t bias = is_signed[i] ? 0x80 : 0;
+
+      for (unsigned j = 0; j < tensor->size; j++)
+         dst[j] = tensor->data[j] ^ bias;
+   }
+}
+
+
+void
+llvmpipe_init_ml_funcs(struct llvmpipe_context *llvmpipe)
+{
+   llvmpipe->pipe.ml_operation_supported = llvmpipe_ml_operation_supported;
+   llvmpipe->pipe.ml_subgraph_create = llvmpipe_ml_subgraph_create;
+   llvmpipe->pipe.ml_subgraph_invoke = llvmpipe_ml_subgraph_invoke;
+   llvmpipe->pipe.ml_subgraph_read_output = llvmpipe_ml_subgraph_read_output;
+   llvmpipe->pipe.ml_subgraph_destroy = llvmpipe_ml_subgraph_destroy;
+}
@@ -44,6 +44,8 @@ struct lp_counters
    unsigned nr_culled_tris;
    unsigned nr_rects;
    unsigned nr_culled_rects;
+   unsigned nr_hiz_culled_tris;  /**< culled by depth bounds in every tile */
+   unsigned nr_hiz_culled_64;    /**< tiles skipped by depth bounds */
    unsigned nr_empty_64;
    unsigned nr_fully_covered_64;
    unsigned nr_partially_covered_64;
@@ -64,6 +66,8 @@ struct lp_counters
    unsigned nr_non_empty_4;
    unsigned nr_llvm_compiles;
    int64_t llvm_compile_time;  /**< total, in microseconds */
+   unsigned nr_fs_async_compiles;
+   unsigned nr_fs_fallback_draws;
 
    unsigned nr_color_tile_clear;
    unsigned nr_color_tile_load;
@@ -1,16 +1,74 @@
 #ifndef LP_PUBLIC_H
 #define LP_PUBLIC_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "compiler/shader_enums.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+struct pipe_context;
 struct pipe_screen;
 struct sw_winsys;
 
 struct pipe_screen *
 llvmpipe_create_screen(struct sw_winsys *winsys);
 
+/**
+ * Storage provided by a frontend for the object code of the variants of one
+ * shader, looked up before the disk cache.  Lavapipe uses it to keep the
+ * code in VkPipelineCache objects.
+ *
+ * The callbacks are called from the shader compiler threads too.
+ */
+struct lp_code_cache
+{
+   /** Returns a malloc'ed copy of the code stored under key, or NULL. */
+   void *(*find)(struct lp_code_cache *cache, const unsigned char key[20],
+                 size_t *size);
+
+   void (*insert)(struct lp_code_cache *cache, const unsigned char key[20],
+                  const void *data, size_t size);
+};
+
+/**
+ * Attach a code cache to a fragment, compute, task or mesh shader CSO,
+ * before it is first bound.  Other stages are compiled by the draw module
+ * and ignore it.
+ */
+void
+llvmpipe_shader_set_code_cache(struct pipe_context *pipe,
+                               mesa_shader_stage stage, void *cso,
+                               struct lp_code_cache *cache);
+
+/**
+ * The texture and sampler handles created on pipe are also used by shaders
+ * running on other contexts.  The sample functions compiled on demand for
+ * them are then no longer moved into the handles when pipe is flushed,
+ * since its fence doesn't cover the other contexts: the frontend calls
+ * llvmpipe_update_texture_handles() instead.
+ */
+void
+llvmpipe_share_texture_handles(struct pipe_context *pipe);
+
+/**
+ * Whether sample functions compiled on demand for the handles of pipe are
+ * waiting to be moved into them.  Shaders sampling through the handles are
+ * slower until then.
+ */
+bool
+llvmpipe_texture_handles_outdated(struct pipe_context *pipe);
+
+/**
+ * Move the sample functions compiled on demand into the handles of pipe.
+ * No context may be running shaders using the handles.
+ */
+void
+llvmpipe_update_texture_handles(struct pipe_context *pipe);
+
 #ifdef __cplusplus
 }
 #endif
@@ -67,25 +67,81 @@ const float lp_sample_pos_4x[4][2] = { { 0.375, 0.125 },
 
 /**
  * Begin rasterizing a scene.
- * Called once per scene by one thread.
+ * Called once per scene by one thread, with rast->mutex held.
+ * \return the sequence number of the scene
  */
-static void
+static unsigned
 lp_rast_begin(struct lp_rasterizer *rast,
               struct lp_scene *scene)
 {
-   rast->curr_scene = scene;
+   const unsigned seq = rast->num_begun++;
+   const unsigned slot = seq % LP_RAST_MAX_ACTIVE_SCENES;
 
-   LP_DBG(DEBUG_RAST, "%s\n", __func__);
+   LP_DBG(DEBUG_RAST, "%s %u\n", __func__, seq);
+
+   assert(seq - rast->num_retired < LP_RAST_MAX_ACTIVE_SCENES);
+   rast->active[slot].scene = scene;
+   rast->active[slot].threads_left = MAX2(1, rast->num_threads);
 
    lp_scene_begin_rasterization(scene);
-   lp_scene_bin_iter_begin(scene);
+   lp_scene_bin_iter_begin(scene, MAX2(1, rast->num_threads));
+
+   return seq;
 }
 
 
-static void
-lp_rast_end(struct lp_rasterizer *rast)
+/**
+ * Called by each thread when done with its part of a scene, with
+ * rast->mutex held.  The last thread retires the finished scenes at the
+ * head of the active list, in order, so that fences are signalled in
+ * submission order and waiting on rast->last_fence waits for everything.
+ * \return true if any scene was retired
+ */
+static bool
+lp_rast_end(struct lp_rasterizer *rast, unsigned seq)
 {
-   rast->curr_scene = NULL;
+   if (--rast->active[seq % LP_RAST_MAX_ACTIVE_SCENES].threads_left)
+      return false;
+
+   while (rast->num_retired != rast->num_begun) {
+      const unsigned slot = rast->num_retired % LP_RAST_MAX_ACTIVE_SCENES;
+      struct lp_scene *scene = rast->active[slot].scene;
+
+      if (rast->active[slot].threads_left)
+         break;
+
+      /* The scene may be recycled by setup as soon as its fence is
+       * signalled, so drop it first.
+       */
+      rast->active[slot].scene = NULL;
+      rast->num_retired++;
+
+      if (scene->fence)
+         lp_fence_signal(scene->fence);
+   }
+
+   return true;
+}
+
+
+/**
+ * Can't start on scene seq until all the earlier unfinished scenes it
+ * depends on are done.
+ */
+static bool
+lp_rast_scene_is_blocked(const struct lp_rasterizer *rast, unsigned seq)
+{
+   const struct lp_scene *scene =
+      rast->active[seq % LP_RAST_MAX_ACTIVE_SCENES].scene;
+
+   for (unsigned s = rast->num_retired; s != seq; s++) {
+      const unsigned slot = s % LP_RAST_MAX_ACTIVE_SCENES;
+      if (rast->active[slot].threads_left &&
+          lp_scene_depends_on(scene, rast->active[slot].scene))
+         return true;
+   }
+
+   return false;
 }
 
 
@@ -1060,14 +1116,23 @@ rasterize_scene(struct lp_rasterizer_task *task,
 
    if (!task->rast->no_rast) {
       /* loop over scene bins, rasterize each */
+      const bool counters = (LP_DEBUG & DEBUG_COUNTERS) != 0;
+      const int64_t start = counters ? os_time_get_nano() : 0;
       struct cmd_bin *bin;
+      bool stolen;
       int i, j;
 
       assert(scene);
-      while ((bin = lp_scene_bin_iter_next(scene, &i, &j))) {
+      while ((bin = lp_scene_bin_iter_next(scene, task->thread_index,
+                                           &i, &j, &stolen))) {
          if (!is_empty_bin(bin))
             rasterize_bin(task, bin, i, j);
+         task->nr_bins++;
+         task->nr_stolen_bins += stolen;
       }
+
+      if (counters)
+         task->busy_time += os_time_get_nano() - start;
    }
 
 #if LP_BUILD_FORMAT_CACHE_DEBUG
@@ -1084,10 +1149,6 @@ rasterize_scene(struct lp_rasterizer_task *task,
    }
 #endif
 
-   if (scene->fence) {
-      lp_fence_signal(scene->fence);
-   }
-
    task->scene = NULL;
 }
 
@@ -1114,15 +1175,13 @@ lp_rast_queue_scene(struct lp_rasterizer *rast,
        */
       util_fpstate_set_denorms_to_zero(fpstate);
 
-      lp_rast_begin(rast, scene);
+      unsigned seq = lp_rast_begin(rast, scene);
 
       rasterize_scene(&rast->tasks[0], scene);
 
-      lp_rast_end(rast);
+      lp_rast_end(rast, seq);
 
       util_fpstate_set(fpstate);
-
-      rast->curr_scene = NULL;
    } else {
       /* threaded rendering! */
       lp_scene_enqueue(rast->full_scenes, scene);
@@ -1169,6 +1228,10 @@ thread_function(void *init_data)
    snprintf(thread_name, sizeof thread_name, "llvmpipe-%u", task->thread_index);
    u_thread_setname(thread_name);
 
+   /* Do this before touching the per-thread data, see below. */
+   llvmpipe_bind_thread_to_L3(thrd_current(), task->thread_index,
+                              rast->num_threads);
+
    /* Make sure that denorms are treated like zeros. This is
     * the behavior required by D3D10. OpenGL doesn't care.
     */
@@ -1184,33 +1247,48 @@ thread_function(void *init_data)
       if (rast->exit_flag)
          break;
 
-      if (task->thread_index == 0) {
-         /* thread[0]:
-          *  - get next scene to rasterize
-          *  - map the framebuffer surfaces
-          */
-         lp_rast_begin(rast, lp_scene_dequeue(rast->full_scenes, true));
+      const unsigned seq = task->scene_seq++;
+      const int64_t start =
+         (LP_DEBUG & DEBUG_COUNTERS) ? os_time_get_nano() : 0;
+
+      mtx_lock(&rast->mutex);
+
+      /* The first thread to get here dequeues the scene and maps the
+       * framebuffer surfaces, once there's room for another active scene.
+       * The scene was queued before work_ready was signalled, so the
+       * dequeue doesn't block.
+       */
+      while (seq == rast->num_begun) {
+         if (seq - rast->num_retired < LP_RAST_MAX_ACTIVE_SCENES)
+            lp_rast_begin(rast, lp_scene_dequeue(rast->full_scenes, true));
+         else
+            cnd_wait(&rast->change, &rast->mutex);
       }
 
-      /* Wait for all threads to get here so that threads[1+] don't
-       * get a null rast->curr_scene pointer.
+      /* Threads done with the previous scene may start on this one while
+       * the others are still busy, unless it depends on it.
        */
-      util_barrier_wait(&rast->barrier);
+      while (lp_rast_scene_is_blocked(rast, seq))
+         cnd_wait(&rast->change, &rast->mutex);
+
+      struct lp_scene *scene =
+         rast->active[seq % LP_RAST_MAX_ACTIVE_SCENES].scene;
+
+      mtx_unlock(&rast->mutex);
+
+      if (LP_DEBUG & DEBUG_COUNTERS)
+         task->idle_time += os_time_get_nano() - start;
 
       /* do work */
       if (debug)
          debug_printf("thread %d doing work\n", task->thread_index);
 
-      rasterize_scene(task, rast->curr_scene);
-
-      /* wait for all threads to finish with this scene */
-      util_barrier_wait(&rast->barrier);
+      rasterize_scene(task, scene);
 
-      /* XXX: shouldn't be necessary:
-       */
-      if (task->thread_index == 0) {
-         lp_rast_end(rast);
-      }
+      mtx_lock(&rast->mutex);
+      if (lp_rast_end(rast, seq))
+         cnd_broadcast(&rast->change);
+      mtx_unlock(&rast->mutex);
 
       /* signal done with work */
       if (debug)
@@ -1271,6 +1349,9 @@ lp_rast_create(unsigned num_threads)
       struct lp_rasterizer_task *task = &rast->tasks[i];
       task->rast = rast;
       task->thread_index = i;
+      /* Not touched until the first scene is rasterized, so the pages are
+       * backed on the NUMA node the thread runs on.
+       */
       task->thread_data.cache =
          align_malloc(sizeof(struct lp_build_format_cache), 16);
       if (!task->thread_data.cache) {
@@ -1282,12 +1363,11 @@ lp_rast_create(unsigned num_threads)
 
    rast->no_rast = debug_get_bool_option("LP_NO_RAST", false);
 
-   create_rast_threads(rast);
-
    /* for synchronizing rasterization threads */
-   if (rast->num_threads > 0) {
-      util_barrier_init(&rast->barrier, rast->num_threads);
-   }
+   (void) mtx_init(&rast->mutex, mtx_plain);
+   cnd_init(&rast->change);
+
+   create_rast_threads(rast);
 
    memset(lp_dummy_tile, 0, sizeof lp_dummy_tile);
 
@@ -1340,6 +1420,16 @@ lp_rast_destroy(struct lp_rasterizer *rast)
 #endif
    }
 
+   if (LP_DEBUG & DEBUG_COUNTERS) {
+      for (unsigned i = 0; i < MAX2(1, rast->num_threads); i++) {
+         const struct lp_rasterizer_task *task = &rast->tasks[i];
+         debug_printf("llvmpipe: thread %u: bins %u, stolen %u, "
+                      "busy %.3f ms, waiting %.3f ms\n",
+                      i, task->nr_bins, task->nr_stolen_bins,
+                      task->busy_time / 1e6, task->idle_time / 1e6);
+      }
+   }
+
    /* Clean up per-thread data */
    for (unsigned i = 0; i < rast->num_threads; i++) {
       util_semaphore_destroy(&rast->tasks[i].work_ready);
@@ -1355,9 +1445,8 @@ lp_rast_destroy(struct lp_rasterizer *rast)
    lp_fence_reference(&rast->last_fence, NULL);
 
    /* for synchronizing rasterization threads */
-   if (rast->num_threads > 0) {
-      util_barrier_destroy(&rast->barrier);
-   }
+   cnd_destroy(&rast->change);
+   mtx_destroy(&rast->mutex);
 
    lp_scene_queue_destroy(rast->full_scenes);
 
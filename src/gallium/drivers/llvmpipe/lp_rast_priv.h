@@ -97,9 +97,18 @@ struct lp_rasterizer_task
    /** "my" index */
    unsigned thread_index;
 
+   /** Sequence number of the next scene this thread will work on */
+   unsigned scene_seq;
+
    /** Non-interpolated passthru state and occlude counter for visible pixels */
    struct lp_jit_thread_data thread_data;
 
+   /** Scheduler statistics, only gathered with LP_DEBUG=counters.
+    * idle_time is the time spent waiting for other scenes to finish.
+    */
+   int64_t busy_time, idle_time;
+   unsigned nr_bins, nr_stolen_bins;
+
    util_semaphore work_ready;
    util_semaphore work_done;
 #ifdef _WIN32
@@ -108,6 +117,13 @@ struct lp_rasterizer_task
 };
 
 
+/**
+ * Max number of scenes the rasterizer threads work on at once.  Must be a
+ * power of two.
+ */
+#define LP_RAST_MAX_ACTIVE_SCENES 8
+
+
 /**
  * This is the state required while rasterizing tiles.
  * Note that this contains per-thread information too.
@@ -121,8 +137,22 @@ struct lp_rasterizer
    /** The incoming queue of scenes ready to rasterize */
    struct lp_scene_queue *full_scenes;
 
-   /** The scene currently being rasterized by the threads */
-   struct lp_scene *curr_scene;
+   /**
+    * Scenes being rasterized, indexed by sequence number modulo
+    * LP_RAST_MAX_ACTIVE_SCENES.  Scenes are begun and retired in queue
+    * order, but a thread done with its part of a scene may start on the
+    * next one if it doesn't depend on the scenes still in progress.
+    * Protected by mutex.
+    */
+   struct {
+      struct lp_scene *scene;
+      unsigned threads_left;  /**< threads still working on the scene */
+   } active[LP_RAST_MAX_ACTIVE_SCENES];
+   unsigned num_begun;    /**< scenes dequeued from full_scenes */
+   unsigned num_retired;  /**< scenes finished and fenced */
+
+   mtx_t mutex;
+   cnd_t change;
 
    /** A task object for each rasterization thread */
    struct lp_rasterizer_task tasks[LP_MAX_THREADS];
@@ -130,9 +160,6 @@ struct lp_rasterizer
    unsigned num_threads;
    thrd_t threads[LP_MAX_THREADS];
 
-   /** For synchronizing the rasterization threads */
-   util_barrier barrier;
-
    struct lp_fence *last_fence;
 };
 
@@ -25,6 +25,7 @@
  *
  **************************************************************************/
 
+#include "util/u_atomic.h"
 #include "util/u_framebuffer.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
@@ -103,6 +104,7 @@ lp_scene_destroy(struct lp_scene *scene)
    lp_scene_end_rasterization(scene);
    mtx_destroy(&scene->mutex);
    free(scene->tiles);
+   free(scene->bin_order);
    assert(scene->data.head == &scene->data.first);
    slab_free_st(&scene->setup->scene_slab, scene);
 }
@@ -534,60 +536,213 @@ lp_scene_is_resource_referenced(const struct lp_scene *scene,
 }
 
 
-/** advance curr_x,y to the next bin */
 static bool
-next_bin(struct lp_scene *scene)
+scene_writes_referenced(const struct lp_scene *writer,
+                        const struct lp_scene *reader)
 {
-   scene->curr_x++;
-   if (scene->curr_x >= scene->tiles_x) {
-      scene->curr_x = 0;
-      scene->curr_y++;
+   for (unsigned i = 0; i < writer->fb.nr_cbufs; i++) {
+      const struct pipe_resource *texture = writer->fb.cbufs[i].texture;
+      if (texture && lp_scene_is_resource_referenced(reader, texture))
+         return true;
    }
-   if (scene->curr_y >= scene->tiles_y) {
-      /* no more bins */
-      return false;
+
+   if (writer->fb.zsbuf.texture &&
+       lp_scene_is_resource_referenced(reader, writer->fb.zsbuf.texture))
+      return true;
+
+   for (const struct resource_ref *ref = writer->writeable_resources; ref;
+        ref = ref->next) {
+      for (int i = 0; i < ref->count; i++)
+         if (lp_scene_is_resource_referenced(reader, ref->resource[i]))
+            return true;
    }
-   return true;
+
+   return false;
 }
 
 
-void
-lp_scene_bin_iter_begin(struct lp_scene *scene)
+/**
+ * Must the earlier scene prev be finished before the rasterization of
+ * scene can start?  That's the case if either writes a resource the other
+ * one references, which includes rendering to the same surfaces, or if
+ * they come from the same context and use queries, whose per-thread
+ * counters are shared between its scenes.
+ */
+bool
+lp_scene_depends_on(const struct lp_scene *scene,
+                    const struct lp_scene *prev)
 {
-   scene->curr_x = scene->curr_y = -1;
+   if (scene->setup == prev->setup &&
+       (scene->had_queries || prev->had_queries))
+      return true;
+
+   return scene_writes_referenced(prev, scene) ||
+          scene_writes_referenced(scene, prev);
 }
 
 
+/*
+ * Bins are handed out to the rasterizer threads by a lock-free
+ * work-stealing scheduler.  lp_scene_bin_iter_begin() sorts the non-empty
+ * bins by their number of commands, most expensive first, and deals them
+ * out round-robin into one contiguous range of bin_order per thread.
+ * Each thread takes bins from the front of its own range and, once that
+ * is empty, steals from the back of the other threads' ranges, where the
+ * cheapest bins are.
+ */
+#define LP_BIN_RANGE(begin, end) (((uint64_t)(end) << 32) | (begin))
+#define LP_BIN_COST_BUCKETS 32
+
+
 /**
- * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
- * Multiple rendering threads will call this function to get a chunk
- * of work (a bin) to work on.
+ * The number of commands in a bin, as counted by lp_characterize_bin(),
+ * but without looking at every command.
  */
-struct cmd_bin *
-lp_scene_bin_iter_next(struct lp_scene *scene , int *x, int *y)
+static unsigned
+bin_cost(const struct cmd_bin *bin)
 {
-   struct cmd_bin *bin = NULL;
+   unsigned count = 0;
 
-   mtx_lock(&scene->mutex);
+   for (const struct cmd_block *block = bin->head; block; block = block->next)
+      count += block->count;
+
+   return count;
+}
+
+
+/**
+ * Prepare the bin schedule for rasterization by num_threads threads.
+ * Called by one thread before any thread calls lp_scene_bin_iter_next().
+ */
+void
+lp_scene_bin_iter_begin(struct lp_scene *scene, unsigned num_threads)
+{
+   const unsigned num_bins = lp_scene_get_num_bins(scene);
+   unsigned *packed = scene->bin_order;
+   unsigned *sorted = scene->bin_order + scene->num_alloced_tiles;
+   unsigned bucket_start[LP_BIN_COST_BUCKETS] = { 0 };
+   unsigned num_active = 0;
+
+   assert(num_threads >= 1 && num_threads <= LP_MAX_THREADS);
+   assert(num_bins < (1 << 24));
+
+   /* Find the non-empty bins and histogram them by log2 of their cost,
+    * which is all the ordering precision the scheduler needs.
+    */
+   for (unsigned i = 0; i < num_bins; i++) {
+      const struct cmd_bin *bin = &scene->tiles[i];
+      if (!bin->head)
+         continue;
+
+      unsigned bucket = util_logbase2(MAX2(bin_cost(bin), 1));
+      packed[num_active++] = (bucket << 24) | i;
+      bucket_start[bucket]++;
+   }
 
-   if (scene->curr_x < 0) {
-      /* first bin */
-      scene->curr_x = 0;
-      scene->curr_y = 0;
-   } else if (!next_bin(scene)) {
-      /* no more bins left */
-      goto end;
+   /* Counting sort, most expensive bucket first. */
+   unsigned offset = 0;
+   for (int b = LP_BIN_COST_BUCKETS - 1; b >= 0; b--) {
+      unsigned count = bucket_start[b];
+      bucket_start[b] = offset;
+      offset += count;
    }
 
-   bin = lp_scene_get_bin(scene, scene->curr_x, scene->curr_y);
-   *x = scene->curr_x;
-   *y = scene->curr_y;
+   for (unsigned k = 0; k < num_active; k++) {
+      unsigned bucket = packed[k] >> 24;
+      sorted[bucket_start[bucket]++] = packed[k] & 0xffffff;
+   }
 
-end:
-   /*printf("return bin %p at %d, %d\n", (void *) bin, *bin_x, *bin_y);*/
-   mtx_unlock(&scene->mutex);
-   return bin;
+   /* Deal the sorted bins out to the threads. */
+   unsigned start[LP_MAX_THREADS];
+   offset = 0;
+   for (unsigned t = 0; t < num_threads; t++) {
+      unsigned count = t < num_active ?
+         (num_active - t + num_threads - 1) / num_threads : 0;
+      start[t] = offset;
+      scene->bin_ranges[t].range = LP_BIN_RANGE(offset, offset + count);
+      offset += count;
+   }
+
+   for (unsigned k = 0; k < num_active; k++)
+      scene->bin_order[start[k % num_threads] + k / num_threads] = sorted[k];
+
+   scene->num_bin_ranges = num_threads;
+}
+
+
+static bool
+bin_range_pop_front(uint64_t *range, unsigned *index)
+{
+   uint64_t old = p_atomic_read(range);
+
+   for (;;) {
+      const uint32_t begin = (uint32_t)old, end = (uint32_t)(old >> 32);
+      if (begin >= end)
+         return false;
+
+      uint64_t prev = p_atomic_cmpxchg(range, old, LP_BIN_RANGE(begin + 1, end));
+      if (prev == old) {
+         *index = begin;
+         return true;
+      }
+      old = prev;
+   }
+}
+
+
+static bool
+bin_range_pop_back(uint64_t *range, unsigned *index)
+{
+   uint64_t old = p_atomic_read(range);
+
+   for (;;) {
+      const uint32_t begin = (uint32_t)old, end = (uint32_t)(old >> 32);
+      if (begin >= end)
+         return false;
+
+      uint64_t prev = p_atomic_cmpxchg(range, old, LP_BIN_RANGE(begin, end - 1));
+      if (prev == old) {
+         *index = end - 1;
+         return true;
+      }
+      old = prev;
+   }
+}
+
+
+/**
+ * Return pointer to next bin to be rendered by the given thread, or NULL
+ * when all the bins of the scene have been handed out.
+ * Empty bins are never returned.
+ * \param stolen  set if the bin was taken from another thread's range
+ */
+struct cmd_bin *
+lp_scene_bin_iter_next(struct lp_scene *scene, unsigned thread_index,
+                       int *x, int *y, bool *stolen)
+{
+   const unsigned num_ranges = scene->num_bin_ranges;
+   unsigned index;
+
+   assert(thread_index < num_ranges);
+
+   *stolen = false;
+   if (!bin_range_pop_front(&scene->bin_ranges[thread_index].range, &index)) {
+      unsigned i;
+      for (i = 1; i < num_ranges; i++) {
+         unsigned victim = (thread_index + i) % num_ranges;
+         if (bin_range_pop_back(&scene->bin_ranges[victim].range, &index))
+            break;
+      }
+      if (i == num_ranges)
+         return NULL;
+      *stolen = true;
+   }
+
+   const unsigned bin_index = scene->bin_order[index];
+   *x = bin_index % scene->tiles_x;
+   *y = bin_index / scene->tiles_x;
+
+   return &scene->tiles[bin_index];
 }
 
 
@@ -610,6 +765,12 @@ lp_scene_begin_binning(struct lp_scene *scene,
                                   sizeof(struct cmd_bin));
       if (!scene->tiles)
          return;
+      /* second half is scratch space for lp_scene_bin_iter_begin() */
+      scene->bin_order = reallocarray(scene->bin_order,
+                                      2 * num_required_tiles,
+                                      sizeof(unsigned));
+      if (!scene->bin_order)
+         return;
       memset(scene->tiles, 0, sizeof(struct cmd_bin) * num_required_tiles);
       scene->num_alloced_tiles = num_required_tiles;
    }
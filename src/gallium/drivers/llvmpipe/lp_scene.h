@@ -35,6 +35,7 @@
 #ifndef LP_SCENE_H
 #define LP_SCENE_H
 
+#include "util/u_memory.h"
 #include "util/u_thread.h"
 #include "lp_rast.h"
 #include "lp_debug.h"
@@ -197,9 +198,17 @@ struct lp_scene {
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
    mtx_t mutex;
 
+   /**
+    * Bin scheduling for the rasterizer threads, see
+    * lp_scene_bin_iter_begin().  Each thread owns the range [begin, end)
+    * of bin_order, packed into 64 bits so it can be updated atomically.
+    */
+   unsigned num_bin_ranges;
+   EXCLUSIVE_CACHELINE(uint64_t range) bin_ranges[LP_MAX_THREADS];
+   unsigned *bin_order;    /**< bin indices, twice num_alloced_tiles */
+
    unsigned num_alloced_tiles;
    struct cmd_bin *tiles;
    struct data_block_list data;
@@ -225,6 +234,9 @@ bool lp_scene_add_resource_reference(struct lp_scene *scene,
                                      bool initializing_scene,
                                      bool writeable);
 
+bool lp_scene_depends_on(const struct lp_scene *scene,
+                         const struct lp_scene *prev);
+
 unsigned lp_scene_is_resource_referenced(const struct lp_scene *scene,
                                          const struct pipe_resource *resource);
 
@@ -398,10 +410,11 @@ lp_scene_get_num_bins(const struct lp_scene *scene)
 
 
 void
-lp_scene_bin_iter_begin(struct lp_scene *scene);
+lp_scene_bin_iter_begin(struct lp_scene *scene, unsigned num_threads);
 
 struct cmd_bin *
-lp_scene_bin_iter_next(struct lp_scene *scene, int *x, int *y);
+lp_scene_bin_iter_next(struct lp_scene *scene, unsigned thread_index,
+                       int *x, int *y, bool *stolen);
 
 
 
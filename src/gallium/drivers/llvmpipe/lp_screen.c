@@ -101,6 +101,7 @@ static const struct debug_named_value lp_perf_flags[] = {
    { "no_alphatest",   PERF_NO_ALPHATEST, NULL },
    { "no_rast_linear", PERF_NO_RAST_LINEAR, NULL },
    { "no_shade",       PERF_NO_SHADE, NULL },
+   { "no_hiz",         PERF_NO_HIZ, NULL },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -724,9 +725,15 @@ llvmpipe_destroy_screen(struct pipe_screen *_screen)
 {
    struct llvmpipe_screen *screen = llvmpipe_screen(_screen);
 
+   if (screen->async_fs)
+      util_queue_destroy(&screen->fs_compile_queue);
+
    if (screen->cs_tpool)
       lp_cs_tpool_destroy(screen->cs_tpool);
 
+   if (screen->draw_vs_threads)
+      util_queue_destroy(&screen->draw_vs_queue);
+
    if (screen->rast)
       lp_rast_destroy(screen->rast);
 
@@ -821,13 +828,20 @@ lp_disk_cache_create(struct llvmpipe_screen *screen)
    char cache_id[20 * 2 + 1];
    _mesa_sha1_init(&ctx);
 
-   if (!disk_cache_get_function_identifier(lp_disk_cache_create, &ctx) ||
-       !disk_cache_get_function_identifier(LLVMLinkInMCJIT, &ctx))
-      return;
+   bool have_id =
+      disk_cache_get_function_identifier(lp_disk_cache_create, &ctx) &&
+      disk_cache_get_function_identifier(LLVMLinkInMCJIT, &ctx);
 
    _mesa_sha1_update(&ctx, &gallivm_perf, sizeof(gallivm_perf));
    update_cache_sha1_cpu(&ctx);
    _mesa_sha1_final(&ctx, sha1);
+
+   /* Code handed to frontends must not be loaded on another CPU either. */
+   memcpy(screen->code_cache_id, sha1, sizeof(screen->code_cache_id));
+
+   if (!have_id)
+      return;
+
    mesa_bytes_to_hex(cache_id, sha1, 20);
 
    screen->disk_shader_cache = disk_cache_create("llvmpipe", cache_id, 0);
@@ -879,6 +893,33 @@ lp_disk_cache_find_shader(struct llvmpipe_screen *screen,
 }
 
 
+DEBUG_GET_ONCE_BOOL_OPTION(lp_thread_affinity, "LP_THREAD_AFFINITY", true)
+
+
+/**
+ * Restrict one thread of a pool of num_threads to the CPUs sharing an L3
+ * cache, which on multi-socket and chiplet machines is also the NUMA
+ * domain.  Consecutive thread indices are placed in the same domain, so
+ * that threads that steal work from their neighbours touch the same
+ * caches and memory, and per-thread data allocated lazily by the thread
+ * ends up on its local node.
+ */
+void
+llvmpipe_bind_thread_to_L3(thrd_t thread, unsigned thread_index,
+                           unsigned num_threads)
+{
+   const struct util_cpu_caps_t *caps = util_get_cpu_caps();
+
+   if (caps->num_L3_caches <= 1 || !caps->L3_affinity_mask ||
+       !debug_get_option_lp_thread_affinity())
+      return;
+
+   unsigned L3 = thread_index * caps->num_L3_caches / num_threads;
+   util_set_thread_affinity(thread, caps->L3_affinity_mask[L3], NULL,
+                            caps->num_cpu_mask_bits);
+}
+
+
 void
 lp_disk_cache_insert_shader(struct llvmpipe_screen *screen,
                             struct lp_cached_code *cache,
@@ -895,6 +936,104 @@ lp_disk_cache_insert_shader(struct llvmpipe_screen *screen,
 }
 
 
+static void
+lp_code_cache_key(struct llvmpipe_screen *screen,
+                  const unsigned char ir_sha1_cache_key[20],
+                  unsigned char key[20])
+{
+   struct mesa_sha1 ctx;
+   _mesa_sha1_init(&ctx);
+   _mesa_sha1_update(&ctx, screen->code_cache_id,
+                     sizeof(screen->code_cache_id));
+   _mesa_sha1_update(&ctx, ir_sha1_cache_key, 20);
+   _mesa_sha1_final(&ctx, key);
+}
+
+
+/**
+ * Look up the code of a shader variant stored with
+ * lp_disk_cache_insert_variant(), first in the frontend's code cache of the
+ * shader, if any, then in the disk cache.  On success the header is
+ * returned separately and cache only holds the object code.
+ */
+bool
+lp_disk_cache_find_variant(struct llvmpipe_screen *screen,
+                           struct lp_code_cache *code_cache,
+                           struct lp_cached_code *cache,
+                           unsigned char ir_sha1_cache_key[20],
+                           struct lp_variant_cache_header *header)
+{
+   unsigned char key[20];
+
+   if (code_cache)
+      lp_code_cache_key(screen, ir_sha1_cache_key, key);
+
+   cache->data_size = 0;
+   if (code_cache) {
+      size_t size;
+      void *data = code_cache->find(code_cache, key, &size);
+      if (data) {
+         cache->data = data;
+         cache->data_size = size;
+      }
+   }
+
+   if (!cache->data_size) {
+      lp_disk_cache_find_shader(screen, cache, ir_sha1_cache_key);
+
+      /* Let the frontend carry code found on disk along too. */
+      if (cache->data_size && code_cache)
+         code_cache->insert(code_cache, key, cache->data, cache->data_size);
+   }
+
+   if (!cache->data_size)
+      return false;
+
+   if (cache->data_size <= sizeof(*header)) {
+      free(cache->data);
+      cache->data = NULL;
+      cache->data_size = 0;
+      return false;
+   }
+
+   memcpy(header, cache->data, sizeof(*header));
+   cache->data_size -= sizeof(*header);
+   memmove(cache->data, (uint8_t *)cache->data + sizeof(*header),
+           cache->data_size);
+   return true;
+}
+
+
+void
+lp_disk_cache_insert_variant(struct llvmpipe_screen *screen,
+                             struct lp_code_cache *code_cache,
+                             struct lp_cached_code *cache,
+                             unsigned char ir_sha1_cache_key[20],
+                             const struct lp_variant_cache_header *header)
+{
+   if ((!screen->disk_shader_cache && !code_cache) ||
+       !cache->data_size || cache->dont_cache)
+      return;
+
+   struct lp_cached_code blob = *cache;
+   blob.data_size = sizeof(*header) + cache->data_size;
+   blob.data = malloc(blob.data_size);
+   if (!blob.data)
+      return;
+
+   memcpy(blob.data, header, sizeof(*header));
+   memcpy((uint8_t *)blob.data + sizeof(*header), cache->data,
+          cache->data_size);
+   if (code_cache) {
+      unsigned char key[20];
+      lp_code_cache_key(screen, ir_sha1_cache_key, key);
+      code_cache->insert(code_cache, key, blob.data, blob.data_size);
+   }
+   lp_disk_cache_insert_shader(screen, &blob, ir_sha1_cache_key);
+   free(blob.data);
+}
+
+
 bool
 llvmpipe_screen_late_init(struct llvmpipe_screen *screen)
 {
@@ -917,6 +1056,17 @@ llvmpipe_screen_late_init(struct llvmpipe_screen *screen)
       goto out;
    }
 
+   /* Without the threads, draws shade their vertices on the draw thread */
+   unsigned num_draw_threads =
+      debug_get_num_option("DRAW_NUM_THREADS",
+                           MIN2(util_get_cpu_caps()->nr_cpus, 8));
+   if (num_draw_threads > 1) {
+      screen->draw_vs_threads =
+         util_queue_init(&screen->draw_vs_queue, "draw_vs", 64,
+                         MIN2(num_draw_threads, LP_MAX_THREADS),
+                         UTIL_QUEUE_INIT_RESIZE_IF_FULL, NULL);
+   }
+
    if (!lp_jit_screen_init(screen)) {
       ret = false;
       goto out;
@@ -983,6 +1133,16 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
                                               screen->num_threads);
    screen->num_threads = MIN2(screen->num_threads, LP_MAX_THREADS);
 
+   unsigned num_compile_threads = debug_get_num_option("LP_ASYNC_FS", 0);
+   if (num_compile_threads) {
+      screen->async_fs =
+         util_queue_init(&screen->fs_compile_queue, "lpfs", 64,
+                         MIN2(num_compile_threads, LP_MAX_THREADS),
+                         UTIL_QUEUE_INIT_RESIZE_IF_FULL |
+                         UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY |
+                         UTIL_QUEUE_INIT_SET_FULL_THREAD_AFFINITY, NULL);
+   }
+
    for (unsigned i = 0; i < MESA_SHADER_MESH_STAGES; i++)
       screen->base.nir_options[i] = &gallivm_nir_options;
 
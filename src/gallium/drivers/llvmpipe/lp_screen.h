@@ -37,6 +37,7 @@
 #include "pipe/p_screen.h"
 #include "pipe/p_defines.h"
 #include "util/u_thread.h"
+#include "util/u_queue.h"
 #include "util/list.h"
 #include "util/vma.h"
 #include "gallivm/lp_bld.h"
@@ -63,15 +64,27 @@ struct llvmpipe_screen
    struct lp_cs_tpool *cs_tpool;
    mtx_t cs_mutex;
 
+   /* Vertex shading of large draws, shared by the draw modules of all
+    * contexts, see DRAW_NUM_THREADS
+    */
+   bool draw_vs_threads;
+   struct util_queue draw_vs_queue;
+
    mtx_t late_mutex;
    bool late_init_done;
 
+   /* Background fragment shader compilation, see LP_ASYNC_FS */
+   bool async_fs;
+   struct util_queue fs_compile_queue;
+
    mtx_t ctx_mutex;
    struct list_head ctx_list;
 
    char renderer_string[100];
 
    struct disk_cache *disk_shader_cache;
+   /** Identifies the CPU and build in the keys given to lp_code_cache */
+   unsigned char code_cache_id[20];
 
 #if defined(HAVE_LIBDRM) && defined(HAVE_LINUX_UDMABUF_H)
    int udmabuf_fd;
@@ -100,9 +113,42 @@ lp_disk_cache_insert_shader(struct llvmpipe_screen *screen,
                             struct lp_cached_code *cache,
                             unsigned char ir_sha1_cache_key[20]);
 
+
+/**
+ * Stored in front of the object code of shader variants, so that they can
+ * be loaded from the disk cache without building their LLVM IR first.
+ */
+struct lp_variant_cache_header
+{
+   uint32_t nr_instrs;
+   uint32_t functions;  /**< bitmask of the functions present in the code */
+};
+
+
+struct lp_code_cache;
+
+bool
+lp_disk_cache_find_variant(struct llvmpipe_screen *screen,
+                           struct lp_code_cache *code_cache,
+                           struct lp_cached_code *cache,
+                           unsigned char ir_sha1_cache_key[20],
+                           struct lp_variant_cache_header *header);
+
+
+void
+lp_disk_cache_insert_variant(struct llvmpipe_screen *screen,
+                             struct lp_code_cache *code_cache,
+                             struct lp_cached_code *cache,
+                             unsigned char ir_sha1_cache_key[20],
+                             const struct lp_variant_cache_header *header);
+
 bool
 llvmpipe_screen_late_init(struct llvmpipe_screen *screen);
 
+void
+llvmpipe_bind_thread_to_L3(thrd_t thread, unsigned thread_index,
+                           unsigned num_threads);
+
 
 static inline struct llvmpipe_screen *
 llvmpipe_screen(struct pipe_screen *pipe)
@@ -56,6 +56,7 @@
 #include "lp_state.h"
 #include "lp_jit.h"
 #include "frontend/sw_winsys.h"
+#include "nir.h"
 
 #include "draw/draw_context.h"
 #include "draw/draw_vbuf.h"
@@ -219,6 +220,115 @@ lp_setup_rasterize_scene(struct lp_setup_context *setup)
 }
 
 
+static void
+hiz_fill(struct lp_setup_context *setup, float zmin, float zmax)
+{
+   const unsigned num_tiles = setup->scene->tiles_x * setup->scene->tiles_y;
+
+   for (unsigned i = 0; i < num_tiles; i++) {
+      setup->hiz.bounds[i][0] = zmin;
+      setup->hiz.bounds[i][1] = zmax;
+   }
+}
+
+
+/**
+ * Start tracking the depth bounds of the zsbuf tiles for a new scene.
+ * Nothing is known about the zsbuf contents unless the scene starts with
+ * a depth clear.
+ */
+static void
+begin_hiz(struct lp_setup_context *setup)
+{
+   struct lp_scene *scene = setup->scene;
+
+   setup->hiz.enabled = false;
+
+   /* Tiles are shared by all layers, and binning doesn't know which
+    * layers a triangle ends up in.
+    */
+   if (!setup->fb.zsbuf.texture ||
+       scene->fb_max_layer != 0 ||
+       (LP_PERF & PERF_NO_HIZ))
+      return;
+
+   const struct util_format_description *desc =
+      util_format_description(setup->fb.zsbuf.format);
+   if (!util_format_has_depth(desc))
+      return;
+
+   const unsigned num_tiles = scene->tiles_x * scene->tiles_y;
+   if (num_tiles > setup->hiz.size) {
+      FREE(setup->hiz.bounds);
+      setup->hiz.bounds = MALLOC(num_tiles * sizeof(*setup->hiz.bounds));
+      setup->hiz.size = setup->hiz.bounds ? num_tiles : 0;
+      if (!setup->hiz.bounds)
+         return;
+   }
+
+   if (setup->clear.flags & PIPE_CLEAR_DEPTH)
+      hiz_fill(setup, setup->clear.depth, setup->clear.depth);
+   else
+      hiz_fill(setup, -INFINITY, INFINITY);
+
+   /* Depth values closer than this may compare equal once converted to a
+    * unorm zsbuf format.
+    */
+   const struct util_format_channel_description *chan =
+      &desc->channel[desc->swizzle[0]];
+   if (chan->type == UTIL_FORMAT_TYPE_FLOAT)
+      setup->hiz.margin = 0.0f;
+   else
+      setup->hiz.margin = 1.0f / (float)((1ull << chan->size) - 1);
+
+   setup->hiz.tiles_x = scene->tiles_x;
+   setup->hiz.enabled = true;
+}
+
+
+/**
+ * Derive from the current fragment shader variant how triangles interact
+ * with the tile depth bounds.
+ */
+static void
+update_hiz_state(struct lp_setup_context *setup)
+{
+   const struct lp_fragment_shader_variant *variant =
+      setup->fs.current.variant;
+
+   setup->hiz.cull = false;
+   setup->hiz.write = false;
+
+   if (!setup->hiz.enabled || !variant || !variant->key.depth.enabled)
+      return;
+
+   const struct lp_fragment_shader_variant_key *key = &variant->key;
+   const struct shader_info *info = &variant->shader->base.ir.nir->info;
+   const bool writes_z =
+      !!(info->outputs_written & BITFIELD64_BIT(FRAG_RESULT_DEPTH));
+   const bool may_kill =
+      key->stencil[0].enabled ||
+      key->alpha.enabled ||
+      key->blend.alpha_to_coverage ||
+      key->multisample ||
+      info->fs.uses_discard ||
+      (info->outputs_written & BITFIELD64_BIT(FRAG_RESULT_SAMPLE_MASK));
+
+   /* Culling skips the shader and the stencil update of fragments failing
+    * the depth test, so there must be no other side effect.
+    */
+   setup->hiz.cull = !writes_z &&
+                     !key->stencil[0].enabled &&
+                     !info->writes_memory;
+   setup->hiz.write = key->depth.writemask;
+   setup->hiz.bounded_write = !writes_z;
+   setup->hiz.full_write = !may_kill;
+   setup->hiz.func = key->depth.func;
+   setup->hiz.depth_clamp = key->depth_clamp;
+   setup->hiz.restrict_depth = key->restrict_depth_values;
+}
+
+
 static bool
 begin_binning(struct lp_setup_context *setup)
 {
@@ -227,12 +337,15 @@ begin_binning(struct lp_setup_context *setup)
    assert(scene);
    assert(scene->fence == NULL);
 
-   /* Always create a fence:
+   /* Always create a fence.  It is signalled once, by the rasterizer
+    * thread that retires the scene.
     */
-   scene->fence = lp_fence_create(MAX2(1, setup->num_threads));
+   scene->fence = lp_fence_create(1);
    if (!scene->fence)
       return false;
 
+   begin_hiz(setup);
+
    if (!try_update_scene_state(setup)) {
       return false;
    }
@@ -516,6 +629,9 @@ lp_setup_try_clear_zs(struct lp_setup_context *setup,
                                    LP_RAST_OP_CLEAR_ZSTENCIL,
                                    lp_rast_arg_clearzs(zsvalue, zsmask)))
          return false;
+
+      if ((flags & PIPE_CLEAR_DEPTH) && setup->hiz.enabled)
+         hiz_fill(setup, depth, depth);
    } else {
       /* Put ourselves into the 'pre-clear' state, specifically to try
        * and accumulate multiple clears to color and depth_stencil
@@ -529,6 +645,8 @@ lp_setup_try_clear_zs(struct lp_setup_context *setup,
       setup->clear.zsmask |= zsmask;
       setup->clear.zsvalue =
          (setup->clear.zsvalue & ~zsmask) | (zsvalue & zsmask);
+      if (flags & PIPE_CLEAR_DEPTH)
+         setup->clear.depth = depth;
    }
 
    return true;
@@ -1190,6 +1308,8 @@ try_update_scene_state(struct lp_setup_context *setup)
       }
    }
 
+   update_hiz_state(setup);
+
    setup->dirty = 0;
 
    assert(setup->fs.stored);
@@ -1314,6 +1434,8 @@ lp_setup_destroy(struct lp_setup_context *setup)
    LP_DBG(DEBUG_SETUP, "number of scenes used: %d\n", setup->num_active_scenes);
    slab_destroy(&setup->scene_slab);
 
+   FREE(setup->hiz.bounds);
+
    FREE(setup);
 }
 
@@ -131,8 +131,30 @@ struct lp_setup_context
       union util_color color_val[PIPE_MAX_COLOR_BUFS];
       uint64_t zsmask;
       uint64_t zsvalue;               /**< lp_rast_clear_zstencil() cmd */
+      float depth;                    /**< unpacked depth of zsvalue */
    } clear;
 
+   /**
+    * Conservative bounds of the depth values in each tile of the zsbuf,
+    * maintained while binning.  A triangle which can't pass the depth test
+    * against those bounds anywhere in a tile isn't binned there.  Bounds
+    * are of the values before conversion to the zsbuf format.
+    */
+   struct {
+      bool enabled;          /**< tracking possible for this scene */
+      bool cull;             /**< current state allows culling */
+      bool write;            /**< current state writes depth */
+      bool bounded_write;    /**< written depth is the interpolated z */
+      bool full_write;       /**< covered pixels are always written */
+      bool depth_clamp;
+      bool restrict_depth;
+      unsigned func;         /**< PIPE_FUNC_x */
+      float margin;          /**< zsbuf format precision */
+      unsigned tiles_x;
+      unsigned size;         /**< allocated number of tiles */
+      float (*bounds)[2];    /**< per tile {zmin, zmax} */
+   } hiz;
+
    enum setup_state {
       SETUP_FLUSHED,    /**< scene is null */
       SETUP_CLEARED,    /**< scene exists but has only clears */
@@ -43,6 +43,7 @@ altivec.h inclusion in -std=c++98..11 causes bool to be redefined
 #endif
 
 #include <stdbool.h>
+#include <math.h>
 
 #include "util/u_math.h"
 #include "util/u_memory.h"
@@ -777,6 +778,153 @@ floor_pot(uint32_t n)
 }
 
 
+/**
+ * Conservative depth range of the triangle within a tile, evaluated from
+ * the position plane equation over the tile's part of the bounding box and
+ * put through the same clamping the fragment shader does.
+ */
+static void
+hiz_tri_bounds(const struct lp_setup_context *setup,
+               const struct lp_rast_triangle *tri,
+               unsigned viewport_index,
+               const struct u_rect *box,
+               int tx, int ty,
+               float *zmin, float *zmax)
+{
+   const float z0 = GET_A0(&tri->inputs)[0][2];
+   const float dzdx = GET_DADX(&tri->inputs)[0][2];
+   const float dzdy = GET_DADY(&tri->inputs)[0][2];
+
+   /* Pixel centers of the tile which are inside the bounding box */
+   const int x0 = MAX2(box->x0, tx * TILE_SIZE);
+   const int y0 = MAX2(box->y0, ty * TILE_SIZE);
+   const int x1 = MIN2(box->x1, tx * TILE_SIZE + TILE_SIZE - 1) + 1;
+   const int y1 = MIN2(box->y1, ty * TILE_SIZE + TILE_SIZE - 1) + 1;
+
+   const float zx0 = dzdx * (float)x0, zx1 = dzdx * (float)x1;
+   const float zy0 = dzdy * (float)y0, zy1 = dzdy * (float)y1;
+   const float zxmax = MAX2(zx0, zx1), zymax = MAX2(zy0, zy1);
+
+   /* Allow for the rounding of the shader's own interpolation. */
+   const float eps = (fabsf(z0) + MAX2(fabsf(zx0), fabsf(zx1)) +
+                      MAX2(fabsf(zy0), fabsf(zy1))) * (1.0f / (1 << 20));
+
+   float lo = z0 + MIN2(zx0, zx1) + MIN2(zy0, zy1) - eps;
+   float hi = z0 + zxmax + zymax + eps;
+
+   if (setup->hiz.restrict_depth) {
+      lo = CLAMP(lo, 0.0f, 1.0f);
+      hi = CLAMP(hi, 0.0f, 1.0f);
+   }
+   if (setup->hiz.depth_clamp) {
+      const struct lp_jit_viewport *vp = &setup->viewports[viewport_index];
+      const float vmin = MIN2(vp->min_depth, vp->max_depth);
+      const float vmax = MAX2(vp->min_depth, vp->max_depth);
+      lo = CLAMP(lo, vmin, vmax);
+      hi = CLAMP(hi, vmin, vmax);
+   }
+
+   *zmin = lo;
+   *zmax = hi;
+}
+
+
+/**
+ * Test the triangle against the depth bounds of a tile, and if it survives,
+ * fold the depth it may write into them.  'full' means the triangle covers
+ * the whole tile.
+ *
+ * \return true if no fragment of the triangle can pass the depth test in
+ * this tile
+ */
+static bool
+hiz_cull_or_update(struct lp_setup_context *setup,
+                   const struct lp_rast_triangle *tri,
+                   unsigned viewport_index,
+                   const struct u_rect *box,
+                   int tx, int ty,
+                   bool full)
+{
+   float *bounds = setup->hiz.bounds[ty * setup->hiz.tiles_x + tx];
+   const float margin = setup->hiz.margin;
+   float zmin, zmax;
+
+   hiz_tri_bounds(setup, tri, viewport_index, box, tx, ty, &zmin, &zmax);
+
+   if (setup->hiz.cull) {
+      bool culled;
+
+      switch (setup->hiz.func) {
+      case PIPE_FUNC_NEVER:
+         culled = true;
+         break;
+      case PIPE_FUNC_LESS:
+         culled = zmin >= bounds[1] + margin;
+         break;
+      case PIPE_FUNC_LEQUAL:
+         culled = zmin > bounds[1] + margin;
+         break;
+      case PIPE_FUNC_GREATER:
+         culled = zmax <= bounds[0] - margin;
+         break;
+      case PIPE_FUNC_GEQUAL:
+         culled = zmax < bounds[0] - margin;
+         break;
+      default:
+         culled = false;
+         break;
+      }
+
+      if (culled)
+         return true;
+   }
+
+   if (!setup->hiz.write)
+      return false;
+
+   if (!setup->hiz.bounded_write) {
+      bounds[0] = -INFINITY;
+      bounds[1] = INFINITY;
+      return false;
+   }
+
+   /* Only a tile which is sure to be entirely written can have its far
+    * bound pulled in.
+    */
+   full = full && setup->hiz.full_write;
+
+   switch (setup->hiz.func) {
+   case PIPE_FUNC_NEVER:
+      break;
+   case PIPE_FUNC_LESS:
+   case PIPE_FUNC_LEQUAL:
+      bounds[0] = MIN2(bounds[0], zmin);
+      if (full)
+         bounds[1] = MIN2(bounds[1], zmax);
+      break;
+   case PIPE_FUNC_GREATER:
+   case PIPE_FUNC_GEQUAL:
+      bounds[1] = MAX2(bounds[1], zmax);
+      if (full)
+         bounds[0] = MAX2(bounds[0], zmin);
+      break;
+   case PIPE_FUNC_ALWAYS:
+      if (full) {
+         bounds[0] = zmin;
+         bounds[1] = zmax;
+         break;
+      }
+      FALLTHROUGH;
+   default:
+      bounds[0] = MIN2(bounds[0], zmin);
+      bounds[1] = MAX2(bounds[1], zmax);
+      break;
+   }
+
+   return false;
+}
+
+
 bool
 lp_setup_bin_triangle(struct lp_setup_context *setup,
                       struct lp_rast_triangle *tri,
@@ -787,6 +935,7 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
                       unsigned viewport_index)
 {
    struct lp_scene *scene = setup->scene;
+   const bool hiz = setup->hiz.enabled && (setup->hiz.cull || setup->hiz.write);
    unsigned cmd;
 
    /* What is the largest power-of-two boundary this triangle crosses:
@@ -828,6 +977,13 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
       assert(iy0 == bbox->y1 / TILE_SIZE &&
              ix0 == bbox->x1 / TILE_SIZE);
 
+      if (hiz && hiz_cull_or_update(setup, tri, viewport_index, &trimmed_box,
+                                    ix0, iy0, false)) {
+         LP_COUNT(nr_hiz_culled_64);
+         LP_COUNT(nr_hiz_culled_tris);
+         return true;
+      }
+
       if (nr_planes == 3) {
          if (sz < 4) {
             /* Triangle is contained in a single 4x4 stamp:
@@ -922,6 +1078,8 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
 
       tri->inputs.is_blit = lp_setup_is_blit(setup, &tri->inputs);
 
+      bool binned = false, culled = false;
+
       /* Test tile-sized blocks against the triangle.
        * Discard blocks fully outside the tri.  If the block is fully
        * contained inside the tri, bin an lp_rast_shade_tile command.
@@ -949,12 +1107,19 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
                if (in)
                   break;  /* exiting triangle, all done with this row */
                LP_COUNT(nr_empty_64);
+            } else if (hiz && hiz_cull_or_update(setup, tri, viewport_index,
+                                                 &trimmed_box, x, y,
+                                                 !partial)) {
+               in = true;
+               culled = true;
+               LP_COUNT(nr_hiz_culled_64);
             } else if (partial) {
                /* Not trivially accepted by at least one plane -
                 * rasterize/shade partial tile
                 */
                int count = util_bitcount(partial);
                in = true;
+               binned = true;
 
                if (setup->multisample)
                   cmd = lp_rast_ms_tri_tab[count];
@@ -970,6 +1135,7 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
                /* triangle covers the whole tile- shade whole tile */
                LP_COUNT(nr_fully_covered_64);
                in = true;
+               binned = true;
                if (!lp_setup_whole_tile(setup, &tri->inputs, x, y, opaque))
                   goto fail;
             }
@@ -983,6 +1149,9 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
          for (int i = 0; i < nr_planes; i++)
             c[i] += ystep[i];
       }
+
+      if (culled && !binned)
+         LP_COUNT(nr_hiz_culled_tris);
    }
 
    return true;
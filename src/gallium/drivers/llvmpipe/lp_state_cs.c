@@ -977,6 +977,17 @@ generate_compute(struct llvmpipe_context *lp,
 }
 
 
+static void
+lp_cs_hash_nir(struct lp_compute_shader *shader)
+{
+   struct blob blob;
+   blob_init(&blob);
+   nir_serialize(&blob, shader->base.ir.nir, true);
+   _mesa_sha1_compute(blob.data, blob.size, shader->nir_sha1);
+   blob_finish(&blob);
+}
+
+
 static void *
 llvmpipe_create_compute_state(struct pipe_context *pipe,
                               const struct pipe_compute_state *templ)
@@ -1008,6 +1019,7 @@ llvmpipe_create_compute_state(struct pipe_context *pipe,
    int nr_sampler_views = BITSET_LAST_BIT(nir->info.textures_used);
    int nr_images = BITSET_LAST_BIT(nir->info.images_used);
    shader->variant_key_size = lp_cs_variant_key_size(MAX2(nr_samplers, nr_sampler_views), nr_images);
+   lp_cs_hash_nir(shader);
 
    return shader;
 }
@@ -1246,22 +1258,12 @@ static void
 lp_cs_get_ir_cache_key(struct lp_compute_shader_variant *variant,
                        unsigned char ir_sha1_cache_key[20])
 {
-   struct blob blob = { 0 };
-   unsigned ir_size;
-   void *ir_binary;
-
-   blob_init(&blob);
-   nir_serialize(&blob, variant->shader->base.ir.nir, true);
-   ir_binary = blob.data;
-   ir_size = blob.size;
-
    struct mesa_sha1 ctx;
    _mesa_sha1_init(&ctx);
    _mesa_sha1_update(&ctx, &variant->key, variant->shader->variant_key_size);
-   _mesa_sha1_update(&ctx, ir_binary, ir_size);
+   _mesa_sha1_update(&ctx, variant->shader->nir_sha1,
+                     sizeof(variant->shader->nir_sha1));
    _mesa_sha1_final(&ctx, ir_sha1_cache_key);
-
-   blob_finish(&blob);
 }
 
 
@@ -1291,13 +1293,14 @@ generate_variant(struct llvmpipe_context *lp,
 
    unsigned char ir_sha1_cache_key[20];
    struct lp_cached_code cached = { 0 };
-   bool needs_caching = false;
+   struct lp_variant_cache_header header = { 0 };
 
    lp_cs_get_ir_cache_key(variant, ir_sha1_cache_key);
 
-   lp_disk_cache_find_shader(screen, &cached, ir_sha1_cache_key);
-   if (!cached.data_size)
-      needs_caching = true;
+   /* With the code in the cache, the IR doesn't need to be built at all. */
+   const bool needs_caching =
+      !lp_disk_cache_find_variant(screen, shader->code_cache, &cached,
+                                  ir_sha1_cache_key, &header);
 
    variant->gallivm = gallivm_create(module_name, &lp->context, &cached);
    if (!variant->gallivm) {
@@ -1313,6 +1316,20 @@ generate_variant(struct llvmpipe_context *lp,
       lp_debug_cs_variant(variant);
    }
 
+   if (!needs_caching) {
+      variant->nr_instrs = header.nr_instrs;
+      variant->function_name = MALLOC(sizeof("cs_variant"));
+      strcpy(variant->function_name, "cs_variant");
+
+      gallivm_compile_module(variant->gallivm);
+
+      variant->jit_function = (lp_jit_cs_func)
+         gallivm_jit_function(variant->gallivm, NULL, variant->function_name);
+
+      gallivm_free_ir(variant->gallivm);
+      return variant;
+   }
+
    lp_jit_init_cs_types(variant);
 
    if (sh_type == MESA_SHADER_MESH) {
@@ -1341,9 +1358,9 @@ generate_variant(struct llvmpipe_context *lp,
    variant->jit_function = (lp_jit_cs_func)
       gallivm_jit_function(variant->gallivm, variant->function, variant->function_name);
 
-   if (needs_caching) {
-      lp_disk_cache_insert_shader(screen, &cached, ir_sha1_cache_key);
-   }
+   header.nr_instrs = variant->nr_instrs;
+   lp_disk_cache_insert_variant(screen, shader->code_cache, &cached,
+                                ir_sha1_cache_key, &header);
    gallivm_free_ir(variant->gallivm);
    return variant;
 }
@@ -1925,6 +1942,7 @@ llvmpipe_create_ts_state(struct pipe_context *pipe,
    int nr_sampler_views = BITSET_LAST_BIT(nir->info.textures_used);
    int nr_images = BITSET_LAST_BIT(nir->info.images_used);
    shader->variant_key_size = lp_cs_variant_key_size(MAX2(nr_samplers, nr_sampler_views), nr_images);
+   lp_cs_hash_nir(shader);
    return shader;
 }
 
@@ -2002,6 +2020,7 @@ llvmpipe_create_ms_state(struct pipe_context *pipe,
    int nr_sampler_views = BITSET_LAST_BIT(nir->info.textures_used);
    int nr_images = BITSET_LAST_BIT(nir->info.images_used);
    shader->variant_key_size = lp_cs_variant_key_size(MAX2(nr_samplers, nr_sampler_views), nr_images);
+   lp_cs_hash_nir(shader);
    return shader;
 }
 
@@ -2121,7 +2140,7 @@ llvmpipe_draw_mesh_tasks(struct pipe_context *pipe,
       return;
 
    memset(&job_info, 0, sizeof(job_info));
-   if (lp->dirty)
+   if (lp->dirty || lp->fs_pending)
       llvmpipe_update_derived(lp);
 
    unsigned draw_count = info->draw_count;
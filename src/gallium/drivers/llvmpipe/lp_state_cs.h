@@ -123,6 +123,12 @@ struct lp_compute_shader {
    unsigned variants_cached;
    bool zero_initialize_shared_memory;
 
+   /** sha1 of the serialized NIR, for the variant disk cache keys */
+   unsigned char nir_sha1[20];
+
+   /** Frontend storage for the variant code, may be NULL */
+   struct lp_code_cache *code_cache;
+
    int max_global_buffers;
    struct pipe_resource **global_buffers;
 };
@@ -308,6 +308,8 @@ llvmpipe_update_derived(struct llvmpipe_context *llvmpipe)
                           LP_NEW_SAMPLER_VIEW |
                           LP_NEW_OCCLUSION_QUERY))
       llvmpipe_update_fs(llvmpipe);
+   else if (llvmpipe->fs_pending)
+      llvmpipe_poll_fs_variant(llvmpipe);
 
    if (llvmpipe->dirty & (LP_NEW_FS |
                           LP_NEW_FRAMEBUFFER |
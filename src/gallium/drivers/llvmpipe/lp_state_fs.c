@@ -3717,6 +3717,8 @@ lp_debug_fs_kind(enum lp_fs_kind kind)
       return "AERO_MINIFICATION";
    case LP_FS_KIND_LLVM_LINEAR:
       return "LLVM_LINEAR";
+   case LP_FS_KIND_TEX_MODULATE:
+      return "TEX_MODULATE";
    default:
       return "unknown";
    }
@@ -3742,35 +3744,24 @@ static void
 lp_fs_get_ir_cache_key(struct lp_fragment_shader_variant *variant,
                        unsigned char ir_sha1_cache_key[20])
 {
-   struct blob blob = { 0 };
-   unsigned ir_size;
-   void *ir_binary;
-
-   blob_init(&blob);
-   nir_serialize(&blob, variant->shader->base.ir.nir, true);
-   ir_binary = blob.data;
-   ir_size = blob.size;
-
    struct mesa_sha1 ctx;
    _mesa_sha1_init(&ctx);
    _mesa_sha1_update(&ctx, &variant->key, variant->shader->variant_key_size);
-   _mesa_sha1_update(&ctx, ir_binary, ir_size);
+   _mesa_sha1_update(&ctx, variant->shader->nir_sha1,
+                     sizeof(variant->shader->nir_sha1));
    _mesa_sha1_final(&ctx, ir_sha1_cache_key);
-
-   blob_finish(&blob);
 }
 
 
 /**
- * Generate a new fragment shader variant from the shader code and
- * other state indicated by the key.
+ * Allocate a new fragment shader variant for the given key.  The code is
+ * generated separately by compile_variant().
  */
 static struct lp_fragment_shader_variant *
-generate_variant(struct llvmpipe_context *lp,
-                 struct lp_fragment_shader *shader,
-                 const struct lp_fragment_shader_variant_key *key)
+create_variant(struct llvmpipe_context *lp,
+               struct lp_fragment_shader *shader,
+               const struct lp_fragment_shader_variant_key *key)
 {
-   struct nir_shader *nir = shader->base.ir.nir;
    struct lp_fragment_shader_variant *variant =
       MALLOC(sizeof *variant + shader->variant_key_size - sizeof variant->key);
    if (!variant)
@@ -3779,34 +3770,92 @@ generate_variant(struct llvmpipe_context *lp,
    memset(variant, 0, sizeof(*variant));
 
    pipe_reference_init(&variant->reference, 1);
+   util_queue_fence_init(&variant->ready);
    lp_fs_reference(lp, &variant->shader, shader);
 
    memcpy(&variant->key, key, shader->variant_key_size);
 
-   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
-   struct lp_cached_code cached = { 0 };
-   unsigned char ir_sha1_cache_key[20];
-   bool needs_caching = false;
-   if (shader->base.ir.nir) {
-      lp_fs_get_ir_cache_key(variant, ir_sha1_cache_key);
+   variant->list_item_global.base = variant;
+   variant->list_item_local.base = variant;
+   variant->no = shader->variants_created++;
 
-      lp_disk_cache_find_shader(screen, &cached, ir_sha1_cache_key);
-      if (!cached.data_size)
-         needs_caching = true;
-   }
+   return variant;
+}
+
+
+/* Functions of a variant, as recorded in struct lp_variant_cache_header */
+#define LP_FS_FUNC_WHOLE  BITFIELD_BIT(RAST_WHOLE)
+#define LP_FS_FUNC_PARTIAL BITFIELD_BIT(RAST_EDGE_TEST)
+#define LP_FS_FUNC_LINEAR BITFIELD_BIT(2)
+
+
+static char *
+fs_function_name(const char *name)
+{
+   char *copy = MALLOC(strlen(name) + 1);
+   if (copy)
+      strcpy(copy, name);
+   return copy;
+}
+
+
+/**
+ * Return why the pipeline state of a variant rules out the linear path,
+ * or NULL if it doesn't.
+ */
+static const char *
+linear_pipeline_miss_reason(const struct lp_fragment_shader_variant_key *key,
+                            const struct nir_shader *nir)
+{
+   if (key->stencil[0].enabled)
+      return "stencil test";
+   if (key->depth.enabled)
+      return "depth test";
+   if (nir->info.fs.uses_discard)
+      return "discard";
+   if (key->blend.logicop_enable)
+      return "logicop";
+   if (key->cbuf_format[0] != PIPE_FORMAT_B8G8R8A8_UNORM &&
+       key->cbuf_format[0] != PIPE_FORMAT_B8G8R8X8_UNORM &&
+       key->cbuf_format[0] != PIPE_FORMAT_R8G8B8A8_UNORM &&
+       key->cbuf_format[0] != PIPE_FORMAT_R8G8B8X8_UNORM)
+      return "color buffer format";
+   return NULL;
+}
+
+
+/**
+ * Generate and compile the code for a fragment shader variant.
+ *
+ * If cached_header is given, cached holds the object code of the variant
+ * from the disk cache and no LLVM IR is built at all; the functions listed
+ * in the header are looked up by name instead.
+ *
+ * This also runs on the screen's fs_compile_queue threads, so it must not
+ * touch any context state besides the given LLVM context.
+ */
+static bool
+compile_variant(struct llvmpipe_context *lp,
+                lp_context_ref *context,
+                struct lp_fragment_shader_variant *variant,
+                struct lp_cached_code *cached,
+                const struct lp_variant_cache_header *cached_header,
+                unsigned char *ir_sha1_cache_key,
+                bool fast_compile)
+{
+   struct lp_fragment_shader *shader = variant->shader;
+   const struct lp_fragment_shader_variant_key *key = &variant->key;
+   struct nir_shader *nir = shader->base.ir.nir;
 
    char module_name[64];
-   snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
-            shader->no, shader->variants_created);
-   variant->gallivm = gallivm_create(module_name, &lp->context, &cached);
-   if (!variant->gallivm) {
-      FREE(variant);
-      return NULL;
-   }
+   snprintf(module_name, sizeof(module_name), "fs%u_variant%u%s",
+            shader->no, variant->no, fast_compile ? "_fallback" : "");
+   variant->gallivm = gallivm_create(module_name, context, cached);
+   if (!variant->gallivm)
+      return false;
 
-   variant->list_item_global.base = variant;
-   variant->list_item_local.base = variant;
-   variant->no = shader->variants_created++;
+   if (fast_compile)
+      gallivm_set_fast_compile(variant->gallivm);
 
    /*
     * Determine whether we are touching all channels in the color buffer.
@@ -3896,17 +3945,8 @@ generate_variant(struct llvmpipe_context *lp,
    /* Determine whether this shader + pipeline state is a candidate for
     * the linear path.
     */
-   const bool linear_pipeline =
-         !key->stencil[0].enabled &&
-         !key->depth.enabled &&
-         !nir->info.fs.uses_discard &&
-         !key->blend.logicop_enable &&
-         (key->cbuf_format[0] == PIPE_FORMAT_B8G8R8A8_UNORM ||
-          key->cbuf_format[0] == PIPE_FORMAT_B8G8R8X8_UNORM ||
-          key->cbuf_format[0] == PIPE_FORMAT_R8G8B8A8_UNORM ||
-          key->cbuf_format[0] == PIPE_FORMAT_R8G8B8X8_UNORM);
-
-   memcpy(&variant->key, key, sizeof *key);
+   const char *linear_miss = linear_pipeline_miss_reason(key, nir);
+   const bool linear_pipeline = linear_miss == NULL;
 
    if ((LP_DEBUG & DEBUG_FS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
       lp_debug_fs_variant(variant);
@@ -3914,12 +3954,13 @@ generate_variant(struct llvmpipe_context *lp,
 
    llvmpipe_fs_variant_fastpath(variant);
 
-   lp_jit_init_types(variant);
+   if (!cached_header)
+      lp_jit_init_types(variant);
 
-   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
+   if (variant->jit_function[RAST_EDGE_TEST] == NULL && !cached_header)
       generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
 
-   if (variant->jit_function[RAST_WHOLE] == NULL) {
+   if (variant->jit_function[RAST_WHOLE] == NULL && !cached_header) {
       if (variant->opaque) {
          /* Specialized shader, which doesn't need to read the color buffer. */
          generate_fragment(lp, shader, variant, RAST_WHOLE);
@@ -3942,16 +3983,18 @@ generate_variant(struct llvmpipe_context *lp,
       /* If the original fastpath doesn't cover this variant, try the new
        * code:
        */
-      if (variant->jit_linear == NULL) {
+      if (variant->jit_linear == NULL && !cached_header) {
          if (shader->kind == LP_FS_KIND_BLIT_RGBA ||
              shader->kind == LP_FS_KIND_BLIT_RGB1 ||
-             shader->kind == LP_FS_KIND_LLVM_LINEAR) {
+             shader->kind == LP_FS_KIND_LLVM_LINEAR ||
+             shader->kind == LP_FS_KIND_TEX_MODULATE) {
             llvmpipe_fs_variant_linear_llvm(lp, shader, variant);
          }
       }
    } else {
       if (LP_DEBUG & DEBUG_LINEAR) {
          lp_debug_fs_variant(variant);
+         debug_printf("  -- %s\n", linear_miss);
          debug_printf("    ----> no linear path for this variant\n");
       }
    }
@@ -3960,25 +4003,51 @@ generate_variant(struct llvmpipe_context *lp,
     * Compile everything
     */
 
+   unsigned functions;
+   if (cached_header) {
+      variant->nr_instrs = cached_header->nr_instrs;
+      functions = cached_header->functions;
+
+      if (functions & LP_FS_FUNC_PARTIAL)
+         variant->function_name[RAST_EDGE_TEST] =
+            fs_function_name("fs_variant_partial");
+      if (functions & LP_FS_FUNC_WHOLE)
+         variant->function_name[RAST_WHOLE] =
+            fs_function_name("fs_variant_whole");
+      if (functions & LP_FS_FUNC_LINEAR)
+         variant->linear_function_name =
+            fs_function_name("fs_variant_linear2");
+
+      gallivm_compile_module(variant->gallivm);
+   } else {
+      functions = 0;
+      if (variant->function[RAST_EDGE_TEST])
+         functions |= LP_FS_FUNC_PARTIAL;
+      if (variant->function[RAST_WHOLE])
+         functions |= LP_FS_FUNC_WHOLE;
+      if (variant->linear_function)
+         functions |= LP_FS_FUNC_LINEAR;
+
 #if GALLIVM_USE_ORCJIT
 /* module has been moved into ORCJIT after gallivm_compile_module */
-   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
+      variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
 
-   gallivm_compile_module(variant->gallivm);
+      gallivm_compile_module(variant->gallivm);
 #else
-   gallivm_compile_module(variant->gallivm);
+      gallivm_compile_module(variant->gallivm);
 
-   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
+      variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
 #endif
+   }
 
-   if (variant->function[RAST_EDGE_TEST]) {
+   if (functions & LP_FS_FUNC_PARTIAL) {
       variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
             gallivm_jit_function(variant->gallivm,
                                  variant->function[RAST_EDGE_TEST],
                                  variant->function_name[RAST_EDGE_TEST]);
    }
 
-   if (variant->function[RAST_WHOLE]) {
+   if (functions & LP_FS_FUNC_WHOLE) {
       variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
          gallivm_jit_function(variant->gallivm,
                               variant->function[RAST_WHOLE],
@@ -3989,7 +4058,7 @@ generate_variant(struct llvmpipe_context *lp,
    }
 
    if (linear_pipeline) {
-      if (variant->linear_function) {
+      if (functions & LP_FS_FUNC_LINEAR) {
          variant->jit_linear_llvm = (lp_jit_linear_llvm_func)
             gallivm_jit_function(variant->gallivm, variant->linear_function,
                                  variant->linear_function_name);
@@ -4002,16 +4071,160 @@ generate_variant(struct llvmpipe_context *lp,
       lp_linear_check_variant(variant);
    }
 
-   if (needs_caching) {
-      lp_disk_cache_insert_shader(screen, &cached, ir_sha1_cache_key);
+   if (ir_sha1_cache_key) {
+      const struct lp_variant_cache_header header = {
+         .nr_instrs = variant->nr_instrs,
+         .functions = functions,
+      };
+      lp_disk_cache_insert_variant(llvmpipe_screen(lp->pipe.screen),
+                                   variant->shader->code_cache, cached,
+                                   ir_sha1_cache_key, &header);
    }
 
    gallivm_free_ir(variant->gallivm);
 
+   return true;
+}
+
+
+struct lp_fs_compile_job
+{
+   struct llvmpipe_context *lp;
+   struct lp_fragment_shader_variant *variant;
+   struct lp_cached_code cached;
+   struct lp_variant_cache_header cached_header;
+   unsigned char ir_sha1_cache_key[20];
+   bool needs_caching;
+};
+
+
+static void
+fs_compile_job_execute(void *data, void *gdata, int thread_index)
+{
+   struct lp_fs_compile_job *job = data;
+   struct lp_fragment_shader_variant *variant = job->variant;
+
+   /* LLVM contexts are not thread-safe, so each variant gets its own. */
+   lp_context_create(&variant->llvm_context);
+
+   if (!compile_variant(job->lp, &variant->llvm_context, variant,
+                        &job->cached, NULL,
+                        job->needs_caching ? job->ir_sha1_cache_key : NULL,
+                        false))
+      variant->failed = true;
+}
+
+
+static void
+fs_compile_job_cleanup(void *data, void *gdata, int thread_index)
+{
+   FREE(data);
+}
+
+
+/**
+ * Generate a new fragment shader variant from the shader code and
+ * other state indicated by the key.
+ *
+ * With LP_ASYNC_FS the optimized code is compiled on the screen's
+ * fs_compile_queue instead, and the returned variant is marked pending.
+ * Until it is ready, draws use a fallback variant for the same key which
+ * is compiled here without any LLVM optimizations.
+ */
+static struct lp_fragment_shader_variant *
+generate_variant(struct llvmpipe_context *lp,
+                 struct lp_fragment_shader *shader,
+                 const struct lp_fragment_shader_variant_key *key)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   struct lp_fragment_shader_variant *variant =
+      create_variant(lp, shader, key);
+   if (!variant)
+      return NULL;
+
+   struct lp_fs_compile_job *job = CALLOC_STRUCT(lp_fs_compile_job);
+   if (!job) {
+      lp_fs_variant_reference(lp, &variant, NULL);
+      return NULL;
+   }
+
+   job->lp = lp;
+   job->variant = variant;
+
+   if (shader->base.ir.nir) {
+      lp_fs_get_ir_cache_key(variant, job->ir_sha1_cache_key);
+
+      if (!lp_disk_cache_find_variant(screen, shader->code_cache,
+                                      &job->cached,
+                                      job->ir_sha1_cache_key,
+                                      &job->cached_header))
+         job->needs_caching = true;
+   }
+
+   /* Loading code from the disk cache is cheap, don't defer it. */
+   if (screen->async_fs && !job->cached.data_size) {
+      variant->pending = true;
+      util_queue_add_job(&screen->fs_compile_queue, job, &variant->ready,
+                         fs_compile_job_execute, fs_compile_job_cleanup, 0);
+      LP_COUNT(nr_fs_async_compiles);
+
+      variant->fallback = create_variant(lp, shader, key);
+      if (variant->fallback &&
+          !compile_variant(lp, &lp->context, variant->fallback,
+                           NULL, NULL, NULL, true)) {
+         lp_fs_variant_reference(lp, &variant->fallback, NULL);
+      }
+
+      /* Without a fallback there is nothing else to draw with. */
+      if (!variant->fallback) {
+         util_queue_fence_wait(&variant->ready);
+         if (variant->failed) {
+            variant->pending = false;
+            lp_fs_variant_reference(lp, &variant, NULL);
+         }
+      }
+
+      return variant;
+   }
+
+   bool ok = compile_variant(lp, &lp->context, variant, &job->cached,
+                             job->cached.data_size ? &job->cached_header : NULL,
+                             job->needs_caching ? job->ir_sha1_cache_key : NULL,
+                             false);
+   FREE(job);
+
+   if (!ok)
+      lp_fs_variant_reference(lp, &variant, NULL);
+
    return variant;
 }
 
 
+/**
+ * Wait for a pending variant to be compiled and drop its fallback, unless
+ * the compile failed.
+ */
+static void
+finish_variant(struct llvmpipe_context *lp,
+               struct lp_fragment_shader_variant *variant)
+{
+   if (!variant->pending)
+      return;
+
+   util_queue_fence_wait(&variant->ready);
+
+   if (lp->fs_pending == variant)
+      lp->fs_pending = NULL;
+
+   variant->pending = false;
+
+   if (!variant->failed) {
+      lp_fs_variant_reference(lp, &variant->fallback, NULL);
+      lp->nr_fs_instrs += variant->nr_instrs;
+   }
+}
+
+
 static void *
 llvmpipe_create_fs_state(struct pipe_context *pipe,
                          const struct pipe_shader_state *templ)
@@ -4111,6 +4324,12 @@ llvmpipe_create_fs_state(struct pipe_context *pipe,
 
    llvmpipe_fs_analyse_nir(shader);
 
+   struct blob blob;
+   blob_init(&blob);
+   nir_serialize(&blob, nir, true);
+   _mesa_sha1_compute(blob.data, blob.size, shader->nir_sha1);
+   blob_finish(&blob);
+
    return shader;
 }
 
@@ -4151,6 +4370,9 @@ llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                    lp->nr_fs_variants, variant->nr_instrs, lp->nr_fs_instrs);
    }
 
+   /* make sure the compiler threads are done with it */
+   finish_variant(lp, variant);
+
    /* remove from shader's list */
    list_del(&variant->list_item_local.list);
    variant->shader->variants_cached--;
@@ -4166,7 +4388,13 @@ void
 llvmpipe_destroy_shader_variant(struct llvmpipe_context *lp,
                                 struct lp_fragment_shader_variant *variant)
 {
-   gallivm_destroy(variant->gallivm);
+   assert(!variant->pending);
+   lp_fs_variant_reference(lp, &variant->fallback, NULL);
+   if (variant->gallivm)
+      gallivm_destroy(variant->gallivm);
+   if (variant->llvm_context.ref)
+      lp_context_destroy(&variant->llvm_context);
+   util_queue_fence_destroy(&variant->ready);
    lp_fs_reference(lp, &variant->shader, NULL);
    if (variant->function_name[RAST_EDGE_TEST])
       FREE(variant->function_name[RAST_EDGE_TEST]);
@@ -4206,6 +4434,9 @@ llvmpipe_delete_fs_state(struct pipe_context *pipe, void *fs)
       lp_fs_variant_reference(llvmpipe, &variant, NULL);
    }
 
+   /* The frontend may free it as soon as the CSO is deleted. */
+   shader->code_cache = NULL;
+
    lp_fs_reference(llvmpipe, &shader, NULL);
 }
 
@@ -4678,6 +4909,34 @@ make_variant_key(struct llvmpipe_context *lp,
 }
 
 
+/**
+ * Bind a variant, or its fallback while it is still being compiled.
+ */
+static void
+bind_variant(struct llvmpipe_context *lp,
+             struct lp_fragment_shader_variant *variant)
+{
+   lp->fs_pending = NULL;
+
+   if (variant && variant->pending) {
+      if (!util_queue_fence_is_signalled(&variant->ready)) {
+         LP_COUNT(nr_fs_fallback_draws);
+         lp->fs_pending = variant;
+         lp_setup_set_fs_variant(lp->setup, variant->fallback);
+         return;
+      }
+
+      finish_variant(lp, variant);
+   }
+
+   /* The optimized compile failed, keep drawing with the fallback. */
+   if (variant && variant->failed)
+      variant = variant->fallback;
+
+   lp_setup_set_fs_variant(lp->setup, variant);
+}
+
+
 /**
  * Update fragment shader state.  This is called just prior to drawing
  * something when some fragment-related state has changed.
@@ -4772,13 +5031,31 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
          list_add(&variant->list_item_local.list, &shader->variants.list);
          list_add(&variant->list_item_global.list, &lp->fs_variants_list.list);
          lp->nr_fs_variants++;
-         lp->nr_fs_instrs += variant->nr_instrs;
+         if (!variant->pending)
+            lp->nr_fs_instrs += variant->nr_instrs;
          shader->variants_cached++;
       }
    }
 
-   /* Bind this variant */
-   lp_setup_set_fs_variant(lp->setup, variant);
+   bind_variant(lp, variant);
+}
+
+
+/**
+ * Called before each draw while a fallback variant is bound, to switch to
+ * the real one as soon as the compiler threads are done with it.
+ */
+void
+llvmpipe_poll_fs_variant(struct llvmpipe_context *lp)
+{
+   struct lp_fragment_shader_variant *variant = lp->fs_pending;
+
+   assert(variant && variant->pending);
+
+   if (util_queue_fence_is_signalled(&variant->ready))
+      bind_variant(lp, variant);
+   else
+      LP_COUNT(nr_fs_fallback_draws);
 }
 
 
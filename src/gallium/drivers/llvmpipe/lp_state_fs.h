@@ -38,6 +38,7 @@
 #include "gallivm/lp_bld_tgsi.h" /* for lp_tgsi_info */
 #include "lp_bld_interp.h" /* for struct lp_shader_input */
 #include "util/u_inlines.h"
+#include "util/u_queue.h"
 #include "lp_jit.h"
 
 struct lp_fragment_shader;
@@ -54,7 +55,8 @@ enum lp_fs_kind
    LP_FS_KIND_BLIT_RGBA,
    LP_FS_KIND_BLIT_RGB1,
    LP_FS_KIND_AERO_MINIFICATION,
-   LP_FS_KIND_LLVM_LINEAR
+   LP_FS_KIND_LLVM_LINEAR,
+   LP_FS_KIND_TEX_MODULATE
 };
 
 
@@ -151,8 +153,26 @@ struct lp_fragment_shader_variant
    unsigned opaque:1;
    unsigned blit:1;
    unsigned linear_input_mask:16;
+
+   /*
+    * Still being compiled on the screen's fs_compile_queue, the fallback
+    * variant must be bound until the ready fence is signalled.  Only
+    * accessed on the context thread.  Not a bitfield, as the compiler
+    * thread writes the bitfields above meanwhile.
+    */
+   bool pending;
    struct pipe_reference reference;
 
+   struct util_queue_fence ready;
+   struct lp_fragment_shader_variant *fallback;
+   /* Set by the compiler thread if the compile failed, the fallback is then
+    * used for good.  Not a bitfield, as it is written concurrently.
+    */
+   bool failed;
+
+   /* Private LLVM context for variants compiled off the draw thread */
+   lp_context_ref llvm_context;
+
    struct gallivm_state *gallivm;
 
    LLVMTypeRef jit_context_type;
@@ -219,6 +239,12 @@ struct lp_fragment_shader
    unsigned variants_created;
    unsigned variants_cached;
 
+   /** sha1 of the serialized NIR, for the variant disk cache keys */
+   unsigned char nir_sha1[20];
+
+   /** Frontend storage for the variant code, may be NULL */
+   struct lp_code_cache *code_cache;
+
    /** Fragment shader input interpolation info */
    struct lp_shader_input inputs[PIPE_MAX_SHADER_INPUTS];
 };
@@ -202,6 +202,18 @@ check_load_const_in_zero_one(const nir_load_const_instr *load)
 }
 
 
+/*
+ * Report why a shader can't take the linear path, for LP_DEBUG=linear.
+ */
+static bool
+not_linear(const char *reason)
+{
+   if (LP_DEBUG & DEBUG_LINEAR)
+      debug_printf("  -- not linear: %s\n", reason);
+   return false;
+}
+
+
 /*
  * Examine the NIR shader to determine if it's "linear".
  * For the linear path, we're optimizing the case of rendering a window-
@@ -221,16 +233,16 @@ llvmpipe_nir_fn_is_linear_compat(const struct nir_shader *shader,
          case nir_instr_type_deref: {
             nir_deref_instr *deref = nir_instr_as_deref(instr);
             if (deref->deref_type != nir_deref_type_var)
-               return false;
+               return not_linear("indirect deref");
             if (deref->var->data.mode == nir_var_shader_out &&
                 deref->var->data.location_frac != 0)
-               return false;
+               return not_linear("partial output write");
             break;
          }
          case nir_instr_type_load_const: {
             nir_load_const_instr *load = nir_instr_as_load_const(instr);
             if (!check_load_const_in_zero_one(load)) {
-               return false;
+               return not_linear("immediate outside [0,1]");
             }
             break;
          }
@@ -239,15 +251,15 @@ llvmpipe_nir_fn_is_linear_compat(const struct nir_shader *shader,
             if (intrin->intrinsic != nir_intrinsic_load_deref &&
                 intrin->intrinsic != nir_intrinsic_store_deref &&
                 intrin->intrinsic != nir_intrinsic_load_ubo)
-               return false;
+               return not_linear(nir_intrinsic_infos[intrin->intrinsic].name);
 
             if (intrin->intrinsic == nir_intrinsic_load_ubo) {
                if (!nir_src_is_const(intrin->src[0]))
-                  return false;
+                  return not_linear("indirect ubo");
                nir_load_const_instr *load =
                   nir_def_as_load_const(intrin->src[0].ssa);
                if (load->value[0].u32 != 0 || load->def.num_components > 1)
-                  return false;
+                  return not_linear("ubo other than #0");
             } else if (intrin->intrinsic == nir_intrinsic_store_deref) {
                /*
                 * Assume the store destination is the FS output color.
@@ -257,7 +269,7 @@ llvmpipe_nir_fn_is_linear_compat(const struct nir_shader *shader,
                 * needed swizzling.
                 */
                if (is_fs_input(&intrin->src[1])) {
-                  return false;
+                  return not_linear("output comes from an input");
                }
             }
             break;
@@ -274,14 +286,20 @@ llvmpipe_nir_fn_is_linear_compat(const struct nir_shader *shader,
                                                &coord_fs_input_index,
                                                texcoord_swizzle)) {
                      //debug nir_print_shader((nir_shader *) shader, stdout);
-                     return false;
+                     return not_linear("texcoord not a plain input");
                   }
                } else if (tex->src[i].src_type == nir_tex_src_texture_handle ||
                           tex->src[i].src_type == nir_tex_src_sampler_handle) {
-                  return false;
+                  return not_linear("bindless texture");
+               } else {
+                  /* The linear samplers ignore offsets, comparators, ... */
+                  return not_linear("texture source other than coord");
                }
             }
 
+            if (tex->is_array || tex->is_shadow)
+               return not_linear("array or shadow texture");
+
             switch (tex->op) {
             case nir_texop_tex:
                tex_info->modifier = LP_BLD_TEX_MODIFIER_NONE;
@@ -289,7 +307,7 @@ llvmpipe_nir_fn_is_linear_compat(const struct nir_shader *shader,
             default:
                /* inaccurate but sufficient. */
                tex_info->modifier = LP_BLD_TEX_MODIFIER_EXPLICIT_LOD;
-               return false;
+               return not_linear("texture op other than tex");
             }
             switch (tex->sampler_dim) {
             case GLSL_SAMPLER_DIM_2D:
@@ -298,7 +316,7 @@ llvmpipe_nir_fn_is_linear_compat(const struct nir_shader *shader,
             default:
                /* inaccurate but sufficient. */
                tex_info->target = TGSI_TEXTURE_1D;
-               return false;
+               return not_linear("texture not 2D");
             }
 
             tex_info->sampler_unit = tex->sampler_index;
@@ -335,23 +353,23 @@ llvmpipe_nir_fn_is_linear_compat(const struct nir_shader *shader,
                      nir_load_const_instr *load =
                         nir_def_as_load_const(alu->src[s].src.ssa);
                      if (!check_load_const_in_zero_one(load)) {
-                        return false;
+                        return not_linear("fmul by immediate outside [0,1]");
                      }
                   } else if (is_fs_input(&alu->src[s].src)) {
                      /* we don't know if the fs inputs are in [0,1] */
-                     return false;
+                     return not_linear("fmul by an input");
                   }
                }
                break;
             }
             default:
                // disallowed instruction
-               return false;
+               return not_linear(nir_op_infos[alu->op].name);
             }
             break;
          }
          default:
-            return false;
+            return not_linear("unsupported instruction type");
          }
       }
    }
@@ -366,22 +384,130 @@ llvmpipe_nir_is_linear_compat(struct nir_shader *shader,
    int num_tex = info->num_texs;
 
    if (util_bitcount64(shader->info.inputs_read) > LP_MAX_LINEAR_INPUTS)
-      return false;
-   
+      return not_linear("too many inputs");
+
    if (!shader->info.outputs_written || shader->info.fs.color_is_dual_source ||
        (shader->info.outputs_written & ~BITFIELD64_BIT(FRAG_RESULT_DATA0)))
-      return false;
+      return not_linear("outputs other than color0");
 
    info->num_texs = 0;
    nir_foreach_function_impl(impl, shader) {
-      if (!llvmpipe_nir_fn_is_linear_compat(shader, impl, info))
+      if (!llvmpipe_nir_fn_is_linear_compat(shader, impl, info)) {
+         info->num_texs = num_tex;
          return false;
+      }
    }
    info->num_texs = num_tex;
    return true;
 }
 
 
+/*
+ * If src is the full result of a tex instruction using texture and
+ * sampler unit N of a non-array, non-shadow 2D texture, and a texcoord
+ * from the .xy of an input as its only source, return the instruction,
+ * else NULL.  The fastpaths ignore offsets, layers and comparators.
+ */
+static nir_tex_instr *
+get_plain_tex(nir_def *def)
+{
+   if (def->num_components != 4 ||
+       def->parent_instr->type != nir_instr_type_tex)
+      return NULL;
+
+   nir_tex_instr *tex = nir_instr_as_tex(def->parent_instr);
+   if (tex->op != nir_texop_tex ||
+       tex->texture_index != tex->sampler_index ||
+       tex->sampler_dim != GLSL_SAMPLER_DIM_2D ||
+       tex->is_array || tex->is_shadow ||
+       tex->num_srcs != 1 ||
+       tex->src[0].src_type != nir_tex_src_coord)
+      return NULL;
+
+   unsigned input;
+   int swizzle[4] = {-1, -1, -1, -1};
+   if (!get_texcoord_provenance(&tex->src[0], &input, swizzle) ||
+       swizzle[0] != 0 || swizzle[1] != 1)
+      return NULL;
+
+   return tex;
+}
+
+
+/*
+ * The fastpaths only handle texcoords interpolated with the perspective
+ * mode, see lp_linear_init_interp().
+ */
+static bool
+is_perspective_texcoord(const struct lp_tgsi_info *info, unsigned tex)
+{
+   const unsigned input = info->tex[tex].coord[0].u.index;
+
+   return info->base.input_interpolate[input] == TGSI_INTERPOLATE_PERSPECTIVE;
+}
+
+
+/*
+ * Recognize the linear shaders which have hand-written fastpaths in
+ * lp_state_fs_linear.c: color0 = tex0(input0.xy) is BLIT_RGBA, and
+ * color0 = tex0(inputN.xy) * tex1(inputM.xy) is TEX_MODULATE.  Anything
+ * else stays LLVM_LINEAR.
+ */
+static enum lp_fs_kind
+llvmpipe_nir_linear_kind(struct nir_shader *shader,
+                         const struct lp_tgsi_info *info)
+{
+   nir_intrinsic_instr *store = NULL;
+
+   nir_foreach_function_impl(impl, shader) {
+      nir_foreach_block(block, impl) {
+         nir_foreach_instr(instr, block) {
+            if (instr->type != nir_instr_type_intrinsic)
+               continue;
+            nir_intrinsic_instr *intrin = nir_instr_as_intrinsic(instr);
+            if (intrin->intrinsic != nir_intrinsic_store_deref)
+               continue;
+            if (store)
+               return LP_FS_KIND_LLVM_LINEAR;
+            store = intrin;
+         }
+      }
+   }
+
+   if (!store || nir_intrinsic_write_mask(store) != 0xf)
+      return LP_FS_KIND_LLVM_LINEAR;
+
+   nir_def *color = store->src[1].ssa;
+
+   if (info->num_texs == 1) {
+      nir_tex_instr *tex = get_plain_tex(color);
+      if (tex && tex->texture_index == 0 &&
+          info->tex[0].coord[0].u.index == 0 &&
+          is_perspective_texcoord(info, 0))
+         return LP_FS_KIND_BLIT_RGBA;
+   }
+
+   if (info->num_texs == 2 &&
+       color->parent_instr->type == nir_instr_type_alu) {
+      nir_alu_instr *alu = nir_instr_as_alu(color->parent_instr);
+      if (alu->op != nir_op_fmul ||
+          !nir_alu_src_is_trivial_ssa(alu, 0) ||
+          !nir_alu_src_is_trivial_ssa(alu, 1))
+         return LP_FS_KIND_LLVM_LINEAR;
+
+      nir_tex_instr *tex0 = get_plain_tex(alu->src[0].src.ssa);
+      nir_tex_instr *tex1 = get_plain_tex(alu->src[1].src.ssa);
+      if (tex0 && tex1 &&
+          tex0->texture_index + tex1->texture_index == 1 &&
+          is_perspective_texcoord(info, 0) &&
+          is_perspective_texcoord(info, 1))
+         return LP_FS_KIND_TEX_MODULATE;
+   }
+
+   return LP_FS_KIND_LLVM_LINEAR;
+}
+
+
 /*
  * Analyze the given NIR fragment shader and set its shader->kind field
  * to LP_FS_KIND_x.
@@ -389,13 +515,27 @@ llvmpipe_nir_is_linear_compat(struct nir_shader *shader,
 void
 llvmpipe_fs_analyse_nir(struct lp_fragment_shader *shader)
 {
-   if (!shader->info.indirect_textures &&
-       !shader->info.sampler_texture_units_different &&
-       shader->info.num_texs <= LP_MAX_LINEAR_TEXTURES &&
-       llvmpipe_nir_is_linear_compat(shader->base.ir.nir, &shader->info)) {
-      shader->kind = LP_FS_KIND_LLVM_LINEAR;
+   if (LP_DEBUG & DEBUG_LINEAR)
+      debug_printf("llvmpipe: fragment shader #%u linear analysis:\n",
+                   shader->no);
+
+   if (shader->info.indirect_textures) {
+      shader->kind = LP_FS_KIND_GENERAL;
+      not_linear("indirect textures");
+   } else if (shader->info.sampler_texture_units_different) {
+      shader->kind = LP_FS_KIND_GENERAL;
+      not_linear("sampler and texture units differ");
+   } else if (shader->info.num_texs > LP_MAX_LINEAR_TEXTURES) {
+      shader->kind = LP_FS_KIND_GENERAL;
+      not_linear("too many textures");
+   } else if (llvmpipe_nir_is_linear_compat(shader->base.ir.nir,
+                                            &shader->info)) {
+      shader->kind = llvmpipe_nir_linear_kind(shader->base.ir.nir,
+                                              &shader->info);
    } else {
       shader->kind = LP_FS_KIND_GENERAL;
    }
-}
 
+   if (LP_DEBUG & DEBUG_LINEAR)
+      debug_printf("    ----> %s\n", lp_debug_fs_kind(shader->kind));
+}
@@ -129,6 +129,41 @@ blend_premul(struct color_blend *blend)
 }
 
 
+/* As above, but for srcalpha/inv_src_alpha (ie straight alpha)
+ * blending.
+ */
+static void
+blend_srcalpha(struct color_blend *blend)
+{
+   const uint32_t *src = blend->src;  /* aligned */
+   uint32_t *dst = (uint32_t *)blend->color;      /* unaligned */
+   const int width = blend->width;
+   int i;
+   union { __m128i m128; uint ui[4]; } dstreg;
+
+   blend->color += blend->stride;
+
+   for (i = 0; i + 3 < width; i += 4) {
+      __m128i tmp;
+      tmp = _mm_loadu_si128((const __m128i *)&dst[i]);  /* UNALIGNED READ */
+      dstreg.m128 = util_sse2_blend_srcalpha_4(*(const __m128i *)&src[i],
+                                               tmp);
+      _mm_storeu_si128((__m128i *)&dst[i], dstreg.m128); /* UNALIGNED WRITE */
+   }
+
+   if (i < width) {
+      int j;
+      for (j = 0; j < width - i ; j++) {
+         dstreg.ui[j] = dst[i+j];
+      }
+      dstreg.m128 = util_sse2_blend_srcalpha_4(*(const __m128i *)&src[i],
+                                               dstreg.m128);
+      for (; i < width; i++)
+         dst[i] = dstreg.ui[i&3];
+   }
+}
+
+
 static void
 blend_noop(struct color_blend *blend)
 {
@@ -330,6 +365,41 @@ shade_rgb1(struct shader *shader)
 }
 
 
+/* Multiply two unorm8 vectors, rounding to nearest: with t = a * b + 128,
+ * (t + (t >> 8)) >> 8 is round(a * b / 255) for all 8-bit a and b.
+ */
+static inline __m128i
+mul_unorm8_epi16(__m128i a, __m128i b)
+{
+   __m128i t = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(0x80));
+   return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+
+static const uint32_t *
+shade_modulate(struct shader *shader)
+{
+   const __m128i zero = _mm_setzero_si128();
+   const uint32_t *src0 = shader->src0;
+   const uint32_t *src1 = shader->src1;
+   uint32_t *dst = shader->out0;
+   int width = shader->width;
+   int i;
+
+   for (i = 0; i + 3 < width; i += 4) {
+      __m128i s0 = *(const __m128i *)&src0[i];
+      __m128i s1 = *(const __m128i *)&src1[i];
+      __m128i lo = mul_unorm8_epi16(_mm_unpacklo_epi8(s0, zero),
+                                    _mm_unpacklo_epi8(s1, zero));
+      __m128i hi = mul_unorm8_epi16(_mm_unpackhi_epi8(s0, zero),
+                                    _mm_unpackhi_epi8(s1, zero));
+      *(__m128i *)&dst[i] = _mm_packus_epi16(lo, hi);
+   }
+
+   return shader->out0;
+}
+
+
 static void
 init_shader(struct shader *shader,
            int x, int y, int width, int height)
@@ -573,6 +643,157 @@ blit_rgba_blend_premul(const struct lp_rast_state *state,
 }
 
 
+/* Linear shader variant implementing the BLIT_RGBA shader with
+ * srcalpha/inv_src_alpha blending.
+ */
+static bool
+blit_rgba_blend_srcalpha(const struct lp_rast_state *state,
+                         unsigned x, unsigned y,
+                         unsigned width, unsigned height,
+                         const float (*a0)[4],
+                         const float (*dadx)[4],
+                         const float (*dady)[4],
+                         uint8_t *color,
+                         unsigned stride)
+{
+   const struct lp_jit_resources *resources = &state->jit_resources;
+   struct nearest_sampler samp;
+   struct color_blend blend;
+
+   LP_DBG(DEBUG_RAST, "%s\n", __func__);
+
+   if (!init_nearest_sampler(&samp,
+                             &resources->textures[0],
+                             x, y, width, height,
+                             a0[1][0], dadx[1][0], dady[1][0],
+                             a0[1][1], dadx[1][1], dady[1][1],
+                             a0[0][3], dadx[0][3], dady[0][3]))
+      return false;
+
+   init_blend(&blend, x, y, width, height, color, stride);
+
+   /* Rasterize the rectangle and run the shader:
+    */
+   for (y = 0; y < height; y++) {
+      blend.src = samp.fetch(&samp);
+      blend_srcalpha(&blend);
+   }
+
+   return true;
+}
+
+
+/* Body of the TEX_MODULATE shader variants: fetch a row from each of
+ * the two textures, multiply them and blend the result with the given
+ * function.
+ */
+static inline bool
+modulate_rgba(const struct lp_rast_state *state,
+              unsigned x, unsigned y,
+              unsigned width, unsigned height,
+              const float (*a0)[4],
+              const float (*dadx)[4],
+              const float (*dady)[4],
+              uint8_t *color,
+              unsigned stride,
+              void (*blend_row)(struct color_blend *blend))
+{
+   const struct lp_jit_resources *resources = &state->jit_resources;
+   const struct lp_tgsi_info *info = &state->variant->shader->info;
+   struct nearest_sampler samp[2];
+   struct color_blend blend;
+   struct shader shader;
+
+   for (unsigned i = 0; i < 2; i++) {
+      const struct lp_tgsi_texture_info *tex_info = &info->tex[i];
+      const unsigned input = tex_info->coord[0].u.index + 1;
+
+      if (!init_nearest_sampler(&samp[i],
+                                &resources->textures[tex_info->texture_unit],
+                                x, y, width, height,
+                                a0[input][0], dadx[input][0], dady[input][0],
+                                a0[input][1], dadx[input][1], dady[input][1],
+                                a0[0][3], dadx[0][3], dady[0][3]))
+         return false;
+   }
+
+   init_blend(&blend, x, y, width, height, color, stride);
+
+   init_shader(&shader, x, y, width, height);
+
+   /* Rasterize the rectangle and run the shader:
+    */
+   for (y = 0; y < height; y++) {
+      shader.src0 = samp[0].fetch(&samp[0]);
+      shader.src1 = samp[1].fetch(&samp[1]);
+      blend.src = shade_modulate(&shader);
+      blend_row(&blend);
+   }
+
+   return true;
+}
+
+
+/* Linear shader variant implementing the TEX_MODULATE shader without
+ * blending.
+ */
+static bool
+modulate_rgba_opaque(const struct lp_rast_state *state,
+                     unsigned x, unsigned y,
+                     unsigned width, unsigned height,
+                     const float (*a0)[4],
+                     const float (*dadx)[4],
+                     const float (*dady)[4],
+                     uint8_t *color,
+                     unsigned stride)
+{
+   LP_DBG(DEBUG_RAST, "%s\n", __func__);
+
+   return modulate_rgba(state, x, y, width, height, a0, dadx, dady,
+                        color, stride, blend_noop);
+}
+
+
+/* Linear shader variant implementing the TEX_MODULATE shader with
+ * one/inv_src_alpha blending.
+ */
+static bool
+modulate_rgba_blend_premul(const struct lp_rast_state *state,
+                           unsigned x, unsigned y,
+                           unsigned width, unsigned height,
+                           const float (*a0)[4],
+                           const float (*dadx)[4],
+                           const float (*dady)[4],
+                           uint8_t *color,
+                           unsigned stride)
+{
+   LP_DBG(DEBUG_RAST, "%s\n", __func__);
+
+   return modulate_rgba(state, x, y, width, height, a0, dadx, dady,
+                        color, stride, blend_premul);
+}
+
+
+/* Linear shader variant implementing the TEX_MODULATE shader with
+ * srcalpha/inv_src_alpha blending.
+ */
+static bool
+modulate_rgba_blend_srcalpha(const struct lp_rast_state *state,
+                             unsigned x, unsigned y,
+                             unsigned width, unsigned height,
+                             const float (*a0)[4],
+                             const float (*dadx)[4],
+                             const float (*dady)[4],
+                             uint8_t *color,
+                             unsigned stride)
+{
+   LP_DBG(DEBUG_RAST, "%s\n", __func__);
+
+   return modulate_rgba(state, x, y, width, height, a0, dadx, dady,
+                        color, stride, blend_srcalpha);
+}
+
+
 /* Linear shader which always emits red.  Used for debugging.
  */
 static bool
@@ -637,6 +858,46 @@ is_one_inv_src_alpha_blend(const struct lp_fragment_shader_variant *variant)
 }
 
 
+/* Check for ADD/SRC_ALPHA/INV_SRC_ALPHA, ie straight alpha blending.
+ */
+static bool
+is_src_alpha_inv_src_alpha_blend(const struct lp_fragment_shader_variant *variant)
+{
+   return
+      !variant->key.blend.logicop_enable &&
+      variant->key.blend.rt[0].blend_enable &&
+      variant->key.blend.rt[0].rgb_func == PIPE_BLEND_ADD &&
+      variant->key.blend.rt[0].rgb_src_factor == PIPE_BLENDFACTOR_SRC_ALPHA &&
+      variant->key.blend.rt[0].rgb_dst_factor == PIPE_BLENDFACTOR_INV_SRC_ALPHA &&
+      variant->key.blend.rt[0].alpha_func == PIPE_BLEND_ADD &&
+      variant->key.blend.rt[0].alpha_src_factor == PIPE_BLENDFACTOR_SRC_ALPHA &&
+      variant->key.blend.rt[0].alpha_dst_factor == PIPE_BLENDFACTOR_INV_SRC_ALPHA &&
+      variant->key.blend.rt[0].colormask == 0xf;
+}
+
+
+/* The fastpaths below write texels to the color buffer without any
+ * swizzling, so the texture and color buffer channel orders must match.
+ */
+static bool
+is_matching_rgba8_texture(const struct lp_fragment_shader_variant *variant,
+                          const struct lp_sampler_static_state *samp)
+{
+   const enum pipe_format cbuf_format = variant->key.cbuf_format[0];
+
+   switch (samp->texture_state.format) {
+   case PIPE_FORMAT_B8G8R8A8_UNORM:
+      return cbuf_format == PIPE_FORMAT_B8G8R8A8_UNORM ||
+             cbuf_format == PIPE_FORMAT_B8G8R8X8_UNORM;
+   case PIPE_FORMAT_R8G8B8A8_UNORM:
+      return cbuf_format == PIPE_FORMAT_R8G8B8A8_UNORM ||
+             cbuf_format == PIPE_FORMAT_R8G8B8X8_UNORM;
+   default:
+      return false;
+   }
+}
+
+
 /* Examine the fragment shader variant and determine whether we can
  * substitute a fastpath linear shader implementation.
  */
@@ -655,15 +916,47 @@ llvmpipe_fs_variant_linear_fastpath(struct lp_fragment_shader_variant *variant)
 
    enum pipe_format tex_format = samp0->texture_state.format;
    if (variant->shader->kind == LP_FS_KIND_BLIT_RGBA &&
-       tex_format == PIPE_FORMAT_B8G8R8A8_UNORM &&
+       is_matching_rgba8_texture(variant, samp0) &&
        is_nearest_clamp_sampler(samp0)) {
       if (variant->opaque) {
-         variant->jit_linear_blit = blit_rgba_blit;
+         if (tex_format == PIPE_FORMAT_B8G8R8A8_UNORM)
+            variant->jit_linear_blit = blit_rgba_blit;
          variant->jit_linear = blit_rgba;
       } else if (is_one_inv_src_alpha_blend(variant) &&
                  util_get_cpu_caps()->has_sse2) {
          variant->jit_linear = blit_rgba_blend_premul;
+      } else if (is_src_alpha_inv_src_alpha_blend(variant) &&
+                 util_get_cpu_caps()->has_sse2) {
+         variant->jit_linear = blit_rgba_blend_srcalpha;
       }
+      if ((LP_DEBUG & DEBUG_LINEAR) && !variant->jit_linear)
+         debug_printf("  -- no fastpath for this blend state\n");
+      return;
+   }
+
+   if (variant->shader->kind == LP_FS_KIND_TEX_MODULATE) {
+      struct lp_sampler_static_state *samp1 =
+         lp_fs_variant_key_sampler_idx(&variant->key, 1);
+
+      if (!samp1 ||
+          !is_matching_rgba8_texture(variant, samp0) ||
+          !is_matching_rgba8_texture(variant, samp1) ||
+          !is_nearest_clamp_sampler(samp0) ||
+          !is_nearest_clamp_sampler(samp1) ||
+          !util_get_cpu_caps()->has_sse2) {
+         if (LP_DEBUG & DEBUG_LINEAR)
+            debug_printf("  -- modulate textures not nearest/clamped rgba8\n");
+         return;
+      }
+
+      if (variant->opaque)
+         variant->jit_linear = modulate_rgba_opaque;
+      else if (is_one_inv_src_alpha_blend(variant))
+         variant->jit_linear = modulate_rgba_blend_premul;
+      else if (is_src_alpha_inv_src_alpha_blend(variant))
+         variant->jit_linear = modulate_rgba_blend_srcalpha;
+      else if (LP_DEBUG & DEBUG_LINEAR)
+         debug_printf("  -- no fastpath for this blend state\n");
       return;
    }
 
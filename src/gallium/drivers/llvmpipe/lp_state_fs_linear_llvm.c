@@ -242,7 +242,8 @@ llvmpipe_fs_variant_linear_llvm(struct llvmpipe_context *lp,
 {
    assert(shader->kind == LP_FS_KIND_BLIT_RGBA ||
           shader->kind == LP_FS_KIND_BLIT_RGB1 ||
-          shader->kind == LP_FS_KIND_LLVM_LINEAR);
+          shader->kind == LP_FS_KIND_LLVM_LINEAR ||
+          shader->kind == LP_FS_KIND_TEX_MODULATE);
 
    struct nir_shader *nir = shader->base.ir.nir;
    struct gallivm_state *gallivm = variant->gallivm;
@@ -28,6 +28,7 @@
 
 #include "util/u_math.h"
 #include "util/u_memory.h"
+#include "util/mesa-sha1.h"
 #include "util/os_time.h"
 #include "gallivm/lp_bld_arit.h"
 #include "gallivm/lp_bld_bitarit.h"
@@ -631,11 +632,14 @@ init_args(struct gallivm_state *gallivm,
 /**
  * Generate the runtime callable function for the coefficient calculation.
  *
+ * The code only depends on the variant key, so it is looked up in the
+ * disk cache by the key alone, and the IR is only built on a miss.
  */
 static struct lp_setup_variant *
 generate_setup_variant(struct lp_setup_variant_key *key,
                        struct llvmpipe_context *lp)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
    int64_t t0 = 0, t1;
 
    if (0)
@@ -647,12 +651,30 @@ generate_setup_variant(struct lp_setup_variant_key *key,
 
    variant->no = setup_no++;
 
-   char func_name[64];
-   snprintf(func_name, sizeof(func_name), "setup_variant_%u",
+   /* The function name must not depend on the variant number, as it is
+    * looked up by name in cached code.
+    */
+   const char *func_name = "setup_variant";
+   char module_name[64];
+   snprintf(module_name, sizeof(module_name), "setup_variant_%u",
             variant->no);
 
+   unsigned char ir_sha1_cache_key[20];
+   struct mesa_sha1 ctx;
+   _mesa_sha1_init(&ctx);
+   _mesa_sha1_update(&ctx, func_name, strlen(func_name));
+   _mesa_sha1_update(&ctx, key, key->size);
+   _mesa_sha1_final(&ctx, ir_sha1_cache_key);
+
+   struct lp_cached_code cached = { 0 };
+   struct lp_variant_cache_header header = { 0 };
+   const bool needs_caching =
+      !lp_disk_cache_find_variant(screen, NULL, &cached, ir_sha1_cache_key,
+                                  &header);
+
    struct gallivm_state *gallivm;
-   variant->gallivm = gallivm = gallivm_create(func_name, &lp->context, NULL);
+   variant->gallivm = gallivm = gallivm_create(module_name, &lp->context,
+                                               &cached);
    if (!variant->gallivm) {
       goto fail;
    }
@@ -666,6 +688,17 @@ generate_setup_variant(struct lp_setup_variant_key *key,
    memcpy(&variant->key, key, key->size);
    variant->list_item_global.base = variant;
 
+   variant->function_name = MALLOC(strlen(func_name)+1);
+   if (!variant->function_name)
+      goto fail;
+
+   strcpy(variant->function_name, func_name);
+
+   if (!needs_caching) {
+      gallivm_compile_module(gallivm);
+      goto jit;
+   }
+
    /* Currently always deal with full 4-wide vertex attributes from
     * the vertices.
     */
@@ -691,11 +724,6 @@ generate_setup_variant(struct lp_setup_variant_key *key,
    if (!variant->function)
       goto fail;
 
-   variant->function_name = MALLOC(strlen(func_name)+1);
-   if (!variant->function_name)
-      goto fail;
-
-   strcpy(variant->function_name, func_name);
    LLVMSetFunctionCallConv(variant->function, LLVMCCallConv);
 
    lp_function_add_debug_info(gallivm, variant->function, func_type);
@@ -738,11 +766,16 @@ generate_setup_variant(struct lp_setup_variant_key *key,
 
    gallivm_compile_module(gallivm);
 
+jit:
    variant->jit_function = (lp_jit_setup_triangle)
       gallivm_jit_function(gallivm, variant->function, variant->function_name);
    if (!variant->jit_function)
       goto fail;
 
+   if (needs_caching)
+      lp_disk_cache_insert_variant(screen, NULL, &cached, ir_sha1_cache_key,
+                                   &header);
+
    gallivm_free_ir(variant->gallivm);
 
    /*
@@ -0,0 +1,237 @@
+/**************************************************************************
+ *
+ * Copyright 2026 Red Hat.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * @file
+ * Compute thread pool dispatch tests and microbenchmark.
+ *
+ * Checks that every iteration of a dispatch runs exactly once, and
+ * measures the time per dispatch for various pool and dispatch sizes,
+ * with uniform and uneven per-iteration cost.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "util/u_atomic.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_memory.h"
+#include "util/os_time.h"
+
+#include "lp_cs_tpool.h"
+#include "lp_test.h"
+
+
+struct cs_tpool_test_case {
+   unsigned num_iters;
+   bool uneven;
+};
+
+
+static const struct cs_tpool_test_case test_cases[] = {
+   { 1, false },
+   { 8, false },
+   { 16, false },
+   { 17, false },
+   { 64, false },
+   { 1024, false },
+   { 65536, false },
+   { 64, true },
+   { 1024, true },
+   { 65536, true },
+};
+
+
+static const unsigned thread_counts[] = { 0, 1, 2, 4, 8, 16, 64, LP_MAX_THREADS };
+
+
+struct cs_tpool_test_data {
+   const struct cs_tpool_test_case *test;
+   uint32_t *counts;
+   uint32_t sink;
+};
+
+
+static void
+test_work(void *data, int iter_idx, struct lp_cs_local_mem *lmem)
+{
+   struct cs_tpool_test_data *td = data;
+   uint32_t x = iter_idx;
+
+   /* Make some iterations up to 256 times more expensive than others. */
+   if (td->test->uneven) {
+      unsigned cost = (iter_idx * 2654435761u) >> 24;
+      for (unsigned i = 0; i < cost * 4; i++)
+         x = x * 1664525u + 1013904223u;
+   }
+
+   p_atomic_add(&td->sink, x & 1);
+   p_atomic_inc(&td->counts[iter_idx]);
+}
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "threads\t"
+           "iterations\t"
+           "uneven\t"
+           "ns_per_dispatch\n");
+
+   fflush(fp);
+}
+
+
+static void
+write_tsv_row(FILE *fp, unsigned num_threads,
+              const struct cs_tpool_test_case *test,
+              double ns_per_dispatch, bool success)
+{
+   fprintf(fp, "%s\t", success ? "pass" : "fail");
+   fprintf(fp, "%u\t%u\t%u\t%.0f\n", num_threads, test->num_iters,
+           test->uneven, ns_per_dispatch);
+   fflush(fp);
+}
+
+
+static bool
+test_one(unsigned verbose, FILE *fp, struct lp_cs_tpool *pool,
+         unsigned num_threads, const struct cs_tpool_test_case *test,
+         unsigned long n)
+{
+   struct cs_tpool_test_data td;
+   bool success = true;
+
+   /* Keep the total amount of work per case roughly constant. */
+   const unsigned reps = MAX2(1, n * 64 / test->num_iters);
+
+   td.test = test;
+   td.counts = CALLOC(test->num_iters, sizeof(*td.counts));
+   td.sink = 0;
+   if (!td.counts)
+      return false;
+
+   const int64_t start = os_time_get_nano();
+   for (unsigned r = 0; r < reps; r++) {
+      struct lp_cs_tpool_task *task =
+         lp_cs_tpool_queue_task(pool, test_work, &td, test->num_iters);
+      lp_cs_tpool_wait_for_task(pool, &task);
+   }
+   const double ns = (double)(os_time_get_nano() - start) / reps;
+
+   for (unsigned i = 0; i < test->num_iters; i++) {
+      if (td.counts[i] != reps) {
+         if (verbose < 1)
+            fprintf(stderr, "threads %u, iterations %u%s: ",
+                    num_threads, test->num_iters,
+                    test->uneven ? ", uneven" : "");
+         fprintf(stderr, "iteration %u ran %u times, expected %u\n",
+                 i, td.counts[i], reps);
+         success = false;
+         break;
+      }
+   }
+
+   if (verbose >= 1)
+      printf("threads %3u, iterations %6u%s: %10.0f ns/dispatch\n",
+             num_threads, test->num_iters, test->uneven ? ", uneven" : "",
+             ns);
+
+   if (fp)
+      write_tsv_row(fp, num_threads, test, ns, success);
+
+   FREE(td.counts);
+   return success;
+}
+
+
+static bool
+test_threads(unsigned verbose, FILE *fp, unsigned num_threads,
+             unsigned long n)
+{
+   struct lp_cs_tpool *pool = lp_cs_tpool_create(num_threads);
+   bool success = true;
+
+   if (!pool)
+      return false;
+
+   for (unsigned i = 0; i < ARRAY_SIZE(test_cases); i++) {
+      if (!test_one(verbose, fp, pool, num_threads, &test_cases[i], n))
+         success = false;
+   }
+
+   lp_cs_tpool_destroy(pool);
+   return success;
+}
+
+
+bool
+test_all(unsigned verbose, FILE *fp)
+{
+   return test_some(verbose, fp, 1000);
+}
+
+
+bool
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   const unsigned nr_cpus = util_get_cpu_caps()->nr_cpus;
+   bool success = true;
+
+   for (unsigned i = 0; i < ARRAY_SIZE(thread_counts); i++) {
+      /* Don't oversubscribe the machine, but test threads > 0 anyway. */
+      if (thread_counts[i] > MAX2(nr_cpus, 2))
+         break;
+
+      if (!test_threads(verbose, fp, thread_counts[i], n))
+         success = false;
+   }
+
+   return success;
+}
+
+
+bool
+test_single(unsigned verbose, FILE *fp)
+{
+   const unsigned num_threads =
+      MIN2(util_get_cpu_caps()->nr_cpus, LP_MAX_THREADS);
+   bool success = true;
+
+   struct lp_cs_tpool *pool = lp_cs_tpool_create(num_threads);
+   if (!pool)
+      return false;
+
+   success = test_one(verbose, fp, pool, num_threads,
+                      &test_cases[ARRAY_SIZE(test_cases) - 1], 1000);
+
+   lp_cs_tpool_destroy(pool);
+   return success;
+}
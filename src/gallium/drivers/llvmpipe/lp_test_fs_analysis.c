@@ -0,0 +1,240 @@
+/**************************************************************************
+ *
+ * Copyright 2026 Red Hat.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * @file
+ * Fragment shader linear analysis tests.
+ *
+ * Builds small texturing fragment shaders and checks which kind
+ * llvmpipe_fs_analyse_nir() gives them.  Shaders sampling with offsets
+ * or comparators must not take the linear paths, which ignore them.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "compiler/glsl_types.h"
+#include "compiler/nir/nir_builder.h"
+#include "nir/nir_to_tgsi_info.h"
+#include "util/u_memory.h"
+
+#include "lp_state_fs.h"
+#include "lp_test.h"
+
+
+enum tex_variant {
+   TEX_PLAIN,
+   TEX_OFFSET,
+   TEX_SHADOW,
+};
+
+
+struct fs_analysis_test_case {
+   const char *name;
+   unsigned num_texs;
+   /* variant of the last texture */
+   enum tex_variant variant;
+   enum lp_fs_kind expected;
+};
+
+
+static const struct fs_analysis_test_case test_cases[] = {
+   { "tex", 1, TEX_PLAIN, LP_FS_KIND_BLIT_RGBA },
+   { "tex offset", 1, TEX_OFFSET, LP_FS_KIND_GENERAL },
+   { "tex shadow", 1, TEX_SHADOW, LP_FS_KIND_GENERAL },
+   { "tex * tex", 2, TEX_PLAIN, LP_FS_KIND_TEX_MODULATE },
+   { "tex * tex offset", 2, TEX_OFFSET, LP_FS_KIND_GENERAL },
+};
+
+
+static const nir_shader_compiler_options options = { 0 };
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "shader\t"
+           "kind\n");
+
+   fflush(fp);
+}
+
+
+/* vec2(input.x, input.y), as the texcoords the analysis accepts */
+static nir_def *
+build_texcoord(nir_builder *b, nir_def *input)
+{
+   nir_alu_instr *vec = nir_alu_instr_create(b->shader, nir_op_vec2);
+
+   vec->src[0].src = nir_src_for_ssa(input);
+   vec->src[0].swizzle[0] = 0;
+   vec->src[1].src = nir_src_for_ssa(input);
+   vec->src[1].swizzle[0] = 1;
+   nir_def_init(&vec->instr, &vec->def, 2, 32);
+   nir_builder_instr_insert(b, &vec->instr);
+
+   return &vec->def;
+}
+
+
+static nir_def *
+build_tex(nir_builder *b, nir_def *input, unsigned unit,
+          enum tex_variant variant)
+{
+   nir_tex_instr *tex =
+      nir_tex_instr_create(b->shader, variant == TEX_PLAIN ? 1 : 2);
+
+   tex->op = nir_texop_tex;
+   tex->sampler_dim = GLSL_SAMPLER_DIM_2D;
+   tex->coord_components = 2;
+   tex->dest_type = nir_type_float32;
+   tex->texture_index = unit;
+   tex->sampler_index = unit;
+   tex->src[0] = nir_tex_src_for_ssa(nir_tex_src_coord,
+                                     build_texcoord(b, input));
+
+   /* Constants in [0,1], so only the source itself keeps the shader from
+    * being linear.
+    */
+   if (variant == TEX_OFFSET) {
+      tex->src[1] = nir_tex_src_for_ssa(nir_tex_src_offset,
+                                        nir_imm_ivec2(b, 1, 0));
+   } else if (variant == TEX_SHADOW) {
+      tex->is_shadow = true;
+      tex->src[1] = nir_tex_src_for_ssa(nir_tex_src_comparator,
+                                        nir_imm_float(b, 0.5));
+   }
+
+   nir_def_init(&tex->instr, &tex->def, 4, 32);
+   nir_builder_instr_insert(b, &tex->instr);
+
+   return &tex->def;
+}
+
+
+static nir_shader *
+build_shader(const struct fs_analysis_test_case *test)
+{
+   nir_builder b = nir_builder_init_simple_shader(MESA_SHADER_FRAGMENT,
+                                                  &options, "%s",
+                                                  test->name);
+
+   nir_variable *in = nir_variable_create(b.shader, nir_var_shader_in,
+                                          glsl_vec4_type(), "texcoord");
+   in->data.location = VARYING_SLOT_VAR0;
+   in->data.driver_location = 0;
+   in->data.interpolation = INTERP_MODE_SMOOTH;
+
+   nir_variable *out = nir_variable_create(b.shader, nir_var_shader_out,
+                                           glsl_vec4_type(), "color");
+   out->data.location = FRAG_RESULT_DATA0;
+
+   nir_def *input = nir_load_var(&b, in);
+   nir_def *color;
+   if (test->num_texs == 1) {
+      color = build_tex(&b, input, 0, test->variant);
+   } else {
+      color = nir_fmul(&b, build_tex(&b, input, 0, TEX_PLAIN),
+                       build_tex(&b, input, 1, test->variant));
+   }
+   nir_store_var(&b, out, color, 0xf);
+
+   nir_shader_gather_info(b.shader, nir_shader_get_entrypoint(b.shader));
+   return b.shader;
+}
+
+
+static bool
+test_one(unsigned verbose, FILE *fp,
+         const struct fs_analysis_test_case *test)
+{
+   struct lp_fragment_shader *shader = CALLOC_STRUCT(lp_fragment_shader);
+   if (!shader)
+      return false;
+
+   /* Like llvmpipe_create_fs_state(). */
+   shader->base.type = PIPE_SHADER_IR_NIR;
+   shader->base.ir.nir = build_shader(test);
+   nir_tgsi_scan_shader(shader->base.ir.nir, &shader->info.base, true);
+   shader->info.num_texs = shader->info.base.opcode_count[TGSI_OPCODE_TEX];
+
+   llvmpipe_fs_analyse_nir(shader);
+
+   const bool success = shader->kind == test->expected;
+
+   if (verbose >= 1 || !success) {
+      fprintf(success ? stdout : stderr, "%s: %s, expected %s\n",
+              test->name, lp_debug_fs_kind(shader->kind),
+              lp_debug_fs_kind(test->expected));
+   }
+
+   if (fp) {
+      fprintf(fp, "%s\t%s\t%s\n", success ? "pass" : "fail",
+              test->name, lp_debug_fs_kind(shader->kind));
+      fflush(fp);
+   }
+
+   ralloc_free(shader->base.ir.nir);
+   FREE(shader);
+   return success;
+}
+
+
+bool
+test_all(unsigned verbose, FILE *fp)
+{
+   bool success = true;
+
+   glsl_type_singleton_init_or_ref();
+
+   for (unsigned i = 0; i < ARRAY_SIZE(test_cases); i++) {
+      if (!test_one(verbose, fp, &test_cases[i]))
+         success = false;
+   }
+
+   glsl_type_singleton_decref();
+
+   return success;
+}
+
+
+bool
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+bool
+test_single(unsigned verbose, FILE *fp)
+{
+   printf("no test_single()");
+   return true;
+}
@@ -0,0 +1,329 @@
+/**************************************************************************
+ *
+ * Copyright 2026 Red Hat.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * @file
+ * Unit tests and benchmark for the masked selects and gathers at the core of
+ * shading and texture sampling, at every vector width from 4 up to 16
+ * (AVX-512) elements.
+ *
+ * With "-o file.tsv" the cycles per element are written for each width, so
+ * that 256-bit and 512-bit code can be compared on the same machine.  Run
+ * with LP_NATIVE_VECTOR_WIDTH=512 to get the 16-wide code compiled as it
+ * would be for shaders.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "util/u_memory.h"
+#include "util/u_math.h"
+
+#include "gallivm/lp_bld.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_type.h"
+#include "gallivm/lp_bld_arit.h"
+#include "gallivm/lp_bld_logic.h"
+#include "gallivm/lp_bld_gather.h"
+
+#include "lp_test.h"
+
+
+#define TABLE_SIZE 1024
+
+/* Number of vectors processed per call, so that the timing isn't dominated
+ * by the call itself.
+ */
+#define NUM_VECTORS 64
+
+
+typedef void (*wide_test_func_t)(const float *a, const float *b,
+                                 const int32_t *mask, const float *table,
+                                 const int32_t *offsets, float *res);
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "cycles_per_element\t"
+           "type\n");
+
+   fflush(fp);
+}
+
+
+static void
+write_tsv_row(FILE *fp,
+              struct lp_type type,
+              double cycles,
+              bool success)
+{
+   fprintf(fp, "%s\t", success ? "pass" : "fail");
+
+   fprintf(fp, "%.1f\t", cycles / (type.length * NUM_VECTORS));
+
+   dump_type(fp, type);
+   fprintf(fp, "\n");
+
+   fflush(fp);
+}
+
+
+/**
+ * res[i] = (mask[i] ? a[i] * b[i] : a[i] + b[i]) + table[offsets[i] / 4]
+ *
+ * The mask is loaded from memory rather than being the result of a compare,
+ * like execution masks are, so that lp_build_select() can't turn it back
+ * into a boolean vector for free.
+ */
+static LLVMValueRef
+build_wide_test_func(struct gallivm_state *gallivm,
+                     struct lp_type type)
+{
+   LLVMContextRef context = gallivm->context;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_type int_type = lp_int_type(type);
+   struct lp_build_context bld;
+
+   lp_build_context_init(&bld, gallivm, type);
+
+   LLVMTypeRef vec_type = lp_build_vec_type(gallivm, type);
+   LLVMTypeRef int_vec_type = lp_build_vec_type(gallivm, int_type);
+   LLVMTypeRef i8_ptr_type = LLVMPointerType(LLVMInt8TypeInContext(context), 0);
+   LLVMTypeRef i32_type = LLVMInt32TypeInContext(context);
+   LLVMTypeRef args[6] = {
+      LLVMPointerType(vec_type, 0),
+      LLVMPointerType(vec_type, 0),
+      LLVMPointerType(int_vec_type, 0),
+      i8_ptr_type,
+      LLVMPointerType(int_vec_type, 0),
+      LLVMPointerType(vec_type, 0),
+   };
+   LLVMValueRef func =
+      LLVMAddFunction(gallivm->module, "test",
+                      LLVMFunctionType(LLVMVoidTypeInContext(context),
+                                       args, ARRAY_SIZE(args), 0));
+   LLVMSetFunctionCallConv(func, LLVMCCallConv);
+
+   LLVMBasicBlockRef block = LLVMAppendBasicBlockInContext(context, func,
+                                                           "entry");
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   for (unsigned i = 0; i < NUM_VECTORS; i++) {
+      LLVMValueRef index = LLVMConstInt(i32_type, i, 0);
+      LLVMValueRef ptrs[6];
+
+      for (unsigned j = 0; j < ARRAY_SIZE(ptrs); j++) {
+         if (j == 3)
+            continue;
+         LLVMTypeRef elem_type = j == 2 || j == 4 ? int_vec_type : vec_type;
+         ptrs[j] = LLVMBuildGEP2(builder, elem_type, LLVMGetParam(func, j),
+                                 &index, 1, "");
+      }
+
+      LLVMValueRef a = LLVMBuildLoad2(builder, vec_type, ptrs[0], "a");
+      LLVMValueRef b = LLVMBuildLoad2(builder, vec_type, ptrs[1], "b");
+      LLVMValueRef mask = LLVMBuildLoad2(builder, int_vec_type, ptrs[2], "mask");
+      LLVMValueRef offsets = LLVMBuildLoad2(builder, int_vec_type, ptrs[4],
+                                            "offsets");
+
+      LLVMValueRef res = lp_build_select(&bld, mask,
+                                         lp_build_mul(&bld, a, b),
+                                         lp_build_add(&bld, a, b));
+
+      LLVMValueRef texel = lp_build_gather(gallivm, type.length, 32,
+                                           lp_type_float(32), true,
+                                           LLVMGetParam(func, 3), offsets,
+                                           false);
+      res = lp_build_add(&bld, res, texel);
+
+      LLVMBuildStore(builder, res, ptrs[5]);
+   }
+
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, func);
+
+   return func;
+}
+
+
+static bool
+test_one(unsigned verbose,
+         FILE *fp,
+         struct lp_type type)
+{
+   const unsigned n = LP_TEST_NUM_SAMPLES;
+   const unsigned num_elems = type.length * NUM_VECTORS;
+   const unsigned size = num_elems * 4;
+   int64_t cycles[LP_TEST_NUM_SAMPLES];
+   double cycles_avg = 0.0;
+   bool success = true;
+   unsigned i, j;
+
+   if (verbose >= 1)
+      dump_type(stdout, type);
+
+   lp_context_ref context;
+   lp_context_create(&context);
+   struct gallivm_state *gallivm =
+      gallivm_create("test_module", &context, NULL);
+
+   LLVMValueRef func = build_wide_test_func(gallivm, type);
+
+   gallivm_compile_module(gallivm);
+
+   wide_test_func_t test_func_jit =
+      (wide_test_func_t)gallivm_jit_function(gallivm, func, "test");
+
+   gallivm_free_ir(gallivm);
+
+   float *a = align_malloc(size, 64);
+   float *b = align_malloc(size, 64);
+   int32_t *mask = align_malloc(size, 64);
+   int32_t *offsets = align_malloc(size, 64);
+   float *res = align_malloc(size, 64);
+   float *table = align_malloc(TABLE_SIZE * 4, 64);
+
+   for (i = 0; i < TABLE_SIZE; ++i)
+      table[i] = (float)i;
+
+   for (i = 0; i < n && success; ++i) {
+      for (j = 0; j < num_elems; ++j) {
+         a[j] = (float)(rand() % 256) / 16.0f;
+         b[j] = (float)(rand() % 256) / 16.0f;
+         mask[j] = rand() & 1 ? ~0 : 0;
+         offsets[j] = (rand() % TABLE_SIZE) * 4;
+      }
+
+      int64_t start_counter = rdtsc();
+      test_func_jit(a, b, mask, table, offsets, res);
+      int64_t end_counter = rdtsc();
+
+      cycles[i] = end_counter - start_counter;
+
+      for (j = 0; j < num_elems; ++j) {
+         float ref = (mask[j] ? a[j] * b[j] : a[j] + b[j]) +
+                     table[offsets[j] / 4];
+
+         if (res[j] != ref) {
+            success = false;
+
+            if (verbose < 1)
+               dump_type(stderr, type);
+            fprintf(stderr,
+                    "\nMISMATCH at %u: a = %f, b = %f, mask = %d, "
+                    "offset = %d, res = %f, ref = %f\n",
+                    j, a[j], b[j], mask[j], offsets[j], res[j], ref);
+            break;
+         }
+      }
+   }
+
+   align_free(a);
+   align_free(b);
+   align_free(mask);
+   align_free(offsets);
+   align_free(res);
+   align_free(table);
+
+   /*
+    * Unfortunately the output of cycle counter is not very reliable as it comes
+    * -- sometimes we get outliers (due IRQs perhaps?) which are
+    * better removed to avoid random or biased data.
+    */
+   if (success) {
+      double sum = 0.0, sum2 = 0.0;
+      double avg, std;
+      unsigned m;
+
+      for (i = 0; i < n; ++i) {
+         sum += cycles[i];
+         sum2 += cycles[i]*cycles[i];
+      }
+
+      avg = sum/n;
+      std = sqrtf((sum2 - n*avg*avg)/n);
+
+      m = 0;
+      sum = 0.0;
+      for (i = 0; i < n; ++i) {
+         if (fabs(cycles[i] - avg) <= 4.0*std) {
+            sum += cycles[i];
+            ++m;
+         }
+      }
+
+      cycles_avg = sum/m;
+   }
+
+   if (verbose >= 1)
+      printf("%s\n", success ? "" : "FAIL");
+
+   if (fp)
+      write_tsv_row(fp, type, cycles_avg, success);
+
+   gallivm_destroy(gallivm);
+   lp_context_destroy(&context);
+
+   return success;
+}
+
+
+bool
+test_all(unsigned verbose, FILE *fp)
+{
+   bool success = true;
+
+   for (unsigned length = 4; length <= 16; length *= 2) {
+      if (!test_one(verbose, fp, lp_type_float_vec(32, length * 32)))
+         success = false;
+   }
+
+   return success;
+}
+
+
+bool
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   /*
+    * Not randomly generated test cases, so test all.
+    */
+
+   return test_all(verbose, fp);
+}
+
+
+bool
+test_single(unsigned verbose, FILE *fp)
+{
+   printf("no test_single()");
+   return true;
+}
@@ -23,6 +23,7 @@
 
 #include "lp_context.h"
 #include "lp_texture_handle.h"
+#include "lp_public.h"
 #include "lp_screen.h"
 
 #include "gallivm/lp_bld_const.h"
@@ -1458,28 +1459,21 @@ llvmpipe_register_shader(struct pipe_context *ctx, const struct pipe_shader_stat
       nir_shader_instructions_pass(shader->ir.nir, register_instr, nir_metadata_all, ctx);
 }
 
-void
-llvmpipe_clear_sample_functions_cache(struct llvmpipe_context *ctx, struct pipe_fence_handle **fence)
+static bool
+sampler_matrix_has_cache_entry(struct lp_sampler_matrix *matrix)
 {
-   if (!fence)
-      return;
-
-   struct lp_sampler_matrix *matrix = &ctx->sampler_matrix;
-
-   /* If the cache is empty, there is nothing to do. */
-   bool has_cache_entry = false;
    for (uint32_t i = 0; i < ARRAY_SIZE(matrix->caches); i++) {
-      if (_mesa_hash_table_num_entries(acquire_latest_function_cache(&matrix->caches[i]))) {
-         has_cache_entry = true;
-         break;
-      }
+      if (_mesa_hash_table_num_entries(acquire_latest_function_cache(&matrix->caches[i])))
+         return true;
    }
-   if (!has_cache_entry)
-      return;
 
-   ctx->pipe.screen->fence_finish(ctx->pipe.screen, NULL, *fence, OS_TIMEOUT_INFINITE);
+   return false;
+}
 
-   /* All work is finished, it's safe to move cache entries into the table. */
+/* No shader using the handles may be running. */
+static void
+sampler_matrix_move_caches(struct lp_sampler_matrix *matrix)
+{
    hash_table_foreach_remove(acquire_latest_function_cache(&matrix->caches[LP_FUNCTION_CACHE_SAMPLE]), entry) {
       struct sample_function_cache_key *key = (void *)entry->key;
 
@@ -1520,3 +1514,43 @@ llvmpipe_clear_sample_functions_cache(struct llvmpipe_context *ctx, struct pipe_
       util_dynarray_clear(&matrix->caches[i].trash_caches);
    }
 }
+
+void
+llvmpipe_clear_sample_functions_cache(struct llvmpipe_context *ctx, struct pipe_fence_handle **fence)
+{
+   struct lp_sampler_matrix *matrix = &ctx->sampler_matrix;
+
+   /* The fence only covers the work of this context. */
+   if (!fence || matrix->shared)
+      return;
+
+   /* If the cache is empty, there is nothing to do. */
+   if (!sampler_matrix_has_cache_entry(matrix))
+      return;
+
+   ctx->pipe.screen->fence_finish(ctx->pipe.screen, NULL, *fence, OS_TIMEOUT_INFINITE);
+
+   /* All work is finished, it's safe to move cache entries into the table. */
+   sampler_matrix_move_caches(matrix);
+}
+
+void
+llvmpipe_share_texture_handles(struct pipe_context *pipe)
+{
+   llvmpipe_context(pipe)->sampler_matrix.shared = true;
+}
+
+bool
+llvmpipe_texture_handles_outdated(struct pipe_context *pipe)
+{
+   return sampler_matrix_has_cache_entry(&llvmpipe_context(pipe)->sampler_matrix);
+}
+
+void
+llvmpipe_update_texture_handles(struct pipe_context *pipe)
+{
+   struct lp_sampler_matrix *matrix = &llvmpipe_context(pipe)->sampler_matrix;
+
+   if (sampler_matrix_has_cache_entry(matrix))
+      sampler_matrix_move_caches(matrix);
+}
@@ -65,6 +65,11 @@ struct lp_sampler_matrix {
 
    simple_mtx_t lock;
 
+   /* The handles are used by other contexts too, the caches are only moved
+    * into them by llvmpipe_update_texture_handles().
+    */
+   bool shared;
+
    struct llvmpipe_context *ctx;
 
    /* Use a separate LLVMContext since it is not thread safe but can be accessed by shaders. */
@@ -8,6 +8,9 @@
 
 #include "radix_sort/radix_sort_u64.h"
 #include "bvh/vk_bvh.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_debug.h"
+#include "vk_cmd_enqueue_entrypoints.h"
 
 struct radix_sort_vk_target_config lvp_radix_sort_config = {
    .keyval_dwords = 2,
@@ -76,7 +79,7 @@ lvp_get_leaf_node_size(VkGeometryTypeKHR geometry_type, uint32_t *ir_leaf_node_s
    }
 }
 
-static VkDeviceSize
+VkDeviceSize
 lvp_get_as_size_internal(VkGeometryTypeKHR geometry_type, uint32_t leaf_node_count)
 {
    uint32_t internal_node_count = MAX2(leaf_node_count, 2) - 1;
@@ -231,7 +234,7 @@ ir_id_to_offset(uint32_t id)
    return id & (~3u);
 }
 
-static uint32_t
+uint32_t
 lvp_pack_sbt_offset_and_flags(uint32_t sbt_offset, VkGeometryInstanceFlagsKHR flags)
 {
    uint32_t ret = sbt_offset;
@@ -246,185 +249,305 @@ lvp_pack_sbt_offset_and_flags(uint32_t sbt_offset, VkGeometryInstanceFlagsKHR fl
    return ret;
 }
 
-static void
-lvp_select_subtrees_to_flatten(const struct vk_ir_header *header, const struct vk_ir_box_node *ir_box_nodes,
-                               const uint32_t *node_depth, const uint32_t *child_counts, uint32_t root_offset,
-                               uint32_t index, struct util_dynarray *subtrees, uint32_t *max_subtree_size)
+static float
+lvp_aabb_component(const vec3 *v, unsigned axis)
 {
-   uint32_t depth = node_depth[header->ir_internal_node_count - index - 1];
-   uint32_t available_depth = 23 - depth;
-   uint32_t allowed_child_count = 1 << available_depth;
-   uint32_t child_count = child_counts[index];
-   bool flatten = child_count > allowed_child_count;
+   return ((const float *)v)[axis];
+}
 
-   const struct vk_ir_box_node *node = ir_box_nodes + index;
+static float
+lvp_aabb_half_area(const vk_aabb *aabb)
+{
+   float x = aabb->max.x - aabb->min.x;
+   float y = aabb->max.y - aabb->min.y;
+   float z = aabb->max.z - aabb->min.z;
+   return x * y + y * z + z * x;
+}
 
-   bool has_internal_child = false;
-   for (uint32_t child_index = 0; child_index < 2; child_index++) {
-      if (node->children[child_index] == VK_BVH_INVALID_NODE)
-         continue;
+/* Writes a box node over child_count children.  Inactive children must not
+ * be passed in, the remaining slots are marked as invalid.
+ */
+void
+lvp_bvh_encode_box_node(struct lvp_bvh_box_node *node, const uint32_t *children,
+                        const vk_aabb *child_bounds, uint32_t child_count)
+{
+   vk_aabb bounds[LVP_BVH_WIDTH];
+   vk_aabb node_bounds = {
+      .min = { INFINITY, INFINITY, INFINITY },
+      .max = { -INFINITY, -INFINITY, -INFINITY },
+   };
+
+   assert(child_count <= LVP_BVH_WIDTH);
+
+   for (uint32_t i = 0; i < child_count; i++) {
+      bounds[i] = child_bounds[i];
+
+      /* Increase the bounding box size a bit for watertightness. */
+      bounds[i].min.x -= MAX2(fabsf(bounds[i].min.x), 1.0) * FLT_EPSILON;
+      bounds[i].min.y -= MAX2(fabsf(bounds[i].min.y), 1.0) * FLT_EPSILON;
+      bounds[i].min.z -= MAX2(fabsf(bounds[i].min.z), 1.0) * FLT_EPSILON;
+      bounds[i].max.x += MAX2(fabsf(bounds[i].max.x), 1.0) * FLT_EPSILON;
+      bounds[i].max.y += MAX2(fabsf(bounds[i].max.y), 1.0) * FLT_EPSILON;
+      bounds[i].max.z += MAX2(fabsf(bounds[i].max.z), 1.0) * FLT_EPSILON;
+
+      node_bounds.min.x = MIN2(node_bounds.min.x, bounds[i].min.x);
+      node_bounds.min.y = MIN2(node_bounds.min.y, bounds[i].min.y);
+      node_bounds.min.z = MIN2(node_bounds.min.z, bounds[i].min.z);
+      node_bounds.max.x = MAX2(node_bounds.max.x, bounds[i].max.x);
+      node_bounds.max.y = MAX2(node_bounds.max.y, bounds[i].max.y);
+      node_bounds.max.z = MAX2(node_bounds.max.z, bounds[i].max.z);
+   }
 
-      uint32_t ir_child_offset = ir_id_to_offset(node->children[child_index]);
-      if (ir_child_offset < root_offset)
-         continue;
+   for (unsigned axis = 0; axis < 3; axis++) {
+      float origin = child_count ? MAX2(lvp_aabb_component(&node_bounds.min, axis), -FLT_MAX) : 0.0f;
+      float max = child_count ? lvp_aabb_component(&node_bounds.max, axis) : 0.0f;
+
+      /* Pick the finest grid whose 255 steps still cover the node. */
+      double extent = (double)max - origin;
+      int exponent = -126;
+      if (extent > 0.0)
+         exponent = isinf(extent) ? 127 : CLAMP((int)ceil(log2(extent / 255.0)), -126, 127);
+      while (exponent < 127 && origin + 255.0f * ldexpf(1.0f, exponent) < max)
+         exponent++;
 
-      if (!flatten) {
-         uint32_t src_index = (ir_child_offset - root_offset) / sizeof(struct vk_ir_box_node);
-         lvp_select_subtrees_to_flatten(header, ir_box_nodes, node_depth, child_counts, root_offset,
-                                        src_index, subtrees, max_subtree_size);
+      float scale = ldexpf(1.0f, exponent);
+
+      node->origin[axis] = origin;
+      node->exponents[axis] = exponent + 127;
+
+      /* q * scale is exact, so rounding only happens when adding the
+       * origin.  The traversal decodes with the same operations.
+       */
+      for (uint32_t i = 0; i < child_count; i++) {
+         float child_min = lvp_aabb_component(&bounds[i].min, axis);
+         float child_max = lvp_aabb_component(&bounds[i].max, axis);
+
+         uint32_t q_min = CLAMP(floor(((double)child_min - origin) / scale), 0.0, 255.0);
+         while (q_min > 0 && origin + (float)q_min * scale > child_min)
+            q_min--;
+
+         uint32_t q_max = CLAMP(ceil(((double)child_max - origin) / scale), 0.0, 255.0);
+         while (q_max < 255 && origin + (float)q_max * scale < child_max)
+            q_max++;
+
+         node->child_min[axis][i] = q_min;
+         node->child_max[axis][i] = q_max;
       }
 
-      has_internal_child = true;
+      for (uint32_t i = child_count; i < LVP_BVH_WIDTH; i++) {
+         node->child_min[axis][i] = 0;
+         node->child_max[axis][i] = 0;
+      }
    }
+   node->exponents[3] = 0;
 
-   if (flatten && has_internal_child) {
-      util_dynarray_append(subtrees, uint32_t, index);
-      *max_subtree_size = MAX2(*max_subtree_size, child_count);
-      return;
-   }
+   for (uint32_t i = 0; i < LVP_BVH_WIDTH; i++)
+      node->children[i] = i < child_count ? children[i] : LVP_BVH_INVALID_NODE;
+}
+
+struct lvp_encode_state {
+   const uint8_t *ir_bvh;
+   /* offset of the first IR box node, everything before it are leaves */
+   uint32_t root_offset;
+   uint32_t ir_leaf_node_size;
+   uint32_t output_leaf_node_size;
+   uint32_t leaf_type;
+   /* number of leaves below every IR box node */
+   const uint32_t *leaf_counts;
+
+   uint8_t *output;
+   uint32_t leaf_nodes_offset;
+   uint32_t node_count;
+
+   /* scratch space for rebuilding subtrees that are too deep */
+   struct util_dynarray leaves;
+   struct util_dynarray stack;
+};
+
+struct lvp_encode_child {
+   uint32_t ir_offset;
+   uint32_t leaf_count;
+   vk_aabb bounds;
+};
+
+static bool
+lvp_ir_is_leaf(const struct lvp_encode_state *state, uint32_t ir_offset)
+{
+   return ir_offset < state->root_offset;
 }
 
+static const vk_aabb *
+lvp_ir_bounds(const struct lvp_encode_state *state, uint32_t ir_offset)
+{
+   return &((const struct vk_ir_node *)(state->ir_bvh + ir_offset))->aabb;
+}
+
+/* Appends the active children of an IR box node. */
 static void
-lvp_gather_subtree(const uint8_t *output, uint32_t offset, uint32_t *leaf_nodes,
-                   vk_aabb *leaf_bounds, uint32_t *leaf_node_count, uint32_t *internal_nodes,
-                   uint32_t *internal_node_count)
+lvp_ir_add_children(const struct lvp_encode_state *state, uint32_t ir_offset,
+                    struct lvp_encode_child *children, uint32_t *child_count)
 {
-   const struct lvp_bvh_box_node *node = (void *)(output + offset);
+   const struct vk_ir_box_node *ir_box = (const void *)(state->ir_bvh + ir_offset);
 
-   for (uint32_t child_index = 0; child_index < 2; child_index++) {
-      if (node->children[child_index] == VK_BVH_INVALID_NODE)
+   for (uint32_t i = 0; i < 2; i++) {
+      if (ir_box->children[i] == VK_BVH_INVALID_NODE)
          continue;
 
-      uint32_t type = node->children[child_index] & 3;
-      if (type == lvp_bvh_node_internal) {
-         internal_nodes[*internal_node_count] = node->children[child_index];
-         (*internal_node_count)++;
+      uint32_t child_offset = ir_id_to_offset(ir_box->children[i]);
+      const vk_aabb *bounds = lvp_ir_bounds(state, child_offset);
 
-         uint32_t ir_child_offset = ir_id_to_offset(node->children[child_index]);
-         lvp_gather_subtree(output, ir_child_offset, leaf_nodes, leaf_bounds,
-                            leaf_node_count, internal_nodes, internal_node_count);
-      } else {
-         leaf_nodes[*leaf_node_count] = node->children[child_index];
-         leaf_bounds[*leaf_node_count] = node->bounds[child_index];
-         (*leaf_node_count)++;
-      }
+      /* If x of the aabb min is NaN, then this is an inactive primitive. */
+      if (isnan(bounds->min.x))
+         continue;
+
+      children[*child_count] = (struct lvp_encode_child){
+         .ir_offset = child_offset,
+         .leaf_count = lvp_ir_is_leaf(state, child_offset) ? 1 :
+            state->leaf_counts[(child_offset - state->root_offset) / sizeof(struct vk_ir_box_node)],
+         .bounds = *bounds,
+      };
+      (*child_count)++;
    }
 }
 
 static uint32_t
-lvp_rebuild_subtree(const uint8_t *output, uint32_t *leaf_nodes, vk_aabb *leaf_bounds,
-                    uint32_t *internal_nodes, uint32_t leaf_node_count, 
-                    uint32_t *internal_node_index)
+lvp_encode_alloc_box_node(struct lvp_encode_state *state, struct lvp_bvh_box_node **node)
 {
-   uint32_t child_nodes[2];
-   vk_aabb child_leaf_bounds[2];
-
-   if (leaf_node_count < 2)
-      return leaf_nodes[0];
+   uint32_t offset = sizeof(struct lvp_bvh_header) + state->node_count++ * sizeof(struct lvp_bvh_box_node);
+   *node = (void *)(state->output + offset);
+   return offset | lvp_bvh_node_internal;
+}
 
-   uint32_t node_id = internal_nodes[*internal_node_index];
-   (*internal_node_index)++;
+static uint32_t
+lvp_encode_leaf(const struct lvp_encode_state *state, uint32_t ir_offset)
+{
+   return (state->leaf_nodes_offset +
+           (ir_offset / state->ir_leaf_node_size) * state->output_leaf_node_size) | state->leaf_type;
+}
 
-   uint32_t split_index = leaf_node_count / 2;
+/* Builds a balanced tree over a run of IR leaves, which are in the order of
+ * the IR tree and therefore spatially coherent.
+ */
+static uint32_t
+lvp_encode_balanced(struct lvp_encode_state *state, const uint32_t *leaves, uint32_t count,
+                    vk_aabb *bounds)
+{
+   if (count == 1) {
+      *bounds = *lvp_ir_bounds(state, leaves[0]);
+      return lvp_encode_leaf(state, leaves[0]);
+   }
 
-   child_leaf_bounds[0] = leaf_bounds[0];
-   child_nodes[0] = lvp_rebuild_subtree(output, leaf_nodes, leaf_bounds, internal_nodes, split_index, internal_node_index);
+   struct lvp_bvh_box_node *node;
+   uint32_t node_id = lvp_encode_alloc_box_node(state, &node);
 
-   child_leaf_bounds[1] = leaf_bounds[split_index];
-   child_nodes[1] = lvp_rebuild_subtree(output, leaf_nodes + split_index, leaf_bounds + split_index, internal_nodes,
-                                        leaf_node_count - split_index, internal_node_index);
+   uint32_t child_count = MIN2(count, LVP_BVH_WIDTH);
+   uint32_t children[LVP_BVH_WIDTH];
+   vk_aabb child_bounds[LVP_BVH_WIDTH];
 
-   struct lvp_bvh_box_node *node = (void *)(output + ir_id_to_offset(node_id));
+   for (uint32_t i = 0; i < child_count; i++) {
+      uint32_t begin = count * i / child_count;
+      uint32_t end = count * (i + 1) / child_count;
+      children[i] = lvp_encode_balanced(state, leaves + begin, end - begin, &child_bounds[i]);
 
-   for (uint32_t i = 0; i < 2; i++) {
-      node->children[i] = child_nodes[i];
-
-      uint32_t type = child_nodes[i] & 3;
-      if (type == lvp_bvh_node_internal) {
-         const struct lvp_bvh_box_node *child_node =
-            (void *)(output + ir_id_to_offset(child_nodes[i]));
-         node->bounds[i].min.x = MIN2(child_node->bounds[0].min.x, child_node->bounds[1].min.x);
-         node->bounds[i].min.y = MIN2(child_node->bounds[0].min.y, child_node->bounds[1].min.y);
-         node->bounds[i].min.z = MIN2(child_node->bounds[0].min.z, child_node->bounds[1].min.z);
-         node->bounds[i].max.x = MAX2(child_node->bounds[0].max.x, child_node->bounds[1].max.x);
-         node->bounds[i].max.y = MAX2(child_node->bounds[0].max.y, child_node->bounds[1].max.y);
-         node->bounds[i].max.z = MAX2(child_node->bounds[0].max.z, child_node->bounds[1].max.z);
+      if (i == 0) {
+         *bounds = child_bounds[0];
       } else {
-         node->bounds[i] = child_leaf_bounds[i];
+         bounds->min.x = MIN2(bounds->min.x, child_bounds[i].min.x);
+         bounds->min.y = MIN2(bounds->min.y, child_bounds[i].min.y);
+         bounds->min.z = MIN2(bounds->min.z, child_bounds[i].min.z);
+         bounds->max.x = MAX2(bounds->max.x, child_bounds[i].max.x);
+         bounds->max.y = MAX2(bounds->max.y, child_bounds[i].max.y);
+         bounds->max.z = MAX2(bounds->max.z, child_bounds[i].max.z);
       }
    }
 
+   lvp_bvh_encode_box_node(node, children, child_bounds, child_count);
    return node_id;
 }
 
-static void
-lvp_flatten_as(const struct vk_ir_header *header, const struct vk_ir_box_node *ir_box_nodes,
-               uint32_t root_offset, const uint32_t *node_depth, uint8_t *output)
+/* Converts the IR subtree at ir_offset into wide nodes, the subtree root
+ * is placed at the given depth.
+ */
+static uint32_t
+lvp_encode_subtree(struct lvp_encode_state *state, uint32_t ir_offset, uint32_t depth)
 {
-   struct util_dynarray subtrees = { 0 };
-   uint32_t *child_counts = NULL;
-   uint32_t *leaf_nodes = NULL;
-   vk_aabb *leaf_bounds = NULL;
-   uint32_t *internal_nodes = NULL;
+   if (lvp_ir_is_leaf(state, ir_offset))
+      return lvp_encode_leaf(state, ir_offset);
 
-   child_counts = calloc(header->ir_internal_node_count, sizeof(uint32_t));
-   if (!child_counts)
-      goto ret;
+   struct lvp_encode_child children[LVP_BVH_WIDTH];
+   uint32_t child_count = 0;
+   lvp_ir_add_children(state, ir_offset, children, &child_count);
 
-   /* Iterate over the internal nodes in bottom-up order and
-    * compute the the number child leafs for each internal node.
+   /* Pull up the children of the largest box children until the node is
+    * full.
     */
-   for (uint32_t i = 0; i < header->ir_internal_node_count; i++) {
-      const struct vk_ir_box_node *ir_box = ir_box_nodes + i;
-      for (uint32_t child_index = 0; child_index < 2; child_index++) {
-         if (ir_box->children[child_index] == VK_BVH_INVALID_NODE)
+   while (child_count < LVP_BVH_WIDTH) {
+      int expand = -1;
+      float expand_area = -1.0f;
+      for (uint32_t i = 0; i < child_count; i++) {
+         if (lvp_ir_is_leaf(state, children[i].ir_offset))
             continue;
 
-         uint32_t ir_child_offset = ir_id_to_offset(ir_box->children[child_index]);
-         if (ir_child_offset < root_offset) {
-            child_counts[i]++;
-         } else {
-            uint32_t src_index = (ir_child_offset - root_offset) / sizeof(struct vk_ir_box_node);
-            child_counts[i] += child_counts[src_index];
+         float area = lvp_aabb_half_area(&children[i].bounds);
+         if (area > expand_area) {
+            expand = i;
+            expand_area = area;
          }
       }
+
+      if (expand < 0)
+         break;
+
+      uint32_t expand_offset = children[expand].ir_offset;
+      children[expand] = children[--child_count];
+      lvp_ir_add_children(state, expand_offset, children, &child_count);
    }
 
-   /* Select the subtrees that have to be rebuilt in order to
-    * limit the BVH to a supported depth.
-    */
-   util_dynarray_init(&subtrees, NULL);
-   uint32_t max_subtree_size = 0;
-   lvp_select_subtrees_to_flatten(header, ir_box_nodes, node_depth, child_counts,
-                                  root_offset, header->ir_internal_node_count - 1,
-                                  &subtrees, &max_subtree_size);
-
-   leaf_nodes = calloc(max_subtree_size, sizeof(uint32_t));
-   leaf_bounds = calloc(max_subtree_size, sizeof(vk_aabb));
-   internal_nodes = calloc(max_subtree_size, sizeof(uint32_t));
-   if (!leaf_nodes || !leaf_bounds || !internal_nodes)
-      goto ret;
-
-   util_dynarray_foreach(&subtrees, uint32_t, root_index) {
-      uint32_t offset = sizeof(struct lvp_bvh_header) +
-         (header->ir_internal_node_count - 1 - *root_index) * sizeof(struct lvp_bvh_box_node);
-
-      internal_nodes[0] = offset | lvp_bvh_node_internal;
-
-      uint32_t leaf_node_count = 0;
-      uint32_t internal_node_count = 1;
-      lvp_gather_subtree(output, offset, leaf_nodes, leaf_bounds, &leaf_node_count, internal_nodes, &internal_node_count);
-
-      uint32_t internal_node_index = 0;
-      lvp_rebuild_subtree(output, leaf_nodes, leaf_bounds, internal_nodes, leaf_node_count, &internal_node_index);
+   bool fits = true;
+   for (uint32_t i = 0; i < child_count; i++)
+      fits &= depth + 1 + lvp_bvh_balanced_depth(children[i].leaf_count) <= LVP_BVH_MAX_DEPTH;
+
+   if (!fits) {
+      /* The subtree would exceed the maximum depth supported by the
+       * traversal stack, rebuild it as a balanced tree.
+       */
+      util_dynarray_clear(&state->leaves);
+      util_dynarray_clear(&state->stack);
+      util_dynarray_append(&state->stack, uint32_t, ir_offset);
+
+      while (util_dynarray_num_elements(&state->stack, uint32_t)) {
+         uint32_t offset = util_dynarray_pop(&state->stack, uint32_t);
+         if (lvp_ir_is_leaf(state, offset)) {
+            util_dynarray_append(&state->leaves, uint32_t, offset);
+            continue;
+         }
+
+         struct lvp_encode_child ir_children[2];
+         uint32_t ir_child_count = 0;
+         lvp_ir_add_children(state, offset, ir_children, &ir_child_count);
+         for (uint32_t i = ir_child_count; i-- > 0;)
+            util_dynarray_append(&state->stack, uint32_t, ir_children[i].ir_offset);
+      }
+
+      uint32_t leaf_count = util_dynarray_num_elements(&state->leaves, uint32_t);
+      if (leaf_count > 1) {
+         vk_aabb bounds;
+         return lvp_encode_balanced(state, util_dynarray_begin(&state->leaves), leaf_count, &bounds);
+      }
+   }
+
+   struct lvp_bvh_box_node *node;
+   uint32_t node_id = lvp_encode_alloc_box_node(state, &node);
+
+   uint32_t child_ids[LVP_BVH_WIDTH];
+   vk_aabb child_bounds[LVP_BVH_WIDTH];
+   for (uint32_t i = 0; i < child_count; i++) {
+      child_ids[i] = lvp_encode_subtree(state, children[i].ir_offset, depth + 1);
+      child_bounds[i] = children[i].bounds;
    }
 
-ret:
-   util_dynarray_fini(&subtrees);
-   free(child_counts);
-   free(leaf_nodes);
-   free(leaf_bounds);
-   free(internal_nodes);
+   lvp_bvh_encode_box_node(node, child_ids, child_bounds, child_count);
+   return node_id;
 }
 
 void
@@ -505,79 +628,63 @@ lvp_encode_as(struct vk_acceleration_structure *dst, VkDeviceAddress intermediat
       }
    }
 
-   uint32_t *node_depth = calloc(header->ir_internal_node_count, sizeof(uint32_t));
-   if (!node_depth)
+   /* Count the leaves below every box node, children come before their
+    * parents.
+    */
+   uint32_t *leaf_counts = calloc(MAX2(header->ir_internal_node_count, 1), sizeof(uint32_t));
+   if (!leaf_counts)
       return;
 
-   uint32_t max_node_depth = 0;
-
    for (uint32_t i = 0; i < header->ir_internal_node_count; i++) {
-      const struct vk_ir_box_node *ir_box = ir_box_nodes + (header->ir_internal_node_count - i - 1);
-      struct lvp_bvh_box_node *output_box =
-         (void *)(output + sizeof(struct lvp_bvh_header) + i * sizeof(struct lvp_bvh_box_node));
-
+      const struct vk_ir_box_node *ir_box = ir_box_nodes + i;
       for (uint32_t child_index = 0; child_index < 2; child_index++) {
-         if (ir_box->children[child_index] == VK_BVH_INVALID_NODE) {
-            output_box->bounds[child_index] = (struct vk_aabb){
-               .min.x = NAN,
-               .min.y = NAN,
-               .min.z = NAN,
-               .max.x = NAN,
-               .max.y = NAN,
-               .max.z = NAN,
-            };
-            output_box->children[child_index] = LVP_BVH_INVALID_NODE;
+         if (ir_box->children[child_index] == VK_BVH_INVALID_NODE)
             continue;
-         }
 
          uint32_t ir_child_offset = ir_id_to_offset(ir_box->children[child_index]);
-         const struct vk_ir_node *ir_child = (const void *)(ir_bvh + ir_child_offset);
-
-         output_box->bounds[child_index] = ir_child->aabb;
-         /* Increase the bounding box size a bit for watertightness. */
-         output_box->bounds[child_index].min.x -= MAX2(fabsf(output_box->bounds[child_index].min.x), 1.0) * FLT_EPSILON;
-         output_box->bounds[child_index].min.y -= MAX2(fabsf(output_box->bounds[child_index].min.y), 1.0) * FLT_EPSILON;
-         output_box->bounds[child_index].min.z -= MAX2(fabsf(output_box->bounds[child_index].min.z), 1.0) * FLT_EPSILON;
-         output_box->bounds[child_index].max.x += MAX2(fabsf(output_box->bounds[child_index].max.x), 1.0) * FLT_EPSILON;
-         output_box->bounds[child_index].max.y += MAX2(fabsf(output_box->bounds[child_index].max.y), 1.0) * FLT_EPSILON;
-         output_box->bounds[child_index].max.z += MAX2(fabsf(output_box->bounds[child_index].max.z), 1.0) * FLT_EPSILON;
-
          if (ir_child_offset < root_offset) {
-            output_box->children[child_index] =
-               output_header->leaf_nodes_offset + (ir_child_offset / ir_leaf_node_size) * output_leaf_node_size;
-            switch (geometry_type) {
-            case VK_GEOMETRY_TYPE_TRIANGLES_KHR:
-               output_box->children[child_index] |= lvp_bvh_node_triangle;
-               break;
-            case VK_GEOMETRY_TYPE_AABBS_KHR:
-               output_box->children[child_index] |= lvp_bvh_node_aabb;
-               break;
-            case VK_GEOMETRY_TYPE_INSTANCES_KHR:
-               output_box->children[child_index] |= lvp_bvh_node_instance;
-               break;
-            default:
-               break;
-            }
+            leaf_counts[i]++;
          } else {
             uint32_t src_index = (ir_child_offset - root_offset) / sizeof(struct vk_ir_box_node);
-            uint32_t dst_index = header->ir_internal_node_count - src_index - 1;
-            output_box->children[child_index] =
-               sizeof(struct lvp_bvh_header) + dst_index * sizeof(struct lvp_bvh_box_node);
-            output_box->children[child_index] |= lvp_bvh_node_internal;
-
-            node_depth[dst_index] = node_depth[i] + 1;
-            max_node_depth = MAX2(max_node_depth, node_depth[dst_index]);
+            leaf_counts[i] += leaf_counts[src_index];
          }
       }
    }
 
-   /* The BVH exceeds the maximum depth supported by the traversal stack, 
-    * flatten the offending parts of the tree.
-    */
-   if (max_node_depth >= 24)
-      lvp_flatten_as(header, ir_box_nodes, root_offset, node_depth, output);
+   struct lvp_encode_state state = {
+      .ir_bvh = ir_bvh,
+      .root_offset = root_offset,
+      .ir_leaf_node_size = ir_leaf_node_size,
+      .output_leaf_node_size = output_leaf_node_size,
+      .leaf_counts = leaf_counts,
+      .output = output,
+      .leaf_nodes_offset = output_header->leaf_nodes_offset,
+   };
+   util_dynarray_init(&state.leaves, NULL);
+   util_dynarray_init(&state.stack, NULL);
 
-   free(node_depth);
+   switch (geometry_type) {
+   case VK_GEOMETRY_TYPE_TRIANGLES_KHR:
+      state.leaf_type = lvp_bvh_node_triangle;
+      break;
+   case VK_GEOMETRY_TYPE_AABBS_KHR:
+      state.leaf_type = lvp_bvh_node_aabb;
+      break;
+   default:
+      state.leaf_type = lvp_bvh_node_instance;
+      break;
+   }
+
+   /* The root is always a box node, even if there are less than two leaves. */
+   uint32_t ir_root_offset = root_offset + (header->ir_internal_node_count - 1) * sizeof(struct vk_ir_box_node);
+   lvp_encode_subtree(&state, ir_root_offset, 0);
+
+   output_header->internal_node_count = state.node_count;
+   output_header->leaf_node_count = header->active_leaf_count;
+
+   util_dynarray_fini(&state.leaves);
+   util_dynarray_fini(&state.stack);
+   free(leaf_counts);
 }
 
 static_assert(sizeof(struct lvp_bvh_triangle_node) % 8 == 0, "lvp_bvh_triangle_node is not padded");
@@ -680,6 +787,19 @@ lvp_device_init_accel_struct_state(struct lvp_device *device)
 
    simple_mtx_init(&device->radix_sort_lock, mtx_plain);
 
+   /* LVP_COMPUTE_BVH=true builds with the generic compute shaders instead,
+    * for comparison.
+    */
+   device->compute_bvh_build = debug_get_bool_option("LVP_COMPUTE_BVH", false);
+
+   /* The queue starts with a single thread and only grows when jobs wait. */
+   unsigned num_threads = MIN2(util_get_cpu_caps()->nr_cpus, LVP_MAX_BVH_THREADS);
+   if (!device->compute_bvh_build && num_threads > 1) {
+      device->has_bvh_queue =
+         util_queue_init(&device->bvh_queue, "lvp_bvh", 64, num_threads,
+                         UTIL_QUEUE_INIT_RESIZE_IF_FULL, NULL);
+   }
+
    return VK_SUCCESS;
 }
 
@@ -688,6 +808,9 @@ lvp_device_finish_accel_struct_state(struct lvp_device *device)
 {
    simple_mtx_destroy(&device->radix_sort_lock);
 
+   if (device->has_bvh_queue)
+      util_queue_destroy(&device->bvh_queue);
+
    if (device->radix_sort)
       radix_sort_vk_destroy(device->radix_sort, lvp_device_to_handle(device), &device->vk.alloc);
 }
@@ -731,6 +854,15 @@ lvp_CmdBuildAccelerationStructuresKHR(VkCommandBuffer commandBuffer, uint32_t in
 {
    VK_FROM_HANDLE(lvp_cmd_buffer, cmd_buffer, commandBuffer);
 
+   /* The native builder runs when the command is executed, so the build
+    * infos are only copied.
+    */
+   if (!cmd_buffer->device->compute_bvh_build) {
+      vk_cmd_enqueue_CmdBuildAccelerationStructuresKHR(commandBuffer, infoCount, pInfos,
+                                                       ppBuildRangeInfos);
+      return;
+   }
+
    lvp_init_radix_sort(cmd_buffer->device);
 
    lvp_enqueue_save_state(commandBuffer);
@@ -10,6 +10,7 @@
 
 #include "lvp_private.h"
 #include "bvh/vk_bvh.h"
+#include "util/u_math.h"
 
 #define LVP_GEOMETRY_OPAQUE (1u << 31)
 
@@ -61,10 +62,28 @@ struct lvp_bvh_instance_node {
    mat3x4 otw_matrix;
 };
 
-/* 56 bytes */
+#define LVP_BVH_WIDTH 4
+
+/* Box nodes can't be nested deeper than this, the traversal stack holds
+ * LVP_BVH_STACK_SIZE entries per level of instancing.
+ */
+#define LVP_BVH_MAX_DEPTH  12
+#define LVP_BVH_STACK_SIZE (LVP_BVH_MAX_DEPTH * (LVP_BVH_WIDTH - 1))
+
+/* 56 bytes
+ *
+ * The child bounds are quantized to a grid that covers the node.  Along
+ * axis a, q decodes to origin[a] + q * 2^(exponents[a] - 127), exactly as
+ * the float with that biased exponent.  Bounds are rounded outwards.  The
+ * quantized planes are stored per axis so that one dword holds the planes
+ * of all children.
+ */
 struct lvp_bvh_box_node {
-   vk_aabb bounds[2];
-   uint32_t children[2];
+   float origin[3];
+   uint8_t exponents[4];
+   uint8_t child_min[3][LVP_BVH_WIDTH];
+   uint8_t child_max[3][LVP_BVH_WIDTH];
+   uint32_t children[LVP_BVH_WIDTH];
 };
 
 #define LVP_BVH_NODE_PREFETCH_SIZE 56
@@ -76,6 +95,9 @@ struct lvp_bvh_header {
    uint32_t serialization_size;
    uint32_t instance_count;
    uint32_t leaf_nodes_offset;
+   /* box nodes and leaves that are part of the tree */
+   uint32_t internal_node_count;
+   uint32_t leaf_node_count;
 };
 
 struct lvp_accel_struct_serialization_header {
@@ -92,6 +114,30 @@ struct lvp_accel_struct_serialization_header {
 #define LVP_BVH_ROOT_NODE        (LVP_BVH_ROOT_NODE_OFFSET | lvp_bvh_node_internal)
 #define LVP_BVH_INVALID_NODE     0xFFFFFFFF
 
+#define LVP_MAX_BVH_THREADS 32
+
+/* Number of box node levels a balanced tree over leaf_count leaves needs. */
+static inline uint32_t
+lvp_bvh_balanced_depth(uint32_t leaf_count)
+{
+   return DIV_ROUND_UP(util_logbase2_ceil(leaf_count), util_logbase2(LVP_BVH_WIDTH));
+}
+
+VkDeviceSize
+lvp_get_as_size_internal(VkGeometryTypeKHR geometry_type, uint32_t leaf_node_count);
+
+uint32_t
+lvp_pack_sbt_offset_and_flags(uint32_t sbt_offset, VkGeometryInstanceFlagsKHR flags);
+
+void
+lvp_bvh_encode_box_node(struct lvp_bvh_box_node *node, const uint32_t *children,
+                        const vk_aabb *child_bounds, uint32_t child_count);
+
+VkResult
+lvp_build_as(struct lvp_device *device,
+             const VkAccelerationStructureBuildGeometryInfoKHR *info,
+             const VkAccelerationStructureBuildRangeInfoKHR *ranges);
+
 VkResult
 lvp_device_init_accel_struct_state(struct lvp_device *device);
 
@@ -0,0 +1,1062 @@
+/*
+ * Copyright © 2026 Red Hat
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Native acceleration structure builder.
+ *
+ * Instead of running the generic compute shader builder through llvmpipe and
+ * converting its intermediate BVH, the primitives are gathered straight into
+ * lvp_bvh leaf nodes and the tree is built top-down with a binned SAH, each
+ * box node taking up to LVP_BVH_WIDTH children.  The top of the tree is
+ * split on the calling thread until there are enough independent subtrees
+ * to keep a thread pool busy, then every subtree is built by a worker.  Box
+ * nodes are allocated before their children so that a refit can update a
+ * tree bottom-up by walking the nodes backwards.
+ */
+
+#include "lvp_acceleration_structure.h"
+
+#include "util/format/u_format.h"
+#include "util/u_atomic.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_math.h"
+
+#define LVP_BVH_BINS 16
+
+/* Number of primitives processed by one leaf job. */
+#define LVP_BVH_LEAF_CHUNK 16384
+
+/* Subtrees with fewer primitives than this are never split between jobs. */
+#define LVP_BVH_MIN_TASK_SIZE 4096
+
+struct lvp_bvh_geometry {
+   VkGeometryTypeKHR type;
+   uint32_t geometry_id_and_flags;
+   /* vertices, AABBs or instances, with the build range offsets applied */
+   const uint8_t *data;
+   const uint8_t *indices;
+   const float *transform;
+   uint32_t stride;
+   VkIndexType index_type;
+   enum pipe_format vertex_format;
+   bool array_of_pointers;
+   /* first primitive of this geometry in the whole build */
+   uint32_t first_id;
+   uint32_t primitive_count;
+};
+
+struct lvp_bvh_builder {
+   struct lvp_device *device;
+
+   VkGeometryTypeKHR geometry_type;
+   uint32_t leaf_type;
+   uint32_t leaf_size;
+   /* keep primitives that are inactive now but could be updated later */
+   bool keep_inactive;
+
+   struct lvp_bvh_geometry *geometries;
+   uint32_t geometry_count;
+   uint32_t primitive_count;
+
+   /* gathered leaf nodes, indexed by primitive */
+   uint8_t *leaves;
+   bool *active;
+
+   /* per active primitive, reordered by the build */
+   vk_aabb *bounds;
+   vec3 *centroids;
+   uint32_t *ids;
+   uint32_t active_count;
+
+   /* unexpanded bounds of every box node */
+   vk_aabb *node_bounds;
+   uint32_t node_count;
+
+   uint8_t *output;
+   uint32_t leaf_nodes_offset;
+};
+
+struct lvp_bvh_job {
+   struct lvp_bvh_builder *builder;
+   struct util_queue_fence fence;
+
+   uint32_t begin;
+   uint32_t end;
+   uint32_t depth;
+   /* receives the child id of the subtree's root */
+   uint32_t *child;
+};
+
+struct lvp_bvh_range {
+   uint32_t begin;
+   uint32_t end;
+   vk_aabb bounds;
+};
+
+static inline float
+vec3_get(const vec3 *v, unsigned axis)
+{
+   return ((const float *)v)[axis];
+}
+
+static inline void
+aabb_init(vk_aabb *aabb)
+{
+   aabb->min = (vec3){ INFINITY, INFINITY, INFINITY };
+   aabb->max = (vec3){ -INFINITY, -INFINITY, -INFINITY };
+}
+
+static inline void
+aabb_extend(vk_aabb *aabb, const vk_aabb *other)
+{
+   aabb->min.x = MIN2(aabb->min.x, other->min.x);
+   aabb->min.y = MIN2(aabb->min.y, other->min.y);
+   aabb->min.z = MIN2(aabb->min.z, other->min.z);
+   aabb->max.x = MAX2(aabb->max.x, other->max.x);
+   aabb->max.y = MAX2(aabb->max.y, other->max.y);
+   aabb->max.z = MAX2(aabb->max.z, other->max.z);
+}
+
+static inline void
+aabb_extend_point(vk_aabb *aabb, const vec3 *p)
+{
+   aabb->min.x = MIN2(aabb->min.x, p->x);
+   aabb->min.y = MIN2(aabb->min.y, p->y);
+   aabb->min.z = MIN2(aabb->min.z, p->z);
+   aabb->max.x = MAX2(aabb->max.x, p->x);
+   aabb->max.y = MAX2(aabb->max.y, p->y);
+   aabb->max.z = MAX2(aabb->max.z, p->z);
+}
+
+static inline float
+aabb_half_area(const vk_aabb *aabb)
+{
+   float x = aabb->max.x - aabb->min.x;
+   float y = aabb->max.y - aabb->min.y;
+   float z = aabb->max.z - aabb->min.z;
+   return x * y + y * z + z * x;
+}
+
+static struct lvp_bvh_box_node *
+get_box_node(uint8_t *output, uint32_t index)
+{
+   return (void *)(output + sizeof(struct lvp_bvh_header) +
+                   index * sizeof(struct lvp_bvh_box_node));
+}
+
+static uint32_t
+box_node_id(uint32_t index)
+{
+   return (sizeof(struct lvp_bvh_header) + index * sizeof(struct lvp_bvh_box_node)) |
+          lvp_bvh_node_internal;
+}
+
+static uint32_t
+box_node_index(uint32_t id)
+{
+   return ((id & ~3u) - sizeof(struct lvp_bvh_header)) / sizeof(struct lvp_bvh_box_node);
+}
+
+/* Whether a subtree over count primitives can be placed at depth. */
+static bool
+subtree_fits(uint32_t depth, uint32_t count)
+{
+   return depth + lvp_bvh_balanced_depth(count) <= LVP_BVH_MAX_DEPTH;
+}
+
+static struct util_queue *
+get_bvh_queue(struct lvp_device *device)
+{
+   return device->has_bvh_queue ? &device->bvh_queue : NULL;
+}
+
+static void
+lvp_bvh_run_jobs(struct lvp_device *device, struct lvp_bvh_job *jobs, uint32_t count,
+                 util_queue_execute_func execute)
+{
+   struct util_queue *queue = count > 1 ? get_bvh_queue(device) : NULL;
+
+   if (!queue) {
+      for (uint32_t i = 0; i < count; i++)
+         execute(&jobs[i], NULL, 0);
+      return;
+   }
+
+   for (uint32_t i = 0; i < count; i++) {
+      util_queue_fence_init(&jobs[i].fence);
+      util_queue_add_job(queue, &jobs[i], &jobs[i].fence, execute, NULL, 0);
+   }
+
+   for (uint32_t i = 0; i < count; i++) {
+      util_queue_fence_wait(&jobs[i].fence);
+      util_queue_fence_destroy(&jobs[i].fence);
+   }
+}
+
+static void
+lvp_bvh_init_geometry(struct lvp_bvh_geometry *geom, uint32_t geom_index, uint32_t first_id,
+                      const VkAccelerationStructureGeometryKHR *geometry,
+                      const VkAccelerationStructureBuildRangeInfoKHR *range)
+{
+   /* see vk_fill_geometry_data */
+   *geom = (struct lvp_bvh_geometry){
+      .type = geometry->geometryType,
+      .geometry_id_and_flags = geom_index,
+      .first_id = first_id,
+      .primitive_count = range->primitiveCount,
+   };
+
+   if (geometry->flags & VK_GEOMETRY_OPAQUE_BIT_KHR)
+      geom->geometry_id_and_flags |= LVP_GEOMETRY_OPAQUE;
+
+   switch (geometry->geometryType) {
+   case VK_GEOMETRY_TYPE_TRIANGLES_KHR: {
+      const VkAccelerationStructureGeometryTrianglesDataKHR *triangles =
+         &geometry->geometry.triangles;
+      geom->data = (const uint8_t *)(uintptr_t)triangles->vertexData.deviceAddress +
+                   range->firstVertex * triangles->vertexStride;
+      geom->indices = (const uint8_t *)(uintptr_t)triangles->indexData.deviceAddress;
+      if (triangles->indexType == VK_INDEX_TYPE_NONE_KHR)
+         geom->data += range->primitiveOffset;
+      else
+         geom->indices += range->primitiveOffset;
+
+      if (triangles->transformData.deviceAddress)
+         geom->transform = (const float *)(uintptr_t)(triangles->transformData.deviceAddress +
+                                                      range->transformOffset);
+
+      geom->stride = triangles->vertexStride;
+      geom->index_type = triangles->indexType;
+      geom->vertex_format = lvp_vk_format_to_pipe_format(triangles->vertexFormat);
+      break;
+   }
+   case VK_GEOMETRY_TYPE_AABBS_KHR:
+      geom->data = (const uint8_t *)(uintptr_t)geometry->geometry.aabbs.data.deviceAddress +
+                   range->primitiveOffset;
+      geom->stride = geometry->geometry.aabbs.stride;
+      break;
+   case VK_GEOMETRY_TYPE_INSTANCES_KHR:
+      geom->data = (const uint8_t *)(uintptr_t)geometry->geometry.instances.data.deviceAddress +
+                   range->primitiveOffset;
+      geom->array_of_pointers = geometry->geometry.instances.arrayOfPointers;
+      geom->stride = geom->array_of_pointers ? sizeof(uint64_t) :
+                                               sizeof(VkAccelerationStructureInstanceKHR);
+      break;
+   default:
+      UNREACHABLE("Unknown geometryType");
+   }
+}
+
+static vec3
+load_vertex(const struct lvp_bvh_geometry *geom, uint32_t index)
+{
+   const uint8_t *src = geom->data + (size_t)index * geom->stride;
+   float v[4];
+
+   if (geom->vertex_format == PIPE_FORMAT_R32G32B32_FLOAT ||
+       geom->vertex_format == PIPE_FORMAT_R32G32B32A32_FLOAT)
+      memcpy(v, src, sizeof(float) * 3);
+   else
+      util_format_unpack_rgba(geom->vertex_format, v, src, 1);
+
+   return (vec3){ v[0], v[1], v[2] };
+}
+
+static uint32_t
+load_index(const struct lvp_bvh_geometry *geom, uint32_t index)
+{
+   switch (geom->index_type) {
+   case VK_INDEX_TYPE_UINT8_KHR:
+      return geom->indices[index];
+   case VK_INDEX_TYPE_UINT16:
+      return ((const uint16_t *)geom->indices)[index];
+   case VK_INDEX_TYPE_UINT32:
+      return ((const uint32_t *)geom->indices)[index];
+   default:
+      return index;
+   }
+}
+
+static bool
+build_triangle(const struct lvp_bvh_geometry *geom, uint32_t primitive,
+               struct lvp_bvh_triangle_node *node, vk_aabb *bounds)
+{
+   vec3 vertices[3];
+
+   for (uint32_t i = 0; i < 3; i++)
+      vertices[i] = load_vertex(geom, load_index(geom, primitive * 3 + i));
+
+   /* An inactive triangle is one for which the X component of any vertex is
+    * NaN.
+    */
+   bool active = !isnan(vertices[0].x) && !isnan(vertices[1].x) && !isnan(vertices[2].x);
+
+   if (geom->transform) {
+      const float *m = geom->transform;
+      for (uint32_t i = 0; i < 3; i++) {
+         vec3 v = vertices[i];
+         vertices[i].x = m[0] * v.x + m[1] * v.y + m[2] * v.z + m[3];
+         vertices[i].y = m[4] * v.x + m[5] * v.y + m[6] * v.z + m[7];
+         vertices[i].z = m[8] * v.x + m[9] * v.y + m[10] * v.z + m[11];
+      }
+   }
+
+   aabb_init(bounds);
+   for (uint32_t i = 0; i < 3; i++) {
+      node->coords[i][0] = vertices[i].x;
+      node->coords[i][1] = vertices[i].y;
+      node->coords[i][2] = vertices[i].z;
+      aabb_extend_point(bounds, &vertices[i]);
+   }
+
+   node->padding = 0;
+   node->primitive_id = primitive;
+   node->geometry_id_and_flags = geom->geometry_id_and_flags;
+
+   return active;
+}
+
+static bool
+build_aabb(const struct lvp_bvh_geometry *geom, uint32_t primitive,
+           struct lvp_bvh_aabb_node *node, vk_aabb *bounds)
+{
+   const VkAabbPositionsKHR *src = (const void *)(geom->data + (size_t)primitive * geom->stride);
+
+   bounds->min = (vec3){ src->minX, src->minY, src->minZ };
+   bounds->max = (vec3){ src->maxX, src->maxY, src->maxZ };
+
+   node->bounds = *bounds;
+   node->primitive_id = primitive;
+   node->geometry_id_and_flags = geom->geometry_id_and_flags;
+
+   /* An inactive AABB is one for which the minimum X coordinate is NaN. */
+   return !isnan(src->minX);
+}
+
+static bool
+build_instance(const struct lvp_bvh_geometry *geom, uint32_t primitive, bool keep_inactive,
+               struct lvp_bvh_instance_node *node, vk_aabb *bounds)
+{
+   const uint8_t *src = geom->data + (size_t)primitive * geom->stride;
+   if (geom->array_of_pointers)
+      src = (const uint8_t *)(uintptr_t)*(const uint64_t *)src;
+
+   const VkAccelerationStructureInstanceKHR *instance = (const void *)src;
+
+   node->bvh_ptr = instance->accelerationStructureReference;
+   node->custom_instance_and_mask =
+      instance->instanceCustomIndex | ((uint32_t)instance->mask << 24);
+   node->sbt_offset_and_flags =
+      lvp_pack_sbt_offset_and_flags(instance->instanceShaderBindingTableRecordOffset,
+                                    instance->flags);
+   node->instance_id = primitive;
+   node->padding = 0;
+   memcpy(node->otw_matrix.values, instance->transform.matrix, sizeof(node->otw_matrix.values));
+
+   float transform[16], inv_transform[16];
+   memcpy(transform, instance->transform.matrix, sizeof(instance->transform.matrix));
+   transform[12] = transform[13] = transform[14] = 0.0f;
+   transform[15] = 1.0f;
+   util_invert_mat4x4(inv_transform, transform);
+   memcpy(node->wto_matrix.values, inv_transform, sizeof(node->wto_matrix.values));
+
+   /* An inactive instance is one whose acceleration structure handle is
+    * VK_NULL_HANDLE.  Instances with a zero mask can never be hit, so they
+    * are skipped too unless they could be changed by an update.
+    */
+   if (!instance->accelerationStructureReference) {
+      aabb_init(bounds);
+      return false;
+   }
+
+   const struct lvp_bvh_header *blas =
+      (const void *)(uintptr_t)instance->accelerationStructureReference;
+   const float (*m)[4] = instance->transform.matrix;
+
+   for (uint32_t comp = 0; comp < 3; comp++) {
+      float min = m[comp][3], max = m[comp][3];
+      for (uint32_t col = 0; col < 3; col++) {
+         float a = m[comp][col] * vec3_get(&blas->bounds.min, col);
+         float b = m[comp][col] * vec3_get(&blas->bounds.max, col);
+         min += MIN2(a, b);
+         max += MAX2(a, b);
+      }
+      ((float *)&bounds->min)[comp] = min;
+      ((float *)&bounds->max)[comp] = max;
+   }
+
+   return instance->mask || keep_inactive;
+}
+
+static bool
+build_leaf(const struct lvp_bvh_builder *builder, const struct lvp_bvh_geometry *geom,
+           uint32_t primitive, void *leaf, vk_aabb *bounds)
+{
+   switch (geom->type) {
+   case VK_GEOMETRY_TYPE_TRIANGLES_KHR:
+      return build_triangle(geom, primitive, leaf, bounds);
+   case VK_GEOMETRY_TYPE_AABBS_KHR:
+      return build_aabb(geom, primitive, leaf, bounds);
+   case VK_GEOMETRY_TYPE_INSTANCES_KHR:
+      return build_instance(geom, primitive, builder->keep_inactive, leaf, bounds);
+   default:
+      UNREACHABLE("Unknown geometryType");
+   }
+}
+
+/* job->begin/end is a range of the whole build's primitives */
+static void
+gather_leaves_job(void *data, void *gdata, int thread_index)
+{
+   struct lvp_bvh_job *job = data;
+   struct lvp_bvh_builder *builder = job->builder;
+
+   for (uint32_t g = 0; g < builder->geometry_count; g++) {
+      const struct lvp_bvh_geometry *geom = &builder->geometries[g];
+      uint32_t begin = MAX2(job->begin, geom->first_id);
+      uint32_t end = MIN2(job->end, geom->first_id + geom->primitive_count);
+
+      for (uint32_t id = begin; id < end; id++) {
+         builder->active[id] = build_leaf(builder, geom, id - geom->first_id,
+                                          builder->leaves + (size_t)id * builder->leaf_size,
+                                          &builder->bounds[id]);
+      }
+   }
+}
+
+static void
+gather_leaves(struct lvp_bvh_builder *builder)
+{
+   uint32_t job_count = DIV_ROUND_UP(builder->primitive_count, LVP_BVH_LEAF_CHUNK);
+   struct lvp_bvh_job *jobs = calloc(job_count, sizeof(*jobs));
+
+   if (jobs) {
+      for (uint32_t i = 0; i < job_count; i++) {
+         jobs[i].builder = builder;
+         jobs[i].begin = i * LVP_BVH_LEAF_CHUNK;
+         jobs[i].end = MIN2(jobs[i].begin + LVP_BVH_LEAF_CHUNK, builder->primitive_count);
+      }
+      lvp_bvh_run_jobs(builder->device, jobs, job_count, gather_leaves_job);
+      free(jobs);
+   } else {
+      struct lvp_bvh_job job = { .builder = builder, .end = builder->primitive_count };
+      gather_leaves_job(&job, NULL, 0);
+   }
+
+   /* Compact the active primitives, the leaf nodes themselves stay where
+    * they are and are only copied once the final order is known.
+    */
+   uint32_t count = 0;
+   for (uint32_t id = 0; id < builder->primitive_count; id++) {
+      if (!builder->active[id])
+         continue;
+
+      const vk_aabb *bounds = &builder->bounds[id];
+      builder->bounds[count] = *bounds;
+      builder->centroids[count] = (vec3){
+         bounds->min.x + bounds->max.x,
+         bounds->min.y + bounds->max.y,
+         bounds->min.z + bounds->max.z,
+      };
+      builder->ids[count] = id;
+      count++;
+   }
+   builder->active_count = count;
+}
+
+static inline void
+swap_prims(struct lvp_bvh_builder *builder, uint32_t a, uint32_t b)
+{
+   SWAP(builder->bounds[a], builder->bounds[b]);
+   SWAP(builder->centroids[a], builder->centroids[b]);
+   SWAP(builder->ids[a], builder->ids[b]);
+}
+
+/* Reorders [begin, end) so that the element at mid has the centroid it
+ * would have if the range was sorted along axis.
+ */
+static void
+select_median(struct lvp_bvh_builder *builder, uint32_t begin, uint32_t end,
+              uint32_t mid, unsigned axis)
+{
+   while (end - begin > 1) {
+      float pivot = vec3_get(&builder->centroids[begin + (end - begin) / 2], axis);
+      uint32_t lo = begin, hi = end - 1;
+
+      while (lo <= hi) {
+         while (vec3_get(&builder->centroids[lo], axis) < pivot)
+            lo++;
+         while (vec3_get(&builder->centroids[hi], axis) > pivot)
+            hi--;
+         if (lo <= hi) {
+            swap_prims(builder, lo, hi);
+            lo++;
+            if (hi == 0)
+               break;
+            hi--;
+         }
+      }
+
+      if (mid <= hi)
+         end = hi + 1;
+      else if (mid >= lo)
+         begin = lo;
+      else
+         return;
+   }
+}
+
+/* Splits [begin, end) in two and returns the start of the second half.  Both
+ * halves are placed at depth.
+ */
+static uint32_t
+split_prims(struct lvp_bvh_builder *builder, uint32_t begin, uint32_t end, uint32_t depth)
+{
+   uint32_t count = end - begin;
+   vk_aabb centroid_bounds;
+
+   aabb_init(&centroid_bounds);
+   for (uint32_t i = begin; i < end; i++)
+      aabb_extend_point(&centroid_bounds, &builder->centroids[i]);
+
+   unsigned axis = 0;
+   float extent[3] = {
+      centroid_bounds.max.x - centroid_bounds.min.x,
+      centroid_bounds.max.y - centroid_bounds.min.y,
+      centroid_bounds.max.z - centroid_bounds.min.z,
+   };
+   if (extent[1] > extent[axis])
+      axis = 1;
+   if (extent[2] > extent[axis])
+      axis = 2;
+
+   /* All centroids are the same, any split is as good as another. */
+   if (!(extent[axis] > 0.0f))
+      return begin + count / 2;
+
+   /* If even the halves of a median split would only just fit, SAH splits
+    * can't be afforded any more.
+    */
+   bool balanced = !subtree_fits(depth, DIV_ROUND_UP(count, 2));
+
+   if (!balanced) {
+      struct {
+         vk_aabb bounds;
+         uint32_t count;
+      } bins[LVP_BVH_BINS];
+
+      for (unsigned b = 0; b < LVP_BVH_BINS; b++) {
+         aabb_init(&bins[b].bounds);
+         bins[b].count = 0;
+      }
+
+      float min = vec3_get(&centroid_bounds.min, axis);
+      float scale = LVP_BVH_BINS * (1.0f - FLT_EPSILON) / extent[axis];
+
+      for (uint32_t i = begin; i < end; i++) {
+         unsigned b = MIN2((unsigned)((vec3_get(&builder->centroids[i], axis) - min) * scale),
+                           LVP_BVH_BINS - 1);
+         aabb_extend(&bins[b].bounds, &builder->bounds[i]);
+         bins[b].count++;
+      }
+
+      /* cost of putting bins [b, LVP_BVH_BINS) on the right */
+      float right_cost[LVP_BVH_BINS];
+      vk_aabb right;
+      uint32_t right_count = 0;
+      aabb_init(&right);
+      for (unsigned b = LVP_BVH_BINS - 1; b > 0; b--) {
+         aabb_extend(&right, &bins[b].bounds);
+         right_count += bins[b].count;
+         right_cost[b] = right_count ? aabb_half_area(&right) * right_count : 0.0f;
+      }
+
+      float best_cost = INFINITY;
+      unsigned best_bin = 0;
+      vk_aabb left;
+      uint32_t left_count = 0;
+      aabb_init(&left);
+      for (unsigned b = 1; b < LVP_BVH_BINS; b++) {
+         aabb_extend(&left, &bins[b - 1].bounds);
+         left_count += bins[b - 1].count;
+         if (!left_count || left_count == count)
+            continue;
+
+         float cost = aabb_half_area(&left) * left_count + right_cost[b];
+         if (cost < best_cost) {
+            best_cost = cost;
+            best_bin = b;
+         }
+      }
+
+      if (best_bin) {
+         uint32_t lo = begin, hi = end;
+         while (lo < hi) {
+            unsigned b = MIN2((unsigned)((vec3_get(&builder->centroids[lo], axis) - min) * scale),
+                              LVP_BVH_BINS - 1);
+            if (b < best_bin)
+               lo++;
+            else
+               swap_prims(builder, lo, --hi);
+         }
+
+         /* Make sure that the larger half still fits within the depth limit. */
+         uint32_t larger = MAX2(lo - begin, end - lo);
+         if (lo > begin && lo < end && subtree_fits(depth, larger))
+            return lo;
+      }
+   }
+
+   uint32_t mid = begin + count / 2;
+   select_median(builder, begin, end, mid, axis);
+   return mid;
+}
+
+static uint32_t
+write_leaf(struct lvp_bvh_builder *builder, uint32_t index)
+{
+   uint32_t offset = builder->leaf_nodes_offset + index * builder->leaf_size;
+
+   memcpy(builder->output + offset,
+          builder->leaves + (size_t)builder->ids[index] * builder->leaf_size,
+          builder->leaf_size);
+
+   return offset | builder->leaf_type;
+}
+
+static const vk_aabb *
+get_child_bounds(const struct lvp_bvh_builder *builder, uint32_t child)
+{
+   if ((child & 3) == lvp_bvh_node_internal)
+      return &builder->node_bounds[box_node_index(child)];
+
+   return &builder->bounds[((child & ~3u) - builder->leaf_nodes_offset) / builder->leaf_size];
+}
+
+static uint32_t
+alloc_box_node(struct lvp_bvh_builder *builder)
+{
+   return p_atomic_inc_return(&builder->node_count) - 1;
+}
+
+/* Encodes a box node whose children are already complete.  The children
+ * are read from the node, the unused slots have to be invalid.
+ */
+static void
+finish_box_node(struct lvp_bvh_builder *builder, uint32_t index)
+{
+   struct lvp_bvh_box_node *node = get_box_node(builder->output, index);
+   vk_aabb *bounds = &builder->node_bounds[index];
+   uint32_t children[LVP_BVH_WIDTH];
+   vk_aabb child_bounds[LVP_BVH_WIDTH];
+   uint32_t child_count = 0;
+
+   aabb_init(bounds);
+   for (uint32_t i = 0; i < LVP_BVH_WIDTH; i++) {
+      if (node->children[i] == LVP_BVH_INVALID_NODE)
+         continue;
+
+      children[child_count] = node->children[i];
+      child_bounds[child_count] = *get_child_bounds(builder, node->children[i]);
+      aabb_extend(bounds, &child_bounds[child_count]);
+      child_count++;
+   }
+
+   lvp_bvh_encode_box_node(node, children, child_bounds, child_count);
+}
+
+static void
+range_bounds(const struct lvp_bvh_builder *builder, struct lvp_bvh_range *range)
+{
+   aabb_init(&range->bounds);
+   for (uint32_t i = range->begin; i < range->end; i++)
+      aabb_extend(&range->bounds, &builder->bounds[i]);
+}
+
+/* Splits [begin, end) into the children of a box node at depth and returns
+ * how many there are.  Children that wouldn't fit within the depth limit
+ * are split first, then always the one with the largest surface.
+ */
+static uint32_t
+split_node(struct lvp_bvh_builder *builder, uint32_t begin, uint32_t end, uint32_t depth,
+           struct lvp_bvh_range *ranges)
+{
+   uint32_t count = 1;
+
+   ranges[0].begin = begin;
+   ranges[0].end = end;
+   range_bounds(builder, &ranges[0]);
+
+   while (count < LVP_BVH_WIDTH) {
+      int best = -1;
+      bool best_fits = true;
+      float best_area = 0.0f;
+
+      for (uint32_t i = 0; i < count; i++) {
+         uint32_t size = ranges[i].end - ranges[i].begin;
+         if (size < 2)
+            continue;
+
+         bool fits = subtree_fits(depth + 1, size);
+         float area = aabb_half_area(&ranges[i].bounds);
+         if (best < 0 || (best_fits && !fits) || (fits == best_fits && area > best_area)) {
+            best = i;
+            best_fits = fits;
+            best_area = area;
+         }
+      }
+
+      if (best < 0)
+         break;
+
+      struct lvp_bvh_range *range = &ranges[best];
+      uint32_t mid = split_prims(builder, range->begin, range->end, depth + 1);
+
+      ranges[count].begin = mid;
+      ranges[count].end = range->end;
+      range->end = mid;
+      range_bounds(builder, range);
+      range_bounds(builder, &ranges[count]);
+      count++;
+   }
+
+   return count;
+}
+
+/* Builds the subtree of [begin, end) with its root at depth.  Returns the
+ * child id of the subtree's root.
+ */
+static uint32_t
+build_subtree(struct lvp_bvh_builder *builder, uint32_t begin, uint32_t end, uint32_t depth)
+{
+   if (end - begin == 1)
+      return write_leaf(builder, begin);
+
+   struct lvp_bvh_range ranges[LVP_BVH_WIDTH];
+   uint32_t count = split_node(builder, begin, end, depth, ranges);
+
+   uint32_t node = alloc_box_node(builder);
+   struct lvp_bvh_box_node *box = get_box_node(builder->output, node);
+
+   for (uint32_t i = 0; i < LVP_BVH_WIDTH; i++) {
+      box->children[i] = i < count ?
+         build_subtree(builder, ranges[i].begin, ranges[i].end, depth + 1) :
+         LVP_BVH_INVALID_NODE;
+   }
+   finish_box_node(builder, node);
+
+   return box_node_id(node);
+}
+
+static void
+build_subtree_job(void *data, void *gdata, int thread_index)
+{
+   struct lvp_bvh_job *job = data;
+   *job->child = build_subtree(job->builder, job->begin, job->end, job->depth);
+}
+
+/* Splits the top of the tree on the calling thread, until the remaining
+ * subtrees are small enough to be handed out as jobs.  Box nodes created
+ * here are recorded in split_nodes so that they can be finished once the
+ * jobs are done.
+ */
+static uint32_t
+split_top(struct lvp_bvh_builder *builder, uint32_t begin, uint32_t end, uint32_t depth,
+          uint32_t task_size, struct util_dynarray *jobs, struct util_dynarray *split_nodes)
+{
+   if (end - begin == 1)
+      return write_leaf(builder, begin);
+
+   struct lvp_bvh_range ranges[LVP_BVH_WIDTH];
+   uint32_t count = split_node(builder, begin, end, depth, ranges);
+
+   uint32_t node = alloc_box_node(builder);
+   struct lvp_bvh_box_node *box = get_box_node(builder->output, node);
+
+   util_dynarray_append(split_nodes, uint32_t, node);
+
+   for (uint32_t i = 0; i < LVP_BVH_WIDTH; i++) {
+      box->children[i] = LVP_BVH_INVALID_NODE;
+      if (i >= count)
+         continue;
+
+      uint32_t size = ranges[i].end - ranges[i].begin;
+      if (size > task_size || size == 1) {
+         box->children[i] = split_top(builder, ranges[i].begin, ranges[i].end, depth + 1,
+                                      task_size, jobs, split_nodes);
+      } else {
+         struct lvp_bvh_job job = {
+            .builder = builder,
+            .begin = ranges[i].begin,
+            .end = ranges[i].end,
+            .depth = depth + 1,
+            .child = &box->children[i],
+         };
+         util_dynarray_append(jobs, struct lvp_bvh_job, job);
+      }
+   }
+
+   return box_node_id(node);
+}
+
+static void
+build_tree(struct lvp_bvh_builder *builder)
+{
+   uint32_t count = builder->active_count;
+
+   if (count < 2) {
+      uint32_t node = alloc_box_node(builder);
+      struct lvp_bvh_box_node *root = get_box_node(builder->output, node);
+      for (uint32_t i = 0; i < LVP_BVH_WIDTH; i++)
+         root->children[i] = LVP_BVH_INVALID_NODE;
+      if (count)
+         root->children[0] = write_leaf(builder, 0);
+      finish_box_node(builder, node);
+      return;
+   }
+
+   struct util_queue *queue = get_bvh_queue(builder->device);
+   unsigned num_threads = queue ? queue->max_threads : 1;
+   uint32_t task_size = MAX2(count / (num_threads * 4), LVP_BVH_MIN_TASK_SIZE);
+
+   struct util_dynarray jobs, split_nodes;
+   util_dynarray_init(&jobs, NULL);
+   util_dynarray_init(&split_nodes, NULL);
+
+   split_top(builder, 0, count, 0, task_size, &jobs, &split_nodes);
+
+   lvp_bvh_run_jobs(builder->device, util_dynarray_begin(&jobs),
+                    util_dynarray_num_elements(&jobs, struct lvp_bvh_job),
+                    build_subtree_job);
+
+   /* parents come before their children */
+   uint32_t num_split_nodes = util_dynarray_num_elements(&split_nodes, uint32_t);
+   for (uint32_t i = num_split_nodes; i-- > 0;)
+      finish_box_node(builder, *util_dynarray_element(&split_nodes, uint32_t, i));
+
+   util_dynarray_fini(&jobs);
+   util_dynarray_fini(&split_nodes);
+}
+
+static void
+write_header(struct lvp_bvh_builder *builder, const vk_aabb *bounds)
+{
+   struct lvp_bvh_header *header = (void *)builder->output;
+
+   header->bounds = *bounds;
+   header->instance_count =
+      builder->geometry_type == VK_GEOMETRY_TYPE_INSTANCES_KHR ? builder->primitive_count : 0;
+   header->leaf_nodes_offset = builder->leaf_nodes_offset;
+   header->internal_node_count = builder->node_count;
+   header->leaf_node_count = builder->active_count;
+
+   uint32_t bvh_size = lvp_get_as_size_internal(builder->geometry_type, builder->primitive_count);
+   header->compacted_size = bvh_size;
+   header->serialization_size = sizeof(struct lvp_accel_struct_serialization_header) +
+                                sizeof(uint64_t) * header->instance_count + bvh_size;
+}
+
+static bool
+lvp_bvh_builder_init(struct lvp_bvh_builder *builder, struct lvp_device *device,
+                     const VkAccelerationStructureBuildGeometryInfoKHR *info,
+                     const VkAccelerationStructureBuildRangeInfoKHR *ranges)
+{
+   *builder = (struct lvp_bvh_builder){
+      .device = device,
+      .geometry_type = vk_get_as_geometry_type(info),
+      .keep_inactive = info->flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR,
+      .geometry_count = info->geometryCount,
+   };
+
+   switch (builder->geometry_type) {
+   case VK_GEOMETRY_TYPE_TRIANGLES_KHR:
+      builder->leaf_type = lvp_bvh_node_triangle;
+      builder->leaf_size = sizeof(struct lvp_bvh_triangle_node);
+      break;
+   case VK_GEOMETRY_TYPE_AABBS_KHR:
+      builder->leaf_type = lvp_bvh_node_aabb;
+      builder->leaf_size = sizeof(struct lvp_bvh_aabb_node);
+      break;
+   default:
+      builder->leaf_type = lvp_bvh_node_instance;
+      builder->leaf_size = sizeof(struct lvp_bvh_instance_node);
+      break;
+   }
+
+   builder->geometries = calloc(MAX2(info->geometryCount, 1), sizeof(*builder->geometries));
+   if (!builder->geometries)
+      return false;
+
+   for (uint32_t i = 0; i < info->geometryCount; i++) {
+      const VkAccelerationStructureGeometryKHR *geometry =
+         info->pGeometries ? &info->pGeometries[i] : info->ppGeometries[i];
+      lvp_bvh_init_geometry(&builder->geometries[i], i, builder->primitive_count,
+                            geometry, &ranges[i]);
+      builder->primitive_count += ranges[i].primitiveCount;
+   }
+
+   uint32_t count = MAX2(builder->primitive_count, 1);
+   builder->leaves = malloc((size_t)count * builder->leaf_size);
+   builder->active = malloc(count * sizeof(*builder->active));
+   builder->bounds = malloc(count * sizeof(*builder->bounds));
+   builder->centroids = malloc(count * sizeof(*builder->centroids));
+   builder->ids = malloc(count * sizeof(*builder->ids));
+   builder->node_bounds = malloc(count * sizeof(*builder->node_bounds));
+
+   return builder->leaves && builder->active && builder->bounds &&
+          builder->centroids && builder->ids && builder->node_bounds;
+}
+
+static void
+lvp_bvh_builder_finish(struct lvp_bvh_builder *builder)
+{
+   free(builder->geometries);
+   free(builder->leaves);
+   free(builder->active);
+   free(builder->bounds);
+   free(builder->centroids);
+   free(builder->ids);
+   free(builder->node_bounds);
+}
+
+/* Rewrites the leaves of an existing tree from the build's geometry. */
+static void
+refit_leaves_job(void *data, void *gdata, int thread_index)
+{
+   struct lvp_bvh_job *job = data;
+   struct lvp_bvh_builder *builder = job->builder;
+
+   for (uint32_t i = job->begin; i < job->end; i++) {
+      uint8_t *leaf = builder->output + builder->leaf_nodes_offset + i * builder->leaf_size;
+      uint32_t geometry_index = 0, primitive;
+
+      switch (builder->geometry_type) {
+      case VK_GEOMETRY_TYPE_TRIANGLES_KHR: {
+         const struct lvp_bvh_triangle_node *node = (const void *)leaf;
+         geometry_index = node->geometry_id_and_flags & ~LVP_GEOMETRY_OPAQUE;
+         primitive = node->primitive_id;
+         break;
+      }
+      case VK_GEOMETRY_TYPE_AABBS_KHR: {
+         const struct lvp_bvh_aabb_node *node = (const void *)leaf;
+         geometry_index = node->geometry_id_and_flags & ~LVP_GEOMETRY_OPAQUE;
+         primitive = node->primitive_id;
+         break;
+      }
+      default: {
+         const struct lvp_bvh_instance_node *node = (const void *)leaf;
+         primitive = node->instance_id;
+         break;
+      }
+      }
+
+      assert(geometry_index < builder->geometry_count);
+      build_leaf(builder, &builder->geometries[geometry_index], primitive, leaf,
+                 &builder->bounds[i]);
+   }
+}
+
+static void
+refit_tree(struct lvp_bvh_builder *builder)
+{
+   const struct lvp_bvh_header *header = (const void *)builder->output;
+   builder->leaf_nodes_offset = header->leaf_nodes_offset;
+
+   builder->node_count = header->internal_node_count;
+   builder->active_count = header->leaf_node_count;
+
+   uint32_t leaf_count = builder->active_count;
+   uint32_t job_count = DIV_ROUND_UP(leaf_count, LVP_BVH_LEAF_CHUNK);
+   struct lvp_bvh_job *jobs = calloc(MAX2(job_count, 1), sizeof(*jobs));
+   if (jobs) {
+      for (uint32_t i = 0; i < job_count; i++) {
+         jobs[i].builder = builder;
+         jobs[i].begin = i * LVP_BVH_LEAF_CHUNK;
+         jobs[i].end = MIN2(jobs[i].begin + LVP_BVH_LEAF_CHUNK, leaf_count);
+      }
+      lvp_bvh_run_jobs(builder->device, jobs, job_count, refit_leaves_job);
+      free(jobs);
+   } else {
+      struct lvp_bvh_job job = { .builder = builder, .end = leaf_count };
+      refit_leaves_job(&job, NULL, 0);
+   }
+
+   /* children always have a higher index than their parent */
+   for (uint32_t i = builder->node_count; i-- > 0;)
+      finish_box_node(builder, i);
+}
+
+/* Writes a tree without any geometry, so that traversal of a structure whose
+ * build failed misses instead of reading stale nodes.
+ */
+static void
+write_empty_tree(uint8_t *output, VkGeometryTypeKHR geometry_type)
+{
+   struct lvp_bvh_header *header = (void *)output;
+   struct lvp_bvh_box_node *root = get_box_node(output, 0);
+
+   for (uint32_t i = 0; i < LVP_BVH_WIDTH; i++)
+      root->children[i] = LVP_BVH_INVALID_NODE;
+   lvp_bvh_encode_box_node(root, NULL, NULL, 0);
+
+   uint32_t bvh_size = lvp_get_as_size_internal(geometry_type, 0);
+   *header = (struct lvp_bvh_header){
+      .compacted_size = bvh_size,
+      .serialization_size = sizeof(struct lvp_accel_struct_serialization_header) + bvh_size,
+      .leaf_nodes_offset = sizeof(struct lvp_bvh_header) + sizeof(struct lvp_bvh_box_node),
+      .internal_node_count = 1,
+   };
+   aabb_init(&header->bounds);
+}
+
+/* Builds or updates the acceleration structure described by info on the
+ * CPU.  The build reads the geometry directly and needs no scratch memory.
+ * If the builder can't allocate its arrays, the structure is left empty and
+ * VK_ERROR_OUT_OF_HOST_MEMORY is returned.
+ */
+VkResult
+lvp_build_as(struct lvp_device *device,
+             const VkAccelerationStructureBuildGeometryInfoKHR *info,
+             const VkAccelerationStructureBuildRangeInfoKHR *ranges)
+{
+   VK_FROM_HANDLE(vk_acceleration_structure, dst, info->dstAccelerationStructure);
+   struct lvp_bvh_builder builder;
+   VkResult result = VK_SUCCESS;
+
+   if (!lvp_bvh_builder_init(&builder, device, info, ranges)) {
+      write_empty_tree((void *)(uintptr_t)vk_acceleration_structure_get_va(dst),
+                       builder.geometry_type);
+      result = VK_ERROR_OUT_OF_HOST_MEMORY;
+      goto out;
+   }
+
+   builder.output = (void *)(uintptr_t)vk_acceleration_structure_get_va(dst);
+
+   if (info->mode == VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR) {
+      VK_FROM_HANDLE(vk_acceleration_structure, src, info->srcAccelerationStructure);
+      const struct lvp_bvh_header *src_header =
+         (const void *)(uintptr_t)vk_acceleration_structure_get_va(src);
+
+      if ((const void *)src_header != builder.output)
+         memcpy(builder.output, src_header, src_header->compacted_size);
+
+      refit_tree(&builder);
+      write_header(&builder, &builder.node_bounds[0]);
+      goto out;
+   }
+
+   gather_leaves(&builder);
+
+   /* Every box node but a lonely root has at least two children. */
+   uint32_t internal_count = MAX2(builder.active_count, 2) - 1;
+   builder.leaf_nodes_offset = sizeof(struct lvp_bvh_header) +
+                               internal_count * sizeof(struct lvp_bvh_box_node);
+
+   build_tree(&builder);
+   write_header(&builder, &builder.node_bounds[0]);
+
+out:
+   lvp_bvh_builder_finish(&builder);
+   return result;
+}
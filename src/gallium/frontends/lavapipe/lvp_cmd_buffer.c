@@ -30,6 +30,7 @@
 static void
 lvp_cmd_buffer_destroy(struct vk_command_buffer *cmd_buffer)
 {
+   lvp_cmd_buffer_bake_free(container_of(cmd_buffer, struct lvp_cmd_buffer, vk));
    vk_command_buffer_finish(cmd_buffer);
    vk_free(&cmd_buffer->pool->alloc, cmd_buffer);
 }
@@ -56,6 +57,8 @@ lvp_create_cmd_buffer(struct vk_command_pool *pool,
    }
 
    cmd_buffer->device = device;
+   cmd_buffer->usage_flags = 0;
+   cmd_buffer->bake = NULL;
 
    *cmd_buffer_out = &cmd_buffer->vk;
 
@@ -66,6 +69,7 @@ static void
 lvp_reset_cmd_buffer(struct vk_command_buffer *vk_cmd_buffer,
                      UNUSED VkCommandBufferResetFlags flags)
 {
+   lvp_cmd_buffer_bake_free(container_of(vk_cmd_buffer, struct lvp_cmd_buffer, vk));
    vk_command_buffer_reset(vk_cmd_buffer);
 }
 
@@ -82,6 +86,7 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_BeginCommandBuffer(
    LVP_FROM_HANDLE(lvp_cmd_buffer, cmd_buffer, commandBuffer);
 
    vk_command_buffer_begin(&cmd_buffer->vk, pBeginInfo);
+   cmd_buffer->usage_flags = pBeginInfo->flags;
 
    return VK_SUCCESS;
 }
@@ -91,5 +96,15 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_EndCommandBuffer(
 {
    LVP_FROM_HANDLE(lvp_cmd_buffer, cmd_buffer, commandBuffer);
 
-   return vk_command_buffer_end(&cmd_buffer->vk);
+   VkResult result = vk_command_buffer_end(&cmd_buffer->vk);
+
+   /* Only command buffers that get submitted more than once are worth
+    * flattening; secondaries are replayed through their primary.
+    */
+   if (result == VK_SUCCESS &&
+       cmd_buffer->vk.level == VK_COMMAND_BUFFER_LEVEL_PRIMARY &&
+       !(cmd_buffer->usage_flags & VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT))
+      lvp_cmd_buffer_bake(cmd_buffer);
+
+   return result;
 }
@@ -330,12 +330,7 @@ lvp_descriptor_set_create(struct lvp_device *device,
    set->layout = layout;
    vk_descriptor_set_layout_ref(&layout->vk);
 
-   uint64_t bo_size = layout->size * sizeof(struct lp_descriptor);
-
-   for (unsigned i = 0; i < layout->binding_count; i++)
-      bo_size += layout->binding[i].uniform_block_size;
-
-   bo_size = MAX2(bo_size, 64);
+   uint64_t bo_size = lvp_descriptor_set_layout_bo_size(layout);
 
    struct pipe_resource template = {
       .bind = PIPE_BIND_CONSTANT_BUFFER,
@@ -357,8 +352,31 @@ lvp_descriptor_set_create(struct lvp_device *device,
 
    device->pscreen->resource_bind_backing(device->pscreen, set->bo, set->pmem, 0, 0, 0);
 
+   lvp_descriptor_set_init_immutable_samplers(set);
+
+   *out_set = set;
+
+   return VK_SUCCESS;
+}
+
+uint64_t
+lvp_descriptor_set_layout_bo_size(const struct lvp_descriptor_set_layout *layout)
+{
+   uint64_t bo_size = layout->size * sizeof(struct lp_descriptor);
+
+   for (unsigned i = 0; i < layout->binding_count; i++)
+      bo_size += layout->binding[i].uniform_block_size;
+
+   return MAX2(bo_size, 64);
+}
+
+void
+lvp_descriptor_set_init_immutable_samplers(struct lvp_descriptor_set *set)
+{
+   const struct lvp_descriptor_set_layout *layout = set->layout;
+
    for (uint32_t binding_index = 0; binding_index < layout->binding_count; binding_index++) {
-      const struct lvp_descriptor_set_binding_layout *bind_layout = &set->layout->binding[binding_index];
+      const struct lvp_descriptor_set_binding_layout *bind_layout = &layout->binding[binding_index];
       if (!bind_layout->immutable_samplers)
          continue;
 
@@ -374,10 +392,6 @@ lvp_descriptor_set_create(struct lvp_device *device,
          }
       }
    }
-
-   *out_set = set;
-
-   return VK_SUCCESS;
 }
 
 void
@@ -43,6 +43,7 @@
 #include "util/os_time.h"
 #include "util/u_thread.h"
 #include "util/u_atomic.h"
+#include "util/futex.h"
 #include "util/timespec.h"
 #include "util/ptralloc.h"
 #include "nir.h"
@@ -1323,11 +1324,19 @@ lvp_physical_device_init(struct lvp_physical_device *device,
    for (unsigned i = 0; i < ARRAY_SIZE(device->drv_options); i++)
       device->drv_options[i] = device->pscreen->nir_options[MIN2(i, MESA_SHADER_COMPUTE)];
 
-   device->sync_timeline_type = vk_sync_timeline_get_type(&lvp_pipe_sync_type);
    device->sync_types[0] = &lvp_pipe_sync_type;
+#if UTIL_FUTEX_SUPPORTED
+   /* Everything runs on the CPU, so timelines are just counters signaled
+    * once the work is done.
+    */
+   device->sync_types[1] = &vk_sync_cpu_timeline_type;
+#else
+   device->sync_timeline_type = vk_sync_timeline_get_type(&lvp_pipe_sync_type);
    device->sync_types[1] = &device->sync_timeline_type.sync;
+#endif
    device->sync_types[2] = NULL;
    device->vk.supported_sync_types = device->sync_types;
+   device->vk.pipeline_cache_import_ops = lvp_pipeline_cache_import_ops;
 
    device->max_images = device->pscreen->shader_caps[MESA_SHADER_FRAGMENT].max_shader_images;
    device->vk.supported_extensions = lvp_device_extensions_supported;
@@ -1523,6 +1532,36 @@ lvp_device_get_cache_uuid(void *uuid)
       memcpy(uuid, PACKAGE_VERSION, MIN2(strlen(PACKAGE_VERSION), VK_UUID_SIZE));
 }
 
+enum lvp_queue_family {
+   LVP_QUEUE_FAMILY_GRAPHICS,
+   LVP_QUEUE_FAMILY_COMPUTE,
+   LVP_QUEUE_FAMILY_TRANSFER,
+};
+
+static const VkQueueFamilyProperties lvp_queue_families[LVP_NUM_QUEUE_FAMILIES] = {
+   [LVP_QUEUE_FAMILY_GRAPHICS] = {
+      .queueFlags = VK_QUEUE_GRAPHICS_BIT |
+      VK_QUEUE_COMPUTE_BIT |
+      VK_QUEUE_TRANSFER_BIT |
+      (DETECT_OS_LINUX ? VK_QUEUE_SPARSE_BINDING_BIT : 0),
+      .queueCount = 1,
+      .timestampValidBits = 64,
+      .minImageTransferGranularity = { 1, 1, 1 },
+   },
+   [LVP_QUEUE_FAMILY_COMPUTE] = {
+      .queueFlags = VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT,
+      .queueCount = LVP_MAX_COMPUTE_QUEUES,
+      .timestampValidBits = 64,
+      .minImageTransferGranularity = { 1, 1, 1 },
+   },
+   [LVP_QUEUE_FAMILY_TRANSFER] = {
+      .queueFlags = VK_QUEUE_TRANSFER_BIT,
+      .queueCount = LVP_MAX_TRANSFER_QUEUES,
+      .timestampValidBits = 64,
+      .minImageTransferGranularity = { 1, 1, 1 },
+   },
+};
+
 VKAPI_ATTR void VKAPI_CALL lvp_GetPhysicalDeviceQueueFamilyProperties2(
    VkPhysicalDevice                            physicalDevice,
    uint32_t*                                   pCount,
@@ -1530,28 +1569,22 @@ VKAPI_ATTR void VKAPI_CALL lvp_GetPhysicalDeviceQueueFamilyProperties2(
 {
    VK_OUTARRAY_MAKE_TYPED(VkQueueFamilyProperties2, out, pQueueFamilyProperties, pCount);
 
-   VkQueueFamilyGlobalPriorityPropertiesKHR *prio = vk_find_struct(pQueueFamilyProperties, QUEUE_FAMILY_GLOBAL_PRIORITY_PROPERTIES_KHR);
-   if (prio) {
-      prio->priorityCount = 4;
-      prio->priorities[0] = VK_QUEUE_GLOBAL_PRIORITY_LOW_KHR;
-      prio->priorities[1] = VK_QUEUE_GLOBAL_PRIORITY_MEDIUM_KHR;
-      prio->priorities[2] = VK_QUEUE_GLOBAL_PRIORITY_HIGH_KHR;
-      prio->priorities[3] = VK_QUEUE_GLOBAL_PRIORITY_REALTIME_KHR;
-   }
-   VkQueueFamilyOwnershipTransferPropertiesKHR *prop = vk_find_struct(pQueueFamilyProperties, QUEUE_FAMILY_OWNERSHIP_TRANSFER_PROPERTIES_KHR);
-   if (prop)
-      prop->optimalImageTransferToQueueFamilies = ~0;
-
-   vk_outarray_append_typed(VkQueueFamilyProperties2, &out, p) {
-      p->queueFamilyProperties = (VkQueueFamilyProperties) {
-         .queueFlags = VK_QUEUE_GRAPHICS_BIT |
-         VK_QUEUE_COMPUTE_BIT |
-         VK_QUEUE_TRANSFER_BIT |
-         (DETECT_OS_LINUX ? VK_QUEUE_SPARSE_BINDING_BIT : 0),
-         .queueCount = 1,
-         .timestampValidBits = 64,
-         .minImageTransferGranularity = (VkExtent3D) { 1, 1, 1 },
-      };
+   for (uint32_t i = 0; i < LVP_NUM_QUEUE_FAMILIES; i++) {
+      vk_outarray_append_typed(VkQueueFamilyProperties2, &out, p) {
+         p->queueFamilyProperties = lvp_queue_families[i];
+
+         VkQueueFamilyGlobalPriorityPropertiesKHR *prio = vk_find_struct(p, QUEUE_FAMILY_GLOBAL_PRIORITY_PROPERTIES_KHR);
+         if (prio) {
+            prio->priorityCount = 4;
+            prio->priorities[0] = VK_QUEUE_GLOBAL_PRIORITY_LOW_KHR;
+            prio->priorities[1] = VK_QUEUE_GLOBAL_PRIORITY_MEDIUM_KHR;
+            prio->priorities[2] = VK_QUEUE_GLOBAL_PRIORITY_HIGH_KHR;
+            prio->priorities[3] = VK_QUEUE_GLOBAL_PRIORITY_REALTIME_KHR;
+         }
+         VkQueueFamilyOwnershipTransferPropertiesKHR *prop = vk_find_struct(p, QUEUE_FAMILY_OWNERSHIP_TRANSFER_PROPERTIES_KHR);
+         if (prop)
+            prop->optimalImageTransferToQueueFamilies = ~0;
+      }
    }
 }
 
@@ -1644,13 +1677,43 @@ VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL vk_icdGetInstanceProcAddr(
 }
 
 static void
-destroy_pipelines(struct lvp_queue *queue)
+destroy_pipelines(struct lvp_device *device)
 {
-   simple_mtx_lock(&queue->lock);
-   while (util_dynarray_contains(&queue->pipeline_destroys, struct lvp_pipeline*)) {
-      lvp_pipeline_destroy(queue->device, util_dynarray_pop(&queue->pipeline_destroys, struct lvp_pipeline*), true);
+   /* The pipelines may have CSOs on every queue, whose locks can only be
+    * taken without holding the device queue's.
+    */
+   simple_mtx_lock(&device->queue.lock);
+   struct util_dynarray pipelines = device->queue.pipeline_destroys;
+   util_dynarray_init(&device->queue.pipeline_destroys, NULL);
+   simple_mtx_unlock(&device->queue.lock);
+
+   util_dynarray_foreach(&pipelines, struct lvp_pipeline *, pipeline)
+      lvp_pipeline_destroy(device, *pipeline);
+   util_dynarray_fini(&pipelines);
+}
+
+/* With extra queues, llvmpipe can't tell when the sample functions compiled
+ * on demand can be moved into the texture handles: wait for all the queues.
+ */
+static void
+update_texture_handles(struct lvp_device *device)
+{
+   u_rwlock_wrlock(&device->execute_lock);
+
+   for (uint32_t i = 0; i <= device->num_extra_queues; i++) {
+      struct lvp_queue *queue = i ? device->extra_queues[i - 1] : &device->queue;
+      if (queue->last_fence) {
+         device->pscreen->fence_finish(device->pscreen, NULL, queue->last_fence,
+                                       OS_TIMEOUT_INFINITE);
+      }
    }
-   simple_mtx_unlock(&queue->lock);
+
+   /* The handles are created and deleted under the device queue's lock. */
+   simple_mtx_lock(&device->queue.lock);
+   llvmpipe_update_texture_handles(device->queue.ctx);
+   simple_mtx_unlock(&device->queue.lock);
+
+   u_rwlock_wrunlock(&device->execute_lock);
 }
 
 static VkResult
@@ -1659,12 +1722,26 @@ lvp_queue_submit(struct vk_queue *vk_queue,
 {
    struct lvp_queue *queue = container_of(vk_queue, struct lvp_queue, vk);
 
+   /* The submit is accepted, later submits waiting on these time points can
+    * be queued.
+    */
+   bool has_timeline_signal = false;
+   for (uint32_t i = 0; i < submit->signal_count; i++) {
+      struct vk_sync_cpu_timeline *timeline =
+         vk_sync_as_cpu_timeline(submit->signals[i].sync);
+      if (timeline) {
+         vk_sync_cpu_timeline_set_pending(timeline, submit->signals[i].signal_value);
+         has_timeline_signal = true;
+      }
+   }
+
    VkResult result = vk_sync_wait_many(&queue->device->vk,
                                        submit->wait_count, submit->waits,
                                        VK_SYNC_WAIT_COMPLETE, UINT64_MAX);
    if (result != VK_SUCCESS)
       return result;
 
+   u_rwlock_rdlock(&queue->device->execute_lock);
    simple_mtx_lock(&queue->lock);
 
    for (uint32_t i = 0; i < submit->buffer_bind_count; i++) {
@@ -1697,12 +1774,34 @@ lvp_queue_submit(struct vk_queue *vk_queue,
    if (submit->command_buffer_count > 0)
       queue->ctx->flush(queue->ctx, &queue->last_fence, 0);
 
+   u_rwlock_rdunlock(&queue->device->execute_lock);
+
+   /* CPU timelines can't hold a fence, wait for the work to be done. */
+   if (has_timeline_signal && queue->last_fence) {
+      queue->device->pscreen->fence_finish(queue->device->pscreen, NULL,
+                                           queue->last_fence,
+                                           OS_TIMEOUT_INFINITE);
+   }
+
    for (uint32_t i = 0; i < submit->signal_count; i++) {
+      if (vk_sync_type_is_vk_sync_cpu_timeline(submit->signals[i].sync->type)) {
+         result = vk_sync_signal(&queue->device->vk, submit->signals[i].sync,
+                                 submit->signals[i].signal_value);
+         if (result != VK_SUCCESS)
+            return result;
+         continue;
+      }
+
       struct lvp_pipe_sync *sync =
          vk_sync_as_lvp_pipe_sync(submit->signals[i].sync);
       lvp_pipe_sync_signal_with_fence(queue->device, sync, queue->last_fence);
    }
-   destroy_pipelines(queue);
+
+   if (queue->device->num_extra_queues &&
+       llvmpipe_texture_handles_outdated(queue->device->queue.ctx))
+      update_texture_handles(queue->device);
+
+   destroy_pipelines(queue->device);
 
    return VK_SUCCESS;
 }
@@ -1725,10 +1824,26 @@ lvp_queue_init(struct lvp_device *device, struct lvp_queue *queue,
 
    queue->device = device;
 
+   queue->state = vk_zalloc(&device->vk.alloc, lvp_get_rendering_state_size(), 8,
+                            VK_SYSTEM_ALLOCATION_SCOPE_DEVICE);
+   if (!queue->state) {
+      vk_queue_finish(&queue->vk);
+      return vk_error(device, VK_ERROR_OUT_OF_HOST_MEMORY);
+   }
+
    queue->ctx = device->pscreen->context_create(device->pscreen, NULL, PIPE_CONTEXT_ROBUST_BUFFER_ACCESS);
    queue->cso = cso_create_context(queue->ctx, CSO_NO_VBUF);
    queue->uploader = u_upload_create(queue->ctx, 1024 * 1024, PIPE_BIND_CONSTANT_BUFFER, PIPE_USAGE_STREAM, 0);
 
+   nir_builder b = nir_builder_init_simple_shader(MESA_SHADER_FRAGMENT, device->physical_device->drv_options[MESA_SHADER_FRAGMENT], "dummy_frag");
+   struct pipe_shader_state shstate = {0};
+   shstate.type = PIPE_SHADER_IR_NIR;
+   shstate.ir.nir = b.shader;
+   queue->noop_fs = queue->ctx->create_fs_state(queue->ctx, &shstate);
+
+   if (queue != &device->queue)
+      queue->shader_csos = _mesa_pointer_hash_table_create(NULL);
+
    queue->vk.driver_submit = lvp_queue_submit;
 
    simple_mtx_init(&queue->lock, mtx_plain);
@@ -1742,13 +1857,92 @@ lvp_queue_finish(struct lvp_queue *queue)
 {
    vk_queue_finish(&queue->vk);
 
-   destroy_pipelines(queue);
+   destroy_pipelines(queue->device);
    simple_mtx_destroy(&queue->lock);
    util_dynarray_fini(&queue->pipeline_destroys);
 
+   /* The application leaked the pipelines of what is left. */
+   _mesa_hash_table_destroy(queue->shader_csos, NULL);
+
+   if (queue->last_fence)
+      queue->device->pscreen->fence_reference(queue->device->pscreen, &queue->last_fence, NULL);
+
+   queue->ctx->delete_fs_state(queue->ctx, queue->noop_fs);
    u_upload_destroy(queue->uploader);
    cso_destroy_context(queue->cso);
    queue->ctx->destroy(queue->ctx);
+   vk_free(&queue->device->vk.alloc, queue->state);
+}
+
+static void
+lvp_device_finish_queues(struct lvp_device *device)
+{
+   /* Run the pending pipeline destructions while every context is alive. */
+   destroy_pipelines(device);
+
+   for (uint32_t i = 0; i < device->num_extra_queues; i++) {
+      lvp_queue_finish(device->extra_queues[i]);
+      vk_free(&device->vk.alloc, device->extra_queues[i]);
+   }
+   device->num_extra_queues = 0;
+
+   lvp_queue_finish(&device->queue);
+}
+
+static VkResult
+lvp_device_init_queues(struct lvp_device *device,
+                       const VkDeviceCreateInfo *pCreateInfo)
+{
+   const VkDeviceQueueCreateInfo *graphics_info = NULL;
+   for (uint32_t i = 0; i < pCreateInfo->queueCreateInfoCount; i++) {
+      const VkDeviceQueueCreateInfo *info = &pCreateInfo->pQueueCreateInfos[i];
+      assert(info->queueFamilyIndex < LVP_NUM_QUEUE_FAMILIES);
+      assert(info->queueCount <= lvp_queue_families[info->queueFamilyIndex].queueCount);
+      if (info->queueFamilyIndex == LVP_QUEUE_FAMILY_GRAPHICS)
+         graphics_info = info;
+   }
+
+   /* The device queue is needed to create objects even if the application
+    * only uses the other families, it then simply never gets submissions.
+    */
+   const VkDeviceQueueCreateInfo default_info = {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+      .queueFamilyIndex = LVP_QUEUE_FAMILY_GRAPHICS,
+      .queueCount = 1,
+   };
+   VkResult result = lvp_queue_init(device, &device->queue,
+                                    graphics_info ? graphics_info : &default_info, 0);
+   if (result != VK_SUCCESS)
+      return result;
+
+   for (uint32_t i = 0; i < pCreateInfo->queueCreateInfoCount; i++) {
+      const VkDeviceQueueCreateInfo *info = &pCreateInfo->pQueueCreateInfos[i];
+      if (info->queueFamilyIndex == LVP_QUEUE_FAMILY_GRAPHICS)
+         continue;
+
+      for (uint32_t q = 0; q < info->queueCount; q++) {
+         struct lvp_queue *queue = vk_zalloc(&device->vk.alloc, sizeof(*queue), 8,
+                                             VK_SYSTEM_ALLOCATION_SCOPE_DEVICE);
+         if (!queue) {
+            lvp_device_finish_queues(device);
+            return vk_error(device, VK_ERROR_OUT_OF_HOST_MEMORY);
+         }
+
+         result = lvp_queue_init(device, queue, info, q);
+         if (result != VK_SUCCESS) {
+            vk_free(&device->vk.alloc, queue);
+            lvp_device_finish_queues(device);
+            return result;
+         }
+
+         device->extra_queues[device->num_extra_queues++] = queue;
+      }
+   }
+
+   if (device->num_extra_queues)
+      llvmpipe_share_texture_handles(device->queue.ctx);
+
+   return VK_SUCCESS;
 }
 
 VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
@@ -1763,16 +1957,15 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
 
    assert(pCreateInfo->sType == VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO);
 
-   size_t state_size = lvp_get_rendering_state_size();
    device = vk_zalloc2(&physical_device->vk.instance->alloc, pAllocator,
-                       sizeof(*device) + state_size, 8,
+                       sizeof(*device), 8,
                        VK_SYSTEM_ALLOCATION_SCOPE_DEVICE);
    if (!device)
       return vk_error(instance, VK_ERROR_OUT_OF_HOST_MEMORY);
 
-   device->queue.state = device + 1;
    device->poison_mem = debug_get_bool_option("LVP_POISON_MEMORY", false);
    device->print_cmds = debug_get_bool_option("LVP_CMD_DEBUG", false);
+   device->rt_packets = debug_get_bool_option("LVP_RT_PACKETS", false);
 
    struct vk_device_dispatch_table dispatch_table;
    vk_device_dispatch_table_from_entrypoints(&dispatch_table,
@@ -1797,22 +1990,14 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
 
    device->pscreen = physical_device->pscreen;
 
-   assert(pCreateInfo->queueCreateInfoCount <= LVP_NUM_QUEUES);
-   if (pCreateInfo->queueCreateInfoCount) {
-      assert(pCreateInfo->pQueueCreateInfos[0].queueFamilyIndex == 0);
-      assert(pCreateInfo->pQueueCreateInfos[0].queueCount == 1);
-   }
-   result = lvp_queue_init(device, &device->queue, pCreateInfo->pQueueCreateInfos, 0);
+   u_rwlock_init(&device->execute_lock);
+   result = lvp_device_init_queues(device, pCreateInfo);
    if (result != VK_SUCCESS) {
+      u_rwlock_destroy(&device->execute_lock);
       vk_free(&device->vk.alloc, device);
       return result;
    }
 
-   nir_builder b = nir_builder_init_simple_shader(MESA_SHADER_FRAGMENT, physical_device->drv_options[MESA_SHADER_FRAGMENT], "dummy_frag");
-   struct pipe_shader_state shstate = {0};
-   shstate.type = PIPE_SHADER_IR_NIR;
-   shstate.ir.nir = b.shader;
-   device->noop_fs = device->queue.ctx->create_fs_state(device->queue.ctx, &shstate);
    _mesa_hash_table_init(&device->bda, NULL, _mesa_hash_pointer, _mesa_key_pointer_equal);
    simple_mtx_init(&device->bda_lock, mtx_plain);
 
@@ -1837,6 +2022,16 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
 
    lvp_device_init_accel_struct_state(device);
 
+   /* Shares shaders, and the code of their variants, between pipelines
+    * created without a VkPipelineCache.
+    */
+   struct vk_pipeline_cache_create_info pcc_info = { .weak_ref = true, };
+   device->vk.mem_cache = vk_pipeline_cache_create(&device->vk, &pcc_info, NULL);
+   if (!device->vk.mem_cache) {
+      lvp_DestroyDevice(lvp_device_to_handle(device), pAllocator);
+      return vk_error(instance, VK_ERROR_OUT_OF_HOST_MEMORY);
+   }
+
    *pDevice = lvp_device_to_handle(device);
 
    return VK_SUCCESS;
@@ -1853,6 +2048,9 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyDevice(
 
    vk_meta_device_finish(&device->vk, &device->meta);
 
+   if (device->vk.mem_cache)
+      vk_pipeline_cache_destroy(device->vk.mem_cache, NULL);
+
    util_dynarray_foreach(&device->bda_texture_handles, struct lp_texture_handle *, handle)
       device->queue.ctx->delete_texture_handle(device->queue.ctx, (uint64_t)(uintptr_t)*handle);
 
@@ -1866,15 +2064,12 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyDevice(
    device->queue.ctx->delete_texture_handle(device->queue.ctx, (uint64_t)(uintptr_t)device->null_texture_handle);
    device->queue.ctx->delete_image_handle(device->queue.ctx, (uint64_t)(uintptr_t)device->null_image_handle);
 
-   device->queue.ctx->delete_fs_state(device->queue.ctx, device->noop_fs);
-
-   if (device->queue.last_fence)
-      device->pscreen->fence_reference(device->pscreen, &device->queue.last_fence, NULL);
    ralloc_free(device->bda.table);
    simple_mtx_destroy(&device->bda_lock);
    pipe_resource_reference(&device->zero_buffer, NULL);
 
-   lvp_queue_finish(&device->queue);
+   lvp_device_finish_queues(device);
+   u_rwlock_destroy(&device->execute_lock);
    vk_device_finish(&device->vk);
    vk_free(&device->vk.alloc, device);
 }
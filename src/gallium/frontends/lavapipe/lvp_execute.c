@@ -90,6 +90,7 @@ struct lvp_conditional_rendering_state {
 struct rendering_state {
    struct pipe_context *pctx;
    struct lvp_device *device;
+   struct lvp_queue *queue;
    struct u_upload_mgr *uploader;
    struct cso_context *cso;
 
@@ -174,6 +175,9 @@ struct rendering_state {
    void *velems_cso;
 
    uint8_t push_constants[128 * 4];
+   /* set when push_constants matches a block packed in a command buffer bake */
+   const struct lvp_cmd_bake *pcbuf_bake;
+   uint32_t pcbuf_bake_offset;
    uint16_t push_size[LVP_PIPELINE_TYPE_COUNT];
    uint16_t gfx_push_sizes[LVP_SHADER_STAGES];
 
@@ -296,7 +300,14 @@ update_pcbuf(struct rendering_state *state, mesa_shader_stage pstage,
              mesa_shader_stage api_stage)
 {
    unsigned size = get_pcbuf_size(state, api_stage);
-   if (size) {
+   if (size && state->pcbuf_bake && size <= state->pcbuf_bake->push_constant_stride) {
+      struct pipe_constant_buffer cbuf = {
+         .buffer = state->pcbuf_bake->push_constants,
+         .buffer_offset = state->pcbuf_bake_offset,
+         .buffer_size = size,
+      };
+      state->pctx->set_constant_buffer(state->pctx, pstage, 0, false, &cbuf);
+   } else if (size) {
       uint8_t *mem;
       struct pipe_constant_buffer cbuf;
       cbuf.buffer_size = size;
@@ -322,7 +333,7 @@ static void emit_compute_state(struct rendering_state *state)
    }
 
    if (state->compute_shader_dirty)
-      state->pctx->bind_compute_state(state->pctx, state->shaders[MESA_SHADER_COMPUTE]->shader_cso);
+      state->pctx->bind_compute_state(state->pctx, lvp_queue_shader_cso(state->queue, state->shaders[MESA_SHADER_COMPUTE], false));
 
    state->compute_shader_dirty = false;
 
@@ -374,7 +385,7 @@ static void update_vertex_elements_buffer_index(struct rendering_state *state)
 static void emit_state(struct rendering_state *state)
 {
    if (!state->shaders[MESA_SHADER_FRAGMENT] && !state->noop_fs_bound) {
-      state->pctx->bind_fs_state(state->pctx, state->device->noop_fs);
+      state->pctx->bind_fs_state(state->pctx, state->queue->noop_fs);
       state->noop_fs_bound = true;
    }
    if (state->blend_dirty) {
@@ -619,37 +630,37 @@ handle_graphics_stages(struct rendering_state *state, VkShaderStageFlagBits shad
 
       switch (vk_stage) {
       case VK_SHADER_STAGE_FRAGMENT_BIT:
-         state->pctx->bind_fs_state(state->pctx, state->shaders[MESA_SHADER_FRAGMENT]->shader_cso);
+         state->pctx->bind_fs_state(state->pctx, lvp_queue_shader_cso(state->queue, state->shaders[MESA_SHADER_FRAGMENT], false));
          state->noop_fs_bound = false;
          break;
       case VK_SHADER_STAGE_VERTEX_BIT:
-         state->pctx->bind_vs_state(state->pctx, state->shaders[MESA_SHADER_VERTEX]->shader_cso);
+         state->pctx->bind_vs_state(state->pctx, lvp_queue_shader_cso(state->queue, state->shaders[MESA_SHADER_VERTEX], false));
          break;
       case VK_SHADER_STAGE_GEOMETRY_BIT:
-         state->pctx->bind_gs_state(state->pctx, state->shaders[MESA_SHADER_GEOMETRY]->shader_cso);
+         state->pctx->bind_gs_state(state->pctx, lvp_queue_shader_cso(state->queue, state->shaders[MESA_SHADER_GEOMETRY], false));
          state->gs_output_lines = state->shaders[MESA_SHADER_GEOMETRY]->pipeline_nir->nir->info.gs.output_primitive == MESA_PRIM_LINES ? GS_OUTPUT_LINES : GS_OUTPUT_NOT_LINES;
          break;
       case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT:
-         state->pctx->bind_tcs_state(state->pctx, state->shaders[MESA_SHADER_TESS_CTRL]->shader_cso);
+         state->pctx->bind_tcs_state(state->pctx, lvp_queue_shader_cso(state->queue, state->shaders[MESA_SHADER_TESS_CTRL], false));
          break;
       case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT:
          state->tess_states[0] = NULL;
          state->tess_states[1] = NULL;
          if (dynamic_tess_origin) {
-            state->tess_states[0] = state->shaders[MESA_SHADER_TESS_EVAL]->shader_cso;
-            state->tess_states[1] = state->shaders[MESA_SHADER_TESS_EVAL]->tess_ccw_cso;
+            state->tess_states[0] = lvp_queue_shader_cso(state->queue, state->shaders[MESA_SHADER_TESS_EVAL], false);
+            state->tess_states[1] = lvp_queue_shader_cso(state->queue, state->shaders[MESA_SHADER_TESS_EVAL], true);
             state->pctx->bind_tes_state(state->pctx, state->tess_states[state->tess_ccw]);
          } else {
-            state->pctx->bind_tes_state(state->pctx, state->shaders[MESA_SHADER_TESS_EVAL]->shader_cso);
+            state->pctx->bind_tes_state(state->pctx, lvp_queue_shader_cso(state->queue, state->shaders[MESA_SHADER_TESS_EVAL], false));
          }
          if (!dynamic_tess_origin)
             state->tess_ccw = false;
          break;
       case VK_SHADER_STAGE_TASK_BIT_EXT:
-         state->pctx->bind_ts_state(state->pctx, state->shaders[MESA_SHADER_TASK]->shader_cso);
+         state->pctx->bind_ts_state(state->pctx, lvp_queue_shader_cso(state->queue, state->shaders[MESA_SHADER_TASK], false));
          break;
       case VK_SHADER_STAGE_MESH_BIT_EXT:
-         state->pctx->bind_ms_state(state->pctx, state->shaders[MESA_SHADER_MESH]->shader_cso);
+         state->pctx->bind_ms_state(state->pctx, lvp_queue_shader_cso(state->queue, state->shaders[MESA_SHADER_MESH], false));
          break;
       default:
          assert(0);
@@ -713,7 +724,7 @@ static void handle_graphics_pipeline(struct lvp_pipeline *pipeline,
                                      struct rendering_state *state)
 {
    const struct vk_graphics_pipeline_state *ps = &pipeline->graphics_state;
-   lvp_pipeline_shaders_compile(pipeline, true);
+   lvp_pipeline_shaders_compile(pipeline, state->queue == &state->device->queue);
    bool dynamic_tess_origin = BITSET_TEST(ps->dynamic, MESA_VK_DYNAMIC_TS_DOMAIN_ORIGIN);
    unbind_graphics_stages(state,
                           (~pipeline->graphics_state.shader_stages) &
@@ -1101,7 +1112,7 @@ handle_set_stage_buffer(struct rendering_state *state,
 {
    state->const_buffer[stage][index].buffer = bo;
    state->const_buffer[stage][index].buffer_offset = offset;
-   state->const_buffer[stage][index].buffer_size = bo->width0;
+   state->const_buffer[stage][index].buffer_size = bo->width0 - offset;
    state->const_buffer[stage][index].user_buffer = NULL;
 
    state->constbuf_dirty[stage] = true;
@@ -1117,24 +1128,79 @@ static void handle_set_stage(struct rendering_state *state,
                              uint32_t index)
 {
    state->desc_sets[pipeline_type][index] = set;
-   handle_set_stage_buffer(state, set->bo, 0, stage, index);
+   handle_set_stage_buffer(state, set->bo, set->bo_offset, stage, index);
 }
 
-static void
-apply_dynamic_offsets(struct lvp_descriptor_set **out_set, const uint32_t *offsets, uint32_t offset_count,
-                      struct rendering_state *state)
+/* Sets for dynamic offsets and push descriptors only live while the command
+ * buffer executes.  Rather than getting their own memory like the
+ * application's sets, they are suballocated from the uploader, the set
+ * itself in front of its descriptors.  The layout is kept alive by the set
+ * or the pipeline layout of the command.
+ *
+ * The descriptors are copied from base, which must have the same layout, or
+ * initialized like a new set.  If the uploader is out of memory, the queue
+ * is marked lost and NULL is returned; callers must then leave the set
+ * unbound rather than bind descriptors the application didn't ask for.
+ */
+static struct lvp_descriptor_set *
+create_transient_set(struct rendering_state *state,
+                     struct lvp_descriptor_set_layout *layout,
+                     const struct lvp_descriptor_set *base)
 {
-   if (!offset_count)
-      return;
+   const uint32_t header_size = align(sizeof(struct lvp_descriptor_set), 64);
+   uint64_t bo_size = lvp_descriptor_set_layout_bo_size(layout);
 
-   struct lvp_descriptor_set *in_set = *out_set;
+   struct pipe_resource *bo = NULL;
+   unsigned offset;
+   uint8_t *mem;
+   u_upload_alloc(state->uploader, 0, header_size + bo_size, 64, &offset, &bo, (void **)&mem);
+   if (!bo || !mem) {
+      pipe_resource_reference(&bo, NULL);
+      vk_queue_set_lost(&state->queue->vk, "out of memory for a transient descriptor set");
+      return NULL;
+   }
+   util_dynarray_append(&state->internal_buffers, struct pipe_resource *, bo);
 
-   struct lvp_descriptor_set *set;
-   lvp_descriptor_set_create(state->device, in_set->layout, &set);
+   struct lvp_descriptor_set *set = (void *)mem;
+   memset(set, 0, sizeof(*set));
+   vk_object_base_init(&state->device->vk, &set->base,
+                       VK_OBJECT_TYPE_DESCRIPTOR_SET);
+   set->layout = layout;
+   set->bo = bo;
+   set->bo_offset = offset + header_size;
+   set->map = mem + header_size;
+
+   if (base) {
+      assert(base->layout == layout);
+      memcpy(set->map, base->map, bo_size);
+   } else {
+      memset(set->map, 0, bo_size);
+      lvp_descriptor_set_init_immutable_samplers(set);
+   }
 
    util_dynarray_append(&state->push_desc_sets, struct lvp_descriptor_set *, set);
 
-   memcpy(set->map, in_set->map, in_set->bo->width0);
+   return set;
+}
+
+/* Returns false if the set with the offsets applied couldn't be created. */
+static bool
+apply_dynamic_offsets(struct lvp_descriptor_set **out_set, const uint32_t *offsets, uint32_t offset_count,
+                      struct rendering_state *state)
+{
+   struct lvp_descriptor_set *in_set = *out_set;
+
+   /* Zero offsets leave the descriptors as they are, bind the set itself */
+   uint32_t count = MIN2(offset_count, in_set->layout->dynamic_offset_count);
+   uint32_t first_offset = 0;
+   while (first_offset < count && !offsets[first_offset])
+      first_offset++;
+   if (first_offset == count)
+      return true;
+
+   struct lvp_descriptor_set *set = create_transient_set(state, in_set->layout, in_set);
+   if (!set)
+      return false;
 
    *out_set = set;
 
@@ -1149,11 +1215,13 @@ apply_dynamic_offsets(struct lvp_descriptor_set **out_set, const uint32_t *offse
       for (uint32_t j = 0; j < binding->array_size; j++) {
          uint32_t offset_index = binding->dynamic_index + j;
          if (offset_index >= offset_count)
-            return;
+            return true;
 
          desc[j].buffer.u = (uint32_t *)((uint8_t *)desc[j].buffer.u + offsets[offset_index]);
       }
    }
+
+   return true;
 }
 
 static void
@@ -1188,11 +1256,13 @@ handle_descriptor_sets(VkBindDescriptorSetsInfoKHR *bds, struct rendering_state
          if (!set)
             continue;
 
-         apply_dynamic_offsets(&set, bds->pDynamicOffsets + dynamic_offset_index,
-                              bds->dynamicOffsetCount - dynamic_offset_index, state);
-
+         uint32_t set_offset_index = dynamic_offset_index;
          dynamic_offset_index += set->layout->dynamic_offset_count;
 
+         if (!apply_dynamic_offsets(&set, bds->pDynamicOffsets + set_offset_index,
+                                    bds->dynamicOffsetCount - set_offset_index, state))
+            continue;
+
          if (pipeline_type == LVP_PIPELINE_COMPUTE || pipeline_type == LVP_PIPELINE_EXEC_GRAPH) {
             if (set->layout->shader_stages & VK_SHADER_STAGE_COMPUTE_BIT)
                handle_set_stage(state, set, pipeline_type, MESA_SHADER_COMPUTE, bds->firstSet + i);
@@ -2783,11 +2853,20 @@ static void handle_dispatch_indirect(struct vk_cmd_queue_entry *cmd,
 }
 
 static void handle_push_constants(struct vk_cmd_queue_entry *cmd,
+                                  const struct lvp_cmd_bake *bake,
+                                  const struct lvp_baked_cmd *baked,
                                   struct rendering_state *state)
 {
    VkPushConstantsInfoKHR *pci = cmd->u.push_constants2.push_constants_info;
    memcpy(state->push_constants + pci->offset, pci->pValues, pci->size);
 
+   if (baked && baked->push_constant_offset != UINT32_MAX) {
+      state->pcbuf_bake = bake;
+      state->pcbuf_bake_offset = baked->push_constant_offset;
+   } else {
+      state->pcbuf_bake = NULL;
+   }
+
    VkShaderStageFlags stage_flags = pci->stageFlags;
    state->pcbuf_dirty[MESA_SHADER_VERTEX] |= (stage_flags & VK_SHADER_STAGE_VERTEX_BIT) > 0;
    state->pcbuf_dirty[MESA_SHADER_FRAGMENT] |= (stage_flags & VK_SHADER_STAGE_FRAGMENT_BIT) > 0;
@@ -2801,6 +2880,7 @@ static void handle_push_constants(struct vk_cmd_queue_entry *cmd,
 }
 
 static void lvp_execute_cmd_buffer(struct list_head *cmds,
+                                   const struct lvp_cmd_bake *bake,
                                    struct rendering_state *state, bool print_cmds);
 
 static void handle_execute_commands(struct vk_cmd_queue_entry *cmd,
@@ -2808,7 +2888,7 @@ static void handle_execute_commands(struct vk_cmd_queue_entry *cmd,
 {
    for (unsigned i = 0; i < cmd->u.execute_commands.command_buffer_count; i++) {
       LVP_FROM_HANDLE(lvp_cmd_buffer, secondary_buf, cmd->u.execute_commands.command_buffers[i]);
-      lvp_execute_cmd_buffer(&secondary_buf->vk.cmd_queue.cmds, state, print_cmds);
+      lvp_execute_cmd_buffer(&secondary_buf->vk.cmd_queue.cmds, NULL, state, print_cmds);
    }
 }
 
@@ -3283,16 +3363,16 @@ static void handle_push_descriptor_set(struct vk_cmd_queue_entry *cmd,
    LVP_FROM_HANDLE(lvp_pipeline_layout, layout, pds->layout);
    struct lvp_descriptor_set_layout *set_layout = (struct lvp_descriptor_set_layout *)layout->vk.set_layouts[pds->set];
 
-   struct lvp_descriptor_set *set;
-   lvp_descriptor_set_create(state->device, set_layout, &set);
-
-   util_dynarray_append(&state->push_desc_sets, struct lvp_descriptor_set *, set);
+   struct lvp_descriptor_set *set = create_transient_set(state, set_layout, NULL);
+   if (!set)
+      return;
 
    uint32_t types = lvp_pipeline_types_from_shader_stages(pds->stageFlags);
    u_foreach_bit(pipeline_type, types) {
       struct lvp_descriptor_set *base = state->desc_sets[pipeline_type][pds->set];
       if (base)
-         memcpy(set->map, base->map, MIN2(set->bo->width0, base->bo->width0));
+         memcpy(set->map, base->map, MIN2(lvp_descriptor_set_layout_bo_size(set->layout),
+                                          lvp_descriptor_set_layout_bo_size(base->layout)));
 
       VkDescriptorSet set_handle = lvp_descriptor_set_to_handle(set);
 
@@ -3321,14 +3401,14 @@ static void handle_push_descriptor_set_with_template(struct vk_cmd_queue_entry *
    LVP_FROM_HANDLE(lvp_pipeline_layout, layout, pds->layout);
    struct lvp_descriptor_set_layout *set_layout = (struct lvp_descriptor_set_layout *)layout->vk.set_layouts[pds->set];
 
-   struct lvp_descriptor_set *set;
-   lvp_descriptor_set_create(state->device, set_layout, &set);
-
-   util_dynarray_append(&state->push_desc_sets, struct lvp_descriptor_set *, set);
+   struct lvp_descriptor_set *set = create_transient_set(state, set_layout, NULL);
+   if (!set)
+      return;
 
    struct lvp_descriptor_set *base = state->desc_sets[lvp_pipeline_type_from_bind_point(templ->bind_point)][pds->set];
    if (base)
-      memcpy(set->map, base->map, MIN2(set->bo->width0, base->bo->width0));
+      memcpy(set->map, base->map, MIN2(lvp_descriptor_set_layout_bo_size(set->layout),
+                                       lvp_descriptor_set_layout_bo_size(base->layout)));
 
    VkDescriptorSet set_handle = lvp_descriptor_set_to_handle(set);
    lvp_descriptor_set_update_with_template(lvp_device_to_handle(state->device), set_handle,
@@ -4205,7 +4285,7 @@ handle_execute_generated_commands_ext(struct vk_cmd_queue_entry *cmd, struct ren
 
    struct vk_cmd_queue_entry *exec_cmd = list_first_entry(list, struct vk_cmd_queue_entry, cmd_link);
    if (exec_cmd)
-      lvp_execute_cmd_buffer(list, state, print_cmds);
+      lvp_execute_cmd_buffer(list, NULL, state, print_cmds);
 }
 
 static void
@@ -4585,7 +4665,7 @@ lvp_trace_rays(struct rendering_state *state, VkTraceRaysIndirectCommand2KHR *co
       state->constbuf_dirty[MESA_SHADER_RAYGEN] = false;
    }
 
-   state->pctx->bind_compute_state(state->pctx, state->shaders[MESA_SHADER_RAYGEN]->shader_cso);
+   state->pctx->bind_compute_state(state->pctx, lvp_queue_shader_cso(state->queue, state->shaders[MESA_SHADER_RAYGEN], false));
 
    state->pcbuf_dirty[MESA_SHADER_COMPUTE] = true;
    state->constbuf_dirty[MESA_SHADER_COMPUTE] = true;
@@ -4763,6 +4843,24 @@ handle_encode_as(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
                  encode->geometry_type);
 }
 
+static void
+handle_build_acceleration_structures(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
+{
+   struct vk_cmd_build_acceleration_structures_khr *build = &cmd->u.build_acceleration_structures_khr;
+
+   finish_fence(state);
+
+   for (uint32_t i = 0; i < build->info_count; i++) {
+      VkResult result = lvp_build_as(state->device, &build->infos[i],
+                                     build->pp_build_range_infos[i]);
+      /* The command buffer was recorded successfully, so the failure can
+       * only be reported by losing the queue.
+       */
+      if (result != VK_SUCCESS)
+         vk_queue_set_lost(&state->queue->vk, "acceleration structure build failed");
+   }
+}
+
 static void
 handle_save_state(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
 {
@@ -4777,6 +4875,7 @@ handle_restore_state(struct vk_cmd_queue_entry *cmd, struct rendering_state *sta
       handle_compute_shader(state, state->saved.compute_shader);
 
    memcpy(state->push_constants, state->saved.push_constants, sizeof(state->push_constants));
+   state->pcbuf_bake = NULL;
    state->pcbuf_dirty[MESA_SHADER_COMPUTE] = true;
 }
 
@@ -4941,13 +5040,34 @@ void lvp_add_enqueue_cmd_entrypoints(struct vk_device_dispatch_table *disp)
 #undef ENQUEUE_CMD
 }
 
+static struct vk_cmd_queue_entry *
+next_cmd(struct list_head *cmds, const struct lvp_cmd_bake *bake,
+         const struct lvp_baked_cmd **baked, struct vk_cmd_queue_entry *cmd)
+{
+   if (bake) {
+      *baked = *baked ? *baked + 1 : bake->cmds;
+      return *baked < bake->cmds + bake->cmd_count ? (*baked)->cmd : NULL;
+   }
+
+   struct list_head *next = cmd ? cmd->cmd_link.next : cmds->next;
+   if (!next || next == cmds)
+      return NULL;
+   return list_entry(next, struct vk_cmd_queue_entry, cmd_link);
+}
+
+/* Executes either the recorded command list or, if the command buffer was
+ * baked, the flattened command array.
+ */
 static void lvp_execute_cmd_buffer(struct list_head *cmds,
+                                   const struct lvp_cmd_bake *bake,
                                    struct rendering_state *state, bool print_cmds)
 {
+   const struct lvp_baked_cmd *baked = NULL;
    struct vk_cmd_queue_entry *cmd;
    bool did_flush = false;
 
-   LIST_FOR_EACH_ENTRY(cmd, cmds, cmd_link) {
+   for (cmd = next_cmd(cmds, bake, &baked, NULL); cmd;
+        cmd = next_cmd(cmds, bake, &baked, cmd)) {
       if (cmd->type >= VK_CMD_TYPE_COUNT) {
          uint32_t type = cmd->type;
          if (type == LVP_CMD_WRITE_BUFFER_CP) {
@@ -5113,7 +5233,7 @@ static void lvp_execute_cmd_buffer(struct list_head *cmds,
          handle_copy_query_pool_results(cmd, state);
          break;
       case VK_CMD_PUSH_CONSTANTS2:
-         handle_push_constants(cmd, state);
+         handle_push_constants(cmd, bake, baked, state);
          break;
       case VK_CMD_EXECUTE_COMMANDS:
          handle_execute_commands(cmd, state, print_cmds);
@@ -5329,6 +5449,9 @@ static void lvp_execute_cmd_buffer(struct list_head *cmds,
       case VK_CMD_COPY_ACCELERATION_STRUCTURE_TO_MEMORY_KHR:
          handle_copy_acceleration_structure_to_memory(cmd, state);
          break;
+      case VK_CMD_BUILD_ACCELERATION_STRUCTURES_KHR:
+         handle_build_acceleration_structures(cmd, state);
+         break;
       case VK_CMD_BUILD_ACCELERATION_STRUCTURES_INDIRECT_KHR:
          break;
       case VK_CMD_WRITE_ACCELERATION_STRUCTURES_PROPERTIES_KHR:
@@ -5367,6 +5490,7 @@ VkResult lvp_execute_cmds(struct lvp_device *device,
    memset(state, 0, sizeof(*state));
    state->pctx = queue->ctx;
    state->device = device;
+   state->queue = queue;
    state->uploader = queue->uploader;
    state->cso = queue->cso;
    state->blend_dirty = true;
@@ -5402,7 +5526,8 @@ VkResult lvp_execute_cmds(struct lvp_device *device,
    state->index_buffer = state->device->zero_buffer;
 
    /* create a gallium context */
-   lvp_execute_cmd_buffer(&cmd_buffer->vk.cmd_queue.cmds, state, device->print_cmds);
+   lvp_execute_cmd_buffer(&cmd_buffer->vk.cmd_queue.cmds, cmd_buffer->bake,
+                          state, device->print_cmds);
 
    state->start_vb = -1;
    state->num_vb = 0;
@@ -5415,8 +5540,9 @@ VkResult lvp_execute_cmds(struct lvp_device *device,
 
    finish_fence(state);
 
+   /* The memory of the sets is released with the internal buffers */
    util_dynarray_foreach (&state->push_desc_sets, struct lvp_descriptor_set *, set)
-      lvp_descriptor_set_destroy(device, *set);
+      vk_object_base_finish(&(*set)->base);
 
    util_dynarray_fini(&state->push_desc_sets);
 
@@ -5431,6 +5557,278 @@ VkResult lvp_execute_cmds(struct lvp_device *device,
    return VK_SUCCESS;
 }
 
+/* Dynamic state setters whose handler only stores the command's own
+ * parameters.  Such a setter can be dropped when it repeats the value that
+ * was in effect for the last draw, or when another setter of the same type
+ * replaces it before anything draws.
+ */
+static const enum vk_cmd_type bake_setters[] = {
+   VK_CMD_SET_LINE_WIDTH,
+   VK_CMD_SET_DEPTH_BIAS,
+   VK_CMD_SET_BLEND_CONSTANTS,
+   VK_CMD_SET_DEPTH_BOUNDS,
+   VK_CMD_SET_CULL_MODE,
+   VK_CMD_SET_FRONT_FACE,
+   VK_CMD_SET_PRIMITIVE_TOPOLOGY,
+   VK_CMD_SET_DEPTH_TEST_ENABLE,
+   VK_CMD_SET_DEPTH_WRITE_ENABLE,
+   VK_CMD_SET_DEPTH_COMPARE_OP,
+   VK_CMD_SET_DEPTH_BOUNDS_TEST_ENABLE,
+   VK_CMD_SET_STENCIL_TEST_ENABLE,
+   VK_CMD_SET_DEPTH_BIAS_ENABLE,
+   VK_CMD_SET_LOGIC_OP_EXT,
+   VK_CMD_SET_PATCH_CONTROL_POINTS_EXT,
+   VK_CMD_SET_PRIMITIVE_RESTART_ENABLE,
+   VK_CMD_SET_RASTERIZER_DISCARD_ENABLE,
+   VK_CMD_SET_POLYGON_MODE_EXT,
+   VK_CMD_SET_TESSELLATION_DOMAIN_ORIGIN_EXT,
+   VK_CMD_SET_DEPTH_CLAMP_ENABLE_EXT,
+   VK_CMD_SET_DEPTH_CLIP_ENABLE_EXT,
+   VK_CMD_SET_LOGIC_OP_ENABLE_EXT,
+   VK_CMD_SET_ALPHA_TO_COVERAGE_ENABLE_EXT,
+   VK_CMD_SET_LINE_RASTERIZATION_MODE_EXT,
+   VK_CMD_SET_LINE_STIPPLE_ENABLE_EXT,
+   VK_CMD_SET_PROVOKING_VERTEX_MODE_EXT,
+};
+
+static int
+bake_setter_slot(uint32_t type)
+{
+   for (unsigned i = 0; i < ARRAY_SIZE(bake_setters); i++) {
+      if (bake_setters[i] == type)
+         return i;
+   }
+   return -1;
+}
+
+static bool
+bake_is_draw(uint32_t type)
+{
+   switch (type) {
+   case VK_CMD_DRAW:
+   case VK_CMD_DRAW_MULTI_EXT:
+   case VK_CMD_DRAW_INDEXED:
+   case VK_CMD_DRAW_INDIRECT:
+   case VK_CMD_DRAW_INDEXED_INDIRECT:
+   case VK_CMD_DRAW_MULTI_INDEXED_EXT:
+   case VK_CMD_DRAW_INDIRECT_COUNT:
+   case VK_CMD_DRAW_INDEXED_INDIRECT_COUNT:
+   case VK_CMD_DRAW_INDIRECT_BYTE_COUNT_EXT:
+   case VK_CMD_DRAW_MESH_TASKS_EXT:
+   case VK_CMD_DRAW_MESH_TASKS_INDIRECT_EXT:
+   case VK_CMD_DRAW_MESH_TASKS_INDIRECT_COUNT_EXT:
+      return true;
+   default:
+      return false;
+   }
+}
+
+/* commands that don't touch any of the state written by bake_setters */
+static bool
+bake_keeps_setters(uint32_t type)
+{
+   switch (type) {
+   case VK_CMD_PUSH_CONSTANTS2:
+   case VK_CMD_BIND_DESCRIPTOR_SETS2:
+   case VK_CMD_BIND_INDEX_BUFFER:
+   case VK_CMD_BIND_INDEX_BUFFER2:
+   case VK_CMD_BIND_VERTEX_BUFFERS2:
+      return true;
+   default:
+      return false;
+   }
+}
+
+static bool
+bake_is_noop(uint32_t type)
+{
+   switch (type) {
+   case VK_CMD_SET_ATTACHMENT_FEEDBACK_LOOP_ENABLE_EXT:
+   case VK_CMD_BUILD_ACCELERATION_STRUCTURES_INDIRECT_KHR:
+   case VK_CMD_SET_RAY_TRACING_PIPELINE_STACK_SIZE_KHR:
+      return true;
+   default:
+      return false;
+   }
+}
+
+static bool
+bake_setters_equal(const struct vk_cmd_queue_entry *a,
+                   const struct vk_cmd_queue_entry *b)
+{
+   /* entries are zero-allocated, so padding compares equal too */
+   size_t size = vk_cmd_queue_type_sizes[a->type] - sizeof(struct vk_cmd_queue_entry_base);
+   return !memcmp(&a->u, &b->u, size);
+}
+
+static void
+bake_push_constants(struct lvp_cmd_buffer *cmd_buffer, struct lvp_cmd_bake *bake)
+{
+   struct lvp_device *device = cmd_buffer->device;
+   uint32_t num_blocks = 0;
+   uint32_t stride = 0;
+
+   /* Push constants written by anything other than VK_CMD_PUSH_CONSTANTS2
+    * (secondaries, generated commands, meta state restores) aren't known
+    * here, so only the blocks before the first of those can be packed.
+    */
+   uint32_t end = bake->cmd_count;
+   for (uint32_t i = 0; i < bake->cmd_count; i++) {
+      uint32_t type = bake->cmds[i].cmd->type;
+      bake->cmds[i].push_constant_offset = UINT32_MAX;
+
+      if (type == VK_CMD_EXECUTE_COMMANDS ||
+          type == VK_CMD_EXECUTE_GENERATED_COMMANDS_EXT ||
+          type == LVP_CMD_RESTORE_STATE) {
+         end = i;
+         break;
+      }
+
+      if (type == VK_CMD_PUSH_CONSTANTS2) {
+         VkPushConstantsInfoKHR *pci = bake->cmds[i].cmd->u.push_constants2.push_constants_info;
+         stride = MAX2(stride, pci->offset + pci->size);
+         num_blocks++;
+      }
+   }
+   for (uint32_t i = end; i < bake->cmd_count; i++)
+      bake->cmds[i].push_constant_offset = UINT32_MAX;
+
+   if (!num_blocks)
+      return;
+
+   stride = align(stride, 16);
+   uint8_t *data = malloc((size_t)num_blocks * stride);
+   if (!data)
+      return;
+
+   /* rendering_state starts every command buffer with zeroed push constants */
+   uint8_t block[MAX_PUSH_CONSTANTS_SIZE] = {0};
+   uint32_t offset = 0;
+   for (uint32_t i = 0; i < end; i++) {
+      if (bake->cmds[i].cmd->type != VK_CMD_PUSH_CONSTANTS2)
+         continue;
+
+      VkPushConstantsInfoKHR *pci = bake->cmds[i].cmd->u.push_constants2.push_constants_info;
+      memcpy(block + pci->offset, pci->pValues, pci->size);
+      memcpy(data + offset, block, stride);
+      bake->cmds[i].push_constant_offset = offset;
+      offset += stride;
+   }
+
+   simple_mtx_lock(&device->queue.lock);
+   bake->push_constants =
+      pipe_buffer_create_with_data(device->queue.ctx, PIPE_BIND_CONSTANT_BUFFER,
+                                   PIPE_USAGE_IMMUTABLE, offset, data);
+   simple_mtx_unlock(&device->queue.lock);
+   free(data);
+
+   if (bake->push_constants) {
+      bake->push_constant_stride = stride;
+   } else {
+      for (uint32_t i = 0; i < end; i++)
+         bake->cmds[i].push_constant_offset = UINT32_MAX;
+   }
+}
+
+/* Flattens the command list of a reusable command buffer into an array,
+ * dropping commands that can't have any effect, and packs all of its push
+ * constant blocks into a single buffer so that executing it doesn't have to
+ * upload them again on every submit.
+ */
+void
+lvp_cmd_buffer_bake(struct lvp_cmd_buffer *cmd_buffer)
+{
+   struct lvp_device *device = cmd_buffer->device;
+   struct list_head *cmds = &cmd_buffer->vk.cmd_queue.cmds;
+
+   lvp_cmd_buffer_bake_free(cmd_buffer);
+
+   /* keep every command visible to LVP_CMD_PRINT */
+   if (device->print_cmds || list_is_empty(cmds))
+      return;
+
+   uint32_t count = list_length(cmds);
+   struct lvp_cmd_bake *bake = calloc(1, sizeof(*bake));
+   if (!bake)
+      return;
+   bake->cmds = malloc(count * sizeof(*bake->cmds));
+   if (!bake->cmds) {
+      free(bake);
+      return;
+   }
+
+   /* applied: the setter in effect for the last draw
+    * pending: index of the setter recorded since the last draw, or -1
+    */
+   const struct vk_cmd_queue_entry *applied[ARRAY_SIZE(bake_setters)] = {0};
+   int pending[ARRAY_SIZE(bake_setters)];
+   uint32_t pending_mask = 0;
+   uint32_t n = 0;
+
+   STATIC_ASSERT(ARRAY_SIZE(bake_setters) <= 32);
+   memset(pending, -1, sizeof(pending));
+
+   list_for_each_entry(struct vk_cmd_queue_entry, cmd, cmds, cmd_link) {
+      uint32_t type = cmd->type;
+      int slot = type < VK_CMD_TYPE_COUNT ? bake_setter_slot(type) : -1;
+
+      if (type < VK_CMD_TYPE_COUNT && bake_is_noop(type))
+         continue;
+
+      if (slot >= 0) {
+         if (pending[slot] >= 0)
+            bake->cmds[pending[slot]].cmd = NULL;
+
+         if (applied[slot] && bake_setters_equal(applied[slot], cmd)) {
+            pending[slot] = -1;
+            pending_mask &= ~BITFIELD_BIT(slot);
+            continue;
+         }
+
+         pending[slot] = n;
+         pending_mask |= BITFIELD_BIT(slot);
+      } else if (type < VK_CMD_TYPE_COUNT && bake_is_draw(type)) {
+         u_foreach_bit(i, pending_mask) {
+            applied[i] = bake->cmds[pending[i]].cmd;
+            pending[i] = -1;
+         }
+         pending_mask = 0;
+      } else if (type >= VK_CMD_TYPE_COUNT || !bake_keeps_setters(type)) {
+         /* the pending setters stay, but nothing is known to be in effect */
+         memset(applied, 0, sizeof(applied));
+         memset(pending, -1, sizeof(pending));
+         pending_mask = 0;
+      }
+
+      bake->cmds[n++].cmd = cmd;
+   }
+
+   uint32_t kept = 0;
+   for (uint32_t i = 0; i < n; i++) {
+      if (bake->cmds[i].cmd)
+         bake->cmds[kept++] = bake->cmds[i];
+   }
+   bake->cmd_count = kept;
+
+   bake_push_constants(cmd_buffer, bake);
+
+   cmd_buffer->bake = bake;
+}
+
+void
+lvp_cmd_buffer_bake_free(struct lvp_cmd_buffer *cmd_buffer)
+{
+   struct lvp_cmd_bake *bake = cmd_buffer->bake;
+
+   if (!bake)
+      return;
+
+   pipe_resource_reference(&bake->push_constants, NULL);
+   free(bake->cmds);
+   free(bake);
+   cmd_buffer->bake = NULL;
+}
+
 size_t
 lvp_get_rendering_state_size(void)
 {
@@ -45,49 +45,79 @@
 typedef void (*cso_destroy_func)(struct pipe_context*, void*);
 
 static void
-shader_destroy(struct lvp_device *device, struct lvp_shader *shader, bool locked)
+delete_shader_cso(struct pipe_context *ctx, mesa_shader_stage stage, void *cso)
+{
+   cso_destroy_func destroy[] = {
+      ctx->delete_vs_state,
+      ctx->delete_tcs_state,
+      ctx->delete_tes_state,
+      ctx->delete_gs_state,
+      ctx->delete_fs_state,
+      ctx->delete_compute_state,
+      ctx->delete_ts_state,
+      ctx->delete_ms_state,
+   };
+
+   destroy[stage](ctx, cso);
+}
+
+static void
+delete_queue_shader_cso(struct lvp_queue *queue, mesa_shader_stage stage, void *cso)
+{
+   struct hash_entry *entry = _mesa_hash_table_search(queue->shader_csos, cso);
+   if (entry) {
+      delete_shader_cso(queue->ctx, stage, entry->data);
+      _mesa_hash_table_remove(queue->shader_csos, entry);
+   }
+}
+
+static void
+shader_destroy(struct lvp_device *device, struct lvp_shader *shader)
 {
    if (!shader->pipeline_nir)
       return;
    mesa_shader_stage stage = shader->pipeline_nir->nir->info.stage;
-   cso_destroy_func destroy[] = {
-      device->queue.ctx->delete_vs_state,
-      device->queue.ctx->delete_tcs_state,
-      device->queue.ctx->delete_tes_state,
-      device->queue.ctx->delete_gs_state,
-      device->queue.ctx->delete_fs_state,
-      device->queue.ctx->delete_compute_state,
-      device->queue.ctx->delete_ts_state,
-      device->queue.ctx->delete_ms_state,
-   };
 
-   if (!locked)
-      simple_mtx_lock(&device->queue.lock);
+   /* The translations are keyed by the device queue's CSOs, drop them before
+    * those can be reused.
+    */
+   for (unsigned i = 0; i < device->num_extra_queues; i++) {
+      struct lvp_queue *queue = device->extra_queues[i];
+
+      simple_mtx_lock(&queue->lock);
+      if (shader->shader_cso)
+         delete_queue_shader_cso(queue, stage, shader->shader_cso);
+      if (shader->tess_ccw_cso)
+         delete_queue_shader_cso(queue, stage, shader->tess_ccw_cso);
+      simple_mtx_unlock(&queue->lock);
+   }
+
+   simple_mtx_lock(&device->queue.lock);
 
    if (shader->shader_cso)
-      destroy[stage](device->queue.ctx, shader->shader_cso);
+      delete_shader_cso(device->queue.ctx, stage, shader->shader_cso);
    if (shader->tess_ccw_cso)
-      destroy[stage](device->queue.ctx, shader->tess_ccw_cso);
+      delete_shader_cso(device->queue.ctx, stage, shader->tess_ccw_cso);
 
-   if (!locked)
-      simple_mtx_unlock(&device->queue.lock);
+   simple_mtx_unlock(&device->queue.lock);
 
    lvp_pipeline_nir_ref(&shader->pipeline_nir, NULL);
    lvp_pipeline_nir_ref(&shader->tess_ccw, NULL);
+   lvp_shader_cache_object_unref(device, &shader->cache_object);
 }
 
 void
-lvp_pipeline_destroy(struct lvp_device *device, struct lvp_pipeline *pipeline, bool locked)
+lvp_pipeline_destroy(struct lvp_device *device, struct lvp_pipeline *pipeline)
 {
    lvp_forall_stage(i)
-      shader_destroy(device, &pipeline->shaders[i], locked);
+      shader_destroy(device, &pipeline->shaders[i]);
 
    if (pipeline->layout)
       vk_pipeline_layout_unref(&device->vk, &pipeline->layout->vk);
 
    for (unsigned i = 0; i < pipeline->num_groups; i++) {
       LVP_FROM_HANDLE(lvp_pipeline, p, pipeline->groups[i]);
-      lvp_pipeline_destroy(device, p, locked);
+      lvp_pipeline_destroy(device, p);
    }
 
    if (pipeline->rt.stages) {
@@ -119,7 +149,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyPipeline(
       util_dynarray_append(&device->queue.pipeline_destroys, struct lvp_pipeline*, pipeline);
       simple_mtx_unlock(&device->queue.lock);
    } else {
-      lvp_pipeline_destroy(device, pipeline, false);
+      lvp_pipeline_destroy(device, pipeline);
    }
 }
 
@@ -472,20 +502,140 @@ lvp_shader_init(struct lvp_shader *shader, nir_shader *nir)
    shader->pipeline_nir = lvp_create_pipeline_nir(nir);
 }
 
+static void
+lvp_hash_pipeline_layout(struct mesa_sha1 *ctx,
+                         const struct lvp_pipeline_layout *layout)
+{
+   if (!layout)
+      return;
+
+   _mesa_sha1_update(ctx, &layout->vk.set_count, sizeof(layout->vk.set_count));
+   for (unsigned s = 0; s < layout->vk.set_count; s++) {
+      if (!layout->vk.set_layouts[s]) {
+         const uint32_t null_set = UINT32_MAX;
+         _mesa_sha1_update(ctx, &null_set, sizeof(null_set));
+         continue;
+      }
+
+      const struct lvp_descriptor_set_layout *set_layout =
+         vk_to_lvp_descriptor_set_layout(layout->vk.set_layouts[s]);
+      _mesa_sha1_update(ctx, &set_layout->binding_count,
+                        sizeof(set_layout->binding_count));
+
+      for (unsigned b = 0; b < set_layout->binding_count; b++) {
+         const struct lvp_descriptor_set_binding_layout *binding =
+            &set_layout->binding[b];
+
+         /* like layouts_equal(), the samplers are compared by value */
+         _mesa_sha1_update(ctx, binding,
+                           offsetof(struct lvp_descriptor_set_binding_layout,
+                                    immutable_samplers));
+         if (!binding->immutable_samplers)
+            continue;
+
+         for (unsigned i = 0; i < binding->array_size; i++) {
+            const struct vk_ycbcr_conversion *conversion =
+               binding->immutable_samplers[i]->vk.ycbcr_conversion;
+            if (conversion)
+               _mesa_sha1_update(ctx, &conversion->state,
+                                 sizeof(conversion->state));
+         }
+      }
+   }
+}
+
+/* Everything lvp_spirv_to_nir() output depends on. */
+static void
+lvp_hash_shader_stage(struct lvp_pipeline *pipeline, const void *pipeline_pNext,
+                      const VkPipelineShaderStageCreateInfo *sinfo,
+                      unsigned char key[SHA1_DIGEST_LENGTH])
+{
+   struct vk_pipeline_robustness_state robustness;
+   vk_pipeline_robustness_state_fill(&pipeline->device->vk, &robustness,
+                                     pipeline_pNext, sinfo->pNext);
+
+   unsigned char stage_sha1[SHA1_DIGEST_LENGTH];
+   vk_pipeline_hash_shader_stage(pipeline->flags, sinfo, &robustness, stage_sha1);
+
+   struct mesa_sha1 ctx;
+   _mesa_sha1_init(&ctx);
+   _mesa_sha1_update(&ctx, stage_sha1, sizeof(stage_sha1));
+   lvp_hash_pipeline_layout(&ctx, pipeline->layout);
+   _mesa_sha1_final(&ctx, key);
+}
+
 static VkResult
-lvp_shader_compile_to_ir(struct lvp_pipeline *pipeline, const void *pipeline_pNext,
-                         const VkPipelineShaderStageCreateInfo *sinfo)
+lvp_shader_compile_to_ir(struct lvp_pipeline *pipeline,
+                         struct vk_pipeline_cache *cache,
+                         const void *pipeline_pNext,
+                         const VkPipelineShaderStageCreateInfo *sinfo,
+                         bool *cache_hit)
 {
+   struct lvp_device *device = pipeline->device;
    mesa_shader_stage stage = vk_to_mesa_shader_stage(sinfo->stage);
    assert(stage <= LVP_SHADER_STAGES && stage != MESA_SHADER_NONE);
-   nir_shader *nir;
-   VkResult result = lvp_spirv_to_nir(pipeline, pipeline_pNext, sinfo, &nir);
-   if (result == VK_SUCCESS) {
-      struct lvp_shader *shader = &pipeline->shaders[stage];
-      lvp_shader_init(shader, nir);
-      shader->push_constant_size = pipeline->layout->push_constant_size;
+   struct lvp_shader *shader = &pipeline->shaders[stage];
+   unsigned char key[SHA1_DIGEST_LENGTH];
+   nir_shader *nir = NULL;
+
+   *cache_hit = false;
+
+   /* Execution graph shaders are lowered against the whole graph, and debug
+    * info doesn't survive serialization.
+    */
+   if (pipeline->type == LVP_PIPELINE_EXEC_GRAPH ||
+       (gallivm_debug & GALLIVM_DEBUG_SYMBOLS))
+      cache = NULL;
+#ifdef VK_ENABLE_BETA_EXTENSIONS
+   if (vk_find_struct_const(sinfo->pNext, PIPELINE_SHADER_STAGE_NODE_CREATE_INFO_AMDX))
+      cache = NULL;
+#endif
+
+   if (cache) {
+      lvp_hash_shader_stage(pipeline, pipeline_pNext, sinfo, key);
+
+      /* Only hits in the application's VkPipelineCache are reported in the
+       * creation feedback, not those in the device's implicit cache.
+       */
+      struct vk_pipeline_cache_object *object =
+         vk_pipeline_cache_lookup_object(cache, key, sizeof(key),
+                                         &lvp_shader_cache_object_ops,
+                                         cache != device->vk.mem_cache ?
+                                         cache_hit : NULL);
+      if (object) {
+         shader->cache_object =
+            container_of(object, struct lvp_shader_cache_object, base);
+
+         struct blob_reader blob;
+         blob_reader_init(&blob, shader->cache_object->nir.data,
+                          shader->cache_object->nir.size);
+         nir = nir_deserialize(NULL, device->physical_device->drv_options[stage],
+                               &blob);
+         if (!nir) {
+            lvp_shader_cache_object_unref(device, &shader->cache_object);
+            *cache_hit = false;
+         }
+      }
    }
-   return result;
+
+   if (!nir) {
+      VkResult result = lvp_spirv_to_nir(pipeline, pipeline_pNext, sinfo, &nir);
+      if (result != VK_SUCCESS)
+         return result;
+
+      struct lvp_shader_cache_object *object =
+         cache ? lvp_shader_cache_object_create(device, key, nir) : NULL;
+      if (object) {
+         struct vk_pipeline_cache_object *cached =
+            vk_pipeline_cache_add_object(cache, &object->base);
+         shader->cache_object =
+            container_of(cached, struct lvp_shader_cache_object, base);
+      }
+   }
+
+   lvp_shader_init(shader, nir);
+   shader->push_constant_size = pipeline->layout->push_constant_size;
+   return VK_SUCCESS;
 }
 
 static void
@@ -574,14 +724,14 @@ lvp_pipeline_xfb_init(struct lvp_pipeline *pipeline)
 }
 
 static void *
-lvp_shader_compile_stage(struct lvp_device *device, struct lvp_shader *shader, nir_shader *nir)
+lvp_shader_compile_stage(struct pipe_context *ctx, struct lvp_shader *shader, nir_shader *nir)
 {
    if (nir->info.stage == MESA_SHADER_COMPUTE) {
       struct pipe_compute_state shstate = {0};
       shstate.prog = nir;
       shstate.ir_type = PIPE_SHADER_IR_NIR;
       shstate.static_shared_mem = nir->info.shared_size;
-      return device->queue.ctx->create_compute_state(device->queue.ctx, &shstate);
+      return ctx->create_compute_state(ctx, &shstate);
    } else {
       struct pipe_shader_state shstate = {0};
       shstate.type = PIPE_SHADER_IR_NIR;
@@ -590,19 +740,19 @@ lvp_shader_compile_stage(struct lvp_device *device, struct lvp_shader *shader, n
 
       switch (nir->info.stage) {
       case MESA_SHADER_FRAGMENT:
-         return device->queue.ctx->create_fs_state(device->queue.ctx, &shstate);
+         return ctx->create_fs_state(ctx, &shstate);
       case MESA_SHADER_VERTEX:
-         return device->queue.ctx->create_vs_state(device->queue.ctx, &shstate);
+         return ctx->create_vs_state(ctx, &shstate);
       case MESA_SHADER_GEOMETRY:
-         return device->queue.ctx->create_gs_state(device->queue.ctx, &shstate);
+         return ctx->create_gs_state(ctx, &shstate);
       case MESA_SHADER_TESS_CTRL:
-         return device->queue.ctx->create_tcs_state(device->queue.ctx, &shstate);
+         return ctx->create_tcs_state(ctx, &shstate);
       case MESA_SHADER_TESS_EVAL:
-         return device->queue.ctx->create_tes_state(device->queue.ctx, &shstate);
+         return ctx->create_tes_state(ctx, &shstate);
       case MESA_SHADER_TASK:
-         return device->queue.ctx->create_ts_state(device->queue.ctx, &shstate);
+         return ctx->create_ts_state(ctx, &shstate);
       case MESA_SHADER_MESH:
-         return device->queue.ctx->create_ms_state(device->queue.ctx, &shstate);
+         return ctx->create_ms_state(ctx, &shstate);
       default:
          UNREACHABLE("illegal shader");
          break;
@@ -611,6 +761,22 @@ lvp_shader_compile_stage(struct lvp_device *device, struct lvp_shader *shader, n
    return NULL;
 }
 
+static void *
+lvp_shader_compile_for_context(struct pipe_context *ctx, struct lvp_shader *shader,
+                               nir_shader *nir)
+{
+   mesa_shader_stage stage = nir->info.stage;
+
+   void *state = lvp_shader_compile_stage(ctx, shader, nir);
+
+   /* Keep the code of the variants in the pipeline cache entry. */
+   if (state && shader->cache_object)
+      llvmpipe_shader_set_code_cache(ctx, stage, state,
+                                     &shader->cache_object->code_cache);
+
+   return state;
+}
+
 void *
 lvp_shader_compile(struct lvp_device *device, struct lvp_shader *shader, nir_shader *nir, bool locked)
 {
@@ -619,7 +785,7 @@ lvp_shader_compile(struct lvp_device *device, struct lvp_shader *shader, nir_sha
    if (!locked)
       simple_mtx_lock(&device->queue.lock);
 
-   void *state = lvp_shader_compile_stage(device, shader, nir);
+   void *state = lvp_shader_compile_for_context(device->queue.ctx, shader, nir);
 
    if (!locked)
       simple_mtx_unlock(&device->queue.lock);
@@ -627,6 +793,33 @@ lvp_shader_compile(struct lvp_device *device, struct lvp_shader *shader, nir_sha
    return state;
 }
 
+/* Returns the CSO to bind for the shader on the queue, which is the one
+ * created by lvp_shader_compile() on the device queue, or its translation
+ * created on first use on the other queues.  Called with the queue locked.
+ */
+void *
+lvp_queue_shader_cso(struct lvp_queue *queue, struct lvp_shader *shader, bool tess_ccw)
+{
+   void *cso = tess_ccw ? shader->tess_ccw_cso : shader->shader_cso;
+   if (!cso || !queue->shader_csos)
+      return cso;
+
+   struct hash_entry *entry = _mesa_hash_table_search(queue->shader_csos, cso);
+   if (entry)
+      return entry->data;
+
+   struct lvp_device *device = queue->device;
+   struct lvp_pipeline_nir *pipeline_nir = tess_ccw ? shader->tess_ccw : shader->pipeline_nir;
+   nir_shader *nir = nir_shader_clone(NULL, pipeline_nir->nir);
+   device->pscreen->finalize_nir(device->pscreen, nir);
+
+   void *state = lvp_shader_compile_for_context(queue->ctx, shader, nir);
+   if (state)
+      _mesa_hash_table_insert(queue->shader_csos, cso, state);
+
+   return state;
+}
+
 #ifndef NDEBUG
 static bool
 layouts_equal(const struct lvp_descriptor_set_layout *a, const struct lvp_descriptor_set_layout *b)
@@ -737,6 +930,8 @@ copy_shader_sanitized(struct lvp_shader *dst, const struct lvp_shader *src)
    *dst = *src;
    dst->pipeline_nir = NULL; //this gets handled later
    dst->tess_ccw = NULL; //this gets handled later
+   if (src->cache_object)
+      vk_pipeline_cache_object_ref(&src->cache_object->base);
    assert(!dst->shader_cso);
    assert(!dst->tess_ccw_cso);
 }
@@ -744,9 +939,10 @@ copy_shader_sanitized(struct lvp_shader *dst, const struct lvp_shader *src)
 static VkResult
 lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
                            struct lvp_device *device,
-                           struct lvp_pipeline_cache *cache,
+                           struct vk_pipeline_cache *cache,
                            const VkGraphicsPipelineCreateInfo *pCreateInfo,
-                           VkPipelineCreateFlagBits2KHR flags)
+                           VkPipelineCreateFlagBits2KHR flags,
+                           uint32_t *cache_hits)
 {
    pipeline->type = LVP_PIPELINE_GRAPHICS;
    pipeline->flags = flags;
@@ -842,9 +1038,13 @@ lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
          if (!(pipeline->stages & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT))
             continue;
       }
-      result = lvp_shader_compile_to_ir(pipeline, pCreateInfo->pNext, sinfo);
+      bool cache_hit;
+      result = lvp_shader_compile_to_ir(pipeline, cache, pCreateInfo->pNext,
+                                        sinfo, &cache_hit);
       if (result != VK_SUCCESS)
          goto fail;
+      if (cache_hit)
+         *cache_hits |= BITFIELD_BIT(i);
 
       switch (stage) {
       case MESA_SHADER_FRAGMENT:
@@ -904,6 +1104,7 @@ lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
 fail:
    for (unsigned i = 0; i < ARRAY_SIZE(pipeline->shaders); i++) {
       lvp_pipeline_nir_ref(&pipeline->shaders[i].pipeline_nir, NULL);
+      lvp_shader_cache_object_unref(device, &pipeline->shaders[i].cache_object);
    }
    vk_free(&device->vk.alloc, pipeline->state_data);
 
@@ -913,22 +1114,62 @@ fail:
 void
 lvp_pipeline_shaders_compile(struct lvp_pipeline *pipeline, bool locked)
 {
-   if (pipeline->compiled)
+   /* Pairs with the release below, so the compiled shaders are visible. */
+   if (p_atomic_read(&pipeline->compiled))
       return;
-   for (uint32_t i = 0; i < ARRAY_SIZE(pipeline->shaders); i++) {
-      if (!pipeline->shaders[i].pipeline_nir)
-         continue;
 
-      mesa_shader_stage stage = i;
-      assert(stage == pipeline->shaders[i].pipeline_nir->nir->info.stage);
+   /* Pipelines linked at bind time may be bound on several queues at once. */
+   if (!locked)
+      simple_mtx_lock(&pipeline->device->queue.lock);
 
-      pipeline->shaders[stage].shader_cso = lvp_shader_compile(pipeline->device, &pipeline->shaders[stage],
-         nir_shader_clone(NULL, pipeline->shaders[stage].pipeline_nir->nir), locked);
-      if (pipeline->shaders[MESA_SHADER_TESS_EVAL].tess_ccw)
-         pipeline->shaders[MESA_SHADER_TESS_EVAL].tess_ccw_cso = lvp_shader_compile(pipeline->device, &pipeline->shaders[stage],
-            nir_shader_clone(NULL, pipeline->shaders[MESA_SHADER_TESS_EVAL].tess_ccw->nir), locked);
+   if (!pipeline->compiled) {
+      for (uint32_t i = 0; i < ARRAY_SIZE(pipeline->shaders); i++) {
+         if (!pipeline->shaders[i].pipeline_nir)
+            continue;
+
+         mesa_shader_stage stage = i;
+         assert(stage == pipeline->shaders[i].pipeline_nir->nir->info.stage);
+
+         pipeline->shaders[stage].shader_cso = lvp_shader_compile(pipeline->device, &pipeline->shaders[stage],
+            nir_shader_clone(NULL, pipeline->shaders[stage].pipeline_nir->nir), true);
+         if (pipeline->shaders[MESA_SHADER_TESS_EVAL].tess_ccw)
+            pipeline->shaders[MESA_SHADER_TESS_EVAL].tess_ccw_cso = lvp_shader_compile(pipeline->device, &pipeline->shaders[stage],
+               nir_shader_clone(NULL, pipeline->shaders[MESA_SHADER_TESS_EVAL].tess_ccw->nir), true);
+      }
+      p_atomic_set(&pipeline->compiled, true);
+   }
+
+   if (!locked)
+      simple_mtx_unlock(&pipeline->device->queue.lock);
+}
+
+/* cache_hits has a bit set for each of the stages found in the application's
+ * VkPipelineCache.
+ */
+static void
+lvp_pipeline_creation_feedback(const void *pNext, uint64_t t0,
+                               uint32_t stage_count, uint32_t cache_hits)
+{
+   const VkPipelineCreationFeedbackCreateInfo *feedback =
+      vk_find_struct_const(pNext, PIPELINE_CREATION_FEEDBACK_CREATE_INFO);
+   if (!feedback)
+      return;
+
+   feedback->pPipelineCreationFeedback->duration = os_time_get_nano() - t0;
+   feedback->pPipelineCreationFeedback->flags = VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT;
+   if (stage_count && cache_hits == BITFIELD_MASK(stage_count)) {
+      feedback->pPipelineCreationFeedback->flags |=
+         VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT;
+   }
+
+   memset(feedback->pPipelineStageCreationFeedbacks, 0, sizeof(VkPipelineCreationFeedback) * feedback->pipelineStageCreationFeedbackCount);
+   for (uint32_t i = 0; i < MIN2(stage_count, feedback->pipelineStageCreationFeedbackCount); i++) {
+      if (cache_hits & BITFIELD_BIT(i)) {
+         feedback->pPipelineStageCreationFeedbacks[i].flags =
+            VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT |
+            VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT;
+      }
    }
-   pipeline->compiled = true;
 }
 
 static VkResult
@@ -941,12 +1182,15 @@ lvp_graphics_pipeline_create(
    bool group)
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
-   LVP_FROM_HANDLE(lvp_pipeline_cache, cache, _cache);
+   VK_FROM_HANDLE(vk_pipeline_cache, cache, _cache);
    struct lvp_pipeline *pipeline;
    VkResult result;
 
    assert(pCreateInfo->sType == VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO);
 
+   if (!cache)
+      cache = device->vk.mem_cache;
+
    pipeline = vk_zalloc(&device->vk.alloc, sizeof(*pipeline), 8,
                          VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
    if (pipeline == NULL)
@@ -955,17 +1199,16 @@ lvp_graphics_pipeline_create(
    vk_object_base_init(&device->vk, &pipeline->base,
                        VK_OBJECT_TYPE_PIPELINE);
    uint64_t t0 = os_time_get_nano();
-   result = lvp_graphics_pipeline_init(pipeline, device, cache, pCreateInfo, flags);
+   uint32_t cache_hits = 0;
+   result = lvp_graphics_pipeline_init(pipeline, device, cache, pCreateInfo, flags, &cache_hits);
    if (result != VK_SUCCESS) {
       vk_free(&device->vk.alloc, pipeline);
       return result;
    }
 
-   VkPipelineCreationFeedbackCreateInfo *feedback = (void*)vk_find_struct_const(pCreateInfo->pNext, PIPELINE_CREATION_FEEDBACK_CREATE_INFO);
-   if (feedback && !group) {
-      feedback->pPipelineCreationFeedback->duration = os_time_get_nano() - t0;
-      feedback->pPipelineCreationFeedback->flags = VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT;
-      memset(feedback->pPipelineStageCreationFeedbacks, 0, sizeof(VkPipelineCreationFeedback) * feedback->pipelineStageCreationFeedbackCount);
+   if (!group) {
+      lvp_pipeline_creation_feedback(pCreateInfo->pNext, t0, pCreateInfo->stageCount,
+                                     cache_hits);
    }
 
    *pPipeline = lvp_pipeline_to_handle(pipeline);
@@ -1013,9 +1256,10 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateGraphicsPipelines(
 static VkResult
 lvp_compute_pipeline_init(struct lvp_pipeline *pipeline,
                           struct lvp_device *device,
-                          struct lvp_pipeline_cache *cache,
+                          struct vk_pipeline_cache *cache,
                           const VkComputePipelineCreateInfo *pCreateInfo,
-                          VkPipelineCreateFlagBits2KHR flags)
+                          VkPipelineCreateFlagBits2KHR flags,
+                          bool *cache_hit)
 {
    pipeline->flags = flags;
    pipeline->device = device;
@@ -1025,7 +1269,8 @@ lvp_compute_pipeline_init(struct lvp_pipeline *pipeline,
 
    pipeline->type = LVP_PIPELINE_COMPUTE;
 
-   VkResult result = lvp_shader_compile_to_ir(pipeline, pCreateInfo->pNext, &pCreateInfo->stage);
+   VkResult result = lvp_shader_compile_to_ir(pipeline, cache, pCreateInfo->pNext,
+                                              &pCreateInfo->stage, cache_hit);
    if (result != VK_SUCCESS)
       return result;
 
@@ -1046,12 +1291,15 @@ lvp_compute_pipeline_create(
    VkPipeline *pPipeline)
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
-   LVP_FROM_HANDLE(lvp_pipeline_cache, cache, _cache);
+   VK_FROM_HANDLE(vk_pipeline_cache, cache, _cache);
    struct lvp_pipeline *pipeline;
    VkResult result;
 
    assert(pCreateInfo->sType == VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO);
 
+   if (!cache)
+      cache = device->vk.mem_cache;
+
    pipeline = vk_zalloc(&device->vk.alloc, sizeof(*pipeline), 8,
                          VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
    if (pipeline == NULL)
@@ -1060,18 +1308,14 @@ lvp_compute_pipeline_create(
    vk_object_base_init(&device->vk, &pipeline->base,
                        VK_OBJECT_TYPE_PIPELINE);
    uint64_t t0 = os_time_get_nano();
-   result = lvp_compute_pipeline_init(pipeline, device, cache, pCreateInfo, flags);
+   bool cache_hit = false;
+   result = lvp_compute_pipeline_init(pipeline, device, cache, pCreateInfo, flags, &cache_hit);
    if (result != VK_SUCCESS) {
       vk_free(&device->vk.alloc, pipeline);
       return result;
    }
 
-   const VkPipelineCreationFeedbackCreateInfo *feedback = (void*)vk_find_struct_const(pCreateInfo->pNext, PIPELINE_CREATION_FEEDBACK_CREATE_INFO);
-   if (feedback) {
-      feedback->pPipelineCreationFeedback->duration = os_time_get_nano() - t0;
-      feedback->pPipelineCreationFeedback->flags = VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT;
-      memset(feedback->pPipelineStageCreationFeedbacks, 0, sizeof(VkPipelineCreationFeedback) * feedback->pipelineStageCreationFeedbackCount);
-   }
+   lvp_pipeline_creation_feedback(pCreateInfo->pNext, t0, 1, cache_hit);
 
    *pPipeline = lvp_pipeline_to_handle(pipeline);
 
@@ -1125,7 +1369,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyShaderEXT(
 
    if (!shader)
       return;
-   shader_destroy(device, shader, false);
+   shader_destroy(device, shader);
 
    vk_pipeline_layout_unref(&device->vk, &shader->layout->vk);
    blob_finish(&shader->blob);
@@ -1223,7 +1467,7 @@ create_shader_object(struct lvp_device *device, const VkShaderCreateInfoEXT *pCr
    } else if (stage == MESA_SHADER_FRAGMENT && nir->info.fs.uses_fbfetch_output) {
       /* this is (currently) illegal */
       assert(!nir->info.fs.uses_fbfetch_output);
-      shader_destroy(device, shader, false);
+      shader_destroy(device, shader);
 
       vk_object_base_finish(&shader->base);
       vk_free2(&device->vk.alloc, pAllocator, shader);
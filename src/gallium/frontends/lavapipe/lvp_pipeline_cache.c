@@ -23,80 +23,209 @@
 
 #include "lvp_private.h"
 
-VKAPI_ATTR VkResult VKAPI_CALL lvp_CreatePipelineCache(
-    VkDevice                                    _device,
-    const VkPipelineCacheCreateInfo*            pCreateInfo,
-    const VkAllocationCallbacks*                pAllocator,
-    VkPipelineCache*                            pPipelineCache)
+#include "nir_serialize.h"
+#include "util/blob.h"
+
+struct lvp_cached_variant {
+   unsigned char key[SHA1_DIGEST_LENGTH];
+   uint32_t size;
+   void *data;
+};
+
+static void *
+lvp_code_cache_find(struct lp_code_cache *code_cache,
+                    const unsigned char key[20], size_t *size)
 {
-   LVP_FROM_HANDLE(lvp_device, device, _device);
-   struct lvp_pipeline_cache *cache;
+   struct lvp_shader_cache_object *object =
+      container_of(code_cache, struct lvp_shader_cache_object, code_cache);
+   void *data = NULL;
 
-   assert(pCreateInfo->sType == VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO);
+   simple_mtx_lock(&object->lock);
+   util_dynarray_foreach(&object->variants, struct lvp_cached_variant, variant) {
+      if (!memcmp(variant->key, key, sizeof(variant->key))) {
+         data = malloc(variant->size);
+         if (data) {
+            memcpy(data, variant->data, variant->size);
+            *size = variant->size;
+         }
+         break;
+      }
+   }
+   simple_mtx_unlock(&object->lock);
 
-   cache = vk_alloc2(&device->vk.alloc, pAllocator,
-                       sizeof(*cache), 8,
-                       VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
-   if (cache == NULL)
-      return vk_error(device, VK_ERROR_OUT_OF_HOST_MEMORY);
+   return data;
+}
 
-   vk_object_base_init(&device->vk, &cache->base,
-                       VK_OBJECT_TYPE_PIPELINE_CACHE);
-   if (pAllocator)
-     cache->alloc = *pAllocator;
-   else
-     cache->alloc = device->vk.alloc;
+static bool
+add_variant(struct lvp_shader_cache_object *object,
+            const unsigned char key[20], const void *data, size_t size)
+{
+   util_dynarray_foreach(&object->variants, struct lvp_cached_variant, variant) {
+      if (!memcmp(variant->key, key, sizeof(variant->key)))
+         return false;
+   }
 
-   cache->device = device;
-   *pPipelineCache = lvp_pipeline_cache_to_handle(cache);
+   struct lvp_cached_variant variant = {
+      .size = size,
+      .data = malloc(size),
+   };
+   if (!variant.data)
+      return false;
 
-   return VK_SUCCESS;
+   memcpy(variant.key, key, sizeof(variant.key));
+   memcpy(variant.data, data, size);
+   util_dynarray_append(&object->variants, struct lvp_cached_variant, variant);
+   return true;
 }
 
-VKAPI_ATTR void VKAPI_CALL lvp_DestroyPipelineCache(
-    VkDevice                                    _device,
-    VkPipelineCache                             _cache,
-    const VkAllocationCallbacks*                pAllocator)
+static void
+lvp_code_cache_insert(struct lp_code_cache *code_cache,
+                      const unsigned char key[20], const void *data,
+                      size_t size)
 {
-   LVP_FROM_HANDLE(lvp_device, device, _device);
-   LVP_FROM_HANDLE(lvp_pipeline_cache, cache, _cache);
-
-   if (!_cache)
-      return;
-//   lvp_pipeline_cache_finish(cache);
-   vk_object_base_finish(&cache->base);
-   vk_free2(&device->vk.alloc, pAllocator, cache);
+   struct lvp_shader_cache_object *object =
+      container_of(code_cache, struct lvp_shader_cache_object, code_cache);
+
+   simple_mtx_lock(&object->lock);
+   /* The object grew, make vkGetPipelineCacheData() serialize it again
+    * rather than trust the size it recorded.
+    */
+   if (add_variant(object, key, data, size))
+      p_atomic_set(&object->base.data_size, 0);
+   simple_mtx_unlock(&object->lock);
 }
 
-VKAPI_ATTR VkResult VKAPI_CALL lvp_GetPipelineCacheData(
-        VkDevice                                    _device,
-        VkPipelineCache                             _cache,
-        size_t*                                     pDataSize,
-        void*                                       pData)
+static struct lvp_shader_cache_object *
+shader_cache_object_alloc(struct lvp_device *device,
+                          const unsigned char key[SHA1_DIGEST_LENGTH])
 {
-   VkResult result = VK_SUCCESS;
-   if (pData) {
-      if (*pDataSize < 32) {
-         *pDataSize = 0;
-         result = VK_INCOMPLETE;
-      } else {
-         uint32_t *hdr = (uint32_t *)pData;
-         hdr[0] = 32;
-         hdr[1] = 1;
-         hdr[2] = VK_VENDOR_ID_MESA;
-         hdr[3] = 0;
-         lvp_device_get_cache_uuid(&hdr[4]);
-      }
-   } else
-      *pDataSize = 32;
-   return result;
+   struct lvp_shader_cache_object *object =
+      vk_zalloc(&device->vk.alloc, sizeof(*object), 8,
+                VK_SYSTEM_ALLOCATION_SCOPE_DEVICE);
+   if (!object)
+      return NULL;
+
+   memcpy(object->key, key, sizeof(object->key));
+   vk_pipeline_cache_object_init(&device->vk, &object->base,
+                                 &lvp_shader_cache_object_ops,
+                                 object->key, sizeof(object->key));
+   object->code_cache.find = lvp_code_cache_find;
+   object->code_cache.insert = lvp_code_cache_insert;
+   blob_init(&object->nir);
+   simple_mtx_init(&object->lock, mtx_plain);
+   util_dynarray_init(&object->variants, NULL);
+
+   return object;
+}
+
+struct lvp_shader_cache_object *
+lvp_shader_cache_object_create(struct lvp_device *device,
+                               const unsigned char key[SHA1_DIGEST_LENGTH],
+                               const nir_shader *nir)
+{
+   struct lvp_shader_cache_object *object =
+      shader_cache_object_alloc(device, key);
+   if (!object)
+      return NULL;
+
+   nir_serialize(&object->nir, nir, true);
+   if (object->nir.out_of_memory) {
+      vk_pipeline_cache_object_unref(&device->vk, &object->base);
+      return NULL;
+   }
+
+   return object;
+}
+
+static bool
+lvp_shader_cache_object_serialize(struct vk_pipeline_cache_object *base,
+                                  struct blob *blob)
+{
+   struct lvp_shader_cache_object *object =
+      container_of(base, struct lvp_shader_cache_object, base);
+
+   blob_write_uint32(blob, object->nir.size);
+   blob_write_bytes(blob, object->nir.data, object->nir.size);
+
+   simple_mtx_lock(&object->lock);
+   blob_write_uint32(blob, util_dynarray_num_elements(&object->variants,
+                                                      struct lvp_cached_variant));
+   util_dynarray_foreach(&object->variants, struct lvp_cached_variant, variant) {
+      blob_write_bytes(blob, variant->key, sizeof(variant->key));
+      blob_write_uint32(blob, variant->size);
+      blob_write_bytes(blob, variant->data, variant->size);
+   }
+   simple_mtx_unlock(&object->lock);
+
+   return !blob->out_of_memory;
 }
 
-VKAPI_ATTR VkResult VKAPI_CALL lvp_MergePipelineCaches(
-        VkDevice                                    _device,
-        VkPipelineCache                             destCache,
-        uint32_t                                    srcCacheCount,
-        const VkPipelineCache*                      pSrcCaches)
+static struct vk_pipeline_cache_object *
+lvp_shader_cache_object_deserialize(struct vk_pipeline_cache *cache,
+                                    const void *key_data, size_t key_size,
+                                    struct blob_reader *blob)
 {
-   return VK_SUCCESS;
+   struct lvp_device *device =
+      container_of(cache->base.device, struct lvp_device, vk);
+
+   if (key_size != SHA1_DIGEST_LENGTH)
+      return NULL;
+
+   struct lvp_shader_cache_object *object =
+      shader_cache_object_alloc(device, key_data);
+   if (!object)
+      return NULL;
+
+   uint32_t nir_size = blob_read_uint32(blob);
+   const void *nir_data = blob_read_bytes(blob, nir_size);
+   if (blob->overrun)
+      goto fail;
+   blob_write_bytes(&object->nir, nir_data, nir_size);
+
+   uint32_t num_variants = blob_read_uint32(blob);
+   for (uint32_t i = 0; i < num_variants && !blob->overrun; i++) {
+      const unsigned char *key = blob_read_bytes(blob, SHA1_DIGEST_LENGTH);
+      uint32_t size = blob_read_uint32(blob);
+      const void *data = blob_read_bytes(blob, size);
+      if (blob->overrun)
+         break;
+      add_variant(object, key, data, size);
+   }
+
+   if (blob->overrun || object->nir.out_of_memory)
+      goto fail;
+
+   return &object->base;
+
+fail:
+   vk_pipeline_cache_object_unref(&device->vk, &object->base);
+   return NULL;
+}
+
+static void
+lvp_shader_cache_object_destroy(struct vk_device *device,
+                                struct vk_pipeline_cache_object *base)
+{
+   struct lvp_shader_cache_object *object =
+      container_of(base, struct lvp_shader_cache_object, base);
+
+   util_dynarray_foreach(&object->variants, struct lvp_cached_variant, variant)
+      free(variant->data);
+   util_dynarray_fini(&object->variants);
+   simple_mtx_destroy(&object->lock);
+   blob_finish(&object->nir);
+
+   vk_pipeline_cache_object_finish(&object->base);
+   vk_free(&device->alloc, object);
 }
+
+const struct vk_pipeline_cache_object_ops lvp_shader_cache_object_ops = {
+   .serialize = lvp_shader_cache_object_serialize,
+   .deserialize = lvp_shader_cache_object_deserialize,
+   .destroy = lvp_shader_cache_object_destroy,
+};
+
+const struct vk_pipeline_cache_object_ops *const lvp_pipeline_cache_import_ops[] = {
+   &lvp_shader_cache_object_ops,
+   NULL,
+};
@@ -34,6 +34,8 @@
 #include "util/macros.h"
 #include "util/list.h"
 #include "util/u_dynarray.h"
+#include "util/mesa-sha1.h"
+#include "util/rwlock.h"
 #include "util/simple_mtx.h"
 #include "util/u_queue.h"
 #include "util/u_upload_mgr.h"
@@ -79,14 +81,17 @@ typedef uint32_t xcb_window_t;
 #include "vk_command_pool.h"
 #include "vk_descriptor_set_layout.h"
 #include "vk_graphics_state.h"
+#include "vk_pipeline_cache.h"
 #include "vk_pipeline_layout.h"
 #include "vk_queue.h"
 #include "vk_sampler.h"
 #include "vk_sync.h"
+#include "vk_sync_cpu_timeline.h"
 #include "vk_sync_timeline.h"
 #include "vk_ycbcr_conversion.h"
 #include "vk_meta.h"
 #include "lp_jit.h"
+#include "lp_public.h"
 
 #include "wsi_common.h"
 
@@ -95,7 +100,11 @@ typedef uint32_t xcb_window_t;
 extern "C" {
 #endif
 
-#define LVP_NUM_QUEUES 1
+/* graphics (the device queue), compute and transfer */
+#define LVP_NUM_QUEUE_FAMILIES 3
+#define LVP_MAX_COMPUTE_QUEUES 4
+#define LVP_MAX_TRANSFER_QUEUES 2
+#define LVP_MAX_EXTRA_QUEUES (LVP_MAX_COMPUTE_QUEUES + LVP_MAX_TRANSFER_QUEUES)
 #define MAX_SETS         8
 #define MAX_DESCRIPTORS 1000000 /* Required by vkd3d-proton */
 #define MAX_PUSH_CONSTANTS_SIZE 256
@@ -192,29 +201,43 @@ struct lvp_queue {
    struct u_upload_mgr *uploader;
    struct pipe_fence_handle *last_fence;
    void *state;
+   void *noop_fs;
+   /* Shader CSOs of the device queue translated to this queue's context,
+    * keyed by the device queue's CSO.  NULL on the device queue.
+    */
+   struct hash_table *shader_csos;
    struct util_dynarray pipeline_destroys;
    simple_mtx_t lock;
 };
 
-struct lvp_pipeline_cache {
-   struct vk_object_base                        base;
-   struct lvp_device *                          device;
-   VkAllocationCallbacks                        alloc;
-};
-
 struct lvp_device {
    struct vk_device vk;
 
+   /* The graphics queue.  Its context also creates the device's objects
+    * (CSOs, texture handles, queries...), under its lock.  A queue's lock is
+    * always taken before the device queue's when both are needed.
+    */
    struct lvp_queue queue;
+   /* Compute and transfer queues, executing concurrently on their own
+    * contexts.  The rasterizer and compute threads are shared by all.
+    */
+   struct lvp_queue *extra_queues[LVP_MAX_EXTRA_QUEUES];
+   uint32_t num_extra_queues;
+   /* Every queue samples through the texture handles of the device queue's
+    * context.  Queues execute under the read lock, the write lock is taken
+    * to wait for all of them before updating the handles.
+    */
+   struct u_rwlock execute_lock;
    struct lvp_instance *                       instance;
    struct lvp_physical_device *physical_device;
    struct pipe_screen *pscreen;
-   void *noop_fs;
    simple_mtx_t bda_lock;
    struct hash_table bda;
    struct pipe_resource *zero_buffer; /* for zeroed bda */
    bool poison_mem;
    bool print_cmds;
+   /* trace rays in packets of coherent rays, see lvp_build_packet_traversal */
+   bool rt_packets;
 
    struct lp_texture_handle *null_texture_handle;
    struct lp_texture_handle *null_image_handle;
@@ -227,6 +250,11 @@ struct lvp_device {
    radix_sort_vk_t *radix_sort;
    simple_mtx_t radix_sort_lock;
    struct vk_acceleration_structure_build_args accel_struct_args;
+
+   /* acceleration structures are built by lvp_build_as unless this is set */
+   bool compute_bvh_build;
+   bool has_bvh_queue;
+   struct util_queue bvh_queue;
 };
 
 void lvp_device_get_cache_uuid(void *uuid);
@@ -372,6 +400,11 @@ struct lvp_descriptor_set {
    struct pipe_memory_allocation *pmem;
    struct pipe_resource *bo;
    void *map;
+
+   /* Offset of the descriptors in bo, only sets created while executing a
+    * command buffer are suballocated.
+    */
+   uint32_t bo_offset;
 };
 
 struct lvp_descriptor_pool {
@@ -391,6 +424,12 @@ void
 lvp_descriptor_set_destroy(struct lvp_device *device,
                            struct lvp_descriptor_set *set);
 
+uint64_t
+lvp_descriptor_set_layout_bo_size(const struct lvp_descriptor_set_layout *layout);
+
+void
+lvp_descriptor_set_init_immutable_samplers(struct lvp_descriptor_set *set);
+
 void
 lvp_descriptor_set_update_with_template(VkDevice _device, VkDescriptorSet descriptorSet,
                                         VkDescriptorUpdateTemplate descriptorUpdateTemplate,
@@ -443,6 +482,9 @@ struct lvp_shader {
    struct pipe_stream_output_info stream_output;
    struct blob blob; //preserved for GetShaderBinaryDataEXT
    uint32_t push_constant_size;
+   /* VkPipelineCache entry this shader was created from, keeps the code of
+    * the llvmpipe variants compiled for it */
+   struct lvp_shader_cache_object *cache_object;
 };
 
 enum lvp_pipeline_type {
@@ -602,11 +644,37 @@ struct lvp_query_pool {
    struct pipe_query *queries[0];
 };
 
+struct lvp_baked_cmd {
+   struct vk_cmd_queue_entry *cmd;
+   /* offset of the push constant block in lvp_cmd_bake::push_constants for
+    * VK_CMD_PUSH_CONSTANTS2, UINT32_MAX if it has to be uploaded at execution
+    */
+   uint32_t push_constant_offset;
+};
+
+/* The command list of a reusable primary command buffer, flattened at
+ * vkEndCommandBuffer so that every submit doesn't have to re-walk and
+ * re-upload the same commands.
+ */
+struct lvp_cmd_bake {
+   struct lvp_baked_cmd *cmds;
+   uint32_t cmd_count;
+
+   /* every push constant block the command buffer produces, packed at
+    * push_constant_stride intervals
+    */
+   struct pipe_resource *push_constants;
+   uint32_t push_constant_stride;
+};
+
 struct lvp_cmd_buffer {
    struct vk_command_buffer vk;
 
    struct lvp_device *                          device;
 
+   VkCommandBufferUsageFlags usage_flags;
+   struct lvp_cmd_bake *bake;
+
    uint8_t push_constants[MAX_PUSH_CONSTANTS_SIZE];
 };
 
@@ -686,8 +754,6 @@ VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_event, base, VkEvent, VK_OBJECT_TYPE_EVENT)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_image, vk.base, VkImage, VK_OBJECT_TYPE_IMAGE)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_image_view, vk.base, VkImageView,
                                VK_OBJECT_TYPE_IMAGE_VIEW);
-VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_pipeline_cache, base, VkPipelineCache,
-                               VK_OBJECT_TYPE_PIPELINE_CACHE)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_pipeline, base, VkPipeline,
                                VK_OBJECT_TYPE_PIPELINE)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_shader, base, VkShaderEXT,
@@ -720,6 +786,8 @@ VkResult lvp_image_bind_sparse(struct lvp_device *device,
 VkResult lvp_execute_cmds(struct lvp_device *device,
                           struct lvp_queue *queue,
                           struct lvp_cmd_buffer *cmd_buffer);
+void lvp_cmd_buffer_bake(struct lvp_cmd_buffer *cmd_buffer);
+void lvp_cmd_buffer_bake_free(struct lvp_cmd_buffer *cmd_buffer);
 size_t
 lvp_get_rendering_state_size(void);
 
@@ -777,11 +845,44 @@ lvp_image_aspects_to_plane(ASSERTED const struct lvp_image *image,
 }
 
 void
-lvp_pipeline_destroy(struct lvp_device *device, struct lvp_pipeline *pipeline, bool locked);
+lvp_pipeline_destroy(struct lvp_device *device, struct lvp_pipeline *pipeline);
 
 void
 queue_thread_noop(void *data, void *gdata, int thread_index);
 
+/* A VkPipelineCache entry for one shader stage: the NIR after
+ * lvp_spirv_to_nir(), and the object code of the llvmpipe variants compiled
+ * from it so far.
+ */
+struct lvp_shader_cache_object {
+   struct vk_pipeline_cache_object base;
+   struct lp_code_cache code_cache;
+
+   unsigned char key[SHA1_DIGEST_LENGTH];
+
+   struct blob nir;
+
+   simple_mtx_t lock;
+   struct util_dynarray variants; /* struct lvp_cached_variant */
+};
+
+extern const struct vk_pipeline_cache_object_ops lvp_shader_cache_object_ops;
+extern const struct vk_pipeline_cache_object_ops *const lvp_pipeline_cache_import_ops[];
+
+struct lvp_shader_cache_object *
+lvp_shader_cache_object_create(struct lvp_device *device,
+                               const unsigned char key[SHA1_DIGEST_LENGTH],
+                               const nir_shader *nir);
+
+static inline void
+lvp_shader_cache_object_unref(struct lvp_device *device,
+                              struct lvp_shader_cache_object **object)
+{
+   if (*object)
+      vk_pipeline_cache_object_unref(&device->vk, &(*object)->base);
+   *object = NULL;
+}
+
 VkResult
 lvp_spirv_to_nir(struct lvp_pipeline *pipeline, const void *pipeline_pNext,
                  const VkPipelineShaderStageCreateInfo *sinfo, nir_shader **out_nir);
@@ -795,6 +896,9 @@ lvp_shader_optimize(nir_shader *nir);
 void *
 lvp_shader_compile(struct lvp_device *device, struct lvp_shader *shader, nir_shader *nir, bool locked);
 
+void *
+lvp_queue_shader_cso(struct lvp_queue *queue, struct lvp_shader *shader, bool tess_ccw);
+
 enum vk_cmd_type
 lvp_nv_dgc_token_to_cmd_type(const VkIndirectCommandsLayoutTokenNV *token);
 
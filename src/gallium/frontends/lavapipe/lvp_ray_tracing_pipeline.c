@@ -356,7 +356,7 @@ lvp_ray_traversal_state_init(nir_function_impl *impl, struct lvp_ray_traversal_s
    state->current_node = nir_local_variable_create(impl, glsl_uint_type(), "traversal.current_node");
    state->stack_base = nir_local_variable_create(impl, glsl_uint_type(), "traversal.stack_base");
    state->stack_ptr = nir_local_variable_create(impl, glsl_uint_type(), "traversal.stack_ptr");
-   state->stack = nir_local_variable_create(impl, glsl_array_type(glsl_uint_type(), 24 * 2, 0), "traversal.stack");
+   state->stack = nir_local_variable_create(impl, glsl_array_type(glsl_uint_type(), LVP_BVH_STACK_SIZE * 2, 0), "traversal.stack");
    state->hit = nir_local_variable_create(impl, glsl_bool_type(), "traversal.hit");
 
    state->instance_addr = nir_local_variable_create(impl, glsl_uint64_t_type(), "traversal.instance_addr");
@@ -790,6 +790,7 @@ lvp_trace_ray(nir_builder *b, struct lvp_ray_tracing_pipeline_compiler *compiler
       .tmin = tmin,
       .dir = dir,
       .vars = vars,
+      .packets = compiler->pipeline->device->rt_packets,
       .aabb_cb = (compiler->flags & VK_PIPELINE_CREATE_2_RAY_TRACING_SKIP_AABBS_BIT_KHR) ?
                  NULL : lvp_handle_aabb_intersection,
       .triangle_cb = (compiler->flags & VK_PIPELINE_CREATE_2_RAY_TRACING_SKIP_TRIANGLES_BIT_KHR) ?
@@ -1035,7 +1036,13 @@ lvp_compile_ray_tracing_pipeline(struct lvp_pipeline *pipeline,
       "ray tracing pipeline");
    nir_builder *b = &_b;
 
-   b->shader->info.workgroup_size[0] = 8;
+   /* Packets work best for rays from neighbouring pixels. */
+   if (pipeline->device->rt_packets) {
+      b->shader->info.workgroup_size[0] = 4;
+      b->shader->info.workgroup_size[1] = 2;
+   } else {
+      b->shader->info.workgroup_size[0] = 8;
+   }
 
    struct lvp_ray_tracing_pipeline_compiler compiler = {
       .pipeline = pipeline,
@@ -1173,7 +1180,7 @@ lvp_create_ray_tracing_pipeline(VkDevice _device, const VkAllocationCallbacks *a
    return VK_SUCCESS;
 
 fail:
-   lvp_pipeline_destroy(device, pipeline, false);
+   lvp_pipeline_destroy(device, pipeline);
    return result;
 }
 
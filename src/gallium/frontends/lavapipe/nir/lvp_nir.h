@@ -89,6 +89,11 @@ struct lvp_ray_traversal_args {
 
    struct lvp_ray_traversal_vars vars;
 
+   /* Traverse the rays of a subgroup in packets that share box nodes. The
+    * traversal can't be resumed after a callback breaks out of it.
+    */
+   bool packets;
+
    lvp_aabb_intersection_cb aabb_cb;
    lvp_triangle_intersection_cb triangle_cb;
 
@@ -61,93 +61,102 @@ lvp_load_vertex_position(nir_builder *b, nir_def *primitive_addr, uint32_t index
    return nir_build_load_global(b, 3, 32, nir_iadd_imm(b, primitive_addr, index * 3 * sizeof(float)));
 }
 
+static_assert(LVP_BVH_WIDTH == 4, "the box test loads the planes of all children as one dword");
+
 static nir_def *
-lvp_build_intersect_ray_box(nir_builder *b, nir_def **node_data, nir_def *ray_tmax,
-                            nir_def *origin, nir_def *dir, nir_def *inv_dir)
+lvp_unpack_box_planes(nir_builder *b, nir_def *planes)
 {
-   const struct glsl_type *vec2_type = glsl_vector_type(GLSL_TYPE_FLOAT, 2);
-   const struct glsl_type *uvec2_type = glsl_vector_type(GLSL_TYPE_UINT, 2);
-
-   nir_variable *distances =
-      nir_variable_create(b->shader, nir_var_shader_temp, vec2_type, "distances");
-   nir_store_var(b, distances, nir_imm_vec2(b, INFINITY, INFINITY), 0xf);
+   nir_def *unpacked[LVP_BVH_WIDTH];
+   for (unsigned i = 0; i < LVP_BVH_WIDTH; i++)
+      unpacked[i] = nir_extract_u8_imm(b, planes, i);
+   return nir_u2f32(b, nir_vec(b, unpacked, LVP_BVH_WIDTH));
+}
 
-   nir_variable *child_indices =
-      nir_variable_create(b->shader, nir_var_shader_temp, uvec2_type, "child_indices");
-   nir_store_var(b, child_indices, nir_imm_ivec2(b, 0xffffffffu, 0xffffffffu), 0xf);
+static nir_def *
+lvp_load_box_children(nir_builder *b, nir_def **node_data)
+{
+   nir_def *children[LVP_BVH_WIDTH];
+   for (unsigned i = 0; i < LVP_BVH_WIDTH; i++)
+      children[i] = lvp_load_node_data(b, NULL, node_data, offsetof(struct lvp_bvh_box_node, children[i]));
+   return nir_vec(b, children, LVP_BVH_WIDTH);
+}
 
+/* Tests all children of a box node at once and returns the distances at
+ * which the ray enters them, INFINITY for the children that are missed.
+ */
+static nir_def *
+lvp_build_intersect_ray_box(nir_builder *b, nir_def **node_data, nir_def *child_indices,
+                            nir_def *ray_tmax, nir_def *origin, nir_def *dir, nir_def *inv_dir)
+{
    inv_dir = nir_bcsel(b, nir_feq_imm(b, dir, 0), nir_imm_float(b, FLT_MAX), inv_dir);
 
-   for (int i = 0; i < 2; i++) {
-      const uint32_t child_offset = offsetof(struct lvp_bvh_box_node, children[i]);
-      const uint32_t coord_offsets[2] = {
-         offsetof(struct lvp_bvh_box_node, bounds[i].min.x),
-         offsetof(struct lvp_bvh_box_node, bounds[i].max.x),
-      };
+   nir_def *exponents =
+      lvp_load_node_data(b, NULL, node_data, offsetof(struct lvp_bvh_box_node, exponents));
 
-      nir_def *child_index = lvp_load_node_data(b, NULL, node_data, child_offset);
-
-      nir_def *node_coords[2] = {
-         nir_vec3(b,
-            lvp_load_node_data(b, NULL, node_data, coord_offsets[0] + 0),
-            lvp_load_node_data(b, NULL, node_data, coord_offsets[0] + 4),
-            lvp_load_node_data(b, NULL, node_data, coord_offsets[0] + 8)
-         ),
-         nir_vec3(b,
-            lvp_load_node_data(b, NULL, node_data, coord_offsets[1] + 0),
-            lvp_load_node_data(b, NULL, node_data, coord_offsets[1] + 4),
-            lvp_load_node_data(b, NULL, node_data, coord_offsets[1] + 8)
-         ),
+   nir_def *tmin = NULL;
+   nir_def *tmax = NULL;
+   for (unsigned axis = 0; axis < 3; axis++) {
+      const uint32_t plane_offsets[2] = {
+         offsetof(struct lvp_bvh_box_node, child_min[axis]),
+         offsetof(struct lvp_bvh_box_node, child_max[axis]),
       };
 
-      /* If x of the aabb min is NaN, then this is an inactive aabb.
-       * We don't need to care about any other components being NaN as that is UB.
-       * https://registry.khronos.org/vulkan/specs/latest/html/vkspec.html#acceleration-structure-inactive-prims
-       */
-      nir_def *min_x = nir_channel(b, node_coords[0], 0);
-      nir_def *min_x_is_not_nan =
-         nir_inot(b, nir_fneu(b, min_x, min_x)); /* NaN != NaN -> true */
-
-      nir_def *bound0 = nir_fmul(b, nir_fsub(b, node_coords[0], origin), inv_dir);
-      nir_def *bound1 = nir_fmul(b, nir_fsub(b, node_coords[1], origin), inv_dir);
-
-      nir_def *tmin =
-         nir_fmax(b,
-                  nir_fmax(b, nir_fmin(b, nir_channel(b, bound0, 0), nir_channel(b, bound1, 0)),
-                           nir_fmin(b, nir_channel(b, bound0, 1), nir_channel(b, bound1, 1))),
-                  nir_fmin(b, nir_channel(b, bound0, 2), nir_channel(b, bound1, 2)));
-
-      nir_def *tmax =
-         nir_fmin(b,
-                  nir_fmin(b, nir_fmax(b, nir_channel(b, bound0, 0), nir_channel(b, bound1, 0)),
-                           nir_fmax(b, nir_channel(b, bound0, 1), nir_channel(b, bound1, 1))),
-                  nir_fmax(b, nir_channel(b, bound0, 2), nir_channel(b, bound1, 2)));
-
-      nir_push_if(b,
-                  nir_iand(b, min_x_is_not_nan,
-                           nir_iand(b, nir_fge(b, tmax, nir_fmax(b, nir_imm_float(b, 0.0f), tmin)),
-                                    nir_flt(b, tmin, ray_tmax))));
-      {
-         nir_def *new_child_indices[2] = {child_index, child_index};
-         nir_store_var(b, child_indices, nir_vec(b, new_child_indices, 2), 1u << i);
-
-         nir_def *new_distances[2] = {tmin, tmin};
-         nir_store_var(b, distances, nir_vec(b, new_distances, 2), 1u << i);
+      nir_def *node_origin =
+         lvp_load_node_data(b, NULL, node_data, offsetof(struct lvp_bvh_box_node, origin[axis]));
+      /* The grid spacing is the float with the stored biased exponent. */
+      nir_def *scale = nir_ishl_imm(b, nir_ubfe_imm(b, exponents, axis * 8, 8), 23);
+
+      nir_def *bounds[2];
+      for (unsigned i = 0; i < 2; i++) {
+         nir_def *planes = lvp_unpack_box_planes(b, lvp_load_node_data(b, NULL, node_data, plane_offsets[i]));
+         planes = nir_fadd(b, nir_fmul(b, planes, scale), node_origin);
+         bounds[i] = nir_fmul(b, nir_fsub(b, planes, nir_channel(b, origin, axis)),
+                              nir_channel(b, inv_dir, axis));
       }
-      nir_pop_if(b, NULL);
+
+      nir_def *near = nir_fmin(b, bounds[0], bounds[1]);
+      nir_def *far = nir_fmax(b, bounds[0], bounds[1]);
+      tmin = tmin ? nir_fmax(b, tmin, near) : near;
+      tmax = tmax ? nir_fmin(b, tmax, far) : far;
    }
 
-   nir_def *ssa_distances = nir_load_var(b, distances);
-   nir_def *ssa_indices = nir_load_var(b, child_indices);
-   nir_push_if(b, nir_flt(b, nir_channel(b, ssa_distances, 1), nir_channel(b, ssa_distances, 0)));
-   {
-      nir_store_var(b, child_indices,
-                    nir_vec2(b, nir_channel(b, ssa_indices, 1), nir_channel(b, ssa_indices, 0)),
-                    0b11);
+   nir_def *hit = nir_iand(b, nir_fge(b, tmax, nir_fmax(b, nir_imm_float(b, 0.0f), tmin)),
+                           nir_flt(b, tmin, ray_tmax));
+   hit = nir_iand(b, hit, nir_ine_imm(b, child_indices, LVP_BVH_INVALID_NODE));
+
+   return nir_bcsel(b, hit, tmin, nir_imm_float(b, INFINITY));
+}
+
+/* Sorts the children by ascending key without branching. */
+static nir_def *
+lvp_sort_box_children(nir_builder *b, nir_def *keys, nir_def *child_indices)
+{
+   static const unsigned sorting_network[][2] = {
+      { 0, 1 }, { 2, 3 }, { 0, 2 }, { 1, 3 }, { 1, 2 },
+   };
+
+   nir_def *distances[LVP_BVH_WIDTH];
+   nir_def *children[LVP_BVH_WIDTH];
+   for (unsigned i = 0; i < LVP_BVH_WIDTH; i++) {
+      distances[i] = nir_channel(b, keys, i);
+      children[i] = nir_channel(b, child_indices, i);
+   }
+
+   for (unsigned i = 0; i < ARRAY_SIZE(sorting_network); i++) {
+      unsigned lo = sorting_network[i][0];
+      unsigned hi = sorting_network[i][1];
+      nir_def *swap = nir_flt(b, distances[hi], distances[lo]);
+
+      nir_def *distance_lo = nir_bcsel(b, swap, distances[hi], distances[lo]);
+      distances[hi] = nir_bcsel(b, swap, distances[lo], distances[hi]);
+      distances[lo] = distance_lo;
+
+      nir_def *child_lo = nir_bcsel(b, swap, children[hi], children[lo]);
+      children[hi] = nir_bcsel(b, swap, children[lo], children[hi]);
+      children[lo] = child_lo;
    }
-   nir_pop_if(b, NULL);
 
-   return nir_load_var(b, child_indices);
+   return nir_vec(b, children, LVP_BVH_WIDTH);
 }
 
 static nir_def *
@@ -471,6 +480,193 @@ lvp_build_pop_stack(nir_builder *b, const struct lvp_ray_traversal_args *args)
    return nir_load_deref(b, nir_build_deref_array(b, args->vars.stack, stack_ptr));
 }
 
+/* Direction octant of the ray, rays in the same octant visit the children of
+ * a box node in a similar order.
+ */
+static nir_def *
+lvp_build_ray_octant(nir_builder *b, nir_def *dir)
+{
+   nir_def *octant = nir_imm_int(b, 0);
+   for (unsigned i = 0; i < 3; i++)
+      octant = nir_ior(b, octant, nir_bcsel(b, nir_flt_imm(b, nir_channel(b, dir, i), 0.0f),
+                                            nir_imm_int(b, 1 << i), nir_imm_int(b, 0)));
+   return octant;
+}
+
+/* Traverses the rays of all active invocations with the same acceleration
+ * structure and direction octant as one packet.  The packet shares the
+ * current node and the stack: a child is visited if any ray of the packet
+ * hits it, and the children are visited in the order of the first ray of the
+ * packet.  Node addresses are uniform this way, so the node data is loaded
+ * once for the whole packet instead of being gathered per invocation.
+ * Invocations that are done or that are culled by an instance mask stay in
+ * the packet but don't test any primitives.
+ */
+static void
+lvp_build_packet_traversal(nir_builder *b, const struct lvp_ray_traversal_args *args,
+                           const struct lvp_ray_flags *ray_flags, nir_variable *incomplete)
+{
+   nir_variable *active = nir_local_variable_create(b->impl, glsl_bool_type(), "packet_active");
+   nir_store_var(b, active, nir_imm_true(b), 0x1);
+
+   nir_def *vec3ones = nir_imm_vec3(b, 1.0, 1.0, 1.0);
+   nir_def *octant = lvp_build_ray_octant(b, args->dir);
+
+   nir_push_loop(b);
+   {
+      nir_def *same_packet =
+         nir_iand(b, nir_ieq(b, octant, nir_read_first_invocation(b, octant)),
+                  nir_ieq(b, args->root_bvh_base, nir_read_first_invocation(b, args->root_bvh_base)));
+      nir_push_if(b, same_packet);
+      {
+         nir_push_loop(b);
+         {
+            nir_push_if(b, nir_ieq_imm(b, nir_load_deref(b, args->vars.current_node), LVP_BVH_INVALID_NODE));
+            {
+               nir_push_if(b, nir_ieq_imm(b, nir_load_deref(b, args->vars.stack_ptr), 0));
+               {
+                  nir_store_var(b, incomplete, nir_imm_false(b), 0x1);
+                  nir_jump(b, nir_jump_break);
+               }
+               nir_pop_if(b, NULL);
+
+               nir_push_if(b, nir_ige(b, nir_load_deref(b, args->vars.stack_base), nir_load_deref(b, args->vars.stack_ptr)));
+               {
+                  nir_store_deref(b, args->vars.stack_base, nir_imm_int(b, -1), 1);
+
+                  nir_store_deref(b, args->vars.bvh_base, args->root_bvh_base, 1);
+                  nir_store_deref(b, args->vars.origin, args->origin, 7);
+                  nir_store_deref(b, args->vars.dir, args->dir, 7);
+                  nir_store_deref(b, args->vars.inv_dir, nir_fdiv(b, vec3ones, args->dir), 7);
+                  nir_store_var(b, active, nir_imm_true(b), 0x1);
+               }
+               nir_pop_if(b, NULL);
+
+               nir_store_deref(b, args->vars.current_node, lvp_build_pop_stack(b, args), 0x1);
+            }
+            nir_pop_if(b, NULL);
+
+            /* All invocations of the packet hold the same node, make that
+             * visible to the backend.
+             */
+            nir_def *bvh_node = nir_read_first_invocation(b, nir_load_deref(b, args->vars.current_node));
+            nir_store_deref(b, args->vars.current_node, nir_imm_int(b, LVP_BVH_INVALID_NODE), 0x1);
+
+            nir_def *bvh_base = nir_read_first_invocation(b, nir_load_deref(b, args->vars.bvh_base));
+            nir_def *node_addr = nir_iadd(b, bvh_base, nir_u2u64(b, nir_iand_imm(b, bvh_node, ~3u)));
+
+            nir_def *node_data[LVP_BVH_NODE_PREFETCH_SIZE / 4];
+            for (uint32_t i = 0; i < ARRAY_SIZE(node_data); i++)
+               node_data[i] = nir_build_load_global(b, 1, 32, nir_iadd_imm(b, node_addr, i * 4));
+
+            nir_def *tmax = nir_load_deref(b, args->vars.tmax);
+
+            nir_def *node_type = nir_iand_imm(b, bvh_node, 3);
+            nir_push_if(b, nir_uge_imm(b, node_type, lvp_bvh_node_internal));
+            {
+               nir_push_if(b, nir_uge_imm(b, node_type, lvp_bvh_node_instance));
+               {
+                  nir_push_if(b, nir_ieq_imm(b, node_type, lvp_bvh_node_aabb));
+                  {
+                     nir_push_if(b, nir_load_var(b, active));
+                     {
+                        lvp_build_aabb_case(b, args, ray_flags, node_addr, node_data);
+                     }
+                     nir_pop_if(b, NULL);
+                  }
+                  nir_push_else(b, NULL);
+                  {
+                     /* instance */
+                     nir_store_deref(b, args->vars.instance_addr, node_addr, 1);
+
+                     nir_def *wto_matrix[3];
+                     lvp_load_wto_matrix(b, node_addr, node_data, wto_matrix);
+
+                     nir_store_deref(b, args->vars.sbt_offset_and_flags, node_data[3], 1);
+
+                     nir_def *instance_and_mask = node_data[2];
+                     nir_def *visible = nir_uge_imm(b, nir_iand(b, instance_and_mask, args->cull_mask), 1 << 24);
+                     nir_store_var(b, active, visible, 0x1);
+
+                     nir_store_deref(b, args->vars.bvh_base,
+                                     nir_pack_64_2x32_split(b, node_data[0], node_data[1]), 1);
+
+                     nir_store_deref(b, args->vars.stack_base, nir_load_deref(b, args->vars.stack_ptr), 0x1);
+
+                     /* Enter the instance unless it is culled for the whole packet. */
+                     nir_store_deref(b, args->vars.current_node,
+                                     nir_bcsel(b, nir_vote_any(b, 1, visible),
+                                               nir_imm_int(b, LVP_BVH_ROOT_NODE),
+                                               nir_imm_int(b, LVP_BVH_INVALID_NODE)), 0x1);
+
+                     /* Transform the ray into object space */
+                     nir_store_deref(b, args->vars.origin,
+                                     lvp_mul_vec3_mat(b, args->origin, wto_matrix, true), 7);
+                     nir_store_deref(b, args->vars.dir,
+                                     lvp_mul_vec3_mat(b, args->dir, wto_matrix, false), 7);
+                     nir_store_deref(b, args->vars.inv_dir,
+                                     nir_fdiv(b, vec3ones, nir_load_deref(b, args->vars.dir)), 7);
+                  }
+                  nir_pop_if(b, NULL);
+               }
+               nir_push_else(b, NULL);
+               {
+                  nir_def *children = lvp_load_box_children(b, node_data);
+                  nir_def *distance = lvp_build_intersect_ray_box(
+                     b, node_data, children, tmax,
+                     nir_load_deref(b, args->vars.origin), nir_load_deref(b, args->vars.dir),
+                     nir_load_deref(b, args->vars.inv_dir));
+                  distance = nir_bcsel(b, nir_load_var(b, active), distance, nir_imm_float(b, INFINITY));
+
+                  nir_def *keys[LVP_BVH_WIDTH];
+                  nir_def *visit[LVP_BVH_WIDTH];
+                  for (unsigned i = 0; i < LVP_BVH_WIDTH; i++) {
+                     nir_def *child_distance = nir_channel(b, distance, i);
+                     keys[i] = nir_read_first_invocation(b, child_distance);
+                     visit[i] = nir_vote_any(b, 1, nir_flt_imm(b, child_distance, INFINITY));
+                  }
+
+                  nir_def *result = lvp_sort_box_children(
+                     b, nir_vec(b, keys, LVP_BVH_WIDTH),
+                     nir_bcsel(b, nir_vec(b, visit, LVP_BVH_WIDTH), children,
+                               nir_imm_int(b, LVP_BVH_INVALID_NODE)));
+
+                  nir_store_deref(b, args->vars.current_node, nir_channel(b, result, 0), 0x1);
+
+                  for (unsigned i = LVP_BVH_WIDTH - 1; i > 0; i--) {
+                     nir_push_if(b, nir_ine_imm(b, nir_channel(b, result, i), LVP_BVH_INVALID_NODE));
+                     {
+                        lvp_build_push_stack(b, args, nir_channel(b, result, i));
+                     }
+                     nir_pop_if(b, NULL);
+                  }
+               }
+               nir_pop_if(b, NULL);
+            }
+            nir_push_else(b, NULL);
+            {
+               nir_push_if(b, nir_load_var(b, active));
+               {
+                  nir_def *result = lvp_build_intersect_ray_tri(
+                     b, node_data, tmax, nir_load_deref(b, args->vars.origin),
+                     nir_load_deref(b, args->vars.dir), nir_load_deref(b, args->vars.inv_dir));
+
+                  lvp_build_triangle_case(b, args, ray_flags, result, node_addr, node_data);
+               }
+               nir_pop_if(b, NULL);
+            }
+            nir_pop_if(b, NULL);
+         }
+         nir_pop_loop(b, NULL);
+
+         /* The other packets are traversed by the next iterations. */
+         nir_jump(b, nir_jump_break);
+      }
+      nir_pop_if(b, NULL);
+   }
+   nir_pop_loop(b, NULL);
+}
+
 nir_def *
 lvp_build_ray_traversal(nir_builder *b, const struct lvp_ray_traversal_args *args)
 {
@@ -497,6 +693,11 @@ lvp_build_ray_traversal(nir_builder *b, const struct lvp_ray_traversal_args *arg
       .no_skip_aabbs = nir_ieq_imm(b, nir_iand_imm(b, args->flags, SpvRayFlagsSkipAABBsKHRMask), 0),
    };
 
+   if (args->packets) {
+      lvp_build_packet_traversal(b, args, &ray_flags, incomplete);
+      return nir_load_var(b, incomplete);
+   }
+
    nir_push_loop(b);
    {
       nir_push_if(b, nir_ieq_imm(b, nir_load_deref(b, args->vars.current_node), LVP_BVH_INVALID_NODE));
@@ -582,18 +783,32 @@ lvp_build_ray_traversal(nir_builder *b, const struct lvp_ray_traversal_args *arg
          }
          nir_push_else(b, NULL);
          {
-            nir_def *result = lvp_build_intersect_ray_box(
-               b, node_data, tmax,
+            nir_def *children = lvp_load_box_children(b, node_data);
+            nir_def *distance = lvp_build_intersect_ray_box(
+               b, node_data, children, tmax,
                nir_load_deref(b, args->vars.origin), nir_load_deref(b, args->vars.dir),
                nir_load_deref(b, args->vars.inv_dir));
 
+            /* The children that are hit ordered by distance, followed by
+             * LVP_BVH_INVALID_NODE for the others.
+             */
+            nir_def *result = lvp_sort_box_children(
+               b, distance,
+               nir_bcsel(b, nir_flt_imm(b, distance, INFINITY), children,
+                         nir_imm_int(b, LVP_BVH_INVALID_NODE)));
+
             nir_store_deref(b, args->vars.current_node, nir_channel(b, result, 0), 0x1);
 
-            nir_push_if(b, nir_ine_imm(b, nir_channel(b, result, 1), LVP_BVH_INVALID_NODE));
-            {
-               lvp_build_push_stack(b, args, nir_channel(b, result, 1));
+            /* Push the farther children so that the nearest of them is
+             * popped first.
+             */
+            for (unsigned i = LVP_BVH_WIDTH - 1; i > 0; i--) {
+               nir_push_if(b, nir_ine_imm(b, nir_channel(b, result, i), LVP_BVH_INVALID_NODE));
+               {
+                  lvp_build_push_stack(b, args, nir_channel(b, result, i));
+               }
+               nir_pop_if(b, NULL);
             }
-            nir_pop_if(b, NULL);
          }
          nir_pop_if(b, NULL);
       }
@@ -28,6 +28,7 @@ static const struct debug_named_value teflon_debug_flags[] = {
    DEBUG_NAMED_VALUE_END};
 
 DEBUG_GET_ONCE_FLAGS_OPTION(debug_teflon, "TEFLON_DEBUG", teflon_debug_flags, 0)
+DEBUG_GET_ONCE_BOOL_OPTION(teflon_cpu, "TEFLON_CPU", false)
 
 static inline void
 teflon_debug(const char *format, ...)
@@ -166,9 +167,20 @@ fill_operation(struct teflon_delegate *delegate, TfLiteContext *tf_context, TfLi
                                   operation->conv.weight_tensor->dims[2] == 1;
       break;
    }
-   case kTfLiteBuiltinAveragePool2d:
+   case kTfLiteBuiltinAveragePool2d: {
+      TfLitePoolParams *params = (TfLitePoolParams *)node->builtin_data;
+
+      if (params->activation != kTfLiteActNone)
+         return false;
+
       operation->type = PIPE_ML_OPERATION_TYPE_POOLING;
+      operation->pooling.stride_x = params->stride_width;
+      operation->pooling.stride_y = params->stride_height;
+      operation->pooling.filter_width = params->filter_width;
+      operation->pooling.filter_height = params->filter_height;
+      operation->pooling.padding_same = params->padding == kTfLitePaddingSame;
       break;
+   }
    case kTfLiteBuiltinAdd:
       operation->type = PIPE_ML_OPERATION_TYPE_ADD;
       break;
@@ -845,6 +857,17 @@ find_drm_device()
    return device;
 }
 
+static struct pipe_loader_device *
+find_sw_device()
+{
+   struct pipe_loader_device *device = NULL;
+
+   if (!pipe_loader_sw_probe_null(&device))
+      return NULL;
+
+   return device;
+}
+
 __attribute__((visibility("default"))) TfLiteDelegate *
 tflite_plugin_create_delegate(char **options_keys,
                               char **options_values,
@@ -864,19 +887,39 @@ tflite_plugin_create_delegate(char **options_keys,
    devs = (struct pipe_loader_device **)malloc(sizeof(*devs) * n);
    pipe_loader_probe(devs, n, false);
 
-   delegate->dev = find_accel_device();
+   if (!debug_get_option_teflon_cpu()) {
+      delegate->dev = find_accel_device();
+      if (delegate->dev == NULL)
+         delegate->dev = find_drm_device();
+   }
+
+   /* Without an NPU, run on the CPU (llvmpipe) */
    if (delegate->dev == NULL)
-      delegate->dev = find_drm_device();
+      delegate->dev = find_sw_device();
 
    if (delegate->dev == NULL) {
       fprintf(stderr, "Couldn't open kernel device\n");
       return NULL;
    }
 
-   teflon_debug("Teflon delegate: loaded %s driver\n", delegate->dev->driver_name);
-
    screen = pipe_loader_create_screen(delegate->dev, false);
+   if (screen == NULL) {
+      fprintf(stderr, "Couldn't create screen for %s\n", delegate->dev->driver_name);
+      pipe_loader_release(&delegate->dev, 1);
+      return NULL;
+   }
+
    delegate->context = screen->context_create(screen, NULL, PIPE_CONTEXT_COMPUTE_ONLY);
+   if (delegate->context == NULL || delegate->context->ml_subgraph_create == NULL) {
+      fprintf(stderr, "The %s driver doesn't support ML operations\n", screen->get_name(screen));
+      if (delegate->context)
+         delegate->context->destroy(delegate->context);
+      screen->destroy(screen);
+      pipe_loader_release(&delegate->dev, 1);
+      return NULL;
+   }
+
+   teflon_debug("Teflon delegate: loaded %s driver\n", delegate->dev->driver_name);
 
    return &delegate->base;
 }
@@ -0,0 +1,302 @@
+/*
+ * Copyright © 2026 Red Hat.
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * @file
+ * Benchmark and sanity test for acceleration structure builds.
+ *
+ * A bottom level acceleration structure over a random triangle soup is
+ * built, and the build time is printed.  After the build the tree is walked
+ * to check that every triangle is reached exactly once, inside the bounds of
+ * all of its ancestors, and the same is checked again after moving the
+ * triangles and updating the acceleration structure.
+ *
+ * lavapipe picks the native CPU builder, or the generic compute shader
+ * builder if LVP_COMPUTE_BVH=true, when the device is created.  meson runs
+ * the test once with each.
+ *
+ * Usage: lvp_test_bvh_build [triangles [iterations]]
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "lvp_test_common.h"
+
+#include "util/macros.h"
+
+/* The parts of the lavapipe BVH layout (lvp_acceleration_structure.h) that
+ * the tree walk needs.
+ */
+struct bvh_aabb {
+   float min[3];
+   float max[3];
+};
+
+struct bvh_header {
+   struct bvh_aabb bounds;
+   uint32_t compacted_size;
+   uint32_t serialization_size;
+   uint32_t instance_count;
+   uint32_t leaf_nodes_offset;
+   uint32_t internal_node_count;
+   uint32_t leaf_node_count;
+};
+
+#define BVH_WIDTH 4
+
+struct bvh_box_node {
+   float origin[3];
+   uint8_t exponents[4];
+   uint8_t child_min[3][BVH_WIDTH];
+   uint8_t child_max[3][BVH_WIDTH];
+   uint32_t children[BVH_WIDTH];
+};
+
+struct bvh_triangle_node {
+   float coords[3][3];
+   uint32_t padding;
+   uint32_t primitive_id;
+   uint32_t geometry_id_and_flags;
+};
+
+#define BVH_NODE_TRIANGLE 0
+#define BVH_NODE_INTERNAL 1
+#define BVH_INVALID_NODE  0xFFFFFFFF
+#define BVH_MAX_DEPTH     12
+
+static bool
+aabb_contains(const struct bvh_aabb *aabb, const float *p)
+{
+   for (unsigned i = 0; i < 3; i++) {
+      if (!(p[i] >= aabb->min[i] && p[i] <= aabb->max[i]))
+         return false;
+   }
+   return true;
+}
+
+/* Returns false if the subtree at node isn't a valid BVH for the triangles
+ * in vertices.  ancestors holds the box bounds on the path from the root.
+ */
+static bool
+validate_node(const uint8_t *bvh, uint32_t node, const float *vertices, uint8_t *seen,
+              uint32_t num_triangles, const struct bvh_aabb **ancestors, unsigned depth)
+{
+   if ((node & 3) == BVH_NODE_TRIANGLE) {
+      const struct bvh_triangle_node *leaf = (const void *)(bvh + (node & ~3u));
+      if (leaf->primitive_id >= num_triangles || seen[leaf->primitive_id]++)
+         return false;
+
+      for (unsigned v = 0; v < 3; v++) {
+         const float *expected = &vertices[(leaf->primitive_id * 3 + v) * 3];
+         if (memcmp(leaf->coords[v], expected, sizeof(leaf->coords[v])))
+            return false;
+
+         for (unsigned i = 0; i < depth; i++) {
+            if (!aabb_contains(ancestors[i], expected))
+               return false;
+         }
+      }
+      return true;
+   }
+
+   if ((node & 3) != BVH_NODE_INTERNAL || depth >= BVH_MAX_DEPTH)
+      return false;
+
+   const struct bvh_box_node *box = (const void *)(bvh + (node & ~3u));
+   struct bvh_aabb bounds;
+   for (unsigned i = 0; i < BVH_WIDTH; i++) {
+      if (box->children[i] == BVH_INVALID_NODE)
+         continue;
+
+      for (unsigned axis = 0; axis < 3; axis++) {
+         float scale = ldexpf(1.0f, box->exponents[axis] - 127);
+         bounds.min[axis] = box->origin[axis] + box->child_min[axis][i] * scale;
+         bounds.max[axis] = box->origin[axis] + box->child_max[axis][i] * scale;
+      }
+
+      ancestors[depth] = &bounds;
+      if (!validate_node(bvh, box->children[i], vertices, seen, num_triangles,
+                         ancestors, depth + 1))
+         return false;
+   }
+   return true;
+}
+
+static bool
+validate_bvh(const uint8_t *bvh, const float *vertices, uint32_t num_triangles)
+{
+   const struct bvh_aabb *ancestors[BVH_MAX_DEPTH];
+   uint8_t *seen = calloc(num_triangles, 1);
+   bool valid = validate_node(bvh, sizeof(struct bvh_header) | BVH_NODE_INTERNAL,
+                              vertices, seen, num_triangles, ancestors, 0);
+
+   for (uint32_t i = 0; valid && i < num_triangles; i++)
+      valid = seen[i] == 1;
+
+   free(seen);
+   return valid;
+}
+
+static double
+build(struct lvp_test_device *dev,
+      VkAccelerationStructureBuildGeometryInfoKHR *build_info,
+      const VkAccelerationStructureBuildRangeInfoKHR *range)
+{
+   VkCommandBuffer cmd =
+      lvp_test_begin_commands(dev, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+   CmdBuildAccelerationStructuresKHR(cmd, 1, build_info, &range);
+   CHECK(EndCommandBuffer(cmd));
+
+   return lvp_test_submit(dev, cmd);
+}
+
+/* Returns the average build time in ns. */
+static double
+run(struct lvp_test_device *dev, const float *vertices,
+    uint32_t num_triangles, unsigned num_iterations, bool *valid)
+{
+   size_t vertices_size = (size_t)num_triangles * 9 * sizeof(float);
+   struct lvp_test_buffer vertex_buffer;
+   lvp_test_create_buffer(dev, vertices_size,
+                          VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR |
+                          VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                          &vertex_buffer);
+   memcpy(vertex_buffer.map, vertices, vertices_size);
+
+   VkAccelerationStructureGeometryKHR geometry = {
+      .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+      .geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR,
+      .geometry.triangles = {
+         .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR,
+         .vertexFormat = VK_FORMAT_R32G32B32_SFLOAT,
+         .vertexData.deviceAddress = vertex_buffer.address,
+         .vertexStride = 3 * sizeof(float),
+         .maxVertex = num_triangles * 3 - 1,
+         .indexType = VK_INDEX_TYPE_NONE_KHR,
+      },
+      .flags = VK_GEOMETRY_OPAQUE_BIT_KHR,
+   };
+   VkAccelerationStructureBuildGeometryInfoKHR build_info = {
+      .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+      .type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+      .flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR |
+               VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR,
+      .mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+      .geometryCount = 1,
+      .pGeometries = &geometry,
+   };
+
+   VkAccelerationStructureBuildSizesInfoKHR sizes = {
+      .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR,
+   };
+   GetAccelerationStructureBuildSizesKHR(dev->device,
+                                         VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
+                                         &build_info, &num_triangles, &sizes);
+
+   struct lvp_test_buffer as_buffer, scratch_buffer;
+   lvp_test_create_buffer(dev, sizes.accelerationStructureSize,
+                          VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR |
+                          VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                          &as_buffer);
+   lvp_test_create_buffer(dev, MAX2(sizes.buildScratchSize, sizes.updateScratchSize),
+                          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                          VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                          &scratch_buffer);
+
+   const VkAccelerationStructureCreateInfoKHR as_info = {
+      .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
+      .buffer = as_buffer.buffer,
+      .size = sizes.accelerationStructureSize,
+      .type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+   };
+   VkAccelerationStructureKHR as;
+   CHECK(CreateAccelerationStructureKHR(dev->device, &as_info, NULL, &as));
+
+   build_info.dstAccelerationStructure = as;
+   build_info.scratchData.deviceAddress = scratch_buffer.address;
+
+   const VkAccelerationStructureBuildRangeInfoKHR range = {
+      .primitiveCount = num_triangles,
+   };
+
+   double time = 0.0;
+   for (unsigned i = 0; i < num_iterations; i++)
+      time += build(dev, &build_info, &range);
+
+   *valid = validate_bvh(as_buffer.map, vertex_buffer.map, num_triangles);
+
+   /* move everything a bit and refit */
+   float *moved = vertex_buffer.map;
+   for (size_t i = 0; i < (size_t)num_triangles * 9; i += 3)
+      moved[i] += 0.5f;
+
+   build_info.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR;
+   build_info.srcAccelerationStructure = as;
+   build(dev, &build_info, &range);
+
+   *valid = *valid && validate_bvh(as_buffer.map, vertex_buffer.map, num_triangles);
+
+   DestroyAccelerationStructureKHR(dev->device, as, NULL);
+   lvp_test_destroy_buffer(dev, &scratch_buffer);
+   lvp_test_destroy_buffer(dev, &as_buffer);
+   lvp_test_destroy_buffer(dev, &vertex_buffer);
+
+   return time / num_iterations;
+}
+
+int
+main(int argc, char **argv)
+{
+   uint32_t num_triangles = argc > 1 ? atoi(argv[1]) : 100000;
+   unsigned num_iterations = argc > 2 ? atoi(argv[2]) : 5;
+
+   VkPhysicalDeviceAccelerationStructureFeaturesKHR as_features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR,
+      .accelerationStructure = VK_TRUE,
+   };
+   VkPhysicalDeviceVulkan12Features features12 = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+      .pNext = &as_features,
+      .bufferDeviceAddress = VK_TRUE,
+   };
+   const char *extensions[] = {
+      VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME,
+      VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME,
+   };
+   const VkDeviceCreateInfo device_info = {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+      .pNext = &features12,
+      .enabledExtensionCount = ARRAY_SIZE(extensions),
+      .ppEnabledExtensionNames = extensions,
+   };
+   struct lvp_test_device dev;
+   lvp_test_init(&dev, "lvp_test_bvh_build", &device_info);
+
+   /* small triangles scattered in a cube, with a few large ones */
+   float *vertices = malloc((size_t)num_triangles * 9 * sizeof(float));
+   srand(42);
+   for (uint32_t t = 0; t < num_triangles; t++) {
+      float size = t % 64 ? 0.01f : 1.0f;
+      float center[3];
+      for (unsigned i = 0; i < 3; i++)
+         center[i] = (float)rand() / RAND_MAX * 100.0f;
+      for (unsigned v = 0; v < 3; v++) {
+         for (unsigned i = 0; i < 3; i++)
+            vertices[t * 9 + v * 3 + i] = center[i] + ((float)rand() / RAND_MAX - 0.5f) * size;
+      }
+   }
+
+   bool valid;
+   double time = run(&dev, vertices, num_triangles, num_iterations, &valid);
+
+   printf("%u triangles: %.3f ms%s\n", num_triangles, time / 1000000.0,
+          valid ? "" : " (INVALID)");
+
+   free(vertices);
+   lvp_test_finish(&dev);
+
+   return valid ? 0 : 1;
+}
@@ -0,0 +1,285 @@
+/*
+ * Copyright © 2026 Red Hat.
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "lvp_test_common.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <vulkan/vk_icd.h>
+
+#include "util/detect_os.h"
+#include "util/os_time.h"
+
+#if !DETECT_OS_WINDOWS
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+#endif
+
+#define LVP_TEST_DEFINE_FUNC(name) PFN_vk##name name;
+LVP_TEST_INSTANCE_FUNCS(LVP_TEST_DEFINE_FUNC)
+LVP_TEST_DEVICE_FUNCS(LVP_TEST_DEFINE_FUNC)
+#undef LVP_TEST_DEFINE_FUNC
+
+void
+lvp_test_init(struct lvp_test_device *dev, const char *name,
+              const VkDeviceCreateInfo *device_info)
+{
+   PFN_vkCreateInstance CreateInstance = (PFN_vkCreateInstance)
+      vk_icdGetInstanceProcAddr(VK_NULL_HANDLE, "vkCreateInstance");
+
+   const VkApplicationInfo app_info = {
+      .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+      .pApplicationName = name,
+      .apiVersion = VK_API_VERSION_1_3,
+   };
+   const VkInstanceCreateInfo instance_info = {
+      .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+      .pApplicationInfo = &app_info,
+   };
+   CHECK(CreateInstance(&instance_info, NULL, &dev->instance));
+
+#define LOAD_FUNC(name) \
+   name = (PFN_vk##name)vk_icdGetInstanceProcAddr(dev->instance, "vk" #name);
+   LVP_TEST_INSTANCE_FUNCS(LOAD_FUNC)
+#undef LOAD_FUNC
+
+   uint32_t num_physical_devices = 1;
+   VkResult result = EnumeratePhysicalDevices(dev->instance, &num_physical_devices,
+                                              &dev->physical_device);
+   if ((result != VK_SUCCESS && result != VK_INCOMPLETE) || !num_physical_devices) {
+      fprintf(stderr, "no lavapipe device\n");
+      exit(LVP_TEST_SKIP);
+   }
+
+   VkPhysicalDeviceMemoryProperties memory_props;
+   GetPhysicalDeviceMemoryProperties(dev->physical_device, &memory_props);
+   const VkMemoryPropertyFlags host_flags =
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+   for (dev->memory_type = 0; dev->memory_type < memory_props.memoryTypeCount; dev->memory_type++) {
+      if ((memory_props.memoryTypes[dev->memory_type].propertyFlags & host_flags) == host_flags)
+         break;
+   }
+
+   const float priority = 1.0f;
+   const VkDeviceQueueCreateInfo queue_info = {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+      .queueFamilyIndex = 0,
+      .queueCount = 1,
+      .pQueuePriorities = &priority,
+   };
+   VkDeviceCreateInfo info = *device_info;
+   if (!info.queueCreateInfoCount) {
+      info.queueCreateInfoCount = 1;
+      info.pQueueCreateInfos = &queue_info;
+   }
+
+   result = CreateDevice(dev->physical_device, &info, NULL, &dev->device);
+   if (result == VK_ERROR_FEATURE_NOT_PRESENT ||
+       result == VK_ERROR_EXTENSION_NOT_PRESENT) {
+      fprintf(stderr, "lavapipe device lacks features or extensions\n");
+      exit(LVP_TEST_SKIP);
+   }
+   CHECK(result);
+
+#define LOAD_FUNC(name) \
+   name = (PFN_vk##name)GetDeviceProcAddr(dev->device, "vk" #name);
+   LVP_TEST_DEVICE_FUNCS(LOAD_FUNC)
+#undef LOAD_FUNC
+
+   GetDeviceQueue(dev->device, 0, 0, &dev->queue);
+
+   const VkCommandPoolCreateInfo pool_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+   };
+   CHECK(CreateCommandPool(dev->device, &pool_info, NULL, &dev->pool));
+}
+
+void
+lvp_test_finish(struct lvp_test_device *dev)
+{
+   DestroyCommandPool(dev->device, dev->pool, NULL);
+   DestroyDevice(dev->device, NULL);
+   DestroyInstance(dev->instance, NULL);
+}
+
+void
+lvp_test_create_buffer(struct lvp_test_device *dev, VkDeviceSize size,
+                       VkBufferUsageFlags usage, struct lvp_test_buffer *buf)
+{
+   const bool device_address = usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+
+   const VkBufferCreateInfo buffer_info = {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+      .size = size,
+      .usage = usage,
+   };
+   CHECK(CreateBuffer(dev->device, &buffer_info, NULL, &buf->buffer));
+
+   VkMemoryRequirements reqs;
+   GetBufferMemoryRequirements(dev->device, buf->buffer, &reqs);
+
+   const VkMemoryAllocateFlagsInfo flags_info = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+      .flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT,
+   };
+   const VkMemoryAllocateInfo alloc_info = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+      .pNext = device_address ? &flags_info : NULL,
+      .allocationSize = reqs.size,
+      .memoryTypeIndex = dev->memory_type,
+   };
+   CHECK(AllocateMemory(dev->device, &alloc_info, NULL, &buf->memory));
+   CHECK(BindBufferMemory(dev->device, buf->buffer, buf->memory, 0));
+   CHECK(MapMemory(dev->device, buf->memory, 0, VK_WHOLE_SIZE, 0, &buf->map));
+
+   buf->address = 0;
+   if (device_address) {
+      const VkBufferDeviceAddressInfo address_info = {
+         .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+         .buffer = buf->buffer,
+      };
+      buf->address = GetBufferDeviceAddress(dev->device, &address_info);
+   }
+}
+
+void
+lvp_test_destroy_buffer(struct lvp_test_device *dev, struct lvp_test_buffer *buf)
+{
+   DestroyBuffer(dev->device, buf->buffer, NULL);
+   FreeMemory(dev->device, buf->memory, NULL);
+}
+
+VkShaderModule
+lvp_test_create_shader_module(struct lvp_test_device *dev,
+                              const uint32_t *code, size_t size)
+{
+   const VkShaderModuleCreateInfo module_info = {
+      .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+      .codeSize = size,
+      .pCode = code,
+   };
+   VkShaderModule module;
+   CHECK(CreateShaderModule(dev->device, &module_info, NULL, &module));
+   return module;
+}
+
+VkCommandBuffer
+lvp_test_begin_commands(struct lvp_test_device *dev,
+                        VkCommandBufferUsageFlags flags)
+{
+   const VkCommandBufferAllocateInfo alloc_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .commandPool = dev->pool,
+      .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+      .commandBufferCount = 1,
+   };
+   VkCommandBuffer cmd;
+   CHECK(AllocateCommandBuffers(dev->device, &alloc_info, &cmd));
+
+   const VkCommandBufferBeginInfo begin_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+      .flags = flags,
+   };
+   CHECK(BeginCommandBuffer(cmd, &begin_info));
+   return cmd;
+}
+
+double
+lvp_test_submit(struct lvp_test_device *dev, VkCommandBuffer cmd)
+{
+   const VkSubmitInfo submit_info = {
+      .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+      .commandBufferCount = 1,
+      .pCommandBuffers = &cmd,
+   };
+
+   int64_t start = os_time_get_nano();
+   CHECK(QueueSubmit(dev->queue, 1, &submit_info, VK_NULL_HANDLE));
+   CHECK(QueueWaitIdle(dev->queue));
+   return os_time_get_nano() - start;
+}
+
+int
+lvp_test_run_child(const char *path, char *const *args,
+                   const char *var, const char *value,
+                   void *data, size_t size)
+{
+#if DETECT_OS_WINDOWS
+   return -1;
+#else
+   unsigned num_env = 0;
+   while (environ[num_env])
+      num_env++;
+
+   const size_t var_len = strlen(var);
+   char *assignment = malloc(var_len + strlen(value) + 2);
+   char **envp = calloc(num_env + 2, sizeof(*envp));
+   if (!assignment || !envp) {
+      free(assignment);
+      free(envp);
+      return -1;
+   }
+   sprintf(assignment, "%s=%s", var, value);
+
+   unsigned n = 0;
+   for (unsigned i = 0; i < num_env; i++) {
+      if (strncmp(environ[i], var, var_len) || environ[i][var_len] != '=')
+         envp[n++] = environ[i];
+   }
+   envp[n] = assignment;
+
+   int fds[2];
+   if (pipe(fds)) {
+      free(assignment);
+      free(envp);
+      return -1;
+   }
+
+   posix_spawn_file_actions_t actions;
+   posix_spawn_file_actions_init(&actions);
+   posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+   posix_spawn_file_actions_addclose(&actions, fds[0]);
+   posix_spawn_file_actions_addclose(&actions, fds[1]);
+
+   pid_t pid;
+   int ret = posix_spawn(&pid, path, &actions, NULL, args, envp);
+   posix_spawn_file_actions_destroy(&actions);
+   close(fds[1]);
+   free(assignment);
+   free(envp);
+
+   if (ret) {
+      close(fds[0]);
+      return -1;
+   }
+
+   size_t offset = 0;
+   while (offset < size) {
+      ssize_t bytes = read(fds[0], (char *)data + offset, size - offset);
+      if (bytes < 0 && errno == EINTR)
+         continue;
+      if (bytes <= 0)
+         break;
+      offset += bytes;
+   }
+   close(fds[0]);
+
+   int status;
+   while (waitpid(pid, &status, 0) < 0) {
+      if (errno != EINTR)
+         return -1;
+   }
+
+   if (!WIFEXITED(status))
+      return -1;
+   if (WEXITSTATUS(status) == 0 && offset != size)
+      return -1;
+   return WEXITSTATUS(status);
+#endif
+}
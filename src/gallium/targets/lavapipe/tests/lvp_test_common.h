@@ -0,0 +1,207 @@
+/*
+ * Copyright © 2026 Red Hat.
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * @file
+ * Helpers shared by the lavapipe tests, which talk to the driver through
+ * vk_icdGetInstanceProcAddr without a loader.
+ *
+ * The entrypoints the tests use are global function pointers named after
+ * the command without its vk prefix, loaded by lvp_test_init().
+ */
+
+#ifndef LVP_TEST_COMMON_H
+#define LVP_TEST_COMMON_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vulkan/vulkan.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Exit code of a test that can't run here, as meson expects it */
+#define LVP_TEST_SKIP 77
+
+#define LVP_TEST_INSTANCE_FUNCS(X) \
+   X(DestroyInstance) \
+   X(EnumeratePhysicalDevices) \
+   X(GetPhysicalDeviceMemoryProperties) \
+   X(GetPhysicalDeviceProperties2) \
+   X(CreateDevice) \
+   X(GetDeviceProcAddr)
+
+/* Entrypoints of extensions the device doesn't enable stay NULL. */
+#define LVP_TEST_DEVICE_FUNCS(X) \
+   X(DestroyDevice) \
+   X(GetDeviceQueue) \
+   X(CreateBuffer) \
+   X(DestroyBuffer) \
+   X(GetBufferMemoryRequirements) \
+   X(BindBufferMemory) \
+   X(GetBufferDeviceAddress) \
+   X(CreateImage) \
+   X(DestroyImage) \
+   X(GetImageMemoryRequirements) \
+   X(BindImageMemory) \
+   X(GetImageSubresourceLayout) \
+   X(CreateImageView) \
+   X(DestroyImageView) \
+   X(CreateSampler) \
+   X(DestroySampler) \
+   X(AllocateMemory) \
+   X(FreeMemory) \
+   X(MapMemory) \
+   X(CreateCommandPool) \
+   X(DestroyCommandPool) \
+   X(AllocateCommandBuffers) \
+   X(BeginCommandBuffer) \
+   X(EndCommandBuffer) \
+   X(ResetCommandBuffer) \
+   X(QueueSubmit) \
+   X(QueueSubmit2) \
+   X(QueueWaitIdle) \
+   X(CreateSemaphore) \
+   X(DestroySemaphore) \
+   X(SignalSemaphore) \
+   X(WaitSemaphores) \
+   X(GetSemaphoreCounterValue) \
+   X(CreateQueryPool) \
+   X(DestroyQueryPool) \
+   X(GetQueryPoolResults) \
+   X(CreateShaderModule) \
+   X(DestroyShaderModule) \
+   X(CreateDescriptorSetLayout) \
+   X(DestroyDescriptorSetLayout) \
+   X(CreatePipelineLayout) \
+   X(DestroyPipelineLayout) \
+   X(CreateDescriptorPool) \
+   X(DestroyDescriptorPool) \
+   X(AllocateDescriptorSets) \
+   X(UpdateDescriptorSets) \
+   X(CreateGraphicsPipelines) \
+   X(CreateComputePipelines) \
+   X(CreateRayTracingPipelinesKHR) \
+   X(GetRayTracingShaderGroupHandlesKHR) \
+   X(DestroyPipeline) \
+   X(GetAccelerationStructureBuildSizesKHR) \
+   X(CreateAccelerationStructureKHR) \
+   X(DestroyAccelerationStructureKHR) \
+   X(GetAccelerationStructureDeviceAddressKHR) \
+   X(CmdBuildAccelerationStructuresKHR) \
+   X(CmdPipelineBarrier) \
+   X(CmdBeginRendering) \
+   X(CmdEndRendering) \
+   X(CmdBindPipeline) \
+   X(CmdBindDescriptorSets) \
+   X(CmdBindVertexBuffers) \
+   X(CmdBindTransformFeedbackBuffersEXT) \
+   X(CmdBeginTransformFeedbackEXT) \
+   X(CmdEndTransformFeedbackEXT) \
+   X(CmdSetLineWidth) \
+   X(CmdSetScissor) \
+   X(CmdPushConstants) \
+   X(CmdResetQueryPool) \
+   X(CmdBeginQuery) \
+   X(CmdEndQuery) \
+   X(CmdDraw) \
+   X(CmdDispatch) \
+   X(CmdCopyImageToBuffer) \
+   X(CmdTraceRaysKHR)
+
+#define LVP_TEST_DECLARE_FUNC(name) extern PFN_vk##name name;
+LVP_TEST_INSTANCE_FUNCS(LVP_TEST_DECLARE_FUNC)
+LVP_TEST_DEVICE_FUNCS(LVP_TEST_DECLARE_FUNC)
+#undef LVP_TEST_DECLARE_FUNC
+
+#define CHECK(call) \
+   do { \
+      VkResult _result = (call); \
+      if (_result != VK_SUCCESS) { \
+         fprintf(stderr, "%s failed: %d\n", #call, _result); \
+         exit(1); \
+      } \
+   } while (0)
+
+struct lvp_test_device {
+   VkInstance instance;
+   VkPhysicalDevice physical_device;
+   VkDevice device;
+   VkQueue queue;
+   VkCommandPool pool;
+   /* host visible and coherent */
+   uint32_t memory_type;
+};
+
+/**
+ * Create an instance and a device, and load the entrypoints.  device_info
+ * gives the features and extensions, and the queues, which default to one
+ * queue of family 0.  dev->queue is the first queue of family 0, which
+ * device_info must then include.  Exits with LVP_TEST_SKIP if there is no
+ * lavapipe device, or if it lacks the features or extensions.
+ */
+void
+lvp_test_init(struct lvp_test_device *dev, const char *name,
+              const VkDeviceCreateInfo *device_info);
+
+void
+lvp_test_finish(struct lvp_test_device *dev);
+
+struct lvp_test_buffer {
+   VkBuffer buffer;
+   VkDeviceMemory memory;
+   /* only if usage has VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT */
+   VkDeviceAddress address;
+   void *map;
+};
+
+void
+lvp_test_create_buffer(struct lvp_test_device *dev, VkDeviceSize size,
+                       VkBufferUsageFlags usage, struct lvp_test_buffer *buf);
+
+void
+lvp_test_destroy_buffer(struct lvp_test_device *dev, struct lvp_test_buffer *buf);
+
+VkShaderModule
+lvp_test_create_shader_module(struct lvp_test_device *dev,
+                              const uint32_t *code, size_t size);
+
+/**
+ * Allocate a primary command buffer from dev->pool and begin it.
+ */
+VkCommandBuffer
+lvp_test_begin_commands(struct lvp_test_device *dev,
+                        VkCommandBufferUsageFlags flags);
+
+/**
+ * Submit cmd, wait for the queue to be idle and return the time that took
+ * in ns.
+ */
+double
+lvp_test_submit(struct lvp_test_device *dev, VkCommandBuffer cmd);
+
+/**
+ * Run the executable at path with the NULL terminated argument list args,
+ * which starts with argv[0], and with var=value added to its environment,
+ * and read size bytes of its stdout into data.  Use it to test
+ * options the driver reads from the environment: changing the environment
+ * of this process would race with the threads of the driver.
+ *
+ * Returns the exit code of the child, or -1 if it could not be run, was
+ * killed, or exited successfully without writing size bytes.
+ */
+int
+lvp_test_run_child(const char *path, char *const *args,
+                   const char *var, const char *value,
+                   void *data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LVP_TEST_COMMON_H */
@@ -0,0 +1,458 @@
+/*
+ * Copyright © 2026 Red Hat.
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * @file
+ * Stress test for sampling on several queues at once.
+ *
+ * The texture handles of lavapipe are created on the context of the
+ * graphics queue and used by every queue, and llvmpipe compiles their
+ * sample functions on demand.  Each round creates new textures and
+ * samplers, so that new functions get compiled, and samples them with
+ * compute dispatches submitted concurrently on the graphics queue and on
+ * every compute queue, one thread per queue.  The functions are moved into
+ * the handles between submits, which must not pull them from under the
+ * other queues: every queue must keep reading the right texels.
+ *
+ * Usage: lvp_test_multi_queue [rounds [submits]]
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "lvp_test_common.h"
+
+#include "c11/threads.h"
+#include "util/macros.h"
+
+static const uint32_t cs_spirv[] = {
+#include "lvp_test_multi_queue.comp.spv.h"
+};
+
+#define NUM_TEXTURES       8
+#define TEXTURE_SIZE       8
+#define NUM_INVOCATIONS    64
+#define COMPUTE_FAMILY     1
+#define NUM_COMPUTE_QUEUES 4
+
+struct queue_thread {
+   thrd_t thread;
+   VkQueue queue;
+   VkCommandBuffer cmd;
+   unsigned submits;
+};
+
+static int
+queue_thread_main(void *data)
+{
+   struct queue_thread *t = data;
+
+   const VkSubmitInfo submit_info = {
+      .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+      .commandBufferCount = 1,
+      .pCommandBuffers = &t->cmd,
+   };
+   for (unsigned i = 0; i < t->submits; i++) {
+      CHECK(QueueSubmit(t->queue, 1, &submit_info, VK_NULL_HANDLE));
+      CHECK(QueueWaitIdle(t->queue));
+   }
+
+   return 0;
+}
+
+/* Every texel of texture t in round r has this RGBA8 color. */
+static uint8_t
+texture_component(unsigned r, unsigned t, unsigned c)
+{
+   return (r * 37 + t * 29 + c * 61) & 0xff;
+}
+
+struct round_objects {
+   VkImage images[NUM_TEXTURES];
+   VkDeviceMemory memories[NUM_TEXTURES];
+   VkImageView views[NUM_TEXTURES];
+   VkSampler samplers[NUM_TEXTURES];
+   VkDescriptorPool pool;
+   VkDescriptorSet set;
+};
+
+static void
+create_textures(struct lvp_test_device *dev, unsigned r,
+                struct round_objects *objs)
+{
+   VkDevice device = dev->device;
+
+   const uint32_t families[] = { 0, COMPUTE_FAMILY };
+   const VkImageCreateInfo image_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+      .imageType = VK_IMAGE_TYPE_2D,
+      .format = VK_FORMAT_R8G8B8A8_UNORM,
+      .extent = { TEXTURE_SIZE, TEXTURE_SIZE, 1 },
+      .mipLevels = 1,
+      .arrayLayers = 1,
+      .samples = VK_SAMPLE_COUNT_1_BIT,
+      .tiling = VK_IMAGE_TILING_LINEAR,
+      .usage = VK_IMAGE_USAGE_SAMPLED_BIT,
+      .sharingMode = VK_SHARING_MODE_CONCURRENT,
+      .queueFamilyIndexCount = ARRAY_SIZE(families),
+      .pQueueFamilyIndices = families,
+      .initialLayout = VK_IMAGE_LAYOUT_PREINITIALIZED,
+   };
+   /* A different filter and wrap mode for each texture */
+   static const VkSamplerAddressMode address_modes[] = {
+      VK_SAMPLER_ADDRESS_MODE_REPEAT,
+      VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT,
+      VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+      VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER,
+   };
+
+   for (unsigned t = 0; t < NUM_TEXTURES; t++) {
+      CHECK(CreateImage(device, &image_info, NULL, &objs->images[t]));
+
+      VkMemoryRequirements reqs;
+      GetImageMemoryRequirements(device, objs->images[t], &reqs);
+      const VkMemoryAllocateInfo alloc_info = {
+         .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+         .allocationSize = reqs.size,
+         .memoryTypeIndex = dev->memory_type,
+      };
+      CHECK(AllocateMemory(device, &alloc_info, NULL, &objs->memories[t]));
+      CHECK(BindImageMemory(device, objs->images[t], objs->memories[t], 0));
+
+      const VkImageSubresource subresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0 };
+      VkSubresourceLayout layout;
+      GetImageSubresourceLayout(device, objs->images[t], &subresource, &layout);
+
+      uint8_t *map;
+      CHECK(MapMemory(device, objs->memories[t], 0, VK_WHOLE_SIZE, 0, (void **)&map));
+      for (unsigned y = 0; y < TEXTURE_SIZE; y++) {
+         uint8_t *row = map + layout.offset + y * layout.rowPitch;
+         for (unsigned x = 0; x < TEXTURE_SIZE * 4; x++)
+            row[x] = texture_component(r, t, x % 4);
+      }
+
+      const VkImageViewCreateInfo view_info = {
+         .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+         .image = objs->images[t],
+         .viewType = VK_IMAGE_VIEW_TYPE_2D,
+         .format = VK_FORMAT_R8G8B8A8_UNORM,
+         .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+      };
+      CHECK(CreateImageView(device, &view_info, NULL, &objs->views[t]));
+
+      const VkFilter filter = t & 1 ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+      const VkSamplerAddressMode address_mode = address_modes[t / 2];
+      const VkSamplerCreateInfo sampler_info = {
+         .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+         .magFilter = filter,
+         .minFilter = filter,
+         .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+         .addressModeU = address_mode,
+         .addressModeV = address_mode,
+         .addressModeW = address_mode,
+         .borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK,
+      };
+      CHECK(CreateSampler(device, &sampler_info, NULL, &objs->samplers[t]));
+   }
+}
+
+static void
+destroy_textures(VkDevice device, struct round_objects *objs)
+{
+   DestroyDescriptorPool(device, objs->pool, NULL);
+   for (unsigned t = 0; t < NUM_TEXTURES; t++) {
+      DestroySampler(device, objs->samplers[t], NULL);
+      DestroyImageView(device, objs->views[t], NULL);
+      DestroyImage(device, objs->images[t], NULL);
+      FreeMemory(device, objs->memories[t], NULL);
+   }
+}
+
+static void
+record(VkCommandBuffer cmd, VkPipeline pipeline, VkPipelineLayout layout,
+       const struct round_objects *objs, unsigned queue_index)
+{
+   const VkCommandBufferBeginInfo begin_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+   };
+   CHECK(ResetCommandBuffer(cmd, 0));
+   CHECK(BeginCommandBuffer(cmd, &begin_info));
+
+   CmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+   CmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, 1,
+                         &objs->set, 0, NULL);
+   for (unsigned t = 0; t < NUM_TEXTURES; t++) {
+      const uint32_t constants[2] = {
+         t, (queue_index * NUM_TEXTURES + t) * NUM_INVOCATIONS,
+      };
+      CmdPushConstants(cmd, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       sizeof(constants), constants);
+      CmdDispatch(cmd, 1, 1, 1);
+   }
+
+   CHECK(EndCommandBuffer(cmd));
+}
+
+static bool
+check_colors(const float *colors, unsigned r, unsigned num_queues)
+{
+   for (unsigned q = 0; q < num_queues; q++) {
+      for (unsigned t = 0; t < NUM_TEXTURES; t++) {
+         for (unsigned i = 0; i < NUM_INVOCATIONS; i++) {
+            const float *color =
+               &colors[((q * NUM_TEXTURES + t) * NUM_INVOCATIONS + i) * 4];
+            for (unsigned c = 0; c < 4; c++) {
+               /* texture, textureLod and texelFetch, plus the gather in red */
+               float expected = (c ? 3.0f : 4.0f) *
+                                texture_component(r, t, c) / 255.0f;
+               if (fabsf(color[c] - expected) > 0.01f) {
+                  fprintf(stderr, "round %u, queue %u, texture %u, "
+                          "invocation %u: component %u is %f, expected %f\n",
+                          r, q, t, i, c, color[c], expected);
+                  return false;
+               }
+            }
+         }
+      }
+   }
+   return true;
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned num_rounds = argc > 1 ? atoi(argv[1]) : 16;
+   unsigned num_submits = argc > 2 ? atoi(argv[2]) : 8;
+
+   /* The graphics family, and the compute family of lavapipe */
+   const float priorities[1 + NUM_COMPUTE_QUEUES] = { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+   const VkDeviceQueueCreateInfo queue_infos[2] = {
+      {
+         .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+         .queueFamilyIndex = 0,
+         .queueCount = 1,
+         .pQueuePriorities = priorities,
+      },
+      {
+         .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+         .queueFamilyIndex = COMPUTE_FAMILY,
+         .queueCount = NUM_COMPUTE_QUEUES,
+         .pQueuePriorities = priorities,
+      },
+   };
+   const VkPhysicalDeviceFeatures features = {
+      .shaderSampledImageArrayDynamicIndexing = VK_TRUE,
+   };
+   const VkDeviceCreateInfo device_info = {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+      .queueCreateInfoCount = ARRAY_SIZE(queue_infos),
+      .pQueueCreateInfos = queue_infos,
+      .pEnabledFeatures = &features,
+   };
+   struct lvp_test_device dev;
+   lvp_test_init(&dev, "lvp_test_multi_queue", &device_info);
+   VkDevice device = dev.device;
+
+   const unsigned num_queues = 1 + NUM_COMPUTE_QUEUES;
+   struct queue_thread threads[1 + NUM_COMPUTE_QUEUES];
+   VkCommandPool pools[2];
+   for (unsigned f = 0; f < 2; f++) {
+      const VkCommandPoolCreateInfo pool_info = {
+         .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+         .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+         .queueFamilyIndex = queue_infos[f].queueFamilyIndex,
+      };
+      CHECK(CreateCommandPool(device, &pool_info, NULL, &pools[f]));
+   }
+   for (unsigned q = 0; q < num_queues; q++) {
+      const unsigned f = q ? 1 : 0;
+      GetDeviceQueue(device, queue_infos[f].queueFamilyIndex, q ? q - 1 : 0,
+                     &threads[q].queue);
+
+      const VkCommandBufferAllocateInfo alloc_info = {
+         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+         .commandPool = pools[f],
+         .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+         .commandBufferCount = 1,
+      };
+      CHECK(AllocateCommandBuffers(device, &alloc_info, &threads[q].cmd));
+      threads[q].submits = num_submits;
+   }
+
+   const VkDeviceSize colors_size =
+      (VkDeviceSize)num_queues * NUM_TEXTURES * NUM_INVOCATIONS * 4 * sizeof(float);
+   struct lvp_test_buffer colors;
+   lvp_test_create_buffer(&dev, colors_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                          &colors);
+
+   const VkDescriptorSetLayoutBinding bindings[] = {
+      {
+         .binding = 0,
+         .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+         .descriptorCount = NUM_TEXTURES,
+         .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+      },
+      {
+         .binding = 1,
+         .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+         .descriptorCount = 1,
+         .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+      },
+   };
+   const VkDescriptorSetLayoutCreateInfo set_layout_info = {
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+      .bindingCount = ARRAY_SIZE(bindings),
+      .pBindings = bindings,
+   };
+   VkDescriptorSetLayout set_layout;
+   CHECK(CreateDescriptorSetLayout(device, &set_layout_info, NULL, &set_layout));
+
+   const VkPushConstantRange push_range = {
+      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+      .size = 8,
+   };
+   const VkPipelineLayoutCreateInfo layout_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+      .setLayoutCount = 1,
+      .pSetLayouts = &set_layout,
+      .pushConstantRangeCount = 1,
+      .pPushConstantRanges = &push_range,
+   };
+   VkPipelineLayout layout;
+   CHECK(CreatePipelineLayout(device, &layout_info, NULL, &layout));
+
+   VkShaderModule module = lvp_test_create_shader_module(&dev, cs_spirv, sizeof(cs_spirv));
+   const VkComputePipelineCreateInfo pipeline_info = {
+      .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+      .stage = {
+         .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+         .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+         .module = module,
+         .pName = "main",
+      },
+      .layout = layout,
+   };
+   VkPipeline pipeline;
+   CHECK(CreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipeline_info,
+                                NULL, &pipeline));
+
+   int ret = 0;
+   for (unsigned r = 0; r < num_rounds && !ret; r++) {
+      struct round_objects objs;
+      create_textures(&dev, r, &objs);
+
+      const VkDescriptorPoolSize pool_sizes[] = {
+         { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, NUM_TEXTURES },
+         { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 },
+      };
+      const VkDescriptorPoolCreateInfo pool_info = {
+         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+         .maxSets = 1,
+         .poolSizeCount = ARRAY_SIZE(pool_sizes),
+         .pPoolSizes = pool_sizes,
+      };
+      CHECK(CreateDescriptorPool(device, &pool_info, NULL, &objs.pool));
+      const VkDescriptorSetAllocateInfo set_info = {
+         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+         .descriptorPool = objs.pool,
+         .descriptorSetCount = 1,
+         .pSetLayouts = &set_layout,
+      };
+      CHECK(AllocateDescriptorSets(device, &set_info, &objs.set));
+
+      VkDescriptorImageInfo image_infos[NUM_TEXTURES];
+      for (unsigned t = 0; t < NUM_TEXTURES; t++) {
+         image_infos[t] = (VkDescriptorImageInfo) {
+            .sampler = objs.samplers[t],
+            .imageView = objs.views[t],
+            .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+         };
+      }
+      const VkDescriptorBufferInfo buffer_info = {
+         .buffer = colors.buffer,
+         .range = VK_WHOLE_SIZE,
+      };
+      const VkWriteDescriptorSet writes[] = {
+         {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = objs.set,
+            .dstBinding = 0,
+            .descriptorCount = NUM_TEXTURES,
+            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .pImageInfo = image_infos,
+         },
+         {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = objs.set,
+            .dstBinding = 1,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pBufferInfo = &buffer_info,
+         },
+      };
+      UpdateDescriptorSets(device, ARRAY_SIZE(writes), writes, 0, NULL);
+
+      /* Move the textures out of the preinitialized layout. */
+      VkImageMemoryBarrier barriers[NUM_TEXTURES];
+      for (unsigned t = 0; t < NUM_TEXTURES; t++) {
+         barriers[t] = (VkImageMemoryBarrier) {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_HOST_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_PREINITIALIZED,
+            .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = objs.images[t],
+            .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+         };
+      }
+      VkCommandBuffer cmd = threads[0].cmd;
+      const VkCommandBufferBeginInfo begin_info = {
+         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+      };
+      CHECK(ResetCommandBuffer(cmd, 0));
+      CHECK(BeginCommandBuffer(cmd, &begin_info));
+      CmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_HOST_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                         0, NULL, 0, NULL, NUM_TEXTURES, barriers);
+      CHECK(EndCommandBuffer(cmd));
+      lvp_test_submit(&dev, cmd);
+
+      for (unsigned q = 0; q < num_queues; q++)
+         record(threads[q].cmd, pipeline, layout, &objs, q);
+
+      memset(colors.map, 0, colors_size);
+      for (unsigned q = 0; q < num_queues; q++) {
+         if (thrd_create(&threads[q].thread, queue_thread_main, &threads[q]) != thrd_success) {
+            fprintf(stderr, "couldn't create a queue thread\n");
+            return 1;
+         }
+      }
+      for (unsigned q = 0; q < num_queues; q++)
+         thrd_join(threads[q].thread, NULL);
+
+      if (!check_colors(colors.map, r, num_queues))
+         ret = 1;
+
+      destroy_textures(device, &objs);
+   }
+   if (ret)
+      return ret;
+
+   printf("%u rounds of %u submits on %u queues\n", num_rounds, num_submits,
+          num_queues);
+
+   DestroyPipeline(device, pipeline, NULL);
+   DestroyShaderModule(device, module, NULL);
+   DestroyPipelineLayout(device, layout, NULL);
+   DestroyDescriptorSetLayout(device, set_layout, NULL);
+   lvp_test_destroy_buffer(&dev, &colors);
+   for (unsigned f = 0; f < 2; f++)
+      DestroyCommandPool(device, pools[f], NULL);
+   lvp_test_finish(&dev);
+
+   return 0;
+}
@@ -0,0 +1,556 @@
+/*
+ * Copyright © 2026 Red Hat.
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * @file
+ * Path tracing benchmark for lavapipe ray tracing pipelines.
+ *
+ * A camera looks at a terrain made of 16 instances of a heightfield tile.
+ * Every pixel traces a primary ray and a bounce ray into a pseudo-random
+ * direction from the hit point.  The scene is rendered with the default
+ * traversal and with packet traversal, the rays per second of both are
+ * printed, and the hit distances of both must match exactly.
+ *
+ * lavapipe picks the traversal from LVP_RT_PACKETS when the device is
+ * created, so each one renders in a child process started with
+ * "--render size iterations", which writes the frame time and the hit
+ * distances to stdout.
+ *
+ * Usage: lvp_test_rt_packets [size [iterations]]
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include "lvp_test_common.h"
+
+#include "util/detect_os.h"
+#include "util/macros.h"
+
+/* quads along each side of a terrain tile, and tiles along each side */
+#define TILE_QUADS  64
+#define TILE_COUNT  4
+#define TILE_TRIANGLES (TILE_QUADS * TILE_QUADS * 2)
+
+static const uint32_t rgen_spirv[] = {
+#include "lvp_test_rt_packets.rgen.spv.h"
+};
+
+static const uint32_t miss_spirv[] = {
+#include "lvp_test_rt_packets.rmiss.spv.h"
+};
+
+static const uint32_t chit_spirv[] = {
+#include "lvp_test_rt_packets.rchit.spv.h"
+};
+
+static float
+terrain_height(uint32_t x, uint32_t z)
+{
+   return 2.0f + 1.5f * sinf(x * 0.35f) * cosf(z * 0.25f) + 0.5f * sinf(x * 1.7f + z * 2.3f);
+}
+
+struct acceleration_structure {
+   struct lvp_test_buffer buffer;
+   VkAccelerationStructureKHR as;
+};
+
+static void
+create_acceleration_structure(struct lvp_test_device *dev, VkCommandBuffer cmd,
+                              VkAccelerationStructureBuildGeometryInfoKHR *build_info,
+                              uint32_t primitive_count, struct lvp_test_buffer *scratch,
+                              struct acceleration_structure *out)
+{
+   VkAccelerationStructureBuildSizesInfoKHR sizes = {
+      .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR,
+   };
+   GetAccelerationStructureBuildSizesKHR(dev->device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
+                                         build_info, &primitive_count, &sizes);
+
+   lvp_test_create_buffer(dev, sizes.accelerationStructureSize,
+                          VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR |
+                          VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                          &out->buffer);
+   lvp_test_create_buffer(dev, sizes.buildScratchSize,
+                          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                          VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                          scratch);
+
+   const VkAccelerationStructureCreateInfoKHR as_info = {
+      .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
+      .buffer = out->buffer.buffer,
+      .size = sizes.accelerationStructureSize,
+      .type = build_info->type,
+   };
+   CHECK(CreateAccelerationStructureKHR(dev->device, &as_info, NULL, &out->as));
+
+   build_info->dstAccelerationStructure = out->as;
+   build_info->scratchData.deviceAddress = scratch->address;
+
+   const VkAccelerationStructureBuildRangeInfoKHR range = {
+      .primitiveCount = primitive_count,
+   };
+   const VkAccelerationStructureBuildRangeInfoKHR *ranges = &range;
+   CmdBuildAccelerationStructuresKHR(cmd, 1, build_info, &ranges);
+
+   const VkMemoryBarrier barrier = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+      .dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR,
+   };
+   CmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                      VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR |
+                      VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+                      0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+static void
+destroy_acceleration_structure(struct lvp_test_device *dev, struct acceleration_structure *as)
+{
+   DestroyAccelerationStructureKHR(dev->device, as->as, NULL);
+   lvp_test_destroy_buffer(dev, &as->buffer);
+}
+
+/* Builds the terrain: one bottom level acceleration structure for a tile and
+ * a top level acceleration structure with TILE_COUNT x TILE_COUNT instances.
+ */
+static void
+build_scene(struct lvp_test_device *dev, struct acceleration_structure *blas,
+            struct acceleration_structure *tlas)
+{
+   struct lvp_test_buffer vertex_buffer, instance_buffer, blas_scratch, tlas_scratch;
+   lvp_test_create_buffer(dev, TILE_TRIANGLES * 9 * sizeof(float),
+                          VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR |
+                          VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                          &vertex_buffer);
+
+   float *vertices = vertex_buffer.map;
+   for (uint32_t z = 0; z < TILE_QUADS; z++) {
+      for (uint32_t x = 0; x < TILE_QUADS; x++) {
+         const uint32_t corners[6][2] = {
+            { x, z }, { x + 1, z }, { x, z + 1 },
+            { x + 1, z }, { x + 1, z + 1 }, { x, z + 1 },
+         };
+         for (unsigned v = 0; v < 6; v++) {
+            *vertices++ = corners[v][0];
+            *vertices++ = terrain_height(corners[v][0], corners[v][1]);
+            *vertices++ = corners[v][1];
+         }
+      }
+   }
+
+   VkCommandBuffer cmd = lvp_test_begin_commands(dev, 0);
+
+   VkAccelerationStructureGeometryKHR geometry = {
+      .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+      .geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR,
+      .geometry.triangles = {
+         .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR,
+         .vertexFormat = VK_FORMAT_R32G32B32_SFLOAT,
+         .vertexData.deviceAddress = vertex_buffer.address,
+         .vertexStride = 3 * sizeof(float),
+         .maxVertex = TILE_TRIANGLES * 3 - 1,
+         .indexType = VK_INDEX_TYPE_NONE_KHR,
+      },
+      .flags = VK_GEOMETRY_OPAQUE_BIT_KHR,
+   };
+   VkAccelerationStructureBuildGeometryInfoKHR build_info = {
+      .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+      .type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+      .flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR,
+      .mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+      .geometryCount = 1,
+      .pGeometries = &geometry,
+   };
+   create_acceleration_structure(dev, cmd, &build_info, TILE_TRIANGLES, &blas_scratch, blas);
+
+   const VkAccelerationStructureDeviceAddressInfoKHR address_info = {
+      .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR,
+      .accelerationStructure = blas->as,
+   };
+   VkDeviceAddress blas_address = GetAccelerationStructureDeviceAddressKHR(dev->device, &address_info);
+
+   lvp_test_create_buffer(dev, TILE_COUNT * TILE_COUNT * sizeof(VkAccelerationStructureInstanceKHR),
+                          VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR |
+                          VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                          &instance_buffer);
+
+   VkAccelerationStructureInstanceKHR *instances = instance_buffer.map;
+   for (uint32_t i = 0; i < TILE_COUNT * TILE_COUNT; i++) {
+      instances[i] = (VkAccelerationStructureInstanceKHR) {
+         .transform.matrix = {
+            { 1.0f, 0.0f, 0.0f, (float)(i % TILE_COUNT * TILE_QUADS) },
+            { 0.0f, 1.0f, 0.0f, 0.0f },
+            { 0.0f, 0.0f, 1.0f, (float)(i / TILE_COUNT * TILE_QUADS) },
+         },
+         .instanceCustomIndex = i,
+         .mask = 0xff,
+         .accelerationStructureReference = blas_address,
+      };
+   }
+
+   geometry = (VkAccelerationStructureGeometryKHR) {
+      .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+      .geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR,
+      .geometry.instances = {
+         .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR,
+         .data.deviceAddress = instance_buffer.address,
+      },
+   };
+   build_info.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+   create_acceleration_structure(dev, cmd, &build_info, TILE_COUNT * TILE_COUNT, &tlas_scratch, tlas);
+
+   CHECK(EndCommandBuffer(cmd));
+   lvp_test_submit(dev, cmd);
+
+   lvp_test_destroy_buffer(dev, &tlas_scratch);
+   lvp_test_destroy_buffer(dev, &instance_buffer);
+   lvp_test_destroy_buffer(dev, &blas_scratch);
+   lvp_test_destroy_buffer(dev, &vertex_buffer);
+}
+
+/* Renders size x size pixels num_iterations times, stores the hit distances of
+ * the last frame in result and returns the average frame time in ns.
+ */
+static double
+run(struct lvp_test_device *dev, uint32_t size, unsigned num_iterations, float *result)
+{
+   struct acceleration_structure blas, tlas;
+   build_scene(dev, &blas, &tlas);
+
+   size_t result_size = (size_t)size * size * 2 * sizeof(float);
+   struct lvp_test_buffer result_buffer;
+   lvp_test_create_buffer(dev, result_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &result_buffer);
+
+   const VkDescriptorSetLayoutBinding bindings[] = {
+      {
+         .binding = 0,
+         .descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR,
+         .descriptorCount = 1,
+         .stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR,
+      },
+      {
+         .binding = 1,
+         .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+         .descriptorCount = 1,
+         .stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR,
+      },
+   };
+   const VkDescriptorSetLayoutCreateInfo set_layout_info = {
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+      .bindingCount = ARRAY_SIZE(bindings),
+      .pBindings = bindings,
+   };
+   VkDescriptorSetLayout set_layout;
+   CHECK(CreateDescriptorSetLayout(dev->device, &set_layout_info, NULL, &set_layout));
+
+   const VkPipelineLayoutCreateInfo layout_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+      .setLayoutCount = 1,
+      .pSetLayouts = &set_layout,
+   };
+   VkPipelineLayout layout;
+   CHECK(CreatePipelineLayout(dev->device, &layout_info, NULL, &layout));
+
+   const VkDescriptorPoolSize pool_sizes[] = {
+      { VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1 },
+      { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 },
+   };
+   const VkDescriptorPoolCreateInfo pool_info = {
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+      .maxSets = 1,
+      .poolSizeCount = ARRAY_SIZE(pool_sizes),
+      .pPoolSizes = pool_sizes,
+   };
+   VkDescriptorPool descriptor_pool;
+   CHECK(CreateDescriptorPool(dev->device, &pool_info, NULL, &descriptor_pool));
+
+   const VkDescriptorSetAllocateInfo set_info = {
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+      .descriptorPool = descriptor_pool,
+      .descriptorSetCount = 1,
+      .pSetLayouts = &set_layout,
+   };
+   VkDescriptorSet set;
+   CHECK(AllocateDescriptorSets(dev->device, &set_info, &set));
+
+   const VkWriteDescriptorSetAccelerationStructureKHR as_write = {
+      .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR,
+      .accelerationStructureCount = 1,
+      .pAccelerationStructures = &tlas.as,
+   };
+   const VkDescriptorBufferInfo buffer_write = {
+      .buffer = result_buffer.buffer,
+      .range = VK_WHOLE_SIZE,
+   };
+   const VkWriteDescriptorSet writes[] = {
+      {
+         .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+         .pNext = &as_write,
+         .dstSet = set,
+         .dstBinding = 0,
+         .descriptorCount = 1,
+         .descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR,
+      },
+      {
+         .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+         .dstSet = set,
+         .dstBinding = 1,
+         .descriptorCount = 1,
+         .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+         .pBufferInfo = &buffer_write,
+      },
+   };
+   UpdateDescriptorSets(dev->device, ARRAY_SIZE(writes), writes, 0, NULL);
+
+   VkShaderModule modules[] = {
+      lvp_test_create_shader_module(dev, rgen_spirv, sizeof(rgen_spirv)),
+      lvp_test_create_shader_module(dev, miss_spirv, sizeof(miss_spirv)),
+      lvp_test_create_shader_module(dev, chit_spirv, sizeof(chit_spirv)),
+   };
+   const VkShaderStageFlagBits stage_flags[] = {
+      VK_SHADER_STAGE_RAYGEN_BIT_KHR,
+      VK_SHADER_STAGE_MISS_BIT_KHR,
+      VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR,
+   };
+   VkPipelineShaderStageCreateInfo stages[ARRAY_SIZE(modules)];
+   for (unsigned i = 0; i < ARRAY_SIZE(modules); i++) {
+      stages[i] = (VkPipelineShaderStageCreateInfo) {
+         .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+         .stage = stage_flags[i],
+         .module = modules[i],
+         .pName = "main",
+      };
+   }
+   const VkRayTracingShaderGroupCreateInfoKHR groups[] = {
+      {
+         .sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR,
+         .type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR,
+         .generalShader = 0,
+         .closestHitShader = VK_SHADER_UNUSED_KHR,
+         .anyHitShader = VK_SHADER_UNUSED_KHR,
+         .intersectionShader = VK_SHADER_UNUSED_KHR,
+      },
+      {
+         .sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR,
+         .type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR,
+         .generalShader = 1,
+         .closestHitShader = VK_SHADER_UNUSED_KHR,
+         .anyHitShader = VK_SHADER_UNUSED_KHR,
+         .intersectionShader = VK_SHADER_UNUSED_KHR,
+      },
+      {
+         .sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR,
+         .type = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR,
+         .generalShader = VK_SHADER_UNUSED_KHR,
+         .closestHitShader = 2,
+         .anyHitShader = VK_SHADER_UNUSED_KHR,
+         .intersectionShader = VK_SHADER_UNUSED_KHR,
+      },
+   };
+   const VkRayTracingPipelineCreateInfoKHR pipeline_info = {
+      .sType = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR,
+      .stageCount = ARRAY_SIZE(stages),
+      .pStages = stages,
+      .groupCount = ARRAY_SIZE(groups),
+      .pGroups = groups,
+      .maxPipelineRayRecursionDepth = 1,
+      .layout = layout,
+   };
+   VkPipeline pipeline;
+   CHECK(CreateRayTracingPipelinesKHR(dev->device, VK_NULL_HANDLE, VK_NULL_HANDLE, 1,
+                                      &pipeline_info, NULL, &pipeline));
+
+   /* one shader binding table region per group */
+   VkPhysicalDeviceRayTracingPipelinePropertiesKHR rt_props = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR,
+   };
+   VkPhysicalDeviceProperties2 props = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+      .pNext = &rt_props,
+   };
+   GetPhysicalDeviceProperties2(dev->physical_device, &props);
+
+   uint32_t handle_size = rt_props.shaderGroupHandleSize;
+   uint32_t region_size = ALIGN_POT(ALIGN_POT(handle_size, rt_props.shaderGroupHandleAlignment),
+                                    rt_props.shaderGroupBaseAlignment);
+   uint8_t handles[ARRAY_SIZE(groups) * 64];
+   assert(handle_size <= 64);
+   CHECK(GetRayTracingShaderGroupHandlesKHR(dev->device, pipeline, 0, ARRAY_SIZE(groups),
+                                            ARRAY_SIZE(groups) * handle_size, handles));
+
+   struct lvp_test_buffer sbt_buffer;
+   lvp_test_create_buffer(dev, ARRAY_SIZE(groups) * region_size,
+                          VK_BUFFER_USAGE_SHADER_BINDING_TABLE_BIT_KHR |
+                          VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                          &sbt_buffer);
+
+   VkStridedDeviceAddressRegionKHR regions[ARRAY_SIZE(groups)];
+   for (unsigned i = 0; i < ARRAY_SIZE(groups); i++) {
+      memcpy((uint8_t *)sbt_buffer.map + i * region_size, handles + i * handle_size, handle_size);
+      regions[i] = (VkStridedDeviceAddressRegionKHR) {
+         .deviceAddress = sbt_buffer.address + i * region_size,
+         .stride = region_size,
+         .size = region_size,
+      };
+   }
+   const VkStridedDeviceAddressRegionKHR callable_region = { 0 };
+
+   VkCommandBuffer cmd = lvp_test_begin_commands(dev, 0);
+   CmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, pipeline);
+   CmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, layout, 0, 1, &set, 0, NULL);
+   CmdTraceRaysKHR(cmd, &regions[0], &regions[1], &regions[2], &callable_region, size, size, 1);
+   CHECK(EndCommandBuffer(cmd));
+
+   /* warm up the shader variant before timing anything */
+   lvp_test_submit(dev, cmd);
+
+   double time = 0.0;
+   for (unsigned i = 0; i < num_iterations; i++)
+      time += lvp_test_submit(dev, cmd);
+
+   memcpy(result, result_buffer.map, result_size);
+
+   lvp_test_destroy_buffer(dev, &sbt_buffer);
+   DestroyPipeline(dev->device, pipeline, NULL);
+   for (unsigned i = 0; i < ARRAY_SIZE(modules); i++)
+      DestroyShaderModule(dev->device, modules[i], NULL);
+   DestroyDescriptorPool(dev->device, descriptor_pool, NULL);
+   DestroyPipelineLayout(dev->device, layout, NULL);
+   DestroyDescriptorSetLayout(dev->device, set_layout, NULL);
+   lvp_test_destroy_buffer(dev, &result_buffer);
+   destroy_acceleration_structure(dev, &tlas);
+   destroy_acceleration_structure(dev, &blas);
+
+   return time / num_iterations;
+}
+
+/* Renders with the traversal LVP_RT_PACKETS selects, and writes the frame
+ * time followed by the hit distances to stdout.
+ */
+static int
+render(uint32_t size, unsigned num_iterations)
+{
+   VkPhysicalDeviceRayTracingPipelineFeaturesKHR rt_features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_FEATURES_KHR,
+      .rayTracingPipeline = VK_TRUE,
+   };
+   VkPhysicalDeviceAccelerationStructureFeaturesKHR as_features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR,
+      .pNext = &rt_features,
+      .accelerationStructure = VK_TRUE,
+   };
+   VkPhysicalDeviceVulkan12Features features12 = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+      .pNext = &as_features,
+      .bufferDeviceAddress = VK_TRUE,
+   };
+   const char *extensions[] = {
+      VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME,
+      VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME,
+      VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME,
+   };
+   const VkDeviceCreateInfo device_info = {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+      .pNext = &features12,
+      .enabledExtensionCount = ARRAY_SIZE(extensions),
+      .ppEnabledExtensionNames = extensions,
+   };
+   struct lvp_test_device dev;
+   lvp_test_init(&dev, "lvp_test_rt_packets", &device_info);
+
+   size_t num_values = (size_t)size * size * 2;
+   float *result = malloc(num_values * sizeof(float));
+   double time = run(&dev, size, num_iterations, result);
+   lvp_test_finish(&dev);
+
+   bool written = fwrite(&time, sizeof(time), 1, stdout) == 1 &&
+                  fwrite(result, sizeof(float), num_values, stdout) == num_values;
+   free(result);
+   return written ? 0 : 1;
+}
+
+/* Runs a child rendering with LVP_RT_PACKETS=packets.  Returns the average
+ * frame time in ns, or exits if the child failed.
+ */
+static double
+run_child(const char *path, const char *packets, uint32_t size,
+          unsigned num_iterations, float *result)
+{
+   char size_arg[16], iterations_arg[16];
+   snprintf(size_arg, sizeof(size_arg), "%u", size);
+   snprintf(iterations_arg, sizeof(iterations_arg), "%u", num_iterations);
+   char *const args[] = {
+      (char *)path, "--render", size_arg, iterations_arg, NULL,
+   };
+
+   size_t num_values = (size_t)size * size * 2;
+   size_t output_size = sizeof(double) + num_values * sizeof(float);
+   uint8_t *output = malloc(output_size);
+
+   int ret = lvp_test_run_child(path, args, "LVP_RT_PACKETS", packets,
+                                output, output_size);
+   if (ret) {
+      fprintf(stderr, "rendering with LVP_RT_PACKETS=%s failed: %d\n",
+              packets, ret);
+      exit(ret == LVP_TEST_SKIP ? LVP_TEST_SKIP : 1);
+   }
+
+   double time;
+   memcpy(&time, output, sizeof(time));
+   memcpy(result, output + sizeof(time), num_values * sizeof(float));
+   free(output);
+   return time;
+}
+
+int
+main(int argc, char **argv)
+{
+   if (argc == 4 && !strcmp(argv[1], "--render"))
+      return render(atoi(argv[2]), atoi(argv[3]));
+
+#if DETECT_OS_WINDOWS
+   fprintf(stderr, "can't run the renders in child processes here\n");
+   return LVP_TEST_SKIP;
+#endif
+
+   uint32_t size = argc > 1 ? atoi(argv[1]) : 512;
+   unsigned num_iterations = argc > 2 ? atoi(argv[2]) : 5;
+
+   size_t num_values = (size_t)size * size * 2;
+   float *scalar_result = malloc(num_values * sizeof(float));
+   float *packet_result = malloc(num_values * sizeof(float));
+
+   double scalar = run_child(argv[0], "false", size, num_iterations, scalar_result);
+   double packet = run_child(argv[0], "true", size, num_iterations, packet_result);
+
+   /* Both traversals test the same triangles with the same math, so the
+    * closest hits have to match exactly.
+    */
+   size_t mismatches = 0;
+   for (size_t i = 0; i < num_values; i++) {
+      if (memcmp(&scalar_result[i], &packet_result[i], sizeof(float))) {
+         if (!mismatches) {
+            fprintf(stderr, "pixel %zu, %s ray: default traversal hit at %f, "
+                    "packet traversal at %f\n", i / 2, i % 2 ? "bounce" : "primary",
+                    scalar_result[i], packet_result[i]);
+         }
+         mismatches++;
+      }
+   }
+
+   double rays = (double)num_values;
+   printf("%ux%u pixels, %.0f rays per frame\n", size, size, rays);
+   printf("default traversal: %.2f Mrays/s\n", rays * 1000.0 / scalar);
+   printf("packet traversal:  %.2f Mrays/s\n", rays * 1000.0 / packet);
+   if (mismatches)
+      fprintf(stderr, "%zu of %zu hit distances differ\n", mismatches, num_values);
+
+   free(scalar_result);
+   free(packet_result);
+
+   return mismatches ? 1 : 0;
+}
@@ -0,0 +1,444 @@
+/*
+ * Copyright © 2026 Red Hat.
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * @file
+ * Test and benchmark for submitting draws through lavapipe.
+ *
+ * A command buffer of many single pixel draws, each with its own push
+ * constants, a redundant dynamic state setter and now and then a new
+ * scissor, is submitted repeatedly.  A reusable command buffer, which
+ * lavapipe bakes at vkEndCommandBuffer, and a one-time-submit command buffer,
+ * which is executed straight from the recorded command list, must both
+ * render the same image as the CPU does.  The time per draw is printed for
+ * both.
+ *
+ * The one-time-submit command buffer is re-recorded every iteration, with
+ * the command pool allocating from counting callbacks.  Once the pool has
+ * warmed up, recording should not need the application's allocator.
+ *
+ * Usage: lvp_test_submit [draws [iterations]]
+ */
+
+#include <string.h>
+
+#include "lvp_test_common.h"
+
+#include "util/macros.h"
+#include "util/os_time.h"
+#include "util/u_math.h"
+
+#define SIZE 64
+
+static const uint32_t vs_spirv[] = {
+#include "lvp_test_submit.vert.spv.h"
+};
+
+static const uint32_t fs_spirv[] = {
+#include "lvp_test_submit.frag.spv.h"
+};
+
+struct counting_allocator {
+   unsigned allocs, frees;
+};
+
+static void *
+counting_alloc(void *user_data, size_t size, size_t align,
+               VkSystemAllocationScope scope)
+{
+   struct counting_allocator *counter = user_data;
+   counter->allocs++;
+   return aligned_alloc(align, align64(size, align));
+}
+
+static void *
+counting_realloc(void *user_data, void *original, size_t size, size_t align,
+                 VkSystemAllocationScope scope)
+{
+   struct counting_allocator *counter = user_data;
+   if (original == NULL)
+      return counting_alloc(user_data, size, align, scope);
+
+   counter->allocs++;
+   counter->frees++;
+   return realloc(original, size);
+}
+
+static void
+counting_free(void *user_data, void *memory)
+{
+   struct counting_allocator *counter = user_data;
+   counter->frees += memory != NULL;
+   free(memory);
+}
+
+/* Draw i covers a single pixel, walking the image 97 pixels at a time so
+ * that each pixel is drawn more than once with different colors.
+ */
+static unsigned
+draw_pixel(unsigned i)
+{
+   return (i * 97) % (SIZE * SIZE);
+}
+
+static uint32_t
+draw_color(unsigned i)
+{
+   return (i & 0xff) | ((i >> 8) & 0xff) << 8 | 0xffu << 16 | 0xffu << 24;
+}
+
+/* Every other block of 256 draws only renders to the left half. */
+static bool
+draw_scissored(unsigned i)
+{
+   return (i / 256) & 1;
+}
+
+static void
+record(VkCommandBuffer cmd, VkCommandBufferUsageFlags flags,
+       VkPipeline pipeline, VkPipelineLayout layout, VkImage image,
+       VkImageView view, VkBuffer readback, unsigned num_draws)
+{
+   const VkCommandBufferBeginInfo begin_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+      .flags = flags,
+   };
+   CHECK(BeginCommandBuffer(cmd, &begin_info));
+
+   VkImageMemoryBarrier barrier = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+      .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+      .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+      .newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = image,
+      .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+   };
+   CmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0,
+                      0, NULL, 0, NULL, 1, &barrier);
+
+   const VkRenderingAttachmentInfo color = {
+      .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+      .imageView = view,
+      .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+      .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+      .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+   };
+   const VkRenderingInfo rendering_info = {
+      .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+      .renderArea = { .extent = { SIZE, SIZE } },
+      .layerCount = 1,
+      .colorAttachmentCount = 1,
+      .pColorAttachments = &color,
+   };
+   CmdBeginRendering(cmd, &rendering_info);
+   CmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+   for (unsigned i = 0; i < num_draws; i++) {
+      if (i % 256 == 0) {
+         const VkRect2D scissor = {
+            .extent = { draw_scissored(i) ? SIZE / 2 : SIZE, SIZE },
+         };
+         CmdSetScissor(cmd, 0, 1, &scissor);
+      }
+
+      unsigned p = draw_pixel(i);
+      uint32_t c = draw_color(i);
+      const float constants[8] = {
+         (p % SIZE + 0.5f) / (SIZE / 2) - 1.0f,
+         (p / SIZE + 0.5f) / (SIZE / 2) - 1.0f,
+         0.0f, 1.0f,
+         (c & 0xff) / 255.0f, ((c >> 8) & 0xff) / 255.0f, 1.0f, 1.0f,
+      };
+
+      CmdSetLineWidth(cmd, 1.0f);
+      CmdPushConstants(cmd, layout,
+                       VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+                       0, sizeof(constants), constants);
+      CmdDraw(cmd, 1, 1, 0, 0);
+   }
+
+   CmdEndRendering(cmd);
+
+   barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+   barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+   barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+   barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+   CmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                      VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                      0, NULL, 0, NULL, 1, &barrier);
+
+   const VkBufferImageCopy region = {
+      .imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+      .imageExtent = { SIZE, SIZE, 1 },
+   };
+   CmdCopyImageToBuffer(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                        readback, 1, &region);
+
+   CHECK(EndCommandBuffer(cmd));
+}
+
+static bool
+check_image(const char *what, const uint32_t *image, const uint32_t *expected)
+{
+   for (unsigned p = 0; p < SIZE * SIZE; p++) {
+      if (image[p] != expected[p]) {
+         fprintf(stderr, "%s command buffer: pixel (%u, %u) is 0x%08x, "
+                 "expected 0x%08x\n", what, p % SIZE, p / SIZE, image[p],
+                 expected[p]);
+         return false;
+      }
+   }
+   return true;
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned num_draws = argc > 1 ? atoi(argv[1]) : 10000;
+   unsigned num_iterations = argc > 2 ? atoi(argv[2]) : 5;
+
+   const VkPhysicalDeviceVulkan13Features features13 = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
+      .dynamicRendering = VK_TRUE,
+   };
+   const VkDeviceCreateInfo device_info = {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+      .pNext = &features13,
+   };
+   struct lvp_test_device dev;
+   lvp_test_init(&dev, "lvp_test_submit", &device_info);
+   VkDevice device = dev.device;
+
+   /* The last draw to each pixel within its scissor wins */
+   uint32_t *expected = calloc(SIZE * SIZE, sizeof(*expected));
+   for (unsigned i = 0; i < num_draws; i++) {
+      unsigned p = draw_pixel(i);
+      if (!draw_scissored(i) || p % SIZE < SIZE / 2)
+         expected[p] = draw_color(i);
+   }
+
+   const VkImageCreateInfo image_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+      .imageType = VK_IMAGE_TYPE_2D,
+      .format = VK_FORMAT_R8G8B8A8_UNORM,
+      .extent = { SIZE, SIZE, 1 },
+      .mipLevels = 1,
+      .arrayLayers = 1,
+      .samples = VK_SAMPLE_COUNT_1_BIT,
+      .tiling = VK_IMAGE_TILING_OPTIMAL,
+      .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+               VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+   };
+   VkImage image;
+   CHECK(CreateImage(device, &image_info, NULL, &image));
+
+   VkMemoryRequirements reqs;
+   GetImageMemoryRequirements(device, image, &reqs);
+   const VkMemoryAllocateInfo image_alloc_info = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+      .allocationSize = reqs.size,
+      .memoryTypeIndex = dev.memory_type,
+   };
+   VkDeviceMemory image_memory;
+   CHECK(AllocateMemory(device, &image_alloc_info, NULL, &image_memory));
+   CHECK(BindImageMemory(device, image, image_memory, 0));
+
+   const VkImageViewCreateInfo view_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+      .image = image,
+      .viewType = VK_IMAGE_VIEW_TYPE_2D,
+      .format = VK_FORMAT_R8G8B8A8_UNORM,
+      .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+   };
+   VkImageView view;
+   CHECK(CreateImageView(device, &view_info, NULL, &view));
+
+   struct lvp_test_buffer readback;
+   lvp_test_create_buffer(&dev, SIZE * SIZE * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                          &readback);
+
+   VkShaderModule vs = lvp_test_create_shader_module(&dev, vs_spirv, sizeof(vs_spirv));
+   VkShaderModule fs = lvp_test_create_shader_module(&dev, fs_spirv, sizeof(fs_spirv));
+
+   const VkPushConstantRange push_range = {
+      .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+      .size = 32,
+   };
+   const VkPipelineLayoutCreateInfo layout_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+      .pushConstantRangeCount = 1,
+      .pPushConstantRanges = &push_range,
+   };
+   VkPipelineLayout layout;
+   CHECK(CreatePipelineLayout(device, &layout_info, NULL, &layout));
+
+   const VkPipelineShaderStageCreateInfo stages[] = {
+      {
+         .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+         .stage = VK_SHADER_STAGE_VERTEX_BIT,
+         .module = vs,
+         .pName = "main",
+      },
+      {
+         .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+         .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+         .module = fs,
+         .pName = "main",
+      },
+   };
+   const VkPipelineVertexInputStateCreateInfo vi = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+   };
+   const VkPipelineInputAssemblyStateCreateInfo ia = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+      .topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST,
+   };
+   const VkViewport viewport = { 0, 0, SIZE, SIZE, 0, 1 };
+   const VkPipelineViewportStateCreateInfo vp = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+      .viewportCount = 1,
+      .pViewports = &viewport,
+      .scissorCount = 1,
+   };
+   const VkPipelineRasterizationStateCreateInfo rs = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+      .polygonMode = VK_POLYGON_MODE_FILL,
+      .lineWidth = 1.0f,
+   };
+   const VkPipelineMultisampleStateCreateInfo ms = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+      .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+   };
+   const VkPipelineColorBlendAttachmentState blend_attachment = {
+      .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+                        VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+   };
+   const VkPipelineColorBlendStateCreateInfo cb = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+      .attachmentCount = 1,
+      .pAttachments = &blend_attachment,
+   };
+   const VkDynamicState dynamic_states[] = {
+      VK_DYNAMIC_STATE_LINE_WIDTH,
+      VK_DYNAMIC_STATE_SCISSOR,
+   };
+   const VkPipelineDynamicStateCreateInfo dyn = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+      .dynamicStateCount = ARRAY_SIZE(dynamic_states),
+      .pDynamicStates = dynamic_states,
+   };
+   const VkFormat color_format = VK_FORMAT_R8G8B8A8_UNORM;
+   const VkPipelineRenderingCreateInfo rendering = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+      .colorAttachmentCount = 1,
+      .pColorAttachmentFormats = &color_format,
+   };
+   const VkGraphicsPipelineCreateInfo pipeline_info = {
+      .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+      .pNext = &rendering,
+      .stageCount = ARRAY_SIZE(stages),
+      .pStages = stages,
+      .pVertexInputState = &vi,
+      .pInputAssemblyState = &ia,
+      .pViewportState = &vp,
+      .pRasterizationState = &rs,
+      .pMultisampleState = &ms,
+      .pColorBlendState = &cb,
+      .pDynamicState = &dyn,
+      .layout = layout,
+   };
+   VkPipeline pipeline;
+   CHECK(CreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info,
+                                 NULL, &pipeline));
+
+   const VkCommandPoolCreateInfo pool_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+      .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+   };
+   struct counting_allocator counter = { 0 };
+   const VkAllocationCallbacks pool_alloc = {
+      .pUserData = &counter,
+      .pfnAllocation = counting_alloc,
+      .pfnReallocation = counting_realloc,
+      .pfnFree = counting_free,
+   };
+   VkCommandPool pool;
+   CHECK(CreateCommandPool(device, &pool_info, &pool_alloc, &pool));
+
+   const VkCommandBufferAllocateInfo alloc_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .commandPool = pool,
+      .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+      .commandBufferCount = 2,
+   };
+   VkCommandBuffer cmds[2];
+   CHECK(AllocateCommandBuffers(device, &alloc_info, cmds));
+
+   /* warm up the shader variants before timing anything */
+   record(cmds[0], 0, pipeline, layout, image, view, readback.buffer, num_draws);
+   lvp_test_submit(&dev, cmds[0]);
+
+   int ret = 0;
+   double reusable = 0.0, one_time = 0.0, recording = 0.0;
+   unsigned first_allocs = 0, steady_allocs = 0;
+   for (unsigned i = 0; i < num_iterations && !ret; i++) {
+      memset(readback.map, 0xcc, SIZE * SIZE * 4);
+      reusable += lvp_test_submit(&dev, cmds[0]);
+      if (!check_image("reusable", readback.map, expected))
+         ret = 1;
+
+      unsigned allocs = counter.allocs;
+      int64_t start = os_time_get_nano();
+      CHECK(ResetCommandBuffer(cmds[1], 0));
+      record(cmds[1], VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+             pipeline, layout, image, view, readback.buffer, num_draws);
+      recording += os_time_get_nano() - start;
+      if (i == 0)
+         first_allocs = counter.allocs - allocs;
+      else
+         steady_allocs = MAX2(steady_allocs, counter.allocs - allocs);
+
+      memset(readback.map, 0xcc, SIZE * SIZE * 4);
+      one_time += lvp_test_submit(&dev, cmds[1]);
+      if (!check_image("one-time", readback.map, expected))
+         ret = 1;
+   }
+   if (ret)
+      return ret;
+
+   double draws = (double)num_draws * num_iterations;
+   printf("reusable command buffer: %.1f ns/draw\n", reusable / draws);
+   printf("one-time command buffer: %.1f ns/draw\n", one_time / draws);
+   printf("recording: %.1f ns/draw, %u pool allocations the first time, "
+          "at most %u after\n", recording / draws, first_allocs, steady_allocs);
+
+   /* Re-recording may only hit the allocator for the odd block */
+   if (num_iterations > 1 && steady_allocs > MAX2(first_allocs / 16, 4)) {
+      fprintf(stderr, "re-recording made %u pool allocations\n", steady_allocs);
+      return 1;
+   }
+
+   DestroyCommandPool(device, pool, &pool_alloc);
+   if (counter.allocs != counter.frees) {
+      fprintf(stderr, "command pool leaked %u allocations\n",
+              counter.allocs - counter.frees);
+      return 1;
+   }
+   DestroyPipeline(device, pipeline, NULL);
+   DestroyPipelineLayout(device, layout, NULL);
+   DestroyShaderModule(device, fs, NULL);
+   DestroyShaderModule(device, vs, NULL);
+   lvp_test_destroy_buffer(&dev, &readback);
+   DestroyImageView(device, view, NULL);
+   DestroyImage(device, image, NULL);
+   FreeMemory(device, image_memory, NULL);
+   free(expected);
+   lvp_test_finish(&dev);
+
+   return 0;
+}
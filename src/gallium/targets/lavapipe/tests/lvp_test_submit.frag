@@ -0,0 +1,17 @@
+#version 450
+
+/* Copyright © 2026 Red Hat.
+ * SPDX-License-Identifier: MIT
+ */
+
+layout(push_constant) uniform Draw {
+   vec4 pos;
+   vec4 color;
+};
+
+layout(location = 0) out vec4 out_color;
+
+void main()
+{
+   out_color = color;
+}
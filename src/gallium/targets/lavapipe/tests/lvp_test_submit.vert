@@ -0,0 +1,16 @@
+#version 450
+
+/* Copyright © 2026 Red Hat.
+ * SPDX-License-Identifier: MIT
+ */
+
+layout(push_constant) uniform Draw {
+   vec4 pos;
+   vec4 color;
+};
+
+void main()
+{
+   gl_Position = pos;
+   gl_PointSize = 1.0;
+}
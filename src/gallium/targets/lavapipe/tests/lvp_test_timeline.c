@@ -0,0 +1,238 @@
+/*
+ * Copyright © 2026 Red Hat.
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * @file
+ * Stress test and benchmark for lavapipe timeline semaphores.
+ *
+ * Signaler threads each own a slice of the semaphores and host-signal them
+ * round after round, while the main thread waits for every round with
+ * vkWaitSemaphores on all the semaphores, and on any of them.  Then a queue
+ * submit that waits on a time point before it is signaled checks that
+ * wait-before-signal still resolves.
+ *
+ * Usage: lvp_test_timeline [semaphores [rounds [threads]]]
+ */
+
+#include "lvp_test_common.h"
+
+#include "c11/threads.h"
+#include "util/macros.h"
+#include "util/os_time.h"
+
+struct signaler {
+   thrd_t thread;
+   VkDevice device;
+   const VkSemaphore *semaphores;
+   unsigned first, stride, count;
+   unsigned rounds;
+};
+
+static int
+signaler_main(void *data)
+{
+   struct signaler *s = data;
+
+   for (uint64_t value = 1; value <= s->rounds; value++) {
+      for (unsigned i = s->first; i < s->count; i += s->stride) {
+         const VkSemaphoreSignalInfo signal_info = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO,
+            .semaphore = s->semaphores[i],
+            .value = value,
+         };
+         CHECK(SignalSemaphore(s->device, &signal_info));
+      }
+   }
+
+   return 0;
+}
+
+static VkSemaphore
+create_timeline(VkDevice device, uint64_t initial_value)
+{
+   const VkSemaphoreTypeCreateInfo type_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+      .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+      .initialValue = initial_value,
+   };
+   const VkSemaphoreCreateInfo semaphore_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+      .pNext = &type_info,
+   };
+   VkSemaphore semaphore;
+   CHECK(CreateSemaphore(device, &semaphore_info, NULL, &semaphore));
+   return semaphore;
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned num_semaphores = argc > 1 ? atoi(argv[1]) : 64;
+   unsigned num_rounds = argc > 2 ? atoi(argv[2]) : 2000;
+   unsigned num_threads = argc > 3 ? atoi(argv[3]) : 8;
+
+   num_threads = MAX2(MIN2(num_threads, num_semaphores), 1);
+
+   const VkPhysicalDeviceVulkan13Features features13 = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
+      .synchronization2 = VK_TRUE,
+   };
+   const VkPhysicalDeviceVulkan12Features features12 = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+      .pNext = (void *)&features13,
+      .timelineSemaphore = VK_TRUE,
+   };
+   const VkDeviceCreateInfo device_info = {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+      .pNext = &features12,
+   };
+   struct lvp_test_device dev;
+   lvp_test_init(&dev, "lvp_test_timeline", &device_info);
+   VkDevice device = dev.device;
+
+   VkSemaphore *semaphores = calloc(num_semaphores, sizeof(*semaphores));
+   uint64_t *values = calloc(num_semaphores, sizeof(*values));
+   struct signaler *signalers = calloc(num_threads, sizeof(*signalers));
+   if (!semaphores || !values || !signalers)
+      return 1;
+
+   for (unsigned i = 0; i < num_semaphores; i++)
+      semaphores[i] = create_timeline(device, 0);
+
+   int64_t start = os_time_get_nano();
+
+   for (unsigned t = 0; t < num_threads; t++) {
+      signalers[t] = (struct signaler) {
+         .device = device,
+         .semaphores = semaphores,
+         .first = t,
+         .stride = num_threads,
+         .count = num_semaphores,
+         .rounds = num_rounds,
+      };
+      if (thrd_create(&signalers[t].thread, signaler_main,
+                      &signalers[t]) != thrd_success)
+         return 1;
+   }
+
+   for (uint64_t value = 1; value <= num_rounds; value++) {
+      for (unsigned i = 0; i < num_semaphores; i++)
+         values[i] = value;
+
+      VkSemaphoreWaitInfo wait_info = {
+         .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+         .flags = VK_SEMAPHORE_WAIT_ANY_BIT,
+         .semaphoreCount = num_semaphores,
+         .pSemaphores = semaphores,
+         .pValues = values,
+      };
+      CHECK(WaitSemaphores(device, &wait_info, UINT64_MAX));
+
+      unsigned reached = 0;
+      for (unsigned i = 0; i < num_semaphores; i++) {
+         uint64_t counter;
+         CHECK(GetSemaphoreCounterValue(device, semaphores[i], &counter));
+         reached += counter >= value;
+      }
+      if (reached == 0) {
+         fprintf(stderr, "wait for any returned before round %u\n",
+                 (unsigned)value);
+         return 1;
+      }
+
+      wait_info.flags = 0;
+      CHECK(WaitSemaphores(device, &wait_info, UINT64_MAX));
+
+      for (unsigned i = 0; i < num_semaphores; i++) {
+         uint64_t counter;
+         CHECK(GetSemaphoreCounterValue(device, semaphores[i], &counter));
+         if (counter < value) {
+            fprintf(stderr, "wait for all returned before round %u\n",
+                    (unsigned)value);
+            return 1;
+         }
+      }
+   }
+
+   for (unsigned t = 0; t < num_threads; t++)
+      thrd_join(signalers[t].thread, NULL);
+
+   double elapsed = os_time_get_nano() - start;
+   printf("%u semaphores, %u threads: %.1f ns/signal\n", num_semaphores,
+          num_threads, elapsed / ((double)num_semaphores * num_rounds));
+
+   /* A zero timeout must not block. */
+   const uint64_t future = num_rounds + 1;
+   const VkSemaphoreWaitInfo poll_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+      .semaphoreCount = 1,
+      .pSemaphores = &semaphores[0],
+      .pValues = &future,
+   };
+   if (WaitSemaphores(device, &poll_info, 0) != VK_TIMEOUT) {
+      fprintf(stderr, "wait for an unsignaled value didn't time out\n");
+      return 1;
+   }
+
+   /* Wait before signal through the queue: the submit can only run once the
+    * host signals semaphores[0] to the future value.
+    */
+   VkSemaphore done = create_timeline(device, 0);
+   const VkSemaphoreSubmitInfo wait_submit = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+      .semaphore = semaphores[0],
+      .value = future,
+      .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+   };
+   const VkSemaphoreSubmitInfo signal_submit = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+      .semaphore = done,
+      .value = 7,
+      .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+   };
+   const VkSubmitInfo2 submit_info = {
+      .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+      .waitSemaphoreInfoCount = 1,
+      .pWaitSemaphoreInfos = &wait_submit,
+      .signalSemaphoreInfoCount = 1,
+      .pSignalSemaphoreInfos = &signal_submit,
+   };
+   CHECK(QueueSubmit2(dev.queue, 1, &submit_info, VK_NULL_HANDLE));
+
+   uint64_t counter;
+   CHECK(GetSemaphoreCounterValue(device, done, &counter));
+   if (counter != 0) {
+      fprintf(stderr, "submit ran before its wait was signaled\n");
+      return 1;
+   }
+
+   const VkSemaphoreSignalInfo signal_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO,
+      .semaphore = semaphores[0],
+      .value = future,
+   };
+   CHECK(SignalSemaphore(device, &signal_info));
+
+   const uint64_t done_value = 7;
+   const VkSemaphoreWaitInfo done_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+      .semaphoreCount = 1,
+      .pSemaphores = &done,
+      .pValues = &done_value,
+   };
+   CHECK(WaitSemaphores(device, &done_info, UINT64_MAX));
+   CHECK(QueueWaitIdle(dev.queue));
+
+   DestroySemaphore(device, done, NULL);
+   for (unsigned i = 0; i < num_semaphores; i++)
+      DestroySemaphore(device, semaphores[i], NULL);
+   free(semaphores);
+   free(values);
+   free(signalers);
+
+   lvp_test_finish(&dev);
+
+   return 0;
+}
@@ -0,0 +1,234 @@
+/*
+ * Copyright © 2026 Red Hat.
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * @file
+ * Benchmark for the vertex throughput of lavapipe.
+ *
+ * Large point list draws are fed from a vertex buffer through a vertex
+ * shader with rasterization discarded, so that the time is spent in the
+ * draw module rather than in the rasterizer.  A pipeline statistics query
+ * checks that every vertex was assembled and shaded, and the positions
+ * captured with transform feedback must be exactly the input positions
+ * plus the offset from the push constants.
+ *
+ * Run it with DRAW_NUM_THREADS=0 to compare against shading on the draw
+ * thread only.
+ *
+ * Usage: lvp_test_vertices [vertices [iterations]]
+ */
+
+#include <string.h>
+
+#include "lvp_test_common.h"
+
+#include "util/macros.h"
+#include "util/os_time.h"
+
+static const uint32_t vs_spirv[] = {
+#include "lvp_test_vertices.vert.spv.h"
+};
+
+enum {
+   STAT_IA_VERTICES,
+   STAT_VS_INVOCATIONS,
+   NUM_STATS,
+};
+
+int
+main(int argc, char **argv)
+{
+   unsigned num_vertices = argc > 1 ? atoi(argv[1]) : 1000000;
+   unsigned num_iterations = argc > 2 ? atoi(argv[2]) : 10;
+
+   num_vertices = MAX2(num_vertices, 1);
+
+   const VkPhysicalDeviceTransformFeedbackFeaturesEXT xfb_features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TRANSFORM_FEEDBACK_FEATURES_EXT,
+      .transformFeedback = VK_TRUE,
+   };
+   const VkPhysicalDeviceVulkan13Features features13 = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
+      .pNext = (void *)&xfb_features,
+      .dynamicRendering = VK_TRUE,
+   };
+   const VkPhysicalDeviceFeatures features = {
+      .pipelineStatisticsQuery = VK_TRUE,
+   };
+   const char *extensions[] = {
+      VK_EXT_TRANSFORM_FEEDBACK_EXTENSION_NAME,
+   };
+   const VkDeviceCreateInfo device_info = {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+      .pNext = &features13,
+      .enabledExtensionCount = ARRAY_SIZE(extensions),
+      .ppEnabledExtensionNames = extensions,
+      .pEnabledFeatures = &features,
+   };
+   struct lvp_test_device dev;
+   lvp_test_init(&dev, "lvp_test_vertices", &device_info);
+   VkDevice device = dev.device;
+
+   const VkDeviceSize buffer_size = (VkDeviceSize)num_vertices * 4 * sizeof(float);
+   struct lvp_test_buffer vertex_buffer, xfb_buffer;
+   lvp_test_create_buffer(&dev, buffer_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                          &vertex_buffer);
+   lvp_test_create_buffer(&dev, buffer_size,
+                          VK_BUFFER_USAGE_TRANSFORM_FEEDBACK_BUFFER_BIT_EXT,
+                          &xfb_buffer);
+
+   float *positions = vertex_buffer.map;
+   for (unsigned i = 0; i < num_vertices; i++) {
+      positions[i * 4 + 0] = (float)(i % 1024) / 512.0f - 1.0f;
+      positions[i * 4 + 1] = (float)(i / 1024 % 1024) / 512.0f - 1.0f;
+      positions[i * 4 + 2] = 0.5f;
+      positions[i * 4 + 3] = 1.0f;
+   }
+
+   const VkQueryPoolCreateInfo query_info = {
+      .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+      .queryCount = 1,
+      .pipelineStatistics =
+         VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+         VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT,
+   };
+   VkQueryPool query_pool;
+   CHECK(CreateQueryPool(device, &query_info, NULL, &query_pool));
+
+   VkShaderModule module = lvp_test_create_shader_module(&dev, vs_spirv, sizeof(vs_spirv));
+
+   const VkPushConstantRange push_range = {
+      .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+      .size = 16,
+   };
+   const VkPipelineLayoutCreateInfo layout_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+      .pushConstantRangeCount = 1,
+      .pPushConstantRanges = &push_range,
+   };
+   VkPipelineLayout layout;
+   CHECK(CreatePipelineLayout(device, &layout_info, NULL, &layout));
+
+   const VkPipelineShaderStageCreateInfo stage = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+      .stage = VK_SHADER_STAGE_VERTEX_BIT,
+      .module = module,
+      .pName = "main",
+   };
+   const VkVertexInputBindingDescription binding = {
+      .binding = 0,
+      .stride = 4 * sizeof(float),
+      .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+   };
+   const VkVertexInputAttributeDescription attribute = {
+      .location = 0,
+      .binding = 0,
+      .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+   };
+   const VkPipelineVertexInputStateCreateInfo vi = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+      .vertexBindingDescriptionCount = 1,
+      .pVertexBindingDescriptions = &binding,
+      .vertexAttributeDescriptionCount = 1,
+      .pVertexAttributeDescriptions = &attribute,
+   };
+   const VkPipelineInputAssemblyStateCreateInfo ia = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+      .topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST,
+   };
+   const VkPipelineRasterizationStateCreateInfo rs = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+      .rasterizerDiscardEnable = VK_TRUE,
+      .polygonMode = VK_POLYGON_MODE_FILL,
+      .lineWidth = 1.0f,
+   };
+   const VkPipelineRenderingCreateInfo rendering = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+   };
+   const VkGraphicsPipelineCreateInfo pipeline_info = {
+      .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+      .pNext = &rendering,
+      .stageCount = 1,
+      .pStages = &stage,
+      .pVertexInputState = &vi,
+      .pInputAssemblyState = &ia,
+      .pRasterizationState = &rs,
+      .layout = layout,
+   };
+   VkPipeline pipeline;
+   CHECK(CreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info,
+                                 NULL, &pipeline));
+
+   const VkRenderingInfo rendering_info = {
+      .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+      .renderArea = { .extent = { 1024, 1024 } },
+      .layerCount = 1,
+   };
+   const float offset[4] = { 0.25f, -0.5f, 0.125f, 0.0f };
+   const VkDeviceSize buffer_offset = 0;
+
+   VkCommandBuffer cmd = lvp_test_begin_commands(&dev, 0);
+   CmdResetQueryPool(cmd, query_pool, 0, 1);
+   CmdBeginRendering(cmd, &rendering_info);
+   CmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+   CmdBindVertexBuffers(cmd, 0, 1, &vertex_buffer.buffer, &buffer_offset);
+   CmdBindTransformFeedbackBuffersEXT(cmd, 0, 1, &xfb_buffer.buffer,
+                                      &buffer_offset, &buffer_size);
+   CmdPushConstants(cmd, layout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                    sizeof(offset), offset);
+   CmdBeginQuery(cmd, query_pool, 0, 0);
+   CmdBeginTransformFeedbackEXT(cmd, 0, 0, NULL, NULL);
+   CmdDraw(cmd, num_vertices, 1, 0, 0);
+   CmdEndTransformFeedbackEXT(cmd, 0, 0, NULL, NULL);
+   CmdEndQuery(cmd, query_pool, 0);
+   CmdEndRendering(cmd);
+   CHECK(EndCommandBuffer(cmd));
+
+   /* warm up the shader variants before timing anything */
+   memset(xfb_buffer.map, 0xff, buffer_size);
+   lvp_test_submit(&dev, cmd);
+
+   double elapsed = 0.0;
+   for (unsigned i = 0; i < num_iterations; i++)
+      elapsed += lvp_test_submit(&dev, cmd);
+
+   if (num_iterations) {
+      printf("%u vertices: %.1f Mvertices/s\n", num_vertices,
+             (double)num_vertices * num_iterations / elapsed * 1000.0);
+   }
+
+   uint64_t stats[NUM_STATS];
+   CHECK(GetQueryPoolResults(device, query_pool, 0, 1, sizeof(stats), stats,
+                             sizeof(stats), VK_QUERY_RESULT_64_BIT |
+                             VK_QUERY_RESULT_WAIT_BIT));
+   if (stats[STAT_IA_VERTICES] != num_vertices ||
+       stats[STAT_VS_INVOCATIONS] < num_vertices) {
+      fprintf(stderr, "%u vertices drawn, but %llu assembled and %llu shaded\n",
+              num_vertices, (unsigned long long)stats[STAT_IA_VERTICES],
+              (unsigned long long)stats[STAT_VS_INVOCATIONS]);
+      return 1;
+   }
+
+   const float *captured = xfb_buffer.map;
+   for (unsigned i = 0; i < num_vertices * 4; i++) {
+      float expected = positions[i] + offset[i % 4];
+      if (memcmp(&captured[i], &expected, sizeof(expected))) {
+         fprintf(stderr, "vertex %u component %u: captured %f, expected %f\n",
+                 i / 4, i % 4, captured[i], expected);
+         return 1;
+      }
+   }
+
+   DestroyPipeline(device, pipeline, NULL);
+   DestroyPipelineLayout(device, layout, NULL);
+   DestroyShaderModule(device, module, NULL);
+   DestroyQueryPool(device, query_pool, NULL);
+   lvp_test_destroy_buffer(&dev, &xfb_buffer);
+   lvp_test_destroy_buffer(&dev, &vertex_buffer);
+   lvp_test_finish(&dev);
+
+   return 0;
+}
@@ -0,0 +1,20 @@
+#version 450
+
+/* Copyright © 2026 Red Hat.
+ * SPDX-License-Identifier: MIT
+ */
+
+layout(location = 0) in vec4 in_pos;
+
+layout(push_constant) uniform Draw {
+   vec4 offset;
+};
+
+layout(xfb_buffer = 0, xfb_offset = 0) out gl_PerVertex {
+   vec4 gl_Position;
+};
+
+void main()
+{
+   gl_Position = in_pos + offset;
+}
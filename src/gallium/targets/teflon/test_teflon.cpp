@@ -23,6 +23,7 @@
 #define TEST_ADD             1
 #define TEST_FULLY_CONNECTED 1
 #define TEST_MODELS          1
+#define TEST_CPU_BACKEND     1
 
 #define TOLERANCE 8
 
@@ -557,6 +558,49 @@ INSTANTIATE_TEST_SUITE_P(
 
 #endif
 
+#if TEST_CPU_BACKEND
+
+/* Small graphs for the llvmpipe backend, compared against the TensorFlow
+ * Lite reference kernels.  Run them with TEFLON_CPU=1, so that the delegate
+ * picks llvmpipe even when an NPU is present.
+ */
+class CPUBackend : public testing::Test {
+protected:
+   void SetUp() override
+   {
+      const char *cpu = getenv("TEFLON_CPU");
+      if (!cpu || atoi(cpu) != 1)
+         GTEST_SKIP() << "Set TEFLON_CPU=1 to test the CPU backend";
+   }
+};
+
+TEST_F(CPUBackend, Conv2D)
+{
+   test_conv(8, 3, 32, 32, 1, false, false, false, 4);
+}
+
+TEST_F(CPUBackend, Conv2DStridePaddingSame)
+{
+   test_conv(8, 3, 32, 32, 2, true, false, false, 4);
+}
+
+TEST_F(CPUBackend, Conv2DPointwise)
+{
+   test_conv(5, 1, 120, 32, 1, false, false, false, 4);
+}
+
+TEST_F(CPUBackend, DepthwiseConv2D)
+{
+   test_conv(8, 3, 32, 32, 1, true, false, true, 4);
+}
+
+TEST_F(CPUBackend, Add)
+{
+   test_add(8, 1, 32, 32, 1, false, false, false, 4, TOLERANCE);
+}
+
+#endif
+
 int
 main(int argc, char **argv)
 {
@@ -0,0 +1,206 @@
+/*
+ * Copyright © 2026 Red Hat.
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Multithreaded stress test and benchmark of the pipeline cache object table.
+ *
+ * Every thread looks up random keys out of a fixed key set and adds the
+ * object on a miss, like drivers do when compiling pipelines from many
+ * threads.  This runs on a regular cache, where objects stay cached once
+ * added, and on a weak reference cache, where objects die and get removed
+ * whenever no thread holds them, which exercises lookups racing removals.
+ *
+ * Usage: vk_pipeline_cache_stress [threads] [iterations per thread]
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "c11/threads.h"
+#include "util/os_time.h"
+
+#include "vk_alloc.h"
+#include "vk_device.h"
+#include "vk_physical_device.h"
+#include "vk_pipeline_cache.h"
+
+#define KEY_COUNT 4096
+#define DATA_SIZE 64
+
+#define CHECK(cond)                                                            \
+   do {                                                                        \
+      if (!(cond)) {                                                           \
+         fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,      \
+                 #cond);                                                       \
+         exit(1);                                                              \
+      }                                                                        \
+   } while (0)
+
+struct stress_key {
+   uint32_t index;
+   uint32_t salt[3];
+};
+
+struct stress_thread {
+   thrd_t thread;
+   struct vk_device *device;
+   struct vk_pipeline_cache *cache;
+   uint32_t seed;
+   unsigned iterations;
+   unsigned hits;
+};
+
+static void
+stress_get_physical_device_properties(VkPhysicalDevice physicalDevice,
+                                      VkPhysicalDeviceProperties *pProperties)
+{
+   memset(pProperties, 0, sizeof(*pProperties));
+}
+
+static void
+stress_fill(struct stress_key *key, uint8_t *data, uint32_t index)
+{
+   key->index = index;
+   for (unsigned i = 0; i < 3; i++)
+      key->salt[i] = index * 0x9e3779b9u + i;
+
+   for (unsigned i = 0; i < DATA_SIZE; i++)
+      data[i] = (uint8_t)(index * 31 + i);
+}
+
+static uint32_t
+stress_rand(uint32_t *state)
+{
+   /* xorshift32 */
+   uint32_t x = *state;
+   x ^= x << 13;
+   x ^= x >> 17;
+   x ^= x << 5;
+   return *state = x;
+}
+
+static int
+stress_thread_main(void *_data)
+{
+   struct stress_thread *t = _data;
+
+   for (unsigned i = 0; i < t->iterations; i++) {
+      struct stress_key key;
+      uint8_t data[DATA_SIZE];
+      stress_fill(&key, data, stress_rand(&t->seed) % KEY_COUNT);
+
+      bool cache_hit = false;
+      struct vk_pipeline_cache_object *object =
+         vk_pipeline_cache_lookup_object(t->cache, &key, sizeof(key),
+                                         &vk_raw_data_cache_object_ops,
+                                         &cache_hit);
+      if (object == NULL) {
+         struct vk_raw_data_cache_object *data_obj =
+            vk_raw_data_cache_object_create(t->device, &key, sizeof(key),
+                                            data, sizeof(data));
+         CHECK(data_obj != NULL);
+         object = vk_pipeline_cache_add_object(t->cache, &data_obj->base);
+      } else {
+         CHECK(cache_hit);
+         t->hits++;
+      }
+
+      CHECK(object->key_size == sizeof(key));
+      CHECK(memcmp(object->key_data, &key, sizeof(key)) == 0);
+
+      struct vk_raw_data_cache_object *data_obj =
+         container_of(object, struct vk_raw_data_cache_object, base);
+      CHECK(data_obj->data_size == sizeof(data));
+      CHECK(memcmp(data_obj->data, data, sizeof(data)) == 0);
+
+      vk_pipeline_cache_object_unref(t->device, object);
+   }
+
+   return 0;
+}
+
+static void
+run(struct vk_device *device, bool weak_ref, unsigned thread_count,
+    unsigned iterations)
+{
+   struct vk_pipeline_cache_create_info info = {
+      .force_enable = true,
+      .weak_ref = weak_ref,
+      .skip_disk_cache = true,
+   };
+   struct vk_pipeline_cache *cache = vk_pipeline_cache_create(device, &info, NULL);
+   CHECK(cache != NULL);
+
+   struct stress_thread *threads = calloc(thread_count, sizeof(*threads));
+   CHECK(threads != NULL);
+
+   int64_t start = os_time_get_nano();
+
+   for (unsigned i = 0; i < thread_count; i++) {
+      threads[i].device = device;
+      threads[i].cache = cache;
+      threads[i].seed = 0x12345u + i * 7919u;
+      threads[i].iterations = iterations;
+      CHECK(thrd_create(&threads[i].thread, stress_thread_main,
+                        &threads[i]) == thrd_success);
+   }
+
+   unsigned hits = 0;
+   for (unsigned i = 0; i < thread_count; i++) {
+      thrd_join(threads[i].thread, NULL);
+      hits += threads[i].hits;
+   }
+
+   int64_t elapsed = os_time_get_nano() - start;
+   uint64_t total = (uint64_t)thread_count * iterations;
+
+   printf("%s cache, %u threads: %.2f Mlookups/s, %.1f%% hits\n",
+          weak_ref ? "weak" : "regular", thread_count,
+          total * 1000.0 / MAX2(elapsed, 1), hits * 100.0 / total);
+
+   /* A regular cache keeps every object it saw, check a few. */
+   if (!weak_ref) {
+      for (uint32_t i = 0; i < KEY_COUNT; i += 97) {
+         struct stress_key key;
+         uint8_t data[DATA_SIZE];
+         stress_fill(&key, data, i);
+
+         bool cache_hit = false;
+         struct vk_pipeline_cache_object *object =
+            vk_pipeline_cache_lookup_object(cache, &key, sizeof(key),
+                                            &vk_raw_data_cache_object_ops,
+                                            &cache_hit);
+         CHECK(object != NULL && cache_hit);
+         vk_pipeline_cache_object_unref(device, object);
+      }
+   }
+
+   free(threads);
+   vk_pipeline_cache_destroy(cache, NULL);
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned thread_count = argc > 1 ? atoi(argv[1]) : 16;
+   unsigned iterations = argc > 2 ? atoi(argv[2]) : 200000;
+
+   /* The cache only needs the allocator and the properties for its header */
+   struct vk_physical_device physical_device;
+   memset(&physical_device, 0, sizeof(physical_device));
+   physical_device.dispatch_table.GetPhysicalDeviceProperties =
+      stress_get_physical_device_properties;
+
+   struct vk_device device;
+   memset(&device, 0, sizeof(device));
+   device.alloc = *vk_default_allocator();
+   device.physical = &physical_device;
+
+   run(&device, false, thread_count, iterations);
+   run(&device, true, thread_count, iterations);
+
+   return 0;
+}
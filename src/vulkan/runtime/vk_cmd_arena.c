@@ -0,0 +1,168 @@
+/*
+ * Copyright © 2026 Red Hat.
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "vk_cmd_arena.h"
+
+#include "vk_alloc.h"
+
+#include "util/macros.h"
+#include "util/u_math.h"
+
+struct vk_cmd_arena_block {
+   struct list_head link;
+
+   /* True for blocks of a single large allocation */
+   bool dedicated;
+
+   char data[];
+};
+
+/* Allocations bigger than this get their own block, so that a large one
+ * doesn't waste most of a block.
+ */
+#define VK_CMD_ARENA_MAX_BUMP_SIZE (VK_CMD_ARENA_BLOCK_SIZE / 4)
+
+static struct vk_cmd_arena_block *
+vk_cmd_arena_block_alloc(struct vk_cmd_arena_pool *pool, size_t size)
+{
+   struct vk_cmd_arena_block *block =
+      vk_alloc(pool->alloc, size, 16, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+   if (block)
+      pool->stats.block_allocs++;
+   return block;
+}
+
+static void
+vk_cmd_arena_block_free(struct vk_cmd_arena_pool *pool,
+                        struct vk_cmd_arena_block *block)
+{
+   vk_free(pool->alloc, block);
+   pool->stats.block_frees++;
+}
+
+static void *
+vk_cmd_arena_alloc(void *user_data, size_t size, size_t align,
+                   VkSystemAllocationScope scope)
+{
+   struct vk_cmd_arena *arena = user_data;
+   struct vk_cmd_arena_pool *pool = arena->pool;
+
+   pool->stats.allocs++;
+   pool->stats.alloc_bytes += size;
+
+   uintptr_t ptr = align_uintptr(arena->next, align);
+   if (arena->next && ptr + size <= arena->end) {
+      arena->next = ptr + size;
+      return (void *)ptr;
+   }
+
+   if (size + align > VK_CMD_ARENA_MAX_BUMP_SIZE) {
+      struct vk_cmd_arena_block *block =
+         vk_cmd_arena_block_alloc(pool, sizeof(*block) + size + align);
+      if (block == NULL)
+         return NULL;
+
+      block->dedicated = true;
+      list_addtail(&block->link, &arena->blocks);
+      return (void *)align_uintptr((uintptr_t)block->data, align);
+   }
+
+   struct vk_cmd_arena_block *block;
+   if (!list_is_empty(&pool->free_blocks)) {
+      block = list_first_entry(&pool->free_blocks, struct vk_cmd_arena_block, link);
+      list_del(&block->link);
+      pool->stats.block_reuses++;
+   } else {
+      block = vk_cmd_arena_block_alloc(pool, VK_CMD_ARENA_BLOCK_SIZE);
+      if (block == NULL)
+         return NULL;
+   }
+
+   block->dedicated = false;
+   list_addtail(&block->link, &arena->blocks);
+
+   ptr = align_uintptr((uintptr_t)block->data, align);
+   arena->next = ptr + size;
+   arena->end = (uintptr_t)block + VK_CMD_ARENA_BLOCK_SIZE;
+
+   return (void *)ptr;
+}
+
+static void *
+vk_cmd_arena_realloc(void *user_data, void *original, size_t size,
+                     size_t align, VkSystemAllocationScope scope)
+{
+   /* The size of allocations isn't tracked, so they can't be copied */
+   assert(original == NULL);
+   if (original != NULL)
+      return NULL;
+
+   return vk_cmd_arena_alloc(user_data, size, align, scope);
+}
+
+static void
+vk_cmd_arena_free(void *user_data, void *memory)
+{
+   /* Everything is freed by vk_cmd_arena_reset() */
+}
+
+void
+vk_cmd_arena_pool_init(struct vk_cmd_arena_pool *pool,
+                       const VkAllocationCallbacks *alloc)
+{
+   pool->alloc = alloc;
+   list_inithead(&pool->free_blocks);
+   memset(&pool->stats, 0, sizeof(pool->stats));
+}
+
+void
+vk_cmd_arena_pool_trim(struct vk_cmd_arena_pool *pool)
+{
+   list_for_each_entry_safe(struct vk_cmd_arena_block, block,
+                            &pool->free_blocks, link) {
+      list_del(&block->link);
+      vk_cmd_arena_block_free(pool, block);
+   }
+}
+
+void
+vk_cmd_arena_pool_finish(struct vk_cmd_arena_pool *pool)
+{
+   vk_cmd_arena_pool_trim(pool);
+}
+
+void
+vk_cmd_arena_init(struct vk_cmd_arena *arena,
+                  struct vk_cmd_arena_pool *pool)
+{
+   arena->alloc = (VkAllocationCallbacks) {
+      .pUserData = arena,
+      .pfnAllocation = vk_cmd_arena_alloc,
+      .pfnReallocation = vk_cmd_arena_realloc,
+      .pfnFree = vk_cmd_arena_free,
+   };
+   arena->pool = pool;
+   list_inithead(&arena->blocks);
+   arena->next = 0;
+   arena->end = 0;
+}
+
+void
+vk_cmd_arena_reset(struct vk_cmd_arena *arena)
+{
+   struct vk_cmd_arena_pool *pool = arena->pool;
+
+   list_for_each_entry_safe(struct vk_cmd_arena_block, block,
+                            &arena->blocks, link) {
+      list_del(&block->link);
+      if (block->dedicated)
+         vk_cmd_arena_block_free(pool, block);
+      else
+         list_add(&block->link, &pool->free_blocks);
+   }
+
+   arena->next = 0;
+   arena->end = 0;
+}
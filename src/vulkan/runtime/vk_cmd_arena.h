@@ -0,0 +1,95 @@
+/*
+ * Copyright © 2026 Red Hat.
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef VK_CMD_ARENA_H
+#define VK_CMD_ARENA_H
+
+#include <stdint.h>
+
+#include "util/list.h"
+
+#include <vulkan/vulkan_core.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Size of the blocks arenas allocate from, including their header */
+#define VK_CMD_ARENA_BLOCK_SIZE (64 * 1024)
+
+struct vk_cmd_arena_stats {
+   /** Allocations served by arenas of the pool */
+   uint64_t allocs;
+
+   /** Bytes requested by those allocations */
+   uint64_t alloc_bytes;
+
+   /** Blocks allocated from and freed to the parent allocator */
+   uint64_t block_allocs;
+   uint64_t block_frees;
+
+   /** Blocks taken back from the pool's free list */
+   uint64_t block_reuses;
+};
+
+/** Recycles arena blocks between the command buffers of a command pool
+ *
+ * The pool is externally synchronized together with its command buffers,
+ * so neither the free list nor the stats are locked.
+ */
+struct vk_cmd_arena_pool {
+   const VkAllocationCallbacks *alloc;
+
+   /* Free blocks of VK_CMD_ARENA_BLOCK_SIZE */
+   struct list_head free_blocks;
+
+   struct vk_cmd_arena_stats stats;
+};
+
+void vk_cmd_arena_pool_init(struct vk_cmd_arena_pool *pool,
+                            const VkAllocationCallbacks *alloc);
+
+/** Returns the free blocks to the parent allocator */
+void vk_cmd_arena_pool_trim(struct vk_cmd_arena_pool *pool);
+
+void vk_cmd_arena_pool_finish(struct vk_cmd_arena_pool *pool);
+
+/** Bump allocator for the commands of a vk_cmd_queue
+ *
+ * Everything recorded in a vk_cmd_queue lives until the queue is reset, so
+ * the arena hands out memory from large blocks and its pfnFree does
+ * nothing.  Resetting the arena puts the blocks back in the pool.
+ * Allocations that don't fit comfortably in a block get a dedicated one,
+ * which is freed on reset.  pfnReallocation only supports new allocations.
+ */
+struct vk_cmd_arena {
+   /** Callbacks allocating from this arena */
+   VkAllocationCallbacks alloc;
+
+   struct vk_cmd_arena_pool *pool;
+
+   struct list_head blocks;
+
+   /* Free space of the current block */
+   uintptr_t next;
+   uintptr_t end;
+};
+
+void vk_cmd_arena_init(struct vk_cmd_arena *arena,
+                       struct vk_cmd_arena_pool *pool);
+
+/** Frees everything allocated from the arena */
+void vk_cmd_arena_reset(struct vk_cmd_arena *arena);
+
+static inline void
+vk_cmd_arena_finish(struct vk_cmd_arena *arena)
+{
+   vk_cmd_arena_reset(arena);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VK_CMD_ARENA_H */
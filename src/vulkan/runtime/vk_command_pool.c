@@ -79,6 +79,8 @@ vk_command_pool_init(struct vk_device *device,
    for (uint32_t i = 0; i < ARRAY_SIZE(pool->free_command_buffers); i++)
       list_inithead(&pool->free_command_buffers[i]);
 
+   vk_cmd_arena_pool_init(&pool->cmd_arena, &pool->alloc);
+
    return VK_SUCCESS;
 }
 
@@ -93,6 +95,8 @@ vk_command_pool_finish(struct vk_command_pool *pool)
 
    destroy_free_command_buffers(pool);
 
+   vk_cmd_arena_pool_finish(&pool->cmd_arena);
+
    vk_object_base_finish(&pool->base);
 }
 
@@ -164,6 +168,9 @@ vk_common_ResetCommandPool(VkDevice device,
          return result;
    }
 
+   if (flags & VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT)
+      vk_cmd_arena_pool_trim(&pool->cmd_arena);
+
    return VK_SUCCESS;
 }
 
@@ -261,6 +268,7 @@ vk_command_pool_trim(struct vk_command_pool *pool,
                      VkCommandPoolTrimFlags flags)
 {
    destroy_free_command_buffers(pool);
+   vk_cmd_arena_pool_trim(&pool->cmd_arena);
 }
 
 VKAPI_ATTR void VKAPI_CALL
@@ -24,6 +24,7 @@
 #ifndef VK_COMMAND_POOL_H
 #define VK_COMMAND_POOL_H
 
+#include "vk_cmd_arena.h"
 #include "vk_object.h"
 #include "util/list.h"
 
@@ -55,6 +56,9 @@ struct vk_command_pool {
 
    /** List of freed command buffers for trimming. */
    struct list_head free_command_buffers[2];
+
+   /** Blocks for recording vk_cmd_queue commands, see vk_cmd_arena */
+   struct vk_cmd_arena_pool cmd_arena;
 };
 
 VK_DEFINE_NONDISP_HANDLE_CASTS(vk_command_pool, base, VkCommandPool,
@@ -31,11 +31,13 @@
 
 #include "compiler/nir/nir_serialize.h"
 
+#include "c11/threads.h"
+
 #include "util/blob.h"
 #include "util/u_debug.h"
+#include "util/u_memory.h"
 #include "util/disk_cache.h"
 #include "util/hash_table.h"
-#include "util/set.h"
 
 #define vk_pipeline_cache_log(cache, ...)                                      \
    if (cache->base.client_visible)                                             \
@@ -127,51 +129,267 @@ vk_raw_data_cache_object_create(struct vk_device *device,
 }
 
 static bool
-object_keys_equal(const void *void_a, const void *void_b)
+object_keys_equal(const struct vk_pipeline_cache_object *object,
+                  const void *key_data, size_t key_size)
 {
-   const struct vk_pipeline_cache_object *a = void_a, *b = void_b;
-   if (a->key_size != b->key_size)
+   if (object->key_size != key_size)
       return false;
 
-   return memcmp(a->key_data, b->key_data, a->key_size) == 0;
+   return memcmp(object->key_data, key_data, key_size) == 0;
 }
 
 static uint32_t
-object_key_hash(const void *void_object)
+object_key_hash(const struct vk_pipeline_cache_object *object)
 {
-   const struct vk_pipeline_cache_object *object = void_object;
    return _mesa_hash_data(object->key_data, object->key_size);
 }
 
-static void
-vk_pipeline_cache_lock(struct vk_pipeline_cache *cache)
+/* The object table is split into shards by the top bits of the key hash.
+ * Each shard is an open addressing table that is read without any lock:
+ *
+ *  - Entries are only ever published with a release store of the object
+ *    pointer.  The hash of an entry is written before and never changes.
+ *
+ *  - Removed entries become tombstones and are only dropped when the table
+ *    is rebuilt.  Replacing an object with one with the same key swaps the
+ *    pointer in place.
+ *
+ *  - Lookups register themselves in one of two reader counters of the
+ *    shard.  Before anything a lookup might still be looking at (an old
+ *    table, a removed or replaced object) is freed, the writer waits for
+ *    both counters to drain, switching new lookups to the other counter
+ *    first so that the wait can't be starved.
+ *
+ * Writers serialize on the shard lock.  Lookups take a reference only if
+ * the object isn't already dying, as objects in weak reference caches stay
+ * in the table until their last reference is dropped.
+ */
+#define VK_PIPELINE_CACHE_SHARD_BITS  4
+#define VK_PIPELINE_CACHE_SHARD_COUNT (1 << VK_PIPELINE_CACHE_SHARD_BITS)
+#define VK_PIPELINE_CACHE_MIN_TABLE_SIZE 16
+
+#define VK_PIPELINE_CACHE_TOMBSTONE ((struct vk_pipeline_cache_object *)(uintptr_t)1)
+
+struct vk_pipeline_cache_entry {
+   uint32_t hash;
+   struct vk_pipeline_cache_object *object;
+};
+
+struct vk_pipeline_cache_table {
+   /* Power of two */
+   uint32_t size;
+   struct vk_pipeline_cache_entry entries[];
+};
+
+struct vk_pipeline_cache_shard {
+   simple_mtx_t lock;
+
+   /* Selects the reader counter new lookups use */
+   uint32_t epoch;
+
+   /* Live entries, and live entries plus tombstones */
+   uint32_t count;
+   uint32_t used;
+
+   struct vk_pipeline_cache_table *table;
+
+   /* Written by every lookup, keep it away from the fields above */
+   EXCLUSIVE_CACHELINE(uint32_t readers[2]);
+};
+
+#define vk_pipeline_cache_foreach_entry(table, entry)                          \
+   for (struct vk_pipeline_cache_entry *entry = (table)->entries;              \
+        entry < (table)->entries + (table)->size; entry++)                     \
+      if (entry->object != NULL &&                                             \
+          entry->object != VK_PIPELINE_CACHE_TOMBSTONE)
+
+static struct vk_pipeline_cache_shard *
+vk_pipeline_cache_get_shard(struct vk_pipeline_cache *cache, uint32_t hash)
+{
+   return &cache->shards[hash >> (32 - VK_PIPELINE_CACHE_SHARD_BITS)];
+}
+
+static struct vk_pipeline_cache_table *
+vk_pipeline_cache_table_create(struct vk_device *device, uint32_t size)
 {
+   struct vk_pipeline_cache_table *table =
+      vk_zalloc(&device->alloc, sizeof(*table) + size * sizeof(table->entries[0]),
+                8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+   if (table)
+      table->size = size;
+   return table;
+}
 
+static void
+vk_pipeline_cache_lock(struct vk_pipeline_cache *cache,
+                       struct vk_pipeline_cache_shard *shard)
+{
    if (!(cache->flags & VK_PIPELINE_CACHE_CREATE_EXTERNALLY_SYNCHRONIZED_BIT))
-      simple_mtx_lock(&cache->lock);
+      simple_mtx_lock(&shard->lock);
 }
 
 static void
-vk_pipeline_cache_unlock(struct vk_pipeline_cache *cache)
+vk_pipeline_cache_unlock(struct vk_pipeline_cache *cache,
+                         struct vk_pipeline_cache_shard *shard)
 {
    if (!(cache->flags & VK_PIPELINE_CACHE_CREATE_EXTERNALLY_SYNCHRONIZED_BIT))
-      simple_mtx_unlock(&cache->lock);
+      simple_mtx_unlock(&shard->lock);
 }
 
-/* cache->lock must be held when calling */
+/* Waits until no lookup can see anything that was unpublished from the shard
+ * before this call.  The shard lock must be held.
+ */
+static void
+vk_pipeline_cache_shard_synchronize(struct vk_pipeline_cache_shard *shard)
+{
+   for (unsigned i = 0; i < 2; i++) {
+      uint32_t idx = p_atomic_fetch_add(&shard->epoch, 1) & 1;
+
+      /* Read with a RMW so that a lookup that registers after this finds
+       * everything the writer did before.
+       */
+      while (p_atomic_add_return(&shard->readers[idx], 0) != 0)
+         thrd_yield();
+   }
+}
+
+static bool
+vk_pipeline_cache_object_try_ref(struct vk_pipeline_cache_object *object)
+{
+   uint32_t ref_cnt = p_atomic_read(&object->ref_cnt);
+   while (ref_cnt != 0) {
+      uint32_t old = p_atomic_cmpxchg(&object->ref_cnt, ref_cnt, ref_cnt + 1);
+      if (old == ref_cnt)
+         return true;
+      ref_cnt = old;
+   }
+   return false;
+}
+
+/* Returns a reference to the object with the given key, without locking. */
+static struct vk_pipeline_cache_object *
+vk_pipeline_cache_shard_lookup(struct vk_pipeline_cache_shard *shard,
+                               uint32_t hash, const void *key_data, size_t key_size)
+{
+   uint32_t idx = p_atomic_read(&shard->epoch) & 1;
+   p_atomic_inc(&shard->readers[idx]);
+
+   struct vk_pipeline_cache_table *table = p_atomic_read(&shard->table);
+   struct vk_pipeline_cache_object *found = NULL;
+
+   const uint32_t mask = table->size - 1;
+   for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+      struct vk_pipeline_cache_entry *entry = &table->entries[i];
+      struct vk_pipeline_cache_object *object = p_atomic_read(&entry->object);
+      if (object == NULL)
+         break;
+
+      if (object == VK_PIPELINE_CACHE_TOMBSTONE || entry->hash != hash ||
+          !object_keys_equal(object, key_data, key_size))
+         continue;
+
+      if (vk_pipeline_cache_object_try_ref(object))
+         found = object;
+      break;
+   }
+
+   p_atomic_dec(&shard->readers[idx]);
+
+   return found;
+}
+
+/* The shard lock must be held when calling */
+static struct vk_pipeline_cache_entry *
+vk_pipeline_cache_shard_search(struct vk_pipeline_cache_shard *shard,
+                               uint32_t hash, const void *key_data, size_t key_size)
+{
+   struct vk_pipeline_cache_table *table = shard->table;
+   const uint32_t mask = table->size - 1;
+   for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+      struct vk_pipeline_cache_entry *entry = &table->entries[i];
+      if (entry->object == NULL)
+         return NULL;
+
+      if (entry->object != VK_PIPELINE_CACHE_TOMBSTONE && entry->hash == hash &&
+          object_keys_equal(entry->object, key_data, key_size))
+         return entry;
+   }
+}
+
+static void
+vk_pipeline_cache_table_insert(struct vk_pipeline_cache_table *table,
+                               uint32_t hash,
+                               struct vk_pipeline_cache_object *object)
+{
+   const uint32_t mask = table->size - 1;
+   uint32_t i = hash & mask;
+   while (table->entries[i].object != NULL)
+      i = (i + 1) & mask;
+
+   table->entries[i].hash = hash;
+   p_atomic_set(&table->entries[i].object, object);
+}
+
+/* Adds an object that isn't in the shard yet.  The shard lock must be held
+ * when calling.
+ */
+static bool
+vk_pipeline_cache_shard_add(struct vk_pipeline_cache *cache,
+                            struct vk_pipeline_cache_shard *shard,
+                            uint32_t hash,
+                            struct vk_pipeline_cache_object *object)
+{
+   struct vk_pipeline_cache_table *table = shard->table;
+
+   /* Keep at least a quarter of the entries empty so that probing is short
+    * and always terminates.  Tombstones are dropped when rebuilding.
+    */
+   if ((shard->used + 1) * 4 > table->size * 3) {
+      uint32_t size = MAX2(util_next_power_of_two((shard->count + 1) * 2),
+                           VK_PIPELINE_CACHE_MIN_TABLE_SIZE);
+      struct vk_pipeline_cache_table *new_table =
+         vk_pipeline_cache_table_create(cache->base.device, size);
+      if (new_table == NULL)
+         return false;
+
+      vk_pipeline_cache_foreach_entry(table, entry)
+         vk_pipeline_cache_table_insert(new_table, entry->hash, entry->object);
+
+      p_atomic_set(&shard->table, new_table);
+      shard->used = shard->count;
+
+      vk_pipeline_cache_shard_synchronize(shard);
+      vk_free(&cache->base.device->alloc, table);
+      table = new_table;
+   }
+
+   vk_pipeline_cache_table_insert(table, hash, object);
+   shard->count++;
+   shard->used++;
+
+   return true;
+}
+
+/* shard->lock must be held when calling */
 static void
 vk_pipeline_cache_remove_object(struct vk_pipeline_cache *cache,
                                 uint32_t hash,
                                 struct vk_pipeline_cache_object *object)
 {
-   struct set_entry *entry =
-      _mesa_set_search_pre_hashed(cache->object_cache, hash, object);
-   if (entry && entry->key == (const void *)object) {
+   struct vk_pipeline_cache_shard *shard = vk_pipeline_cache_get_shard(cache, hash);
+   struct vk_pipeline_cache_entry *entry =
+      vk_pipeline_cache_shard_search(shard, hash, object->key_data,
+                                     object->key_size);
+   if (entry && entry->object == object) {
+      p_atomic_set(&entry->object, VK_PIPELINE_CACHE_TOMBSTONE);
+      shard->count--;
+
+      /* Lookups may still be comparing against the object's key */
+      vk_pipeline_cache_shard_synchronize(shard);
+
       /* Drop the reference owned by the cache */
       if (!cache->weak_ref)
          vk_pipeline_cache_object_unref(cache->base.device, object);
-
-      _mesa_set_remove(cache->object_cache, entry);
    }
 }
 
@@ -194,13 +412,18 @@ vk_pipeline_cache_object_unref(struct vk_device *device, struct vk_pipeline_cach
       if (p_atomic_dec_zero(&object->ref_cnt))
          object->ops->destroy(device, object);
    } else {
-      vk_pipeline_cache_lock(weak_owner);
+      /* Lookups don't take the lock, they just won't ref an object whose
+       * count dropped to zero.  Insertions do, so they never find an object
+       * that is about to be removed.
+       */
+      uint32_t hash = object_key_hash(object);
+      struct vk_pipeline_cache_shard *shard =
+         vk_pipeline_cache_get_shard(weak_owner, hash);
+      vk_pipeline_cache_lock(weak_owner, shard);
       bool destroy = p_atomic_dec_zero(&object->ref_cnt);
-      if (destroy) {
-         uint32_t hash = object_key_hash(object);
+      if (destroy)
          vk_pipeline_cache_remove_object(weak_owner, hash, object);
-      }
-      vk_pipeline_cache_unlock(weak_owner);
+      vk_pipeline_cache_unlock(weak_owner, shard);
       if (destroy)
          object->ops->destroy(device, object);
    }
@@ -293,38 +516,46 @@ vk_pipeline_cache_insert_object(struct vk_pipeline_cache *cache,
 {
    assert(object->ops != NULL);
 
-   if (cache->object_cache == NULL)
+   if (cache->shards == NULL)
       return object;
 
    uint32_t hash = object_key_hash(object);
+   struct vk_pipeline_cache_shard *shard = vk_pipeline_cache_get_shard(cache, hash);
 
-   vk_pipeline_cache_lock(cache);
-   bool found = false;
-   struct set_entry *entry = _mesa_set_search_or_add_pre_hashed(
-       cache->object_cache, hash, object, &found);
+   vk_pipeline_cache_lock(cache, shard);
+   struct vk_pipeline_cache_entry *entry =
+      vk_pipeline_cache_shard_search(shard, hash, object->key_data,
+                                     object->key_size);
+   bool found = entry != NULL;
 
    struct vk_pipeline_cache_object *result = NULL;
    /* add reference to either the found or inserted object */
    if (found) {
-       struct vk_pipeline_cache_object *found_object = (void *)entry->key;
+       struct vk_pipeline_cache_object *found_object = entry->object;
        if (found_object->ops != object->ops) {
           /* The found object in the cache isn't fully formed. Replace it. */
           assert(!cache->weak_ref);
           assert(found_object->ops == &vk_raw_data_cache_object_ops);
           assert(object->ref_cnt == 1);
-          entry->key = object;
+          p_atomic_set(&entry->object, object);
           object = found_object;
+
+          /* The cache's reference to the old object is dropped below. */
+          vk_pipeline_cache_shard_synchronize(shard);
        }
 
-      result = vk_pipeline_cache_object_ref((void *)entry->key);
+      result = vk_pipeline_cache_object_ref(entry->object);
    } else {
       result = object;
-      if (!cache->weak_ref)
+      if (!vk_pipeline_cache_shard_add(cache, shard, hash, object)) {
+         /* Out of memory, the object just isn't cached. */
+      } else if (!cache->weak_ref) {
          vk_pipeline_cache_object_ref(result);
-      else
+      } else {
          vk_pipeline_cache_object_weak_ref(cache, result);
+      }
    }
-   vk_pipeline_cache_unlock(cache);
+   vk_pipeline_cache_unlock(cache, shard);
 
    if (found) {
       vk_pipeline_cache_object_unref(cache->base.device, object);
@@ -344,29 +575,20 @@ vk_pipeline_cache_lookup_object(struct vk_pipeline_cache *cache,
    if (cache_hit != NULL)
       *cache_hit = false;
 
-   struct vk_pipeline_cache_object key = {
-      .key_data = key_data,
-      .key_size = key_size,
-   };
-   uint32_t hash = object_key_hash(&key);
+   uint32_t hash = _mesa_hash_data(key_data, key_size);
 
    struct vk_pipeline_cache_object *object = NULL;
 
-   if (cache != NULL && cache->object_cache != NULL) {
-      vk_pipeline_cache_lock(cache);
-      struct set_entry *entry =
-         _mesa_set_search_pre_hashed(cache->object_cache, hash, &key);
-      if (entry) {
-         object = vk_pipeline_cache_object_ref((void *)entry->key);
-         if (cache_hit != NULL)
-            *cache_hit = true;
-      }
-      vk_pipeline_cache_unlock(cache);
+   if (cache != NULL && cache->shards != NULL) {
+      object = vk_pipeline_cache_shard_lookup(vk_pipeline_cache_get_shard(cache, hash),
+                                              hash, key_data, key_size);
+      if (object != NULL && cache_hit != NULL)
+         *cache_hit = true;
    }
 
    if (object == NULL) {
       struct disk_cache *disk_cache = get_disk_cache(cache);
-      if (!cache->skip_disk_cache && disk_cache && cache->object_cache) {
+      if (!cache->skip_disk_cache && disk_cache && cache->shards) {
          cache_key cache_key;
          disk_cache_compute_key(disk_cache, key_data, key_size, cache_key);
 
@@ -406,9 +628,11 @@ vk_pipeline_cache_lookup_object(struct vk_pipeline_cache *cache,
          vk_pipeline_cache_log(cache,
                                "Deserializing pipeline cache object failed");
 
-         vk_pipeline_cache_lock(cache);
+         struct vk_pipeline_cache_shard *shard =
+            vk_pipeline_cache_get_shard(cache, hash);
+         vk_pipeline_cache_lock(cache, shard);
          vk_pipeline_cache_remove_object(cache, hash, object);
-         vk_pipeline_cache_unlock(cache);
+         vk_pipeline_cache_unlock(cache, shard);
          vk_pipeline_cache_object_unref(cache->base.device, object);
          return NULL;
       }
@@ -651,15 +875,29 @@ vk_pipeline_cache_create(struct vk_device *device,
    };
    memcpy(cache->header.uuid, pdevice_props.pipelineCacheUUID, VK_UUID_SIZE);
 
-   simple_mtx_init(&cache->lock, mtx_plain);
-
    if (info->force_enable ||
        debug_get_bool_option("VK_ENABLE_PIPELINE_CACHE", true)) {
-      cache->object_cache = _mesa_set_create(NULL, object_key_hash,
-                                             object_keys_equal);
+      cache->shards = vk_zalloc(&device->alloc,
+                                VK_PIPELINE_CACHE_SHARD_COUNT * sizeof(*cache->shards),
+                                CACHE_LINE_SIZE, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+      if (cache->shards == NULL) {
+         vk_object_free(device, pAllocator, cache);
+         return NULL;
+      }
+
+      for (unsigned i = 0; i < VK_PIPELINE_CACHE_SHARD_COUNT; i++) {
+         struct vk_pipeline_cache_shard *shard = &cache->shards[i];
+         simple_mtx_init(&shard->lock, mtx_plain);
+         shard->table = vk_pipeline_cache_table_create(device,
+                                                       VK_PIPELINE_CACHE_MIN_TABLE_SIZE);
+         if (shard->table == NULL) {
+            vk_pipeline_cache_destroy(cache, pAllocator);
+            return NULL;
+         }
+      }
    }
 
-   if (cache->object_cache && pCreateInfo->initialDataSize > 0) {
+   if (cache->shards && pCreateInfo->initialDataSize > 0) {
       vk_pipeline_cache_load(cache, pCreateInfo->pInitialData,
                              pCreateInfo->initialDataSize);
    }
@@ -671,17 +909,23 @@ void
 vk_pipeline_cache_destroy(struct vk_pipeline_cache *cache,
                           const VkAllocationCallbacks *pAllocator)
 {
-   if (cache->object_cache) {
-      if (!cache->weak_ref) {
-         set_foreach(cache->object_cache, entry) {
-            vk_pipeline_cache_object_unref(cache->base.device, (void *)entry->key);
+   if (cache->shards) {
+      for (unsigned i = 0; i < VK_PIPELINE_CACHE_SHARD_COUNT; i++) {
+         struct vk_pipeline_cache_shard *shard = &cache->shards[i];
+         if (shard->table == NULL)
+            continue;
+
+         if (!cache->weak_ref) {
+            vk_pipeline_cache_foreach_entry(shard->table, entry)
+               vk_pipeline_cache_object_unref(cache->base.device, entry->object);
+         } else {
+            assert(shard->count == 0);
          }
-      } else {
-         assert(cache->object_cache->entries == 0);
+         vk_free(&cache->base.device->alloc, shard->table);
+         simple_mtx_destroy(&shard->lock);
       }
-      _mesa_set_destroy(cache->object_cache, NULL);
+      vk_free(&cache->base.device->alloc, cache->shards);
    }
-   simple_mtx_destroy(&cache->lock);
    vk_object_free(cache->base.device, pAllocator, cache);
 }
 
@@ -747,12 +991,14 @@ vk_common_GetPipelineCacheData(VkDevice _device,
       return VK_INCOMPLETE;
    }
 
-   vk_pipeline_cache_lock(cache);
-
    VkResult result = VK_SUCCESS;
-   if (cache->object_cache != NULL) {
-      set_foreach(cache->object_cache, entry) {
-         struct vk_pipeline_cache_object *object = (void *)entry->key;
+   for (unsigned s = 0; cache->shards != NULL &&
+                        s < VK_PIPELINE_CACHE_SHARD_COUNT; s++) {
+      struct vk_pipeline_cache_shard *shard = &cache->shards[s];
+      vk_pipeline_cache_lock(cache, shard);
+
+      vk_pipeline_cache_foreach_entry(shard->table, entry) {
+         struct vk_pipeline_cache_object *object = entry->object;
 
          if (object->ops->serialize == NULL)
             continue;
@@ -791,9 +1037,12 @@ vk_common_GetPipelineCacheData(VkDevice _device,
 
          count++;
       }
-   }
 
-   vk_pipeline_cache_unlock(cache);
+      vk_pipeline_cache_unlock(cache, shard);
+
+      if (result != VK_SUCCESS)
+         break;
+   }
 
    blob_overwrite_uint32(&blob, count_offset, count);
 
@@ -815,53 +1064,61 @@ vk_common_MergePipelineCaches(VkDevice _device,
    assert(dst->base.device == device);
    assert(!dst->weak_ref);
 
-   if (!dst->object_cache)
+   if (!dst->shards)
       return VK_SUCCESS;
 
-   vk_pipeline_cache_lock(dst);
+   /* An object lands in the same shard in every cache, so the caches can be
+    * merged one shard at a time.
+    */
+   for (unsigned s = 0; s < VK_PIPELINE_CACHE_SHARD_COUNT; s++) {
+      struct vk_pipeline_cache_shard *dst_shard = &dst->shards[s];
+      vk_pipeline_cache_lock(dst, dst_shard);
 
-   for (uint32_t i = 0; i < srcCacheCount; i++) {
-      VK_FROM_HANDLE(vk_pipeline_cache, src, pSrcCaches[i]);
-      assert(src->base.device == device);
+      for (uint32_t i = 0; i < srcCacheCount; i++) {
+         VK_FROM_HANDLE(vk_pipeline_cache, src, pSrcCaches[i]);
+         assert(src->base.device == device);
 
-      if (!src->object_cache)
-         continue;
+         if (!src->shards)
+            continue;
 
-      assert(src != dst);
-      if (src == dst)
-         continue;
+         assert(src != dst);
+         if (src == dst)
+            continue;
 
-      vk_pipeline_cache_lock(src);
-
-      set_foreach(src->object_cache, src_entry) {
-         struct vk_pipeline_cache_object *src_object = (void *)src_entry->key;
-
-         bool found_in_dst = false;
-         struct set_entry *dst_entry =
-            _mesa_set_search_or_add_pre_hashed(dst->object_cache,
-                                               src_entry->hash,
-                                               src_object, &found_in_dst);
-         if (found_in_dst) {
-            struct vk_pipeline_cache_object *dst_object = (void *)dst_entry->key;
-            if (dst_object->ops == &vk_raw_data_cache_object_ops &&
-                src_object->ops != &vk_raw_data_cache_object_ops) {
-               /* Even though dst has the object, it only has the blob version
-                * which isn't as useful.  Replace it with the real object.
-                */
-               vk_pipeline_cache_object_unref(device, dst_object);
-               dst_entry->key = vk_pipeline_cache_object_ref(src_object);
+         struct vk_pipeline_cache_shard *src_shard = &src->shards[s];
+         vk_pipeline_cache_lock(src, src_shard);
+
+         vk_pipeline_cache_foreach_entry(src_shard->table, src_entry) {
+            struct vk_pipeline_cache_object *src_object = src_entry->object;
+
+            struct vk_pipeline_cache_entry *dst_entry =
+               vk_pipeline_cache_shard_search(dst_shard, src_entry->hash,
+                                              src_object->key_data,
+                                              src_object->key_size);
+            if (dst_entry) {
+               struct vk_pipeline_cache_object *dst_object = dst_entry->object;
+               if (dst_object->ops == &vk_raw_data_cache_object_ops &&
+                   src_object->ops != &vk_raw_data_cache_object_ops) {
+                  /* Even though dst has the object, it only has the blob version
+                   * which isn't as useful.  Replace it with the real object.
+                   */
+                  p_atomic_set(&dst_entry->object,
+                               vk_pipeline_cache_object_ref(src_object));
+                  vk_pipeline_cache_shard_synchronize(dst_shard);
+                  vk_pipeline_cache_object_unref(device, dst_object);
+               }
+            } else if (vk_pipeline_cache_shard_add(dst, dst_shard,
+                                                   src_entry->hash, src_object)) {
+               /* We inserted src_object in dst so it needs a reference */
+               vk_pipeline_cache_object_ref(src_object);
             }
-         } else {
-            /* We inserted src_object in dst so it needs a reference */
-            assert(dst_entry->key == (const void *)src_object);
-            vk_pipeline_cache_object_ref(src_object);
          }
+
+         vk_pipeline_cache_unlock(src, src_shard);
       }
 
-      vk_pipeline_cache_unlock(src);
+      vk_pipeline_cache_unlock(dst, dst_shard);
    }
 
-   vk_pipeline_cache_unlock(dst);
-
    return VK_SUCCESS;
 }
@@ -36,15 +36,13 @@ extern "C" {
 struct blob;
 struct blob_reader;
 
-/* #include "util/set.h" */
-struct set;
-
 /* #include "compiler/nir/nir.h" */
 struct nir_shader;
 struct nir_shader_compiler_options;
 
 struct vk_pipeline_cache;
 struct vk_pipeline_cache_object;
+struct vk_pipeline_cache_shard;
 
 #define VK_PIPELINE_CACHE_BLOB_ALIGN 8
 
@@ -159,10 +157,11 @@ struct vk_pipeline_cache {
 
    struct vk_pipeline_cache_header header;
 
-   /** Protects object_cache */
-   simple_mtx_t lock;
-
-   struct set *object_cache;
+   /** The object table, split in VK_PIPELINE_CACHE_SHARD_COUNT shards by
+    * key hash.  Lookups don't take any lock, insertions and removals lock
+    * only the shard of the object.  NULL if in-memory caching is disabled.
+    */
+   struct vk_pipeline_cache_shard *shards;
 };
 
 VK_DEFINE_NONDISP_HANDLE_CASTS(vk_pipeline_cache, base, VkPipelineCache,
@@ -0,0 +1,258 @@
+/*
+ * Copyright © 2026 Red Hat.
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "vk_sync_cpu_timeline.h"
+
+#include <limits.h>
+
+#include "c11/threads.h"
+#include "util/futex.h"
+#include "util/os_time.h"
+#include "util/timespec.h"
+#include "util/u_atomic.h"
+
+/* Futex words count changes in bits 31:1, bit 0 is set once a thread may be
+ * sleeping on the word.  Only changes that see the bit set bump the word and
+ * wake, so signals nobody waits for are just a couple of atomics.
+ *
+ * Both sides update with a compare-and-swap, which is a full barrier, before
+ * reading what the other side wrote: a waiter sets the bit before checking
+ * the counters and a signal updates the counters before checking the bit.
+ * So either the waiter sees the new value, or the signal sees the bit and
+ * bumps the word, which makes the futex wait return.
+ */
+#define VK_CPU_FUTEX_WAITERS 1u
+
+/* Shared by the waits for any of several timelines, as a thread can only
+ * sleep on one futex.  Signals check it after the timeline's own word.
+ */
+static uint32_t vk_sync_cpu_timeline_any_futex;
+
+static struct vk_sync_cpu_timeline *
+to_vk_sync_cpu_timeline(struct vk_sync *sync)
+{
+   assert(vk_sync_type_is_vk_sync_cpu_timeline(sync->type));
+
+   return container_of(sync, struct vk_sync_cpu_timeline, sync);
+}
+
+static uint32_t
+vk_cpu_futex_prepare_wait(uint32_t *word)
+{
+   uint32_t w = p_atomic_read(word);
+   for (;;) {
+      uint32_t old = p_atomic_cmpxchg(word, w, w | VK_CPU_FUTEX_WAITERS);
+      if (old == w)
+         return w | VK_CPU_FUTEX_WAITERS;
+      w = old;
+   }
+}
+
+static void
+vk_cpu_futex_wake(uint32_t *word)
+{
+   uint32_t w = p_atomic_read(word);
+   while (w & VK_CPU_FUTEX_WAITERS) {
+      uint32_t old = p_atomic_cmpxchg(word, w, (w + 2) & ~VK_CPU_FUTEX_WAITERS);
+      if (old == w) {
+#if UTIL_FUTEX_SUPPORTED
+         futex_wake(word, INT_MAX);
+#endif
+         return;
+      }
+      w = old;
+   }
+}
+
+/* Sleeps until the word changes from w, or the timeout.  May return early. */
+static VkResult
+vk_cpu_futex_wait(uint32_t *word, uint32_t w, uint64_t abs_timeout_ns)
+{
+   if (abs_timeout_ns < INT64_MAX && os_time_get_nano() >= abs_timeout_ns)
+      return VK_TIMEOUT;
+
+#if UTIL_FUTEX_SUPPORTED
+   if (abs_timeout_ns >= INT64_MAX) {
+      futex_wait(word, w, NULL);
+   } else {
+      /* futex_wait() takes an absolute CLOCK_MONOTONIC timeout */
+      struct timespec abs_timeout;
+      timespec_from_nsec(&abs_timeout, abs_timeout_ns);
+      futex_wait(word, w, &abs_timeout);
+   }
+#else
+   thrd_yield();
+#endif
+
+   return VK_SUCCESS;
+}
+
+static bool
+vk_cpu_atomic_max(uint64_t *counter, uint64_t value)
+{
+   uint64_t cur = p_atomic_read(counter);
+   while (cur < value) {
+      uint64_t old = p_atomic_cmpxchg(counter, cur, value);
+      if (old == cur)
+         return true;
+      cur = old;
+   }
+   return false;
+}
+
+static bool
+vk_sync_cpu_timeline_is_done(struct vk_sync_cpu_timeline *timeline,
+                             uint64_t wait_value,
+                             enum vk_sync_wait_flags wait_flags)
+{
+   if (wait_flags & VK_SYNC_WAIT_PENDING)
+      return p_atomic_read(&timeline->pending) >= wait_value;
+   else
+      return p_atomic_read(&timeline->value) >= wait_value;
+}
+
+static void
+vk_sync_cpu_timeline_wake(struct vk_sync_cpu_timeline *timeline)
+{
+   vk_cpu_futex_wake(&timeline->futex);
+   vk_cpu_futex_wake(&vk_sync_cpu_timeline_any_futex);
+}
+
+void
+vk_sync_cpu_timeline_set_pending(struct vk_sync_cpu_timeline *timeline,
+                                 uint64_t value)
+{
+   if (vk_cpu_atomic_max(&timeline->pending, value))
+      vk_sync_cpu_timeline_wake(timeline);
+}
+
+static VkResult
+vk_sync_cpu_timeline_init(struct vk_device *device,
+                          struct vk_sync *sync,
+                          uint64_t initial_value)
+{
+   struct vk_sync_cpu_timeline *timeline = to_vk_sync_cpu_timeline(sync);
+
+   assert(sync->flags & VK_SYNC_IS_TIMELINE);
+   assert(!(sync->flags & VK_SYNC_IS_SHAREABLE));
+
+   timeline->value = initial_value;
+   timeline->pending = initial_value;
+   timeline->futex = 0;
+
+   return VK_SUCCESS;
+}
+
+static void
+vk_sync_cpu_timeline_finish(struct vk_device *device,
+                            struct vk_sync *sync)
+{ }
+
+static VkResult
+vk_sync_cpu_timeline_signal(struct vk_device *device,
+                            struct vk_sync *sync,
+                            uint64_t value)
+{
+   struct vk_sync_cpu_timeline *timeline = to_vk_sync_cpu_timeline(sync);
+
+   /* Keep pending >= value, waits for pending may not fall behind */
+   vk_cpu_atomic_max(&timeline->pending, value);
+   if (vk_cpu_atomic_max(&timeline->value, value))
+      vk_sync_cpu_timeline_wake(timeline);
+
+   return VK_SUCCESS;
+}
+
+static VkResult
+vk_sync_cpu_timeline_get_value(struct vk_device *device,
+                               struct vk_sync *sync,
+                               uint64_t *value)
+{
+   struct vk_sync_cpu_timeline *timeline = to_vk_sync_cpu_timeline(sync);
+
+   *value = p_atomic_read(&timeline->value);
+
+   return VK_SUCCESS;
+}
+
+static VkResult
+vk_sync_cpu_timeline_wait(struct vk_device *device,
+                          struct vk_sync *sync,
+                          uint64_t wait_value,
+                          enum vk_sync_wait_flags wait_flags,
+                          uint64_t abs_timeout_ns)
+{
+   struct vk_sync_cpu_timeline *timeline = to_vk_sync_cpu_timeline(sync);
+
+   if (vk_sync_cpu_timeline_is_done(timeline, wait_value, wait_flags))
+      return VK_SUCCESS;
+
+   for (;;) {
+      uint32_t w = vk_cpu_futex_prepare_wait(&timeline->futex);
+
+      if (vk_sync_cpu_timeline_is_done(timeline, wait_value, wait_flags))
+         return VK_SUCCESS;
+
+      VkResult result = vk_cpu_futex_wait(&timeline->futex, w, abs_timeout_ns);
+      if (result != VK_SUCCESS)
+         return result;
+   }
+}
+
+static VkResult
+vk_sync_cpu_timeline_wait_many(struct vk_device *device,
+                               uint32_t wait_count,
+                               const struct vk_sync_wait *waits,
+                               enum vk_sync_wait_flags wait_flags,
+                               uint64_t abs_timeout_ns)
+{
+   if (!(wait_flags & VK_SYNC_WAIT_ANY)) {
+      /* Values never go back, so waiting for each in turn waits for all */
+      for (uint32_t i = 0; i < wait_count; i++) {
+         VkResult result =
+            vk_sync_cpu_timeline_wait(device, waits[i].sync,
+                                      waits[i].wait_value, wait_flags,
+                                      abs_timeout_ns);
+         if (result != VK_SUCCESS)
+            return result;
+      }
+      return VK_SUCCESS;
+   }
+
+   wait_flags &= ~VK_SYNC_WAIT_ANY;
+
+   for (;;) {
+      uint32_t w = vk_cpu_futex_prepare_wait(&vk_sync_cpu_timeline_any_futex);
+
+      for (uint32_t i = 0; i < wait_count; i++) {
+         struct vk_sync_cpu_timeline *timeline =
+            to_vk_sync_cpu_timeline(waits[i].sync);
+         if (vk_sync_cpu_timeline_is_done(timeline, waits[i].wait_value,
+                                          wait_flags))
+            return VK_SUCCESS;
+      }
+
+      VkResult result = vk_cpu_futex_wait(&vk_sync_cpu_timeline_any_futex, w,
+                                          abs_timeout_ns);
+      if (result != VK_SUCCESS)
+         return result;
+   }
+}
+
+const struct vk_sync_type vk_sync_cpu_timeline_type = {
+   .size = sizeof(struct vk_sync_cpu_timeline),
+   .features = VK_SYNC_FEATURE_TIMELINE |
+               VK_SYNC_FEATURE_GPU_WAIT |
+               VK_SYNC_FEATURE_CPU_WAIT |
+               VK_SYNC_FEATURE_CPU_SIGNAL |
+               VK_SYNC_FEATURE_WAIT_ANY |
+               VK_SYNC_FEATURE_WAIT_PENDING,
+   .init = vk_sync_cpu_timeline_init,
+   .finish = vk_sync_cpu_timeline_finish,
+   .signal = vk_sync_cpu_timeline_signal,
+   .get_value = vk_sync_cpu_timeline_get_value,
+   .wait = vk_sync_cpu_timeline_wait,
+   .wait_many = vk_sync_cpu_timeline_wait_many,
+};
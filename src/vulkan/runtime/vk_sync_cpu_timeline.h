@@ -0,0 +1,67 @@
+/*
+ * Copyright © 2026 Red Hat.
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef VK_SYNC_CPU_TIMELINE_H
+#define VK_SYNC_CPU_TIMELINE_H
+
+#include "vk_sync.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Implements a timeline vk_sync signaled by the CPU
+ *
+ * This is meant for drivers where all work is executed by the CPU, such as
+ * software rasterizers.  Such a driver signals the timeline from its
+ * driver_submit once the work is done, with vk_sync_signal().
+ *
+ * The timeline is a 64-bit counter that is signaled without any allocation
+ * or lock.  Waiters sleep on a futex which signals only wake if someone is
+ * waiting.  A second counter tracks the value that submitted work will
+ * signal, to implement VK_SYNC_WAIT_PENDING.  The driver must bump it with
+ * vk_sync_cpu_timeline_set_pending() as soon as it accepts a submit.
+ *
+ * Because the payload lives in process memory, these timelines can't be
+ * shared.  Without futex support, waits spin.
+ */
+struct vk_sync_cpu_timeline {
+   struct vk_sync sync;
+
+   /* Highest signaled value */
+   uint64_t value;
+
+   /* Highest value signaled or to be signaled by submitted work */
+   uint64_t pending;
+
+   /* Bumped on changes when someone may be waiting, see vk_sync_cpu_timeline.c */
+   uint32_t futex;
+};
+
+extern const struct vk_sync_type vk_sync_cpu_timeline_type;
+
+static inline bool
+vk_sync_type_is_vk_sync_cpu_timeline(const struct vk_sync_type *type)
+{
+   return type == &vk_sync_cpu_timeline_type;
+}
+
+static inline struct vk_sync_cpu_timeline *
+vk_sync_as_cpu_timeline(struct vk_sync *sync)
+{
+   if (!vk_sync_type_is_vk_sync_cpu_timeline(sync->type))
+      return NULL;
+
+   return container_of(sync, struct vk_sync_cpu_timeline, sync);
+}
+
+/** Records that submitted work will signal the timeline to value */
+void vk_sync_cpu_timeline_set_pending(struct vk_sync_cpu_timeline *timeline,
+                                      uint64_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VK_SYNC_CPU_TIMELINE_H */
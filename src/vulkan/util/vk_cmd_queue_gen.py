@@ -77,6 +77,7 @@ TEMPLATE_H = Template(COPYRIGHT + """\
 #pragma once
 
 #include "util/list.h"
+#include "vk_cmd_arena.h"
 
 #define VK_PROTOTYPES
 #include <vulkan/vulkan_core.h>
@@ -91,7 +92,9 @@ extern "C" {
 struct vk_device_dispatch_table;
 
 struct vk_cmd_queue {
+   /* Allocates from arena, everything is freed when the queue is reset */
    const VkAllocationCallbacks *alloc;
+   struct vk_cmd_arena arena;
    struct list_head cmds;
 };
 
@@ -183,9 +186,10 @@ struct vk_cmd_queue_entry {
 void vk_free_queue(struct vk_cmd_queue *queue);
 
 static inline void
-vk_cmd_queue_init(struct vk_cmd_queue *queue, VkAllocationCallbacks *alloc)
+vk_cmd_queue_init(struct vk_cmd_queue *queue, struct vk_cmd_arena_pool *pool)
 {
-   queue->alloc = alloc;
+   vk_cmd_arena_init(&queue->arena, pool);
+   queue->alloc = &queue->arena.alloc;
    list_inithead(&queue->cmds);
 }
 
@@ -201,6 +205,7 @@ vk_cmd_queue_finish(struct vk_cmd_queue *queue)
 {
    vk_free_queue(queue);
    list_inithead(&queue->cmds);
+   vk_cmd_arena_finish(&queue->arena);
 }
 
 void vk_cmd_queue_execute(struct vk_cmd_queue *queue,
@@ -257,24 +262,12 @@ size_t vk_cmd_queue_type_sizes[] = {
 };
 
 % for c in commands:
+% if c.name in manual_commands or c.name in no_enqueue_commands:
+<% continue %>
+% endif
 % if c.guard is not None:
 #ifdef ${c.guard}
 % endif
-static void
-vk_free_${to_underscore(c.name)}(struct vk_cmd_queue *queue,
-${' ' * len('vk_free_' + to_underscore(c.name) + '(')}\\
-struct vk_cmd_queue_entry *cmd)
-{
-% for p in c.params[1:]:
-% if p.len:
-   vk_free(queue->alloc, (${remove_suffix(p.decl.replace("const", ""), p.name)})cmd->u.${to_struct_field_name(c.name)}.${to_field_name(p.name)});
-% elif '*' in p.decl:
-${get_struct_free(c, p, types)}
-% endif
-% endfor
-}
-
-% if c.name not in manual_commands and c.name not in no_enqueue_commands:
 VkResult vk_enqueue_${to_underscore(c.name)}(struct vk_cmd_queue *queue
 % for p in c.params[1:]:
 , ${p.decl}
@@ -287,7 +280,6 @@ VkResult vk_enqueue_${to_underscore(c.name)}(struct vk_cmd_queue *queue
 
    cmd->type = ${to_enum_name(c.name)};
 ${get_params_copy(c, types)}}
-% endif
 % if c.guard is not None:
 #endif // ${c.guard}
 % endif
@@ -297,31 +289,15 @@ ${get_params_copy(c, types)}}
 void
 vk_free_queue(struct vk_cmd_queue *queue)
 {
-   struct vk_cmd_queue_entry *tmp, *cmd;
-   LIST_FOR_EACH_ENTRY_SAFE(cmd, tmp, &queue->cmds, cmd_link) {
-      if (cmd->driver_free_cb) {
+   /* The commands and their copied parameters all live in the arena, only
+    * drivers may have to release references held by their commands.
+    */
+   list_for_each_entry(struct vk_cmd_queue_entry, cmd, &queue->cmds, cmd_link) {
+      if (cmd->driver_free_cb)
          cmd->driver_free_cb(queue, cmd);
-         vk_free(queue->alloc, cmd);
-         continue;
-      }
-      switch(cmd->type) {
-% for c in commands:
-% if c.guard is not None:
-#ifdef ${c.guard}
-% endif
-      case ${to_enum_name(c.name)}:
-         vk_free_${to_underscore(c.name)}(queue, cmd);
-         break;
-% if c.guard is not None:
-#endif // ${c.guard}
-% endif
-% endfor
-      case VK_CMD_TYPE_COUNT:
-         break;
-      }
-      vk_free(queue->alloc, cmd->driver_data);
-      vk_free(queue->alloc, cmd);
    }
+
+   vk_cmd_arena_reset(&queue->arena);
 }
 
 void
@@ -507,36 +483,6 @@ def get_pnext_member_copy(builder, struct, src_type, member, types):
     builder.level -= 1
     builder.add("}")
 
-def get_pnext_member_free(builder, struct_type, types, field_name):
-    if not types[struct_type].extended_by:
-        return
-
-    local_pnext = builder.get_variable_name("pnext")
-
-    builder.add("const VkBaseInStructure *%s = %s;" % (local_pnext, field_name))
-    builder.add("if (%s) {" % (local_pnext))
-    builder.level += 1
-    builder.add("switch ((int32_t)%s->sType) {" % (local_pnext))
-
-    for type in types[struct_type].extended_by:
-        if type.guard is not None:
-            builder.code += "#ifdef %s\n" % (type.guard)
-
-        builder.add("case %s: {" % (type.enum))
-        builder.level += 1
-        get_struct_free(builder, "((%s *)%s)" % (type.name, local_pnext), False, type.name, types)
-        builder.add("vk_free(queue->alloc, (void*)%s);" % (local_pnext))
-        builder.add("break;")
-        builder.level -= 1
-        builder.add("}")
-
-        if type.guard is not None:
-            builder.code += "#endif\n"
-
-    builder.add("}")
-    builder.level -= 1
-    builder.add("}")
-
 def get_struct_copy(builder, dst, src_name, src_type, size, types):
     tmp_dst_name = builder.get_variable_name("tmp_dst")
     tmp_src_name = builder.get_variable_name("tmp_src")
@@ -557,7 +503,7 @@ def get_struct_copy(builder, dst, src_name, src_type, size, types):
                     tmp_src_name, member.name
                 ), member.type, 'sizeof(%s)' % member.type, types)
             elif member.len and member.len == 'null-terminated':
-                builder.add("%s->%s = strdup(%s->%s);" % (tmp_dst_name, member.name, tmp_src_name, member.name))
+                builder.add("%s->%s = vk_strdup(queue->alloc, %s->%s, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);" % (tmp_dst_name, member.name, tmp_src_name, member.name))
             elif member.len:
                 get_array_member_copy(builder, tmp_dst_name, tmp_src_name, member)
             elif member.name == 'pNext':
@@ -570,49 +516,6 @@ def get_struct_copy(builder, dst, src_name, src_type, size, types):
     builder.level -= 1
     builder.add("}")
 
-def get_command_struct_free(command, param, types):
-    field_name = "cmd->u.%s.%s" % (to_struct_field_name(command.name), to_field_name(param.name))
-    builder = CodeBuilder(1)
-    get_struct_free(builder, field_name, True, param.type, types)
-    builder.add("vk_free(queue->alloc, (void*)%s);" % (field_name))
-    return builder.code
-
-def get_struct_free(builder, field_name, nullable, struct_type, types):
-    if struct_type not in types:
-        return
-
-    members = types[struct_type].members
-
-    if members and nullable:
-        builder.add("if (%s) {" % (field_name))
-        builder.level += 1
-
-    for member in members:
-        member_name = "%s->%s" % (field_name, member.name)
-        if member.len and member.len != 'null-terminated':
-            local_member_name = builder.get_variable_name(member.name)
-            builder.add("%s *%s = (void *)(%s);" % (member.type, local_member_name, member_name))
-
-            guard = member.len != "struct-ptr"
-            if guard:
-                builder.add("if (%s->%s) {" % (field_name, member.len))
-                builder.level += 1
-
-            get_struct_free(builder, local_member_name, not guard, member.type, types)
-
-            if guard:
-                builder.level -= 1
-                builder.add("}")
-
-            builder.add("vk_free(queue->alloc, %s);" % (local_member_name))
-
-        elif member.name == 'pNext':
-            get_pnext_member_free(builder, struct_type, types, member_name)
-
-    if members and nullable:
-        builder.level -= 1
-        builder.add("}")
-
 def get_param_copy(builder, command, param, types):
     dst = "cmd->u.%s.%s" % (to_struct_field_name(command.name), to_field_name(param.name))
 
@@ -653,9 +556,8 @@ def get_params_copy(command, types):
     builder.add("return VK_SUCCESS;")
 
     if any_needs_error_handling:
+        # Whatever was allocated is reclaimed when the queue is reset
         builder.code += "\nerr:\n"
-        builder.add("if (cmd)")
-        builder.add("   vk_free_%s(queue, cmd);" % (to_underscore(command.name)))
         builder.add("return VK_ERROR_OUT_OF_HOST_MEMORY;")
 
     return builder.code
@@ -775,7 +677,6 @@ def main():
         'to_enum_name': to_enum_name,
         'to_struct_name': to_struct_name,
         'get_params_copy': get_params_copy,
-        'get_struct_free': get_command_struct_free,
         'types': types,
         'manual_commands': MANUAL_COMMANDS,
         'no_enqueue_commands': NO_ENQUEUE_COMMANDS,